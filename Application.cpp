@@ -4,6 +4,9 @@
 #include "Camera.h"
 #include "InputController.h"
 #include "Buffer.h"
+#include "GeometryHeap.h"
+#include "MeshCache.h"
+#include "UploadContext.h"
 
 // libs
 #define GLM_FORCE_RADIANS				// All GLM functions will expect angles in radians 
@@ -15,6 +18,7 @@
 #include <stdexcept>
 #include <array>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 
 namespace engine {
@@ -29,38 +33,31 @@ namespace engine {
         globalPool = 
             DescriptorPool::Builder(device)
             .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, SwapChain::MAX_FRAMES_IN_FLIGHT)
             .build();
-		loadGameObjects();			// This uses the Game Objects class to take vertex 
-                                    // data from the CPU and copy it into the GPU
+		loadGameObjects();			// This uses the Game Objects class to start loading the
+                                    // models, they are copied into the GPU in the background
         glfwSetScrollCallback(window.getGLFWwindow(), scroll_callback);
     }
 
 	Application::~Application() {}
 
 	void Application::run() {
-        std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < uboBuffers.size(); i++) {
-            uboBuffers[i] = std::make_unique<Buffer>(
-                device,
-                sizeof(GlobalUbo),
-                1,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,     // The value that dictate how many frames can
-                                                        // be submitted for rendering simultaneously.
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);   // Not using host coherent so that we can selectively flush
-            uboBuffers[i]->map();
-        }
+        // The GlobalUbo is written to the renderer's frame allocator every frame, which has a
+        // buffer per frame in flight. The descriptor is dynamic, so it's written once per
+        // frame buffer and only gets the offset of this frame's copy when it's bound.
+        FrameAllocator& frameAllocator = renderer.getFrameAllocator();
 
         // Set up descriptor layout using the Descriptor.h file classes for the uniform buffers.
         auto globalSetLayout = DescriptorSetLayout::Builder(device)
-            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
             .build();
 
         // Let's create the actual descriptor sets, 2 in total (one per frame)
-        // we write the descriptor information from our uboBuffers vector
+        // we write the descriptor information from the frame allocator's buffers
         std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
         for (int i = 0; i < globalDescriptorSets.size(); i++) {
-            auto bufferInfo = uboBuffers[i]->descriptorInfo();
+            VkDescriptorBufferInfo bufferInfo{ frameAllocator.getBuffer(i), 0, sizeof(GlobalUbo) };
             DescriptorWriter(*globalSetLayout, *globalPool)
                 .writeBuffer(0, &bufferInfo)
                 .build(globalDescriptorSets[i]);
@@ -83,6 +80,9 @@ namespace engine {
         // Here we are creating a chrono object so that we can implement time
         auto currentTime = std::chrono::high_resolution_clock::now();
 
+        bool firstFrame = true;
+        bool modelsReported = false;
+
 		while (!window.shouldClose()) {			//This GLFW function checks for and process any 
 			glfwPollEvents();					//events that occur in the window such as key
 												//strokes or mouse clicks. This loop just asks
@@ -101,6 +101,77 @@ namespace engine {
             cameraController.moveInPlaneXZ(frameTime, viewerObject, scroll);
             scroll = 0;
 
+            // Models that finished loading get uploaded and become visible from this frame on
+            modelLoader.update();
+            modelRegistry.update();
+            if (!modelsReported && modelLoader.isIdle()) {
+                modelsReported = true;
+                const ModelLoader::Stats& loaderStats = modelLoader.getStats();
+                MeshCache::Stats cacheStats = MeshCache::getStats();
+                std::cout << "Models: " << loaderStats.resident << " resident, "
+                    << loaderStats.failed << " failed, " << loaderStats.uploadBatches << " upload batch(es), "
+                    << loaderStats.bytesUploaded / 1024 << " KB uploaded, slowest resident after "
+                    << loaderStats.maxMillisecondsToResident << " ms. Mesh cache: "
+                    << cacheStats.hits << " hit(s), " << cacheStats.misses << " miss(es)" << std::endl;
+
+                const ModelRegistry::Stats& registryStats = modelRegistry.getStats();
+                std::cout << "Model registry: " << registryStats.requests << " request(s), "
+                    << registryStats.pathHits + registryStats.contentHits << " shared ("
+                    << registryStats.pathHits << " by path, " << registryStats.contentHits << " by content), "
+                    << registryStats.loads << " loaded" << std::endl;
+                for (const ModelRegistry::ModelStats& model : modelRegistry.getModelStats()) {
+                    std::cout << "  " << model.filePath << ": " << model.references << " reference(s), "
+                        << model.triangles << " triangles, " << (model.vertexBytes + model.indexBytes) / 1024
+                        << " KB on the GPU (" << model.fullPrecisionBytes / 1024 << " KB at full precision)" << std::endl;
+                }
+
+                MemoryAllocator::Stats memoryStats = device.getMemoryStats();
+                std::cout << "GPU memory: " << memoryStats.allocationCount << " allocation(s) in "
+                    << memoryStats.blockCount << " block(s) and " << memoryStats.dedicatedCount << " dedicated, "
+                    << memoryStats.usedBytes / (1024 * 1024) << " of " << memoryStats.reservedBytes / (1024 * 1024)
+                    << " MB used, " << memoryStats.deviceAllocations << " vkAllocateMemory call(s)" << std::endl;
+
+                MemoryAllocator::BudgetStats budget = device.getMemoryBudget();
+                std::cout << "GPU budget (" << (budget.fromExtension ? "VK_EXT_memory_budget" : "80% of the heap sizes")
+                    << "), " << budget.budgetWarnings << " warning(s)" << std::endl;
+                for (size_t i = 0; i < budget.heaps.size(); i++) {
+                    const MemoryAllocator::HeapBudget& heap = budget.heaps[i];
+                    std::cout << "  heap " << i << (heap.deviceLocal ? " (device local): " : ": ")
+                        << heap.usage / (1024 * 1024) << " of " << heap.budget / (1024 * 1024) << " MB, "
+                        << heap.allocated / (1024 * 1024) << " MB allocated by the engine" << std::endl;
+                }
+                std::cout << " ";
+                for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+                    std::cout << " " << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << ": "
+                        << budget.categoryBytes[i] / 1024 << " KB in " << budget.categoryAllocations[i];
+                }
+                std::cout << std::endl;
+
+                GeometryHeap::Stats heapStats = device.getGeometryHeap().getStats();
+                std::cout << "Geometry heap: " << heapStats.usedBytes / 1024 << " of " << heapStats.capacityBytes / 1024
+                    << " KB used, " << heapStats.vertexPools[0].rangeCount + heapStats.vertexPools[1].rangeCount
+                    << " model(s), " << heapStats.fallbacks << " with buffers of their own" << std::endl;
+                const char* poolNames[] = { "standard vertices", "compact vertices", "16 bit indices", "32 bit indices" };
+                const GeometryHeap::PoolStats* pools[] = {
+                    &heapStats.vertexPools[0], &heapStats.vertexPools[1], &heapStats.indexPools[0], &heapStats.indexPools[1] };
+                for (int i = 0; i < 4; i++) {
+                    std::cout << "  " << poolNames[i] << ": " << pools[i]->used << " of " << pools[i]->capacity
+                        << " used, largest free range " << pools[i]->largestFreeRange << std::endl;
+                }
+
+                const TransferQueue::Stats& transferStats = device.getTransferQueue().getStats();
+                std::cout << "Transfer queue: " << (device.getTransferQueue().hasDedicatedQueue() ? "dedicated" : "shared with graphics")
+                    << ", " << transferStats.submits << " submit(s), " << transferStats.bytesUploaded / 1024 << " KB, "
+                    << transferStats.ownershipTransfers << " ownership transfer(s), " << transferStats.stalls << " stall(s) for "
+                    << transferStats.stallMilliseconds << " ms" << std::endl;
+
+                UploadContext::Stats uploadStats = device.getUploadContext().getStats();
+                std::cout << "Upload context: " << uploadStats.bytesUploaded / 1024 << " KB uploaded in "
+                    << uploadStats.submits << " submit(s), " << uploadStats.ringWraps << " ring wrap(s), "
+                    << uploadStats.stalls << " ring wrap stall(s), " << uploadStats.overflows
+                    << " range(s) outside of the " << uploadStats.ringSize / (1024 * 1024) << " MB ring" << std::endl;
+            }
+
             // We update our camera object using the new state of the view object
             camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
             
@@ -116,6 +187,7 @@ namespace engine {
 			// a nullptr if the swap chain needs to be created
 			if (auto commandBuffer = renderer.beginFrame()) {
                 int frameIndex = renderer.getFrameIndex();
+                FrameAllocator::Allocation uboRange = frameAllocator.allocateUniform(sizeof(GlobalUbo));
 
                 // **Important: We reset the values in the frameInfo
                 // every frame so that when it's used in the other
@@ -126,17 +198,18 @@ namespace engine {
                     commandBuffer,
                     camera,
                     globalDescriptorSets[frameIndex],
-                    gameObjects
+                    uboRange.getDynamicOffset(),
+                    gameObjects,
+                    modelRegistry
                 };
                 
-                // update in memory
+                // update in memory, the renderer flushes it to the GPU in endFrame
                 GlobalUbo ubo{};
                 ubo.projection = camera.getProjection();
                 ubo.view = camera.getView();
                 ubo.inverseView = camera.getInverseView();
                 pointLightSystem.update(frameInfo, ubo);
-                uboBuffers[frameIndex]->writeToBuffer(&ubo);
-                uboBuffers[frameIndex]->flush();        // Manually flush memory to the GPU
+                std::memcpy(uboRange.mapped, &ubo, sizeof(GlobalUbo));
 
                 // draw calls will be recorded
 				renderer.beginSwapChainRenderPass(commandBuffer);
@@ -147,6 +220,14 @@ namespace engine {
 
 				renderer.endSwapChainRenderPass(commandBuffer);
 				renderer.endFrame();
+
+                if (firstFrame) {
+                    firstFrame = false;
+                    float milliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(
+                        std::chrono::high_resolution_clock::now() - startTime).count();
+                    std::cout << "First frame after " << milliseconds << " ms, "
+                        << renderSystem.getStats().modelsLoading << " model(s) still loading" << std::endl;
+                }
 			}
 		}
         vkDeviceWaitIdle(device.device());
@@ -154,28 +235,30 @@ namespace engine {
 
     void Application::loadGameObjects() {
 
-        std::shared_ptr<Model> model = Model::createModelFromFile(device, "TestModels/Koenigsegg.obj");
+        // The handles are returned right away, the game objects show up once their models are resident.
+        // Every load adds a reference, asking for the same file again shares the model that's already there.
+        ModelRegistry::Handle model = modelRegistry.load("TestModels/Koenigsegg.obj");
         auto car = GameObject::createGameObject();
         car.model = model;
         car.transform.translation = { 0.0f, 0.5f, 0.0f }; // xyz translation
         car.transform.scale = glm::vec3{0.08f};
         gameObjects.emplace(car.getId(), std::move(car));
 
-        model = Model::createModelFromFile(device, "TestModels/quad.obj");
+        model = modelRegistry.load("TestModels/quad.obj");
         auto plane = GameObject::createGameObject();
         plane.model = model;
         plane.transform.translation = { 0.0f, 0.5f, 0.0f };
         plane.transform.scale = { 2.0f, 2.0f, 2.0f };
         gameObjects.emplace(plane.getId(), std::move(plane));
 
-        //model = Model::createModelFromFile(device, "TestModels/smooth_vase.obj");
+        //model = modelRegistry.load("TestModels/smooth_vase.obj");
         //auto smoothVase = GameObject::createGameObject();
         //smoothVase.model = model;
         //smoothVase.transform.translation = { 0.0f, 0.5f, 0.0f };
         //smoothVase.transform.scale = glm::vec3(3.0f);
         //gameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
 
-        //model = Model::createModelFromFile(device, "TestModels/cube.obj");
+        //model = modelRegistry.load("TestModels/cube.obj");
         //auto cube = GameObject::createGameObject();
         //cube.model = model;
         //cube.transform.translation = { -2.0f, 0.0f, 0.0f };
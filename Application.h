@@ -15,11 +15,14 @@
 
 #include "Device.h"
 #include "GameObject.h"
+#include "ModelLoader.h"
+#include "ModelRegistry.h"
 #include "Renderer.h"
 #include "Window.h"
 #include "Descriptors.h"
 
 // std
+#include <chrono>
 #include <memory>
 
 namespace engine {
@@ -31,12 +34,18 @@ namespace engine {
 		Window window{ WIDTH, HEIGHT, "Cobra Engine" };	
 		Device device{ window };
 		Renderer renderer{ window, device };
+		// Declared before the game objects so they outlive their model handles
+		ModelLoader modelLoader{ device };
+		ModelRegistry modelRegistry{ modelLoader };
 
 		// Note: Order of declarations matters here so
 		// that objects are destroyed in the correct order
 		std::unique_ptr<DescriptorPool> globalPool{};
 		GameObject::Map gameObjects;
 
+		// Used to report how long it took until the first frame was drawn
+		std::chrono::high_resolution_clock::time_point startTime{ std::chrono::high_resolution_clock::now() };
+
 		void loadGameObjects();
 
 	public:
@@ -0,0 +1,197 @@
+#include "AssetPacker.h"
+#include "Inflater.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "Utils.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace engine {
+	namespace {
+		uint64_t alignUp(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		std::string getExtension(const std::string &name) {
+			std::string extension = std::filesystem::path(name).extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(),
+				[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return extension;
+		}
+
+		// Returns the path of the file that goes into the archive in place of the asset
+		std::string cook(const std::string &assetPath) {
+			if (getExtension(assetPath) != ".obj") return assetPath;
+
+			// A mesh cache that is still valid is exactly what cooking would produce
+			if (!MeshCache::open(assetPath)) {
+				Model::Builder builder{};
+				builder.cook(assetPath);
+				if (!MeshCache::write(assetPath, builder)) {
+					throw std::runtime_error("Failed to write the cooked mesh for " + assetPath);
+				}
+			}
+			return MeshCache::getCachePath(assetPath);
+		}
+	}
+
+	AssetPacker::Report AssetPacker::pack(const std::string &outputPath, const std::vector<std::string> &assetPaths) {
+		VirtualFileSystem &fileSystem = VirtualFileSystem::shared();
+		Report report{};
+
+		struct Asset {
+			std::string name;
+			VirtualFileSystem::File file;
+			PackedArchive::TocEntry entry;
+		};
+		std::vector<Asset> assets{};
+		assets.reserve(assetPaths.size());
+		for (const std::string &assetPath : assetPaths) {
+			VirtualFileSystem::FileInfo source{};
+			if (!fileSystem.getInfo(assetPath, source)) throw std::runtime_error("Failed to open file: " + assetPath);
+			report.sourceBytes += source.size;
+
+			Asset asset{};
+			asset.name = std::filesystem::path(cook(assetPath)).lexically_normal().generic_string();
+			if (std::any_of(assets.begin(), assets.end(), [&](const Asset &other) { return other.name == asset.name; })) continue;
+			asset.file = fileSystem.open(asset.name);
+			asset.file.waitForAll();
+			report.names.push_back(asset.name);
+			assets.push_back(std::move(asset));
+		}
+
+		// Lay the archive out: the header, the table of contents and the names, then the data
+		PackedArchive::Header header{};
+		header.magic = PackedArchive::MAGIC;
+		header.version = PackedArchive::VERSION;
+		header.entryCount = static_cast<uint32_t>(assets.size());
+		std::string names{};
+		for (Asset &asset : assets) {
+			asset.entry.nameHash = hashBytes(asset.name.data(), asset.name.size());
+			asset.entry.nameOffset = static_cast<uint32_t>(names.size());
+			asset.entry.nameLength = static_cast<uint32_t>(asset.name.size());
+			asset.entry.kind = getKind(asset.name);
+			asset.entry.size = asset.file.size();
+			asset.entry.crc32 = Inflater::updateCrc32(0, asset.file.data(), asset.file.size());
+			names += asset.name;
+		}
+		header.namesSize = static_cast<uint32_t>(names.size());
+		header.dataOffset = alignUp(sizeof(header) + assets.size() * sizeof(PackedArchive::TocEntry) + names.size(),
+			PackedArchive::DATA_ALIGNMENT);
+
+		// Stored in the order they were given so assets that are loaded together sit together
+		uint64_t offset = header.dataOffset;
+		for (Asset &asset : assets) {
+			asset.entry.offset = offset;
+			offset = alignUp(offset + asset.entry.size, PackedArchive::DATA_ALIGNMENT);
+		}
+		header.dataSize = offset - header.dataOffset;
+
+		std::vector<PackedArchive::TocEntry> toc{};
+		for (const Asset &asset : assets) toc.push_back(asset.entry);
+		std::sort(toc.begin(), toc.end(), [&](const PackedArchive::TocEntry &a, const PackedArchive::TocEntry &b) {
+			if (a.nameHash != b.nameHash) return a.nameHash < b.nameHash;
+			return names.compare(a.nameOffset, a.nameLength, names, b.nameOffset, b.nameLength) < 0;
+		});
+
+		// Like the mesh cache, a crash half way through never leaves a broken archive behind
+		std::string tempPath = outputPath + ".tmp";
+		std::error_code error;
+		{
+			std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!out) throw std::runtime_error("Failed to create file: " + tempPath);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(toc.data()), toc.size() * sizeof(PackedArchive::TocEntry));
+			out.write(names.data(), names.size());
+
+			const char padding[PackedArchive::DATA_ALIGNMENT]{};
+			uint64_t written = sizeof(header) + toc.size() * sizeof(PackedArchive::TocEntry) + names.size();
+			for (const Asset &asset : assets) {
+				out.write(padding, static_cast<std::streamsize>(asset.entry.offset - written));
+				out.write(asset.file.data(), static_cast<std::streamsize>(asset.entry.size));
+				written = asset.entry.offset + asset.entry.size;
+			}
+			out.write(padding, static_cast<std::streamsize>(header.dataOffset + header.dataSize - written));
+			if (!out) {
+				out.close();
+				std::filesystem::remove(tempPath, error);
+				throw std::runtime_error("Failed to write file: " + tempPath);
+			}
+		}
+
+		bool intact = false;
+		try {
+			intact = PackedArchive{ tempPath }.verify();
+		}
+		catch (const std::runtime_error&) {
+		}
+		if (!intact) {
+			std::filesystem::remove(tempPath, error);
+			throw std::runtime_error("The packed archive didn't read back correctly: " + tempPath);
+		}
+
+		std::filesystem::rename(tempPath, outputPath, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+			throw std::runtime_error("Failed to write file: " + outputPath);
+		}
+		report.archiveBytes = header.dataOffset + header.dataSize;
+		return report;
+	}
+
+	std::vector<std::string> AssetPacker::getStartupAssets() {
+		// The shaders of RenderSystem and PointLightSystem, whichever have been compiled
+		std::vector<std::string> assets{};
+		std::error_code error;
+		for (const auto &file : std::filesystem::directory_iterator("Shaders", error)) {
+			if (file.is_regular_file(error) && getExtension(file.path().string()) == ".spv") {
+				assets.push_back(file.path().generic_string());
+			}
+		}
+		std::sort(assets.begin(), assets.end());
+
+		// The models Application::loadGameObjects loads
+		assets.push_back("TestModels/Koenigsegg.obj");
+		assets.push_back("TestModels/quad.obj");
+		return assets;
+	}
+
+	PackedArchive::Kind AssetPacker::getKind(const std::string &name) {
+		std::string extension = getExtension(name);
+		if (extension == ".spv") return PackedArchive::Kind::Shader;
+		if (extension == ".mesh") return PackedArchive::Kind::Mesh;
+		if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".ktx" ||
+			extension == ".ktx2" || extension == ".dds") {
+			return PackedArchive::Kind::Texture;
+		}
+		return PackedArchive::Kind::Other;
+	}
+
+	int runPacker(const std::vector<std::string> &args) {
+		std::string outputPath = args.empty() ? "Assets.pak" : args[0];
+		std::vector<std::string> assetPaths{};
+		if (args.size() > 1) assetPaths.assign(args.begin() + 1, args.end());
+		else assetPaths = AssetPacker::getStartupAssets();
+
+		try {
+			AssetPacker::Report report = AssetPacker::pack(outputPath, assetPaths);
+			for (const std::string &name : report.names) std::cout << "  " << name << std::endl;
+			std::cout << "Packed " << report.names.size() << " asset(s) from " << report.sourceBytes / 1024 << " KB of sources into "
+				<< outputPath << " (" << report.archiveBytes / 1024 << " KB)" << std::endl;
+		}
+		catch (const std::exception &e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+}
@@ -0,0 +1,44 @@
+//**********************************************************************
+// The offline half of the packed archives (see PackedArchive.h). The
+// packer takes a list of asset files, cooks the ones that have a
+// faster form to load from (OBJ files become their mesh cache files,
+// with the optimizer, levels of detail and meshlets already applied)
+// and writes everything into one archive. Start the program with
+// --pack [archive] [assets...] to run it, without any assets it packs
+// what the engine loads at startup into Assets.pak. Main.cpp mounts
+// Assets.pak at the project folder whenever it exists, so the shaders
+// and cooked meshes are then read from it instead of their own files.
+//**********************************************************************
+
+#pragma once
+
+#include "PackedArchive.h"
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class AssetPacker {
+	public:
+		struct Report {
+			std::vector<std::string> names{};	// Of the packed assets, in the order they were given
+			uint64_t sourceBytes{ 0 };			// Of the files before cooking
+			uint64_t archiveBytes{ 0 };
+		};
+
+		// Cooks the assets and writes the archive, names stay relative to the working directory.
+		// The archive is written to a temporary file first and checked before it replaces
+		// outputPath. Throws std::runtime_error when an asset can't be read or cooked.
+		static Report pack(const std::string &outputPath, const std::vector<std::string> &assetPaths);
+
+		// The compiled shaders and the models Application loads
+		static std::vector<std::string> getStartupAssets();
+
+		static PackedArchive::Kind getKind(const std::string &name);
+	};
+
+	// Runs the packer from the command line. Arguments are: [archive] [assets...]
+	int runPacker(const std::vector<std::string> &args);
+}
@@ -0,0 +1,1367 @@
+#include "Benchmarks.h"
+#include "AssetPacker.h"
+#include "Buffer.h"
+#include "Device.h"
+#include "GameObject.h"
+#include "GlbLoader.h"
+#include "MappedFile.h"
+#include "MeshBvh.h"
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshStream.h"
+#include "MeshletBuilder.h"
+#include "Model.h"
+#include "ObjParser.h"
+#include "PackedArchive.h"
+#include "ThreadPool.h"
+#include "TransferQueue.h"
+#include "UploadContext.h"
+#include "Utils.h"
+#include "VertexWelder.h"
+#include "VirtualFileSystem.h"
+#include "Window.h"
+
+// libs
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+	#include <unistd.h>
+#endif
+
+namespace std {
+	// The hash the model loader used with std::unordered_map before the vertex welder
+	template <>
+	struct hash<engine::Model::Vertex> {
+		size_t operator()(engine::Model::Vertex const& vertex) const {
+			size_t seed = 0;
+			engine::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
+			return seed;
+		}
+	};
+}
+
+namespace engine {
+	namespace {
+		constexpr int BENCHMARK_RUNS = 5;
+
+		// Runs the function a few times and returns the fastest time in milliseconds.
+		// The fastest run is the one least disturbed by everything else on the machine.
+		double timeBest(const std::function<void()>& function, int runs = BENCHMARK_RUNS) {
+			double best = 0.0;
+			for (int i = 0; i < runs; i++) {
+				auto start = std::chrono::high_resolution_clock::now();
+				function();
+				auto end = std::chrono::high_resolution_clock::now();
+				double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+				if (i == 0 || milliseconds < best) best = milliseconds;
+			}
+			return best;
+		}
+
+		double megabytesPerSecond(size_t bytes, double milliseconds) {
+			return (bytes / (1024.0 * 1024.0)) / (milliseconds / 1000.0);
+		}
+
+		// Physical memory the process uses right now and the most it has used since it started
+		size_t currentMemoryUsage() {
+		#ifdef _WIN32
+			PROCESS_MEMORY_COUNTERS counters{};
+			GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+			return counters.WorkingSetSize;
+		#else
+			long pages = 0, residentPages = 0;
+			if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+				if (std::fscanf(statm, "%ld %ld", &pages, &residentPages) != 2) residentPages = 0;
+				std::fclose(statm);
+			}
+			return static_cast<size_t>(residentPages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		#endif
+		}
+
+		size_t peakMemoryUsage() {
+		#ifdef _WIN32
+			PROCESS_MEMORY_COUNTERS counters{};
+			GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+			return counters.PeakWorkingSetSize;
+		#else
+			rusage usage{};
+			getrusage(RUSAGE_SELF, &usage);
+			return static_cast<size_t>(usage.ru_maxrss) * 1024;		// Kilobytes on Linux
+		#endif
+		}
+
+		// The models may be inside a mounted archive, so sizes come from the virtual file system
+		size_t getFileSize(const std::string& filePath) {
+			VirtualFileSystem::FileInfo info{};
+			if (!VirtualFileSystem::shared().getInfo(filePath, info)) throw std::runtime_error("Failed to open file: " + filePath);
+			return static_cast<size_t>(info.size);
+		}
+
+		bool isSameObj(const ObjData& a, const ObjData& b) {
+			auto sameIndices = [](const ObjIndex& x, const ObjIndex& y) {
+				return x.vertexIndex == y.vertexIndex && x.normalIndex == y.normalIndex && x.texcoordIndex == y.texcoordIndex;
+			};
+			return a.positions == b.positions && a.colors == b.colors && a.normals == b.normals && a.texcoords == b.texcoords &&
+				a.indices.size() == b.indices.size() && std::equal(a.indices.begin(), a.indices.end(), b.indices.begin(), sameIndices);
+		}
+
+		struct IoCounters {
+			uint64_t readCalls{ 0 };	// read system calls, memory mapped files don't make any
+			uint64_t readBytes{ 0 };
+			uint64_t pageFaults{ 0 };	// Which is where the reads of mapped files show up instead
+		};
+
+		IoCounters readIoCounters() {
+			IoCounters counters{};
+		#ifdef _WIN32
+			IO_COUNTERS io{};
+			GetProcessIoCounters(GetCurrentProcess(), &io);
+			PROCESS_MEMORY_COUNTERS memory{};
+			GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+			counters.readCalls = io.ReadOperationCount;
+			counters.readBytes = io.ReadTransferCount;
+			counters.pageFaults = memory.PageFaultCount;
+		#else
+			std::ifstream io{ "/proc/self/io" };
+			std::string key{};
+			uint64_t value = 0;
+			while (io >> key >> value) {
+				if (key == "syscr:") counters.readCalls = value;
+				else if (key == "rchar:") counters.readBytes = value;
+			}
+			rusage usage{};
+			getrusage(RUSAGE_SELF, &usage);
+			counters.pageFaults = static_cast<uint64_t>(usage.ru_minflt + usage.ru_majflt);
+		#endif
+			return counters;
+		}
+
+		// The counters of a single run, without what reading the counters costs by itself
+		IoCounters countIo(const std::function<void()>& function) {
+			IoCounters idleStart = readIoCounters();
+			IoCounters idleEnd = readIoCounters();
+			IoCounters start = readIoCounters();
+			function();
+			IoCounters end = readIoCounters();
+			auto delta = [&](uint64_t IoCounters::* counter) {
+				uint64_t overhead = idleEnd.*counter - idleStart.*counter;
+				uint64_t used = end.*counter - start.*counter;
+				return used > overhead ? used - overhead : 0;
+			};
+			return { delta(&IoCounters::readCalls), delta(&IoCounters::readBytes), delta(&IoCounters::pageFaults) };
+		}
+
+		// A wavy grid of gridSize x gridSize vertices with normals and uvs, followed by the
+		// triangles of the grid over and over until the file is about targetBytes long.
+		// Written a line at a time so generating it takes next to no memory.
+		void writeSyntheticObj(const std::string& filePath, uint64_t targetBytes, int gridSize) {
+			FILE* file = std::fopen(filePath.c_str(), "wb");
+			if (file == nullptr) throw std::runtime_error("Failed to create file: " + filePath);
+
+			uint64_t written = 0;
+			char line[160];
+			auto writeLine = [&](int length) {
+				std::fwrite(line, 1, static_cast<size_t>(length), file);
+				written += static_cast<uint64_t>(length);
+			};
+			for (int y = 0; y < gridSize; y++) {
+				for (int x = 0; x < gridSize; x++) {
+					float u = static_cast<float>(x) / (gridSize - 1);
+					float v = static_cast<float>(y) / (gridSize - 1);
+					writeLine(std::snprintf(line, sizeof(line), "v %.5f %.5f %.5f\n", u, 0.05f * std::sin(20.0f * u) * std::cos(20.0f * v), v));
+					writeLine(std::snprintf(line, sizeof(line), "vn 0 1 0\n"));
+					writeLine(std::snprintf(line, sizeof(line), "vt %.5f %.5f\n", u, v));
+				}
+			}
+			while (written < targetBytes) {
+				for (int y = 0; y + 1 < gridSize && written < targetBytes; y++) {
+					for (int x = 0; x + 1 < gridSize; x++) {
+						int a = y * gridSize + x + 1;	// OBJ indices start at 1
+						int b = a + 1;
+						int c = a + gridSize;
+						int d = c + 1;
+						writeLine(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b));
+						writeLine(std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d));
+					}
+				}
+			}
+			if (std::fclose(file) != 0) throw std::runtime_error("Failed to write file: " + filePath);
+		}
+		// Writes the model as a glb file with its vertices interleaved exactly like Model::Vertex,
+		// which is how an exporter set up for the engine would write them. Every sub mesh
+		// becomes a primitive of the same mesh, they all share the vertices.
+		void writeGlb(const std::string& filePath, const Model::Builder& builder) {
+			size_t vertexBytes = builder.vertices.size() * sizeof(Model::Vertex);
+			size_t indexBytes = builder.indices.size() * sizeof(uint32_t);
+			size_t subMeshCount = builder.lods.empty() ? builder.subMeshes.size() : builder.lods[0].subMeshCount;
+
+			std::ostringstream json{};
+			json << std::setprecision(9);
+			json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+				<< "\"buffers\":[{\"byteLength\":" << vertexBytes + indexBytes << "}],"
+				<< "\"bufferViews\":["
+				<< "{\"buffer\":0,\"byteLength\":" << vertexBytes << ",\"byteStride\":" << sizeof(Model::Vertex) << ",\"target\":34962},"
+				<< "{\"buffer\":0,\"byteOffset\":" << vertexBytes << ",\"byteLength\":" << indexBytes << ",\"target\":34963}],"
+				<< "\"accessors\":["
+				<< "{\"bufferView\":0,\"byteOffset\":" << offsetof(Model::Vertex, position) << ",\"componentType\":5126,\"count\":"
+				<< builder.vertices.size() << ",\"type\":\"VEC3\",\"min\":[" << builder.bounds.min.x << "," << builder.bounds.min.y << ","
+				<< builder.bounds.min.z << "],\"max\":[" << builder.bounds.max.x << "," << builder.bounds.max.y << "," << builder.bounds.max.z << "]},"
+				<< "{\"bufferView\":0,\"byteOffset\":" << offsetof(Model::Vertex, color) << ",\"componentType\":5126,\"count\":"
+				<< builder.vertices.size() << ",\"type\":\"VEC3\"},"
+				<< "{\"bufferView\":0,\"byteOffset\":" << offsetof(Model::Vertex, normal) << ",\"componentType\":5126,\"count\":"
+				<< builder.vertices.size() << ",\"type\":\"VEC3\"},"
+				<< "{\"bufferView\":0,\"byteOffset\":" << offsetof(Model::Vertex, uv) << ",\"componentType\":5126,\"count\":"
+				<< builder.vertices.size() << ",\"type\":\"VEC2\"}";
+			for (size_t i = 0; i < subMeshCount; i++) {
+				const Model::SubMesh& subMesh = builder.subMeshes[i];
+				json << ",{\"bufferView\":1,\"byteOffset\":" << subMesh.firstIndex * sizeof(uint32_t)
+					<< ",\"componentType\":5125,\"count\":" << subMesh.indexCount << ",\"type\":\"SCALAR\"}";
+			}
+			json << "],\"materials\":[";
+			for (size_t i = 0; i < builder.materials.size(); i++) {
+				const glm::vec4& diffuse = builder.materials[i].diffuse;
+				json << (i > 0 ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":["
+					<< diffuse.r << "," << diffuse.g << "," << diffuse.b << "," << diffuse.a << "]}}";
+			}
+			json << "],\"meshes\":[{\"primitives\":[";
+			for (size_t i = 0; i < subMeshCount; i++) {
+				json << (i > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1,\"NORMAL\":2,\"TEXCOORD_0\":3},\"indices\":" << 4 + i;
+				if (builder.subMeshes[i].material < builder.materials.size()) json << ",\"material\":" << builder.subMeshes[i].material;
+				json << "}";
+			}
+			json << "]}]}";
+
+			// Both chunks have to be padded to 4 bytes, the JSON with spaces
+			std::string text = json.str();
+			text.resize((text.size() + 3) & ~static_cast<size_t>(3), ' ');
+			uint32_t binarySize = static_cast<uint32_t>(vertexBytes + indexBytes);
+			uint32_t header[3]{ 0x46546C67, 2, static_cast<uint32_t>(12 + 8 + text.size() + 8 + binarySize) };
+			uint32_t jsonChunk[2]{ static_cast<uint32_t>(text.size()), 0x4E4F534A };
+			uint32_t binaryChunk[2]{ binarySize, 0x004E4942 };
+
+			FILE* file = std::fopen(filePath.c_str(), "wb");
+			if (file == nullptr) throw std::runtime_error("Failed to create file: " + filePath);
+			std::fwrite(header, sizeof(header), 1, file);
+			std::fwrite(jsonChunk, sizeof(jsonChunk), 1, file);
+			std::fwrite(text.data(), 1, text.size(), file);
+			std::fwrite(binaryChunk, sizeof(binaryChunk), 1, file);
+			std::fwrite(builder.vertices.data(), 1, vertexBytes, file);
+			std::fwrite(builder.indices.data(), 1, indexBytes, file);
+			if (std::fclose(file) != 0) throw std::runtime_error("Failed to write file: " + filePath);
+		}
+
+		// Bytes a depth only draw pulls from memory to read the positions. Every vertex that misses
+		// a FIFO post transform cache of 16 fetches its position. The 64 byte lines it sits in are
+		// looked up in a small FIFO vertex fetch cache of 16 KB, every line that misses is read.
+		uint64_t simulateDepthFetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t stride, uint32_t readSize) {
+			constexpr uint64_t LINE_SIZE = 64;
+			constexpr size_t TRANSFORM_CACHE_SIZE = 16;
+			constexpr size_t FETCH_CACHE_LINES = 256;
+
+			std::vector<uint32_t> transformed(vertexCount, 0);	// Time the vertex entered the cache, 0 is never
+			uint32_t transformTime = 0;
+			std::vector<uint64_t> lines(FETCH_CACHE_LINES, UINT64_MAX);
+			std::unordered_map<uint64_t, size_t> cachedLines{};
+			size_t nextLine = 0;
+			uint64_t bytes = 0;
+			for (uint32_t index : indices) {
+				if (transformed[index] != 0 && transformTime - transformed[index] < TRANSFORM_CACHE_SIZE) continue;
+				transformed[index] = ++transformTime;
+
+				uint64_t first = static_cast<uint64_t>(index) * stride / LINE_SIZE;
+				uint64_t last = (static_cast<uint64_t>(index) * stride + readSize - 1) / LINE_SIZE;
+				for (uint64_t line = first; line <= last; line++) {
+					if (cachedLines.count(line) != 0) continue;
+					if (lines[nextLine] != UINT64_MAX) cachedLines.erase(lines[nextLine]);
+					lines[nextLine] = line;
+					cachedLines[line] = nextLine;
+					nextLine = (nextLine + 1) % FETCH_CACHE_LINES;
+					bytes += LINE_SIZE;
+				}
+			}
+			return bytes;
+		}
+	}
+
+	int runBenchmarks(const std::vector<std::string>& args) {
+		std::vector<std::string> models = args;
+		if (models.empty()) models.push_back("TestModels/Koenigsegg.obj");
+
+		try {
+			for (const auto& model : models) {
+				benchmarkObjLoading(model);
+				benchmarkArchiveLoading(model);
+				benchmarkMeshCache(model);
+				benchmarkMeshCodec(model);
+				benchmarkGlbLoading(model);
+				benchmarkVertexWelding(model);
+				benchmarkMeshOptimizer(model);
+				benchmarkMeshSimplifier(model);
+				benchmarkMeshlets(model);
+				benchmarkVertexStreams(model);
+				benchmarkStreamingLoad(model);
+				benchmarkRaycasts(model);
+			}
+			benchmarkStartupLoading();
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	void benchmarkObjLoading(const std::string& filePath) {
+		size_t fileSize = getFileSize(filePath);
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "OBJ loading: " << filePath << " (" << fileSize / (1024.0 * 1024.0) << " MB)" << std::endl;
+
+		Model::Builder tinyObjBuilder{};
+		Model::Builder parserBuilder{};
+		double tinyObjTime = timeBest([&]() { tinyObjBuilder.loadModelTinyObj(filePath); });
+		double parserTime = timeBest([&]() { parserBuilder.loadModel(filePath); });
+
+		// Both paths have to produce exactly the same model, byte for byte
+		bool identical =
+			tinyObjBuilder.vertices.size() == parserBuilder.vertices.size() &&
+			tinyObjBuilder.indices == parserBuilder.indices &&
+			std::memcmp(
+				tinyObjBuilder.vertices.data(),
+				parserBuilder.vertices.data(),
+				parserBuilder.vertices.size() * sizeof(Model::Vertex)) == 0;
+
+		std::cout << "  tinyobj:    " << tinyObjTime << " ms, "
+			<< megabytesPerSecond(fileSize, tinyObjTime) << " MB/s" << std::endl;
+		std::cout << "  ObjParser:  " << parserTime << " ms, "
+			<< megabytesPerSecond(fileSize, parserTime) << " MB/s ("
+			<< tinyObjTime / parserTime << "x)" << std::endl;
+		std::cout << "  output identical: " << (identical ? "yes" : "NO") << std::endl;
+
+		// Parsing only (no vertex de-duplication) with a growing number of threads. The file is
+		// opened once up front so a zipped model isn't inflated again on every run.
+		VirtualFileSystem::File file = VirtualFileSystem::shared().open(filePath);
+		file.waitForAll();
+		unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		double singleThreadTime = 0.0;
+		for (unsigned threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+			ThreadPool pool{ threads };
+			double parseTime = timeBest([&]() { ObjParser::parse(file, pool); });
+			if (threads == 1) singleThreadTime = parseTime;
+
+			std::cout << "  parse with " << std::setw(2) << threads << " worker thread(s): "
+				<< parseTime << " ms, " << megabytesPerSecond(fileSize, parseTime) << " MB/s, scaling "
+				<< singleThreadTime / parseTime << "x" << std::endl;
+			if (threads == hardwareThreads) break;
+		}
+	}
+
+	void benchmarkArchiveLoading(const std::string& filePath) {
+		std::cout << "Archive loading: " << filePath << std::endl;
+		VirtualFileSystem& fileSystem = VirtualFileSystem::shared();
+		VirtualFileSystem::FileInfo info{};
+		if (!fileSystem.getInfo(filePath, info) || !info.inArchive) {
+			std::cout << "  skipped, the file is on disk rather than in a mounted archive" << std::endl;
+			return;
+		}
+
+		// Inflating on its own, then inflating and parsing one after the other, then parsing
+		// the chunks while the rest of the file is still being inflated
+		size_t fileSize = static_cast<size_t>(info.size);
+		double inflateTime = timeBest([&]() {
+			VirtualFileSystem::File file = fileSystem.open(filePath);
+			file.waitForAll();
+		});
+		ObjData sequential{};
+		double sequentialTime = timeBest([&]() {
+			VirtualFileSystem::File file = fileSystem.open(filePath);
+			file.waitForAll();
+			sequential = ObjParser::parse(file);
+		});
+		ObjData overlapped{};
+		VirtualFileSystem::resetStats();
+		double overlappedTime = timeBest([&]() {
+			VirtualFileSystem::File file = fileSystem.open(filePath);
+			overlapped = ObjParser::parse(file);
+		});
+		VirtualFileSystem::Stats stats = VirtualFileSystem::getStats();
+
+		std::cout << "  inflate only:          " << inflateTime << " ms, "
+			<< megabytesPerSecond(fileSize, inflateTime) << " MB/s" << std::endl;
+		std::cout << "  inflate, then parse:   " << sequentialTime << " ms" << std::endl;
+		std::cout << "  parse while inflating: " << overlappedTime << " ms ("
+			<< sequentialTime / overlappedTime << "x), " << stats.inflatedReads << " inflated and "
+			<< stats.storedReads << " stored read(s)" << std::endl;
+		std::cout << "  output identical: " << (isSameObj(sequential, overlapped) ? "yes" : "NO") << std::endl;
+	}
+
+	void benchmarkMeshCache(const std::string& filePath) {
+		std::cout << "Mesh cache: " << filePath << std::endl;
+		std::string cachePath = MeshCache::getCachePath(filePath);
+
+		// Both loads end with a copy into memory standing in for the staging buffer,
+		// that's the last thing that happens on the CPU before the GPU takes over
+		std::vector<char> staging{};
+		auto copyToStaging = [&](const void* vertices, size_t vertexBytes, const void* indices, size_t indexBytes) {
+			staging.resize(vertexBytes + indexBytes);
+			std::memcpy(staging.data(), vertices, vertexBytes);
+			std::memcpy(staging.data() + vertexBytes, indices, indexBytes);
+		};
+
+		Model::Builder builder{};
+		double coldTime = timeBest([&]() {
+			std::filesystem::remove(cachePath);
+			builder.loadModel(filePath);
+			MeshCache::write(filePath, builder);
+			copyToStaging(
+				builder.vertices.data(), builder.vertices.size() * sizeof(Model::Vertex),
+				builder.indices.data(), builder.indices.size() * sizeof(uint32_t));
+		});
+		std::vector<char> coldBytes = staging;
+
+		// The warm load decodes the cache straight into the staging memory
+		MeshCache::resetStats();
+		uint64_t encodedSize = 0;
+		double warmTime = timeBest([&]() {
+			auto cache = MeshCache::open(filePath);
+			if (!cache) throw std::runtime_error("Mesh cache was not written for " + filePath);
+			size_t vertexBytes = cache->getVertexCount() * sizeof(Model::Vertex);
+			staging.resize(vertexBytes + cache->getIndexCount() * sizeof(uint32_t));
+			cache->writeVertices(reinterpret_cast<Model::Vertex*>(staging.data()));
+			cache->writeIndices(staging.data() + vertexBytes, VK_INDEX_TYPE_UINT32);
+			encodedSize = cache->getEncodedSize();
+		});
+		MeshCache::Stats stats = MeshCache::getStats();
+
+		std::cout << "  cold (parse + write cache): " << coldTime << " ms" << std::endl;
+		std::cout << "  warm (mapped cache):        " << warmTime << " ms ("
+			<< coldTime / warmTime << "x)" << std::endl;
+		std::cout << "  cache file: " << std::filesystem::file_size(cachePath) / (1024.0 * 1024.0) << " MB, "
+			<< stats.hits << " hit(s), " << stats.misses << " miss(es), vertices and indices "
+			<< coldBytes.size() / (1024.0 * 1024.0) << " MB -> " << encodedSize / (1024.0 * 1024.0) << " MB" << std::endl;
+		std::cout << "  output identical: " << (staging == coldBytes ? "yes" : "NO") << std::endl;
+	}
+
+	void benchmarkMeshCodec(const std::string& filePath) {
+		std::cout << "Mesh codec: " << filePath << std::endl;
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		MeshOptimizer::optimize(builder);
+
+		std::vector<Model::CompactVertex> compactVertices(builder.vertices.size());
+		Model::encodeVertices(builder.vertices.data(), builder.vertices.size(),
+			Model::VertexFormat::Compact, builder.bounds, compactVertices.data());
+
+		// Every stream is decoded by each decoder the CPU supports into memory standing in for
+		// the staging buffer, and has to come out exactly as it went in
+		auto run = [&](const char* name, const void* source, size_t count, size_t stride, bool isIndices) {
+			size_t rawSize = count * stride;
+			std::vector<uint8_t> encoded{};
+			double encodeTime = timeBest([&]() {
+				encoded = isIndices
+					? MeshCodec::encodeIndices(static_cast<const uint32_t*>(source), count)
+					: MeshCodec::encodeVertices(source, count, stride);
+			});
+			std::cout << "  " << name << rawSize / (1024.0 * 1024.0) << " MB -> " << encoded.size() / (1024.0 * 1024.0)
+				<< " MB (" << static_cast<double>(rawSize) / encoded.size() << "x), encode "
+				<< megabytesPerSecond(rawSize, encodeTime) << " MB/s" << std::endl;
+
+			std::vector<char> staging(rawSize);
+			for (MeshCodec::Decoder decoder : { MeshCodec::Decoder::Scalar, MeshCodec::Decoder::Sse2,
+				MeshCodec::Decoder::Avx2, MeshCodec::Decoder::Neon }) {
+				if (!MeshCodec::isSupported(decoder)) continue;
+				std::fill(staging.begin(), staging.end(), 0);
+				double decodeTime = timeBest([&]() {
+					if (isIndices) MeshCodec::decodeIndices(staging.data(), count, stride, encoded.data(), encoded.size(), decoder);
+					else MeshCodec::decodeVertices(staging.data(), count, stride, encoded.data(), encoded.size(), decoder);
+				});
+				bool identical = std::memcmp(staging.data(), source, rawSize) == 0;
+				std::cout << "    " << std::setw(6) << std::left << MeshCodec::getName(decoder) << std::right
+					<< megabytesPerSecond(rawSize, decodeTime) / 1024.0 << " GB/s decoded, output identical: "
+					<< (identical ? "yes" : "NO") << std::endl;
+			}
+		};
+
+		run("standard vertices: ", builder.vertices.data(), builder.vertices.size(), sizeof(Model::Vertex), false);
+		run("compact vertices:  ", compactVertices.data(), compactVertices.size(), sizeof(Model::CompactVertex), false);
+		run("indices:           ", builder.indices.data(), builder.indices.size(), sizeof(uint32_t), true);
+	}
+
+	void benchmarkGlbLoading(const std::string& filePath) {
+		std::cout << "glb loading: " << filePath << std::endl;
+		std::string glbPath = filePath + ".glb";
+		{
+			Model::Builder builder{};
+			builder.loadModel(filePath);
+			writeGlb(glbPath, builder);
+		}
+
+		// Every load ends with the vertices and indices in memory standing in for the
+		// staging buffers. The OBJ path is only parsed and welded here, the optimizer,
+		// levels of detail and meshlets of a real cold load would come on top.
+		std::vector<char> staging{};
+		auto loadObj = [&](Model::VertexFormat format) {
+			Model::Builder builder{};
+			builder.loadModel(filePath);
+			size_t vertexBytes = builder.vertices.size() * Model::getVertexSize(format);
+			staging.resize(vertexBytes + builder.indices.size() * sizeof(uint32_t));
+			Model::encodeVertices(builder.vertices.data(), builder.vertices.size(), format, builder.bounds, staging.data());
+			std::memcpy(staging.data() + vertexBytes, builder.indices.data(), builder.indices.size() * sizeof(uint32_t));
+		};
+		uint32_t copiedPrimitives = 0;
+		uint32_t primitives = 0;
+		auto loadGlb = [&](Model::VertexFormat format) {
+			GlbLoader glb{ glbPath };
+			size_t vertexBytes = static_cast<size_t>(glb.getVertexCount()) * Model::getVertexSize(format);
+			staging.resize(vertexBytes + glb.getIndexCount() * sizeof(uint32_t));
+			glb.writeVertices(staging.data(), format);
+			glb.writeIndices(staging.data() + vertexBytes, VK_INDEX_TYPE_UINT32);
+			copiedPrimitives = glb.getCopiedPrimitiveCount(format);
+			primitives = glb.getPrimitiveCount();
+		};
+
+		size_t objSize = getFileSize(filePath);
+		size_t glbSize = getFileSize(glbPath);
+		std::cout << "  OBJ " << objSize / (1024.0 * 1024.0) << " MB, glb " << glbSize / (1024.0 * 1024.0) << " MB" << std::endl;
+		for (Model::VertexFormat format : { Model::VertexFormat::Standard, Model::VertexFormat::Compact }) {
+			double objTime = timeBest([&]() { loadObj(format); });
+			std::vector<char> objBytes = staging;
+			double glbTime = timeBest([&]() { loadGlb(format); });
+
+			std::cout << "  " << (format == Model::VertexFormat::Standard ? "standard" : "compact") << " vertices:" << std::endl;
+			std::cout << "    OBJ (parse + weld): " << objTime << " ms" << std::endl;
+			std::cout << "    glb:                " << glbTime << " ms (" << objTime / glbTime << "x), "
+				<< megabytesPerSecond(glbSize, glbTime) << " MB/s, " << copiedPrimitives << " of "
+				<< primitives << " primitive(s) copied without converting" << std::endl;
+			std::cout << "    output identical: " << (staging == objBytes ? "yes" : "NO") << std::endl;
+		}
+		std::filesystem::remove(glbPath);
+	}
+
+	void benchmarkVertexWelding(const std::string& filePath) {
+		std::cout << "Vertex welding: " << filePath << std::endl;
+
+		// Expand the model back into one vertex per face corner, which
+		// is what the model loader hands to the welder after parsing
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		std::vector<Model::Vertex> corners{};
+		corners.reserve(builder.indices.size());
+		for (uint32_t index : builder.indices) {
+			corners.push_back(builder.vertices[index]);
+		}
+
+		// This is the loop the model loader used to run
+		std::vector<Model::Vertex> mapVertices{};
+		std::vector<uint32_t> mapIndices{};
+		double mapTime = timeBest([&]() {
+			mapVertices.clear();
+			mapIndices.clear();
+			std::unordered_map<Model::Vertex, uint32_t> uniqueVertices{};
+			for (const auto& vertex : corners) {
+				if (uniqueVertices.count(vertex) == 0) {
+					uniqueVertices[vertex] = static_cast<uint32_t>(mapVertices.size());
+					mapVertices.push_back(vertex);
+				}
+				mapIndices.push_back(uniqueVertices[vertex]);
+			}
+		});
+
+		double cornersPerMillisecond = static_cast<double>(corners.size());
+		std::cout << "  " << corners.size() << " corners, " << mapVertices.size() << " unique vertices" << std::endl;
+		std::cout << "  unordered_map:           " << mapTime << " ms, "
+			<< cornersPerMillisecond / mapTime / 1000.0 << " M corners/s" << std::endl;
+
+		unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+			ThreadPool pool{ threads };
+			std::vector<Model::Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			double weldTime = timeBest([&]() { VertexWelder::weld(corners.data(), corners.size(), vertices, indices, pool); });
+
+			bool identical = indices == mapIndices && vertices.size() == mapVertices.size() &&
+				std::memcmp(vertices.data(), mapVertices.data(), vertices.size() * sizeof(Model::Vertex)) == 0;
+			std::cout << "  welder with " << std::setw(2) << threads << " thread(s): " << weldTime << " ms, "
+				<< cornersPerMillisecond / weldTime / 1000.0 << " M corners/s ("
+				<< mapTime / weldTime << "x), output identical: " << (identical ? "yes" : "NO") << std::endl;
+			if (threads == hardwareThreads) break;
+		}
+	}
+
+	void benchmarkMeshOptimizer(const std::string& filePath) {
+		std::cout << "Mesh optimizer: " << filePath << std::endl;
+		Model::Builder loaded{};
+		loaded.loadModel(filePath);
+
+		auto run = [&](const char* name, const MeshOptimizer::Options& options) {
+			Model::Builder builder{};
+			MeshOptimizer::Report report{};
+			double time = timeBest([&]() {
+				builder = loaded;
+				report = MeshOptimizer::optimize(builder, options);
+			});
+			std::cout << std::setprecision(3) << "  " << name
+				<< "ACMR " << report.before.acmr << " -> " << report.after.acmr
+				<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+				<< std::setprecision(2) << ", " << time << " ms" << std::endl;
+		};
+
+		MeshOptimizer::Options cacheOnly{};
+		cacheOnly.reduceOverdraw = false;
+		run("vertex cache + fetch:            ", cacheOnly);
+		run("vertex cache + overdraw + fetch: ", MeshOptimizer::Options{});
+	}
+
+	void benchmarkMeshSimplifier(const std::string& filePath) {
+		std::cout << "Mesh simplifier: " << filePath << std::endl;
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		MeshOptimizer::optimize(builder);
+		std::cout << "  full detail: " << builder.indices.size() / 3 << " triangles" << std::endl;
+
+		for (float targetError : { 0.002f, 0.008f, 0.03f, 0.1f }) {
+			std::vector<uint32_t> indices{};
+			float error = 0.0f;
+			double time = timeBest([&]() {
+				indices = MeshSimplifier::simplify(builder.vertices, builder.indices, 0, targetError, &error);
+			}, 1);
+			std::cout << std::setprecision(3) << "  target error " << targetError << ": "
+				<< indices.size() / 3 << " triangles ("
+				<< std::setprecision(1) << 100.0 * indices.size() / builder.indices.size() << "%), error "
+				<< std::setprecision(4) << error << std::setprecision(2) << ", " << time << " ms" << std::endl;
+		}
+	}
+
+	void benchmarkMeshlets(const std::string& filePath) {
+		std::cout << "Meshlets: " << filePath << std::endl;
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		MeshOptimizer::optimize(builder);
+
+		std::vector<Model::Meshlet> meshlets{};
+		double time = timeBest([&]() {
+			meshlets = MeshletBuilder::build(builder.vertices, builder.indices, 0, static_cast<uint32_t>(builder.indices.size()));
+		});
+		size_t cullable = 0;
+		for (const auto& meshlet : meshlets) cullable += meshlet.coneCutoff < 1.0f ? 1 : 0;
+		std::cout << "  " << meshlets.size() << " meshlets, " << std::setprecision(1)
+			<< builder.indices.size() / 3.0 / meshlets.size() << " triangles each on average, "
+			<< 100.0 * cullable / meshlets.size() << "% with a usable normal cone, "
+			<< std::setprecision(2) << time << " ms" << std::endl;
+
+		// Looks at the model from the six axis directions and checks that every triangle
+		// of a culled meshlet really faces away from the camera
+		glm::vec3 center = (builder.bounds.min + builder.bounds.max) * 0.5f;
+		float distance = 3.0f * glm::length(builder.bounds.max - builder.bounds.min);
+		const glm::vec3 directions[] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+		size_t culled = 0;
+		size_t culledTriangles = 0;
+		bool correct = true;
+		for (const glm::vec3& direction : directions) {
+			glm::vec3 camera = center + direction * distance;
+			for (const auto& meshlet : meshlets) {
+				if (!meshlet.facesAway(camera)) continue;
+				culled++;
+				culledTriangles += meshlet.indexCount / 3;
+				for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+					const glm::vec3& a = builder.vertices[builder.indices[i]].position;
+					const glm::vec3& b = builder.vertices[builder.indices[i + 1]].position;
+					const glm::vec3& c = builder.vertices[builder.indices[i + 2]].position;
+					if (glm::dot(glm::cross(b - a, c - a), a - camera) < 0.0f) correct = false;
+				}
+			}
+		}
+		std::cout << std::setprecision(1) << "  back face culled from the 6 axis views: "
+			<< 100.0 * culled / (meshlets.size() * 6) << "% of meshlets, "
+			<< 100.0 * culledTriangles / (builder.indices.size() / 3 * 6) << "% of triangles, all facing away: "
+			<< (correct ? "yes" : "NO") << std::setprecision(2) << std::endl;
+	}
+
+	void benchmarkVertexStreams(const std::string& filePath) {
+		std::cout << "Vertex streams: " << filePath << std::endl;
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		MeshOptimizer::optimize(builder);
+		uint32_t vertexCount = static_cast<uint32_t>(builder.vertices.size());
+
+		for (Model::VertexFormat format : { Model::VertexFormat::Standard, Model::VertexFormat::Compact }) {
+			uint32_t vertexSize = Model::getVertexSize(format);
+			uint32_t positionSize = Model::getPositionSize(format);
+			std::vector<char> vertices(static_cast<size_t>(vertexCount) * vertexSize);
+			Model::encodeVertices(builder.vertices.data(), vertexCount, format, builder.bounds, vertices.data());
+
+			// Splitting happens once while the model loads
+			std::vector<char> streams(vertices.size());
+			double splitTime = timeBest([&]() {
+				Model::writeVertexStreams(vertices.data(), vertexCount, format, streams.data());
+			});
+
+			uint64_t interleavedBytes = simulateDepthFetch(builder.indices, vertexCount, vertexSize, positionSize);
+			uint64_t splitBytes = simulateDepthFetch(builder.indices, vertexCount, positionSize, positionSize);
+			std::cout << std::setprecision(2) << "  " << (format == Model::VertexFormat::Standard ? "standard" : "compact")
+				<< " vertices, depth only fetch: interleaved " << interleavedBytes / (1024.0 * 1024.0)
+				<< " MB, split " << splitBytes / (1024.0 * 1024.0) << " MB, saved " << std::setprecision(1)
+				<< 100.0 * (interleavedBytes - splitBytes) / interleavedBytes << "% (" << vertexSize << " -> "
+				<< positionSize << " bytes a vertex), splitting " << std::setprecision(2) << splitTime << " ms ("
+				<< megabytesPerSecond(vertices.size(), splitTime) << " MB/s)" << std::endl;
+		}
+	}
+
+	void benchmarkStreamingLoad(const std::string& filePath) {
+		std::cout << "Streaming load: " << filePath << std::endl;
+		VirtualFileSystem::FileInfo info{};
+		if (!VirtualFileSystem::shared().getInfo(filePath, info) || info.inArchive) {
+			std::cout << "  skipped, streaming only reads files on disk" << std::endl;
+			return;
+		}
+		size_t fileSize = static_cast<size_t>(info.size);
+
+		// A small budget so even the test models are split into plenty of windows
+		MeshStream::Options options{};
+		options.memoryBudget = 16 * 1024 * 1024;
+		options.format = Model::VertexFormat::Standard;
+
+		std::vector<Model::Vertex> vertices{};
+		std::vector<uint32_t> indices{};
+		size_t windowCount = 0;
+		double time = timeBest([&]() {
+			MeshStream stream{ filePath, options };
+			windowCount = stream.getWindowCount();
+			vertices.assign(stream.getVertexCount(), Model::Vertex{});
+			indices.assign(stream.getIndexCount(), 0);
+
+			// Stands in for the staging ring, the windows are copied to their place like the GPU would
+			std::vector<char> slot(static_cast<size_t>(stream.getSlotSize()));
+			for (size_t window = 0; window < stream.getWindowCount(); window++) {
+				const MeshStream::WindowRange& range = stream.getWindowRange(window);
+				stream.writeWindow(window, slot.data());
+				std::memcpy(&vertices[range.firstVertex], slot.data(), range.vertexCount * sizeof(Model::Vertex));
+				for (uint32_t i = 0; i < range.indexCount; i++) {
+					indices[range.firstIndex + i] = stream.getIndexType() == VK_INDEX_TYPE_UINT16
+						? reinterpret_cast<const uint16_t*>(slot.data() + range.indexOffset)[i]
+						: reinterpret_cast<const uint32_t*>(slot.data() + range.indexOffset)[i];
+				}
+			}
+		});
+
+		// The regular load keeps the triangles in file order too, only the vertices are shared more
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		bool identical = indices.size() == builder.indices.size();
+		for (size_t i = 0; identical && i < indices.size(); i++) {
+			identical = std::memcmp(&vertices[indices[i]], &builder.vertices[builder.indices[i]], sizeof(Model::Vertex)) == 0;
+		}
+
+		std::cout << "  " << windowCount << " window(s), " << vertices.size() << " vertices ("
+			<< builder.vertices.size() << " with the regular load), " << time << " ms, "
+			<< megabytesPerSecond(fileSize, time) << " MB/s" << std::endl;
+		std::cout << "  triangles identical: " << (identical ? "yes" : "NO") << std::endl;
+	}
+
+	void benchmarkRaycasts(const std::string& filePath) {
+		std::cout << "Ray casts: " << filePath << std::endl;
+		Model::Builder builder{};
+		builder.loadModel(filePath);
+		uint32_t vertexCount = static_cast<uint32_t>(builder.vertices.size());
+		uint32_t indexCount = static_cast<uint32_t>(builder.indices.size());
+
+		std::unique_ptr<MeshBvh> bvh{};
+		ThreadPool singleThread{ 1 };
+		double serialTime = timeBest([&]() {
+			bvh = std::make_unique<MeshBvh>(&builder.vertices[0].position, sizeof(Model::Vertex), vertexCount,
+				builder.indices.data(), indexCount, singleThread);
+		});
+		double parallelTime = timeBest([&]() {
+			bvh = std::make_unique<MeshBvh>(&builder.vertices[0].position, sizeof(Model::Vertex), vertexCount,
+				builder.indices.data(), indexCount);
+		});
+		std::cout << "  " << bvh->getTriangleCount() << " triangles, " << bvh->getNodeCount() << " nodes, "
+			<< bvh->getLeafCount() << " leaves, depth " << bvh->getDepth() << ", " << bvh->getMemorySize() / 1024 << " KB" << std::endl;
+		std::cout << "  build: " << serialTime << " ms on 1 thread, " << parallelTime << " ms on "
+			<< ThreadPool::shared().getThreadCount() << " thread(s)" << std::endl;
+
+		// Rays start on a sphere around the model and aim at random points in the middle of
+		// it, so most of them hit something and the rest pass close by
+		glm::vec3 center = (builder.bounds.min + builder.bounds.max) * 0.5f;
+		glm::vec3 extent = builder.bounds.max - builder.bounds.min;
+		float radius = glm::length(extent);
+		std::mt19937 random{ 1 };
+		std::uniform_real_distribution<float> unit{ -1.0f, 1.0f };
+		constexpr size_t RAY_COUNT = 1 << 20;
+		std::vector<glm::vec3> origins(RAY_COUNT);
+		std::vector<glm::vec3> directions(RAY_COUNT);
+		for (size_t i = 0; i < RAY_COUNT; i++) {
+			glm::vec3 onSphere{ unit(random), unit(random), unit(random) };
+			origins[i] = center + glm::normalize(onSphere + glm::vec3(1e-6f)) * radius;
+			glm::vec3 target = center + glm::vec3(unit(random), unit(random), unit(random)) * extent * 0.25f;
+			directions[i] = glm::normalize(target - origins[i]);
+		}
+
+		size_t hits = 0;
+		double rayTime = timeBest([&]() {
+			hits = 0;
+			for (size_t i = 0; i < RAY_COUNT; i++) {
+				MeshBvh::RayHit hit{};
+				hits += bvh->raycast(origins[i], directions[i], hit) ? 1 : 0;
+			}
+		});
+		constexpr size_t RAY_BLOCK_SIZE = 4096;
+		double parallelRayTime = timeBest([&]() {
+			ThreadPool::shared().parallelFor(RAY_COUNT / RAY_BLOCK_SIZE, [&](size_t block) {
+				for (size_t i = block * RAY_BLOCK_SIZE; i < (block + 1) * RAY_BLOCK_SIZE; i++) {
+					MeshBvh::RayHit hit{};
+					bvh->raycast(origins[i], directions[i], hit);
+				}
+			});
+		});
+		std::cout << std::setprecision(1) << "  " << 100.0 * hits / RAY_COUNT << "% of " << RAY_COUNT << " rays hit, "
+			<< std::setprecision(2) << RAY_COUNT / (rayTime * 1000.0) << " million rays/s on 1 thread, "
+			<< RAY_COUNT / (parallelRayTime * 1000.0) << " million rays/s on all of them" << std::endl;
+
+		// The same rays against a placed object, they're moved into model space on the way in
+		TransformComponent transform{};
+		transform.translation = { 1.0f, -2.0f, 3.0f };
+		transform.rotation = { 0.3f, 1.2f, -0.5f };
+		transform.scale = { 0.5f, 2.0f, 1.5f };
+		glm::mat4 model = transform.mat4();
+		std::vector<glm::vec3> worldOrigins(RAY_COUNT);
+		std::vector<glm::vec3> worldDirections(RAY_COUNT);
+		for (size_t i = 0; i < RAY_COUNT; i++) {
+			worldOrigins[i] = glm::vec3(model * glm::vec4(origins[i], 1.0f));
+			worldDirections[i] = glm::mat3(model) * directions[i];
+		}
+		size_t worldHits = 0;
+		double worldTime = timeBest([&]() {
+			worldHits = 0;
+			for (size_t i = 0; i < RAY_COUNT; i++) {
+				MeshBvh::RayHit hit{};
+				worldHits += bvh->raycast(transform, worldOrigins[i], worldDirections[i], hit) ? 1 : 0;
+			}
+		});
+		std::cout << std::setprecision(1) << "  with a transform: " << 100.0 * worldHits / RAY_COUNT << "% hit, "
+			<< std::setprecision(2) << RAY_COUNT / (worldTime * 1000.0) << " million rays/s" << std::endl;
+
+		// Closest points from random places around the model
+		constexpr size_t POINT_COUNT = 1 << 16;
+		std::vector<glm::vec3> points(POINT_COUNT);
+		for (glm::vec3& point : points) point = center + glm::vec3(unit(random), unit(random), unit(random)) * extent;
+		double pointTime = timeBest([&]() {
+			for (const glm::vec3& point : points) {
+				MeshBvh::ClosestPoint closest{};
+				bvh->findClosestPoint(point, closest);
+			}
+		});
+		std::cout << "  closest point: " << POINT_COUNT / (pointTime * 1000.0) << " million queries/s" << std::endl;
+
+		// A few of the rays and points against every triangle on its own, to make sure nothing was skipped
+		std::vector<std::unique_ptr<MeshBvh>> singleTriangles{};
+		for (uint32_t t = 0; t < indexCount; t += 3) {
+			uint32_t corners[3]{ 0, 1, 2 };
+			glm::vec3 triangle[3];
+			for (int corner = 0; corner < 3; corner++) triangle[corner] = builder.vertices[builder.indices[t + corner]].position;
+			singleTriangles.push_back(std::make_unique<MeshBvh>(triangle, sizeof(glm::vec3), 3, corners, 3, singleThread));
+		}
+		constexpr size_t CHECK_COUNT = 64;
+		bool correct = true;
+		for (size_t i = 0; i < CHECK_COUNT; i++) {
+			float nearestHit = FLT_MAX;
+			float nearestPoint = FLT_MAX;
+			size_t ray = i * (RAY_COUNT / CHECK_COUNT);
+			for (const auto& single : singleTriangles) {
+				MeshBvh::RayHit hit{};
+				if (single->raycast(origins[ray], directions[ray], hit)) nearestHit = std::min(nearestHit, hit.distance);
+				MeshBvh::ClosestPoint closest{};
+				if (single->findClosestPoint(points[i], closest)) nearestPoint = std::min(nearestPoint, closest.distance);
+			}
+			MeshBvh::RayHit hit{};
+			MeshBvh::ClosestPoint closest{};
+			bvh->raycast(origins[ray], directions[ray], hit);
+			bvh->findClosestPoint(points[i], closest);
+			if (hit.distance != nearestHit || closest.distance != nearestPoint) correct = false;
+		}
+		std::cout << "  same as testing every triangle: " << (correct ? "yes" : "NO") << std::endl;
+	}
+
+	void benchmarkStartupLoading() {
+		std::cout << "Startup loading" << std::endl;
+		std::string archivePath = (std::filesystem::temp_directory_path() / "startup_benchmark.pak").string();
+		AssetPacker::Report report = AssetPacker::pack(archivePath, AssetPacker::getStartupAssets());
+
+		// Packing leaves the cooked meshes next to their sources, so every asset also exists as a loose file
+		std::vector<std::string> looseFiles{};
+		for (const std::string& name : report.names) {
+			std::error_code error;
+			if (std::filesystem::is_regular_file(name, error)) looseFiles.push_back(name);
+		}
+
+		// Every asset is read from the first byte to the last, the same as creating a shader
+		// module or copying a mesh into a staging buffer would. The page cache is warm, so
+		// this shows the cost of the calls rather than of the disk.
+		uint64_t checksum = 0;
+		auto readFiles = [&]() {
+			for (const std::string& name : looseFiles) {
+				// How Pipeline::readFile used to load the shaders
+				std::ifstream file{ name, std::ios::ate | std::ios::binary };
+				std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+				file.seekg(0);
+				file.read(buffer.data(), buffer.size());
+				checksum += hashBytes(buffer.data(), buffer.size());
+			}
+		};
+		auto mapFiles = [&]() {
+			for (const std::string& name : looseFiles) {
+				MappedFile file{ name };
+				checksum += hashBytes(file.data(), file.size());
+			}
+		};
+		size_t prefetchCalls = 0;
+		auto readArchive = [&]() {
+			PackedArchive archive{ archivePath };
+			prefetchCalls = archive.prefetchAll();
+			for (const std::string& name : report.names) {
+				const PackedArchive::TocEntry* entry = archive.find(name);
+				if (entry == nullptr) throw std::runtime_error("Missing from the packed archive: " + name);
+				checksum += hashBytes(archive.getData(*entry), static_cast<size_t>(entry->size));
+			}
+		};
+
+		std::cout << "  " << report.names.size() << " asset(s), " << report.archiveBytes / 1024 << " KB packed, "
+			<< looseFiles.size() << " loose file(s)" << std::endl;
+		auto print = [&](const char* label, size_t files, const std::function<void()>& function) {
+			double time = timeBest(function);
+			IoCounters io = countIo(function);
+			std::cout << "  " << label << time << " ms, " << files << " file(s) opened, " << io.readCalls
+				<< " read call(s) for " << io.readBytes / 1024 << " KB, " << io.pageFaults << " page fault(s)" << std::endl;
+		};
+		print("a read per file:     ", looseFiles.size(), readFiles);
+		print("a mapping per file:  ", looseFiles.size(), mapFiles);
+		print("one packed archive:  ", 1, readArchive);
+		std::cout << "  read ahead hints for the archive: " << prefetchCalls << " system call(s)" << std::endl;
+
+		std::error_code error;
+		std::filesystem::remove(archivePath, error);
+	}
+
+	void benchmarkDeviceMemory(Device& device) {
+		std::cout << "Device memory: maxMemoryAllocationCount " << device.properties.limits.maxMemoryAllocationCount
+			<< ", bufferImageGranularity " << device.properties.limits.bufferImageGranularity << std::endl;
+
+		struct TestBuffer {
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			MemoryAllocation memory{};
+		};
+		auto destroy = [&](TestBuffer& test) {
+			vkDestroyBuffer(device.device(), test.buffer, nullptr);
+			device.freeMemory(test.memory);
+		};
+
+		// Creates and destroys the same buffers through the allocator and with a vkAllocateMemory
+		// each, the old path. Stays well below the driver's limit on allocations for the old path.
+		uint32_t count = std::min<uint32_t>(2000, device.properties.limits.maxMemoryAllocationCount / 2);
+		std::vector<TestBuffer> buffers(count);
+		for (bool dedicated : { true, false }) {
+			double createTime = 0.0, destroyTime = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++) {
+				auto start = std::chrono::high_resolution_clock::now();
+				for (TestBuffer& test : buffers) {
+					device.createBuffer(64 * 1024, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other, test.buffer, test.memory, dedicated);
+				}
+				auto created = std::chrono::high_resolution_clock::now();
+				for (TestBuffer& test : buffers) destroy(test);
+				auto end = std::chrono::high_resolution_clock::now();
+				double create = std::chrono::duration<double, std::milli>(created - start).count();
+				double destroyed = std::chrono::duration<double, std::milli>(end - created).count();
+				if (run == 0 || create < createTime) createTime = create;
+				if (run == 0 || destroyed < destroyTime) destroyTime = destroyed;
+			}
+			std::cout << std::fixed << std::setprecision(0) << "  " << (dedicated ? "vkAllocateMemory each: " : "allocator:             ")
+				<< count / (createTime / 1000.0) << " creates/s, " << count / (destroyTime / 1000.0)
+				<< " destroys/s (" << count << " 64 KB buffers)" << std::endl;
+		}
+
+		// Random sizes created and destroyed in random order, to see how the blocks hold up
+		std::mt19937 random{ 42 };
+		std::uniform_int_distribution<uint32_t> sizeDistribution{ 1, 1024 };
+		std::vector<TestBuffer> live{};
+		MemoryAllocator::Stats before = device.getMemoryStats();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < 20000; i++) {
+			if (live.size() < 1000 && (live.empty() || random() % 2 == 0)) {
+				TestBuffer test{};
+				device.createBuffer(static_cast<VkDeviceSize>(sizeDistribution(random)) * 1024,
+					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other,
+					test.buffer, test.memory);
+				live.push_back(test);
+			}
+			else {
+				size_t index = random() % live.size();
+				destroy(live[index]);
+				live[index] = live.back();
+				live.pop_back();
+			}
+		}
+		double churnTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		MemoryAllocator::Stats stats = device.getMemoryStats();
+		std::cout << std::setprecision(1) << "  random churn: 20000 creates and destroys in " << churnTime << " ms, "
+			<< stats.deviceAllocations - before.deviceAllocations << " vkAllocateMemory call(s)" << std::endl;
+		std::cout << "  with " << live.size() << " buffers alive: " << stats.blockCount << " block(s), "
+			<< stats.usedBytes / (1024.0 * 1024.0) << " of " << stats.reservedBytes / (1024.0 * 1024.0) << " MB used, "
+			<< stats.freeRangeCount << " free range(s), largest " << stats.largestFreeRange / (1024.0 * 1024.0)
+			<< " MB, fragmentation " << std::setprecision(3) << stats.fragmentation << std::endl;
+		for (TestBuffer& test : live) destroy(test);
+	}
+
+	void benchmarkUploads(Device& device) {
+		TransferQueue& transferQueue = device.getTransferQueue();
+		std::cout << "Uploads: " << (transferQueue.hasDedicatedQueue() ? "dedicated transfer queue" : "no transfer only queue family, graphics queue")
+			<< std::endl;
+
+		// 64 copies of 1 MB each into their own range of a device local buffer
+		constexpr uint32_t COPY_COUNT = 64;
+		constexpr VkDeviceSize COPY_SIZE = 1024 * 1024;
+		Buffer staging{ device, COPY_SIZE, COPY_COUNT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging };
+		staging.map();
+		std::memset(staging.getMappedMemory(), 0x5a, static_cast<size_t>(COPY_SIZE * COPY_COUNT));
+		Buffer destination{ device, COPY_SIZE, COPY_COUNT, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Other };
+
+		auto region = [&](uint32_t i) {
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = i * COPY_SIZE;
+			copyRegion.dstOffset = i * COPY_SIZE;
+			copyRegion.size = COPY_SIZE;
+			return copyRegion;
+		};
+		auto measure = [&](const char* label, const std::function<void()>& upload) {
+			TransferQueue::Stats before = transferQueue.getStats();
+			double best = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++) {
+				auto start = std::chrono::high_resolution_clock::now();
+				upload();
+				double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				if (run == 0 || time < best) best = time;
+			}
+			TransferQueue::Stats after = transferQueue.getStats();
+			std::cout << std::fixed << std::setprecision(0) << "  " << label
+				<< COPY_SIZE * COPY_COUNT / (1024.0 * 1024.0) / (best / 1000.0) << " MB/s, "
+				<< (after.submits - before.submits) / BENCHMARK_RUNS << " submit(s), "
+				<< (after.stalls - before.stalls) / BENCHMARK_RUNS << " stall(s) a run" << std::endl;
+		};
+
+		// The old path, a graphics queue submit and vkQueueWaitIdle for every copy
+		measure("graphics queue, wait idle each: ", [&]() {
+			for (uint32_t i = 0; i < COPY_COUNT; i++) {
+				VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+				VkBufferCopy copyRegion = region(i);
+				vkCmdCopyBuffer(commandBuffer, staging.getBuffer(), destination.getBuffer(), 1, &copyRegion);
+				device.endSingleTimeCommands(commandBuffer);
+			}
+		});
+		// A transfer queue submit for every copy, only waited for at the end
+		measure("transfer queue, submit each:    ", [&]() {
+			uint64_t last = 0;
+			for (uint32_t i = 0; i < COPY_COUNT; i++) {
+				TransferQueue::Batch batch = transferQueue.begin();
+				VkBufferCopy copyRegion = region(i);
+				batch.copyBuffer(staging.getBuffer(), destination.getBuffer(), 1, &copyRegion);
+				last = transferQueue.submit(batch);
+			}
+			transferQueue.wait(last);
+		});
+		// Every copy in one submit
+		measure("transfer queue, one batch:      ", [&]() {
+			TransferQueue::Batch batch = transferQueue.begin();
+			for (uint32_t i = 0; i < COPY_COUNT; i++) {
+				VkBufferCopy copyRegion = region(i);
+				batch.copyBuffer(staging.getBuffer(), destination.getBuffer(), 1, &copyRegion);
+			}
+			transferQueue.wait(transferQueue.submit(batch));
+		});
+
+		// The acquires on the graphics queue still use the destination buffer
+		transferQueue.waitIdle();
+		TransferQueue::Stats stats = transferQueue.getStats();
+		std::cout << std::setprecision(1) << "  transfer queue total: " << stats.submits << " submit(s), "
+			<< stats.ownershipTransfers << " ownership transfer(s), " << stats.stalls << " stall(s) for "
+			<< stats.stallMilliseconds << " ms" << std::endl;
+	}
+
+	void benchmarkUploadContext(Device& device) {
+		UploadContext& uploadContext = device.getUploadContext();
+		TransferQueue& transferQueue = device.getTransferQueue();
+		std::cout << "Upload context: " << uploadContext.getStats().ringSize / (1024 * 1024) << " MB staging ring" << std::endl;
+
+		// 200 models of 256 KB vertices and 64 KB indices each
+		constexpr uint32_t MODEL_COUNT = 200;
+		constexpr VkDeviceSize VERTEX_BYTES = 256 * 1024;
+		constexpr VkDeviceSize INDEX_BYTES = 64 * 1024;
+		Buffer destination{ device, VERTEX_BYTES + INDEX_BYTES, MODEL_COUNT,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Other };
+		std::vector<char> data(static_cast<size_t>(VERTEX_BYTES), 0x5a);
+
+		auto copy = [&](TransferQueue::Batch& batch, VkBuffer source, VkDeviceSize sourceOffset,
+			uint32_t model, VkDeviceSize offset, VkDeviceSize size) {
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = sourceOffset;
+			copyRegion.dstOffset = model * (VERTEX_BYTES + INDEX_BYTES) + offset;
+			copyRegion.size = size;
+			batch.copyBuffer(source, destination.getBuffer(), 1, &copyRegion);
+		};
+		auto print = [&](const char* label, double time, uint64_t submits) {
+			std::cout << std::fixed << std::setprecision(1) << "  " << label << time << " ms, " << submits
+				<< " submit(s), " << MODEL_COUNT * (VERTEX_BYTES + INDEX_BYTES) / (1024.0 * 1024.0) / (time / 1000.0)
+				<< " MB/s" << std::endl;
+		};
+
+		// The old path, two staging buffers of its own for every model and a submit it waits for
+		uint64_t submitsBefore = transferQueue.getStats().submits;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t model = 0; model < MODEL_COUNT; model++) {
+			Buffer vertexStaging{ device, VERTEX_BYTES, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging };
+			Buffer indexStaging{ device, INDEX_BYTES, 1, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging };
+			vertexStaging.map();
+			indexStaging.map();
+			std::memcpy(vertexStaging.getMappedMemory(), data.data(), static_cast<size_t>(VERTEX_BYTES));
+			std::memcpy(indexStaging.getMappedMemory(), data.data(), static_cast<size_t>(INDEX_BYTES));
+			TransferQueue::Batch batch = transferQueue.begin();
+			copy(batch, vertexStaging.getBuffer(), 0, model, 0, VERTEX_BYTES);
+			copy(batch, indexStaging.getBuffer(), 0, model, VERTEX_BYTES, INDEX_BYTES);
+			transferQueue.wait(transferQueue.submit(batch));
+		}
+		print("staging buffers per model: ", std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count(), transferQueue.getStats().submits - submitsBefore);
+
+		// Every model staged in the ring and sent with a single flush. The ranges go back to the
+		// ring once the copies are done, they're held here until then like a model holds them.
+		UploadContext::Stats before = uploadContext.getStats();
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<std::unique_ptr<UploadContext::Allocation>> ranges{};
+		for (uint32_t model = 0; model < MODEL_COUNT; model++) {
+			ranges.push_back(uploadContext.allocate(VERTEX_BYTES));
+			std::memcpy(ranges.back()->getMappedMemory(), data.data(), static_cast<size_t>(VERTEX_BYTES));
+			copy(uploadContext.record(*ranges.back()), ranges.back()->getBuffer(), ranges.back()->getOffset(), model, 0, VERTEX_BYTES);
+			ranges.push_back(uploadContext.allocate(INDEX_BYTES));
+			std::memcpy(ranges.back()->getMappedMemory(), data.data(), static_cast<size_t>(INDEX_BYTES));
+			copy(uploadContext.record(*ranges.back()), ranges.back()->getBuffer(), ranges.back()->getOffset(), model, VERTEX_BYTES, INDEX_BYTES);
+		}
+		uploadContext.finish();
+		ranges.clear();
+		UploadContext::Stats after = uploadContext.getStats();
+		print("upload context, one flush: ", std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count(), after.submits - before.submits);
+
+		// A flush every 8 models without waiting, more than the ring holds, so it has to wrap
+		before = after;
+		start = std::chrono::high_resolution_clock::now();
+		for (int pass = 0; pass < 4; pass++) {
+			for (uint32_t model = 0; model < MODEL_COUNT; model++) {
+				std::unique_ptr<UploadContext::Allocation> range = uploadContext.allocate(VERTEX_BYTES + INDEX_BYTES);
+				std::memcpy(range->getMappedMemory(), data.data(), static_cast<size_t>(VERTEX_BYTES));
+				copy(uploadContext.record(*range), range->getBuffer(), range->getOffset(), model, 0, VERTEX_BYTES);
+				if (model % 8 == 7) uploadContext.flush();
+			}
+		}
+		uploadContext.finish();
+		after = uploadContext.getStats();
+		print("upload context, streaming: ", std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count() / 4.0, (after.submits - before.submits) / 4);
+		std::cout << "  streaming: " << after.ringWraps - before.ringWraps << " ring wrap(s), "
+			<< after.stalls - before.stalls << " ring wrap stall(s) for " << after.stallMilliseconds - before.stallMilliseconds
+			<< " ms, " << after.overflows - before.overflows << " overflow(s)" << std::endl;
+
+		transferQueue.waitIdle();
+		std::cout << "  upload context total: " << after.bytesUploaded / (1024 * 1024) << " MB uploaded, "
+			<< after.submits << " submit(s), " << after.allocations << " range(s)" << std::endl;
+	}
+
+	void benchmarkBufferWrites(Device& device) {
+		// Host visible without coherent, like the per frame buffers
+		constexpr VkDeviceSize UBO_SIZE = 256;
+		constexpr VkDeviceSize UBO_BUFFER_SIZE = 64 * 1024;
+		constexpr VkDeviceSize LARGE_SIZE = 4 * 1024 * 1024;
+		constexpr uint32_t UBO_WRITES = 10000;
+		constexpr uint32_t LARGE_WRITES = 16;
+		Buffer uboBuffer{ device, UBO_BUFFER_SIZE, 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Other };
+		Buffer largeBuffer{ device, LARGE_SIZE, 1, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryCategory::Other };
+		uboBuffer.map();
+		largeBuffer.map();
+		std::cout << "Buffer writes: " << (largeBuffer.isWriteCombined() ? "write combined" : "cached") << ", "
+			<< (largeBuffer.isCoherent() ? "coherent (nothing is flushed)" : "not coherent") << " memory, "
+			<< device.getAllocator().getNonCoherentAtomSize() << " byte atoms" << std::endl;
+
+		std::vector<char> data(static_cast<size_t>(LARGE_SIZE), 0x5a);
+		auto best = [&](const std::function<void()>& writes) {
+			double bestTime = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++) {
+				auto start = std::chrono::high_resolution_clock::now();
+				writes();
+				double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				if (run == 0 || time < bestTime) bestTime = time;
+			}
+			return bestTime;
+		};
+
+		// A uniform buffer's worth at a time, the old way flushed the whole buffer after each
+		double oldUbo = best([&]() {
+			for (uint32_t i = 0; i < UBO_WRITES; i++) {
+				VkDeviceSize offset = i % (UBO_BUFFER_SIZE / UBO_SIZE) * UBO_SIZE;
+				std::memcpy(static_cast<char*>(uboBuffer.getMappedMemory()) + offset, data.data(), static_cast<size_t>(UBO_SIZE));
+				uboBuffer.flush(uboBuffer.getBufferSize(), 0);
+			}
+		});
+		double newUbo = best([&]() {
+			for (uint32_t i = 0; i < UBO_WRITES; i++) {
+				uboBuffer.writeToBuffer(data.data(), UBO_SIZE, i % (UBO_BUFFER_SIZE / UBO_SIZE) * UBO_SIZE);
+				uboBuffer.flush();
+			}
+		});
+		std::cout << std::fixed << std::setprecision(0) << "  " << UBO_SIZE << " B, memcpy and whole buffer flush: "
+			<< oldUbo * 1000000.0 / UBO_WRITES << " ns a write" << std::endl;
+		std::cout << "  " << UBO_SIZE << " B, writeToBuffer and dirty flush:   "
+			<< newUbo * 1000000.0 / UBO_WRITES << " ns a write" << std::endl;
+
+		// Large writes, where the non temporal stores come in
+		double oldLarge = best([&]() {
+			for (uint32_t i = 0; i < LARGE_WRITES; i++) {
+				std::memcpy(largeBuffer.getMappedMemory(), data.data(), static_cast<size_t>(LARGE_SIZE));
+				largeBuffer.flush(largeBuffer.getBufferSize(), 0);
+			}
+		});
+		double newLarge = best([&]() {
+			for (uint32_t i = 0; i < LARGE_WRITES; i++) {
+				largeBuffer.writeToBuffer(data.data(), LARGE_SIZE);
+				largeBuffer.flush();
+			}
+		});
+		double megabytes = LARGE_WRITES * LARGE_SIZE / (1024.0 * 1024.0);
+		std::cout << "  " << LARGE_SIZE / (1024 * 1024) << " MB, memcpy and flush:       "
+			<< megabytes / (oldLarge / 1000.0) << " MB/s" << std::endl;
+		std::cout << "  " << LARGE_SIZE / (1024 * 1024) << " MB, writeToBuffer and flush: "
+			<< megabytes / (newLarge / 1000.0) << " MB/s" << std::endl;
+	}
+
+	int runMemoryBenchmark() {
+		try {
+			Window window{ 800, 600, "Memory benchmark" };
+			Device device{ window };
+			// No frames are submitted here, so the buffers the benchmarks destroy are only
+			// freed by destroyAll and not by the deletion queue's frame tracking
+			DeletionQueue& deletionQueue = device.getDeletionQueue();
+			benchmarkDeviceMemory(device);
+			benchmarkUploads(device);
+			deletionQueue.destroyAll();
+			benchmarkUploadContext(device);
+			deletionQueue.destroyAll();
+			benchmarkBufferWrites(device);
+			deletionQueue.destroyAll();
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int runStreamingTest(const std::vector<std::string>& args) {
+		std::string filePath = (std::filesystem::temp_directory_path() / "stream_test.obj").string();
+		try {
+			size_t fileMegabytes = args.size() > 0 ? std::stoul(args[0]) : 2048;
+			size_t budgetMegabytes = args.size() > 1 ? std::stoul(args[1]) : 256;
+
+			size_t baseline = currentMemoryUsage();
+			std::cout << std::fixed << std::setprecision(1) << "Streaming test: writing " << fileMegabytes
+				<< " MB to " << filePath << std::endl;
+			writeSyntheticObj(filePath, static_cast<uint64_t>(fileMegabytes) * 1024 * 1024, 1024);
+
+			MeshStream::Options options{};
+			options.memoryBudget = budgetMegabytes * 1024 * 1024;
+			auto start = std::chrono::high_resolution_clock::now();
+			MeshStream stream{ filePath, options };
+			auto scanned = std::chrono::high_resolution_clock::now();
+
+			// The same ring the model loader uses, the windows in flight are written
+			// at the same time and checked before their slots are used again
+			size_t slotCount = options.windowsInFlight;
+			std::vector<char> ring(static_cast<size_t>(stream.getSlotSize()) * slotCount);
+			bool indicesInRange = true;
+			for (size_t first = 0; first < stream.getWindowCount(); first += slotCount) {
+				size_t count = std::min(slotCount, stream.getWindowCount() - first);
+				ThreadPool::shared().parallelFor(count, [&](size_t i) {
+					stream.writeWindow(first + i, ring.data() + i * stream.getSlotSize());
+				});
+				for (size_t i = 0; i < count; i++) {
+					const MeshStream::WindowRange& range = stream.getWindowRange(first + i);
+					const char* slot = ring.data() + i * stream.getSlotSize();
+					for (uint32_t j = 0; j < range.indexCount; j++) {
+						uint32_t index = stream.getIndexType() == VK_INDEX_TYPE_UINT16
+							? reinterpret_cast<const uint16_t*>(slot + range.indexOffset)[j]
+							: reinterpret_cast<const uint32_t*>(slot + range.indexOffset)[j];
+						if (index < range.firstVertex || index >= range.firstVertex + range.vertexCount) indicesInRange = false;
+					}
+				}
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			size_t used = peakMemoryUsage() - baseline;
+			size_t fileSize = static_cast<size_t>(std::filesystem::file_size(filePath));
+			std::filesystem::remove(filePath);
+
+			double scanTime = std::chrono::duration<double, std::milli>(scanned - start).count();
+			double totalTime = std::chrono::duration<double, std::milli>(end - start).count();
+			bool withinBudget = used <= options.memoryBudget;
+			std::cout << "  " << stream.getWindowCount() << " windows, " << stream.getIndexCount() / 3 << " triangles, "
+				<< stream.getVertexCount() << " vertices" << std::endl;
+			std::cout << "  first pass " << scanTime << " ms, total " << totalTime << " ms, "
+				<< megabytesPerSecond(fileSize, totalTime) << " MB/s" << std::endl;
+			std::cout << "  peak memory " << used / (1024.0 * 1024.0) << " MB (estimated "
+				<< stream.getMemoryEstimate() / (1024.0 * 1024.0) << " MB) of a " << budgetMegabytes
+				<< " MB budget for a " << fileSize / (1024.0 * 1024.0) << " MB file" << std::endl;
+			std::cout << "  within budget: " << (withinBudget ? "yes" : "NO")
+				<< ", indices in range: " << (indicesInRange ? "yes" : "NO") << std::endl;
+			return withinBudget && indicesInRange ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			std::error_code ignored{};
+			std::filesystem::remove(filePath, ignored);
+			return EXIT_FAILURE;
+		}
+	}
+}
@@ -0,0 +1,101 @@
+//**********************************************************************
+// These are small timing runs for the performance sensitive parts of
+// the engine. They don't open a window, they just exercise the code
+// paths directly and print the results to the console. Run them by
+// starting the program with --benchmark, optionally followed by the
+// model files to use (TestModels/Koenigsegg.obj is used by default,
+// from TestModels/Models.zip when it hasn't been extracted).
+// --stream-test checks that streamed loading stays within its memory
+// budget on a generated file that is far larger than the budget.
+// --memory-benchmark needs a GPU and measures the memory allocator and
+// the upload paths.
+//**********************************************************************
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace engine {
+	class Device;
+
+	int runBenchmarks(const std::vector<std::string>& args);
+
+	// Compares the multithreaded OBJ parser against tiny object loader and
+	// reports the throughput of the parser for different numbers of threads
+	void benchmarkObjLoading(const std::string& filePath);
+
+	// Compares inflating a model out of a mounted zip archive and then parsing it against
+	// parsing it while it is still being inflated. Skipped for files that aren't in an archive.
+	void benchmarkArchiveLoading(const std::string& filePath);
+
+	// Compares a cold load (parse, de-duplicate and write the mesh cache)
+	// against a warm load straight from the memory mapped mesh cache
+	void benchmarkMeshCache(const std::string& filePath);
+
+	// Reports how far the mesh codec shrinks the vertices (standard and compact) and indices of
+	// the optimized model, and how fast each decoder the CPU supports puts them back together
+	void benchmarkMeshCodec(const std::string& filePath);
+
+	// Writes the model as a glb file next to it and compares loading that against
+	// parsing the OBJ file, both with standard and compact vertices
+	void benchmarkGlbLoading(const std::string& filePath);
+
+	// Compares the vertex welder against the std::unordered_map de-duplication it replaced
+	void benchmarkVertexWelding(const std::string& filePath);
+
+	// Reports the vertex cache efficiency before and after the mesh optimizer
+	void benchmarkMeshOptimizer(const std::string& filePath);
+
+	// Reports how far the mesh simplifier gets for each of the error targets and how long it takes
+	void benchmarkMeshSimplifier(const std::string& filePath);
+
+	// Reports how the model splits into meshlets and how many of them the normal cones cull
+	void benchmarkMeshlets(const std::string& filePath);
+
+	// Estimates how many bytes a depth only pass fetches for the positions of the model with
+	// interleaved and with split vertex streams, in both vertex formats. The draw goes through a
+	// simulated post transform cache and vertex fetch cache, there is no GPU involved.
+	void benchmarkVertexStreams(const std::string& filePath);
+
+	// Streams the model in small windows and checks that every triangle comes out the same
+	// as with the regular load
+	void benchmarkStreamingLoad(const std::string& filePath);
+
+	// Builds the BVH of the model on one thread and on all of them, then reports how many
+	// rays a second it answers and checks a few of them against every triangle
+	void benchmarkRaycasts(const std::string& filePath);
+
+	// Packs the startup assets into a temporary archive and compares reading them from it against
+	// reading the loose files one at a time. Reports the time, the read calls and the page faults.
+	void benchmarkStartupLoading();
+
+	// Compares creating and destroying buffers through the memory allocator against a
+	// vkAllocateMemory call for each of them, then creates and destroys buffers of random
+	// sizes and prints the allocator's statistics
+	void benchmarkDeviceMemory(Device& device);
+
+	// Copies 64 MB from a staging buffer to the GPU, a copy at a time through the graphics queue
+	// with a vkQueueWaitIdle each, through the transfer queue with a submit each and through
+	// the transfer queue in one batch. Reports the throughput, submits and stalls of each.
+	void benchmarkUploads(Device& device);
+
+	// Uploads 200 small models with two staging buffers and a waited for submit each, then through
+	// the upload context's ring with one flush, then streams more than the ring holds through it.
+	// Reports the time, the submits and the ring wraps and stalls.
+	void benchmarkUploadContext(Device& device);
+
+	// Writes 256 byte payloads into a host visible buffer with a flush of the whole buffer each,
+	// then through writeToBuffer with a flush of only what was written, and does the same for
+	// 4 MB payloads where writeToBuffer uses non temporal stores. Reports the time a write and MB/s.
+	void benchmarkBufferWrites(Device& device);
+
+	// Opens a small window for the device and runs benchmarkDeviceMemory, benchmarkUploads,
+	// benchmarkUploadContext and benchmarkBufferWrites (--memory-benchmark)
+	int runMemoryBenchmark();
+
+	// Writes a synthetic OBJ file of about [file MB] (2048 by default) and streams it with a
+	// memory budget of [budget MB] (256 by default). Fails if the memory used by the process
+	// goes over the budget at any point. Arguments are: [file MB] [budget MB]
+	int runStreamingTest(const std::vector<std::string>& args);
+}
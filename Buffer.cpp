@@ -1,11 +1,51 @@
 #include "Buffer.h"
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BUFFER_SSE2
+    #include <emmintrin.h>
+#endif
+
 namespace engine {
 
+    // Non temporal stores need a 16 byte aligned destination, so the first few bytes go through
+    // memcpy. The loads can be unaligned, the source is usually plain heap memory.
+    void Buffer::streamingCopy(void* destination, const void* source, size_t size) {
+#ifdef BUFFER_SSE2
+        char* to = static_cast<char*>(destination);
+        const char* from = static_cast<const char*>(source);
+        size_t head = std::min(size, (16 - (reinterpret_cast<uintptr_t>(to) & 15)) & 15);
+        memcpy(to, from, head);
+        to += head;
+        from += head;
+        size -= head;
+
+        for (; size >= 64; size -= 64, to += 64, from += 64) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + 32));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + 48));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(to), a);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(to + 16), b);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(to + 32), c);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(to + 48), d);
+        }
+        for (; size >= 16; size -= 16, to += 16, from += 16) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(to), _mm_loadu_si128(reinterpret_cast<const __m128i*>(from)));
+        }
+        // Non temporal stores aren't ordered with the rest, the flush or submit after this has to see them
+        _mm_sfence();
+        memcpy(to, from, size);
+#else
+        memcpy(destination, source, size);
+#endif
+    }
+
     // Returns the minimum instance size required to be compatible with devices minOffsetAlignment
     // Parameters:  instanceSize The size of an instance, minOffsetAlignment The minimum required alignment, 
     //              in bytes, for the offset member (egminUniformBufferOffsetAlignment)
@@ -22,6 +62,7 @@ namespace engine {
         uint32_t instanceCount,
         VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
+        MemoryCategory category,
         VkDeviceSize minOffsetAlignment)
         : device{ device },
         instanceSize{ instanceSize },
@@ -30,58 +71,123 @@ namespace engine {
         memoryPropertyFlags{ memoryPropertyFlags } {
         alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
         bufferSize = alignmentSize * instanceCount;
-        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, category, buffer, memory);
+
+        // The memory type can be coherent or cached even when that wasn't asked for
+        VkMemoryPropertyFlags typeFlags = device.getAllocator().getMemoryTypeFlags(memory.memoryType);
+        coherent = (typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+        writeCombined = (typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0
+            && (typeFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) == 0;
+        atomSize = device.getAllocator().getNonCoherentAtomSize();
     }
 
     Buffer::~Buffer() {
         unmap();
-        vkDestroyBuffer(device.device(), buffer, nullptr);
-        vkFreeMemory(device.device(), memory, nullptr);
+        device.destroyBuffer(buffer, memory);     // Only once no frame or upload uses it anymore
     }
 
     // Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
     // Size represents the size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
-    // buffer range. Offset represents the byte offset from beginning. Return vkMapmemory result.
+    // buffer range. Offset represents the byte offset from beginning. Buffers share their memory
+    // with others, so the allocator keeps host visible memory mapped and this only points into it.
     VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(device.device(), memory, offset, size, 0, &mapped);
+        assert(buffer && memory.memory && "Called map on buffer before create");
+        if (memory.mapped == nullptr) return VK_ERROR_MEMORY_MAP_FAILED;
+        mapped = static_cast<char*>(memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
-    // Unmap a mapped memory range. We don't need to return a result as vkUnmapMemory can't fail
+    // Unmap a mapped memory range. The memory itself stays mapped for the other buffers in it
     void Buffer::unmap() {
-        if (mapped) {
-            vkUnmapMemory(device.device(), memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
     // Copies the specified data to the mapped buffer. Default value writes whole buffer range
     // Basically, we take the vertices data we get from the Model class and copy it into the host
-    // mapped memory region. Since we set the property in the Model class to coherent bit, the host 
-    // memory will automatically be flushed to update the device memory.
+    // mapped memory region. Coherent memory is updated on the device by itself, anything else
+    // is remembered as dirty for the next flush. Large writes to write combined memory skip the cache.
     void Buffer::writeToBuffer(void* data, VkDeviceSize size, VkDeviceSize offset) {
         assert(mapped && "Cannot copy to unmapped buffer");
 
-        if (size == VK_WHOLE_SIZE) {
-            memcpy(mapped, data, bufferSize);
+        if (size == VK_WHOLE_SIZE) size = bufferSize - offset;
+        char* memOffset = (char*)mapped;
+        memOffset += offset;
+        if (writeCombined && size >= STREAMING_WRITE_SIZE) {
+            streamingCopy(memOffset, data, static_cast<size_t>(size));
         }
         else {
-            char* memOffset = (char*)mapped;
-            memOffset += offset;
-            memcpy(memOffset, data, size);
+            memcpy(memOffset, data, static_cast<size_t>(size));
+        }
+        markDirty(size, offset);
+    }
+
+    // Adds a range to the dirty ranges, rounded out to whole atoms so that ranges that share an
+    // atom become one. The buffer starts on an atom (see MemoryAllocator::allocate).
+    void Buffer::markDirty(VkDeviceSize size, VkDeviceSize offset) {
+        if (coherent) return;
+        if (size == VK_WHOLE_SIZE) size = bufferSize - offset;
+        if (size == 0) return;
+        DirtyRange range{ offset / atomSize * atomSize,
+            std::min(bufferSize, (offset + size + atomSize - 1) / atomSize * atomSize) };
+
+        // Swallows every range it touches
+        auto first = std::lower_bound(dirtyRanges.begin(), dirtyRanges.end(), range.begin,
+            [](const DirtyRange& other, VkDeviceSize begin) { return other.end < begin; });
+        auto last = first;
+        while (last != dirtyRanges.end() && last->begin <= range.end) {
+            range.begin = std::min(range.begin, last->begin);
+            range.end = std::max(range.end, last->end);
+            ++last;
+        }
+        first = dirtyRanges.erase(first, last);
+        dirtyRanges.insert(first, range);
+
+        if (dirtyRanges.size() > MAX_DIRTY_RANGES) {
+            size_t closest = 0;
+            for (size_t i = 1; i + 1 < dirtyRanges.size(); i++) {
+                if (dirtyRanges[i + 1].begin - dirtyRanges[i].end
+                    < dirtyRanges[closest + 1].begin - dirtyRanges[closest].end) {
+                    closest = i;
+                }
+            }
+            dirtyRanges[closest].end = dirtyRanges[closest + 1].end;
+            dirtyRanges.erase(dirtyRanges.begin() + closest + 1);
         }
     }
 
+    VkDeviceSize Buffer::getDirtyBytes() const {
+        VkDeviceSize bytes = 0;
+        for (const DirtyRange& range : dirtyRanges) bytes += range.end - range.begin;
+        return bytes;
+    }
+
     // Here we flush a memory range of the buffer to make it visible to the device
-    // Size represents the size of the memory range to flush. Pass VK_WHOLE_SIZE to 
-    // flush the complete buffer range. Offset represents the byte offset from beginning
-    // The vkFlushmappedMemoryRanges call will give us a VkResult to return.
+    // Size represents the size of the memory range to flush, offset the byte offset from beginning.
+    // Without either only the dirty ranges are flushed, in one vkFlushMappedMemoryRanges call.
+    // Coherent memory doesn't need it and nothing is flushed at all.
+    // The ranges are moved into the buffer's part of the shared memory and rounded out to nonCoherentAtomSize
     VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};           
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        if (coherent) return VK_SUCCESS;
+
+        if (size == VK_WHOLE_SIZE && offset == 0) {
+            if (dirtyRanges.empty()) return VK_SUCCESS;
+            VkMappedMemoryRange mappedRanges[MAX_DIRTY_RANGES];
+            uint32_t rangeCount = 0;
+            for (const DirtyRange& range : dirtyRanges) {
+                mappedRanges[rangeCount++] = device.getAllocator().getMappedRange(memory, range.end - range.begin, range.begin);
+            }
+            dirtyRanges.clear();
+            return vkFlushMappedMemoryRanges(device.device(), rangeCount, mappedRanges);
+        }
+
+        if (size == VK_WHOLE_SIZE) size = bufferSize - offset;
+        // Dirty ranges inside the flushed one are done with
+        VkDeviceSize flushedBegin = offset / atomSize * atomSize;
+        VkDeviceSize flushedEnd = std::min(bufferSize, (offset + size + atomSize - 1) / atomSize * atomSize);
+        dirtyRanges.erase(std::remove_if(dirtyRanges.begin(), dirtyRanges.end(), [&](const DirtyRange& range) {
+            return range.begin >= flushedBegin && range.end <= flushedEnd;
+        }), dirtyRanges.end());
+        VkMappedMemoryRange mappedRange = device.getAllocator().getMappedRange(memory, size, offset);
         return vkFlushMappedMemoryRanges(device.device(), 1, &mappedRange);
     }
 
@@ -91,11 +197,8 @@ namespace engine {
     // This returns a VkResult of the invalidate call.
     // Note that this is only required for non-coherent memory
     VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        if (size == VK_WHOLE_SIZE) size = bufferSize - offset;
+        VkMappedMemoryRange mappedRange = device.getAllocator().getMappedRange(memory, size, offset);
         return vkInvalidateMappedMemoryRanges(device.device(), 1, &mappedRange);
     }
 
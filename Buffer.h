@@ -1,17 +1,44 @@
+//**********************************************************************
+// Host visible memory that isn't cached is write combined: the CPU
+// gathers the stores to it and sends them over the bus in bursts, and
+// reading it back is very slow. memcpy pulls every destination line
+// through the cache first, so large writes to such buffers use non
+// temporal stores instead, which go straight to memory.
+//
+// Writes to memory that isn't host coherent are remembered as dirty
+// ranges, rounded out to nonCoherentAtomSize. flush() with no arguments
+// only flushes those instead of the whole buffer, and does nothing at
+// all for coherent memory. Writes made through getMappedMemory have to
+// be marked with markDirty, or flushed with an explicit range.
+//**********************************************************************
+
 #pragma once
 
 #include "Device.h"
 
+// std
+#include <vector>
+
 namespace engine {
 
     class Buffer {
     public:
+        // Writes at least this large to write combined memory use non temporal stores
+        static constexpr VkDeviceSize STREAMING_WRITE_SIZE = 4 * 1024;
+        // More dirty ranges than this are merged, the closest ones first
+        static constexpr size_t MAX_DIRTY_RANGES = 8;
+
+        // Copies size bytes with non temporal stores when the CPU has them (SSE2), otherwise
+        // with memcpy. The stores are fenced before it returns.
+        static void streamingCopy(void* destination, const void* source, size_t size);
+
         Buffer(
             Device& device,
             VkDeviceSize instanceSize,
             uint32_t instanceCount,
             VkBufferUsageFlags usageFlags,
             VkMemoryPropertyFlags memoryPropertyFlags,
+            MemoryCategory category,
             VkDeviceSize minOffsetAlignment = 1);
         ~Buffer();
 
@@ -22,7 +49,10 @@ namespace engine {
         void unmap();
 
         void writeToBuffer(void* data, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+        // Without arguments this flushes the dirty ranges, with them exactly that range
         VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+        // For writes made through getMappedMemory, so the next flush() covers them
+        void markDirty(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
         VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
         VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
@@ -39,14 +69,25 @@ namespace engine {
         VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
         VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
         VkDeviceSize getBufferSize() const { return bufferSize; }
+        const MemoryAllocation& getMemory() const { return memory; }
+        MemoryCategory getCategory() const { return memory.category; }
+        bool isCoherent() const { return coherent; }
+        bool isWriteCombined() const { return writeCombined; }
+        // Bytes the next flush() would flush, atom rounding included
+        VkDeviceSize getDirtyBytes() const;
 
     private:
+        struct DirtyRange {
+            VkDeviceSize begin;
+            VkDeviceSize end;
+        };
+
         static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
 
         Device& device;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MemoryAllocation memory{};      // A range of a shared block, see MemoryAllocator.h
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
@@ -54,5 +95,10 @@ namespace engine {
         VkDeviceSize alignmentSize;
         VkBufferUsageFlags usageFlags;
         VkMemoryPropertyFlags memoryPropertyFlags;
+
+        bool coherent = false;
+        bool writeCombined = false;
+        VkDeviceSize atomSize = 1;
+        std::vector<DirtyRange> dirtyRanges{};     // Sorted and apart from each other
     };
 }
\ No newline at end of file
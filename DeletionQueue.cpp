@@ -0,0 +1,104 @@
+#include "DeletionQueue.h"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+namespace engine {
+	DeletionQueue::DeletionQueue(VkDevice tempDevice, TransferQueue& tempTransferQueue)
+		: device{ tempDevice }, transferQueue{ tempTransferQueue } {
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		createInfo.pNext = &typeInfo;
+		if (vkCreateSemaphore(device, &createInfo, nullptr, &frameTimeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create frame timeline semaphore!");
+		}
+	}
+
+	DeletionQueue::~DeletionQueue() {
+		destroyAll();
+		vkDestroySemaphore(device, frameTimeline, nullptr);
+	}
+
+	// Whatever is recorded right now goes out with the next submit, so that is the frame to wait for
+	void DeletionQueue::push(std::function<void()> destroy) {
+		Entry entry{};
+		entry.frame = submittedFrames + 1;
+		entry.upload = transferQueue.getSubmittedValue();
+		entry.destroy = std::move(destroy);
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		entries.push_back(std::move(entry));
+		stats.pushed++;
+		stats.peakDepth = std::max(stats.peakDepth, entries.size());
+	}
+
+	uint64_t DeletionQueue::getCompletedFrames() const {
+		uint64_t value = 0;
+		vkGetSemaphoreCounterValue(device, frameTimeline, &value);
+		return value;
+	}
+
+	void DeletionQueue::collect() {
+		uint64_t completedFrames = getCompletedFrames();
+		std::vector<std::function<void()>> due{};
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			size_t kept = 0;
+			for (Entry& entry : entries) {
+				if (entry.frame <= completedFrames && transferQueue.isFinished(entry.upload)) {
+					due.push_back(std::move(entry.destroy));
+				}
+				else {
+					entries[kept++] = std::move(entry);
+				}
+			}
+			entries.resize(kept);
+			stats.destroyed += due.size();
+		}
+
+		// Outside the lock, destroying a model pushes its buffers
+		for (std::function<void()>& destroy : due) destroy();
+	}
+
+	void DeletionQueue::waitForFrames() {
+		uint64_t value = submittedFrames;
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &frameTimeline;
+		waitInfo.pValues = &value;
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	}
+
+	void DeletionQueue::destroyAll() {
+		// The acquires that haven't been submitted yet still name the buffers
+		transferQueue.waitIdle();
+		vkDeviceWaitIdle(device);
+		for (;;) {
+			std::vector<Entry> due{};
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				if (entries.empty()) break;
+				due.swap(entries);
+				stats.destroyed += due.size();
+			}
+			for (Entry& entry : due) entry.destroy();
+		}
+	}
+
+	DeletionQueue::Stats DeletionQueue::getStats() const {
+		uint64_t completedFrames = getCompletedFrames();
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats current = stats;
+		current.depth = entries.size();
+		current.framesSubmitted = submittedFrames;
+		current.framesCompleted = completedFrames;
+		return current;
+	}
+}
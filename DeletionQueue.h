@@ -0,0 +1,85 @@
+//**********************************************************************
+// Destroying a buffer used to call vkDestroyBuffer and free its memory
+// right away, so the only safe way to unload anything while frames were
+// in flight was vkDeviceWaitIdle. Resources now go into the deletion
+// queue instead and are destroyed once nothing on the GPU can still use
+// them: every frame submitted by the time they were pushed, the one
+// being recorded included, has to be done, and so does every upload
+// submitted by then (see TransferQueue.h). The frames are tracked with
+// a timeline semaphore that each frame's submit signals next to its in
+// flight fence, so it keeps counting when the swap chain and its fences
+// are recreated. Destructors only push a small closure, they never wait.
+//
+// push is thread safe, models are destroyed on the loader threads too.
+// collect runs the closures that are due on the thread that renders,
+// once a frame, and the stats say how many are still waiting.
+//**********************************************************************
+
+#pragma once
+
+#include "TransferQueue.h"
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace engine {
+	class DeletionQueue {
+	public:
+		struct Stats {
+			size_t depth{ 0 };				// Resources waiting for the GPU
+			size_t peakDepth{ 0 };
+			uint64_t pushed{ 0 };
+			uint64_t destroyed{ 0 };
+			uint64_t framesSubmitted{ 0 };
+			uint64_t framesCompleted{ 0 };
+		};
+
+		DeletionQueue(VkDevice device, TransferQueue& transferQueue);
+		// Waits for the device and destroys whatever is left
+		~DeletionQueue();
+
+		DeletionQueue(const DeletionQueue&) = delete;
+		DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+		// destroy runs on the thread that renders once the frames and uploads that could still
+		// use the resource are done. Thread safe.
+		void push(std::function<void()> destroy);
+
+		// Every frame's submit signals this semaphore with the value getNextFrame returns
+		VkSemaphore getFrameTimeline() const { return frameTimeline; }
+		uint64_t getNextFrame() const { return submittedFrames + 1; }
+		// Counts the frame once its submit went through, a failed submit never signals its value
+		void frameSubmitted() { submittedFrames++; }
+
+		// Destroys what is due, without waiting. Call it once a frame.
+		void collect();
+		// Blocks until every frame submitted so far is done, uploads keep going
+		void waitForFrames();
+		// Waits for the device and destroys everything in the queue
+		void destroyAll();
+
+		Stats getStats() const;
+
+	private:
+		struct Entry {
+			uint64_t frame{ 0 };		// The frame timeline value that has to be reached
+			uint64_t upload{ 0 };		// The transfer queue value that has to be complete
+			std::function<void()> destroy{};
+		};
+
+		uint64_t getCompletedFrames() const;
+
+		VkDevice device;
+		TransferQueue& transferQueue;
+		VkSemaphore frameTimeline{ VK_NULL_HANDLE };
+		std::atomic<uint64_t> submittedFrames{ 0 };
+
+		mutable std::mutex mutex;
+		std::vector<Entry> entries{};
+		Stats stats{};
+	};
+}
@@ -1,5 +1,8 @@
 #include "Device.h"
 #include "Application.h"
+#include "GeometryHeap.h"
+#include "MaterialTable.h"
+#include "UploadContext.h"
 
 // std headers
 #include <cstring>
@@ -61,9 +64,24 @@ namespace engine {
         pickPhysicalDevice();       //Here we pick the physical graphics device that our application will use, ie the graphics card.
         createLogicalDevice();      //Here we choose which features of our device we want to use. We can add or remove as we want.
         createCommandPool();        //This is an opaque object that command buffer memory is allocated from.
+        allocator = std::make_unique<MemoryAllocator>(device_, physicalDevice, memoryBudgetSupported);
+        QueueFamilyIndices indices = findPhysicalQueueFamilies();
+        transferQueue = std::make_unique<TransferQueue>(
+            device_, graphicsQueue_, indices.graphicsFamily, transferQueue_, indices.transferFamily);
+        deletionQueue = std::make_unique<DeletionQueue>(device_, *transferQueue);
+        uploadContext = std::make_unique<UploadContext>(*this, *transferQueue);
+        geometryHeap = std::make_unique<GeometryHeap>(*this);
+        materialTable = std::make_unique<MaterialTable>(*this);
     }
 
     Device::~Device() {
+        uploadContext.reset();      //Submits what is still recorded, the staging ring goes with it
+        deletionQueue->destroyAll();//Waits for the uploads and frames, the models' heap ranges and materials go back
+        materialTable.reset();
+        geometryHeap.reset();       //Every model is gone by now, so the heap's buffers can go
+        deletionQueue.reset();      //Destroys the heap's and the material table's buffers
+        transferQueue.reset();
+        allocator.reset();          //Frees the memory blocks, every buffer and image is gone by now
         vkDestroyCommandPool(device_, commandPool, nullptr);
         
         vkDestroyDevice(device_, nullptr);
@@ -88,7 +106,7 @@ namespace engine {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 1, 0);
         appInfo.pEngineName = "Cobra Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 1, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_1;
+        appInfo.apiVersion = VK_API_VERSION_1_2;     //1.2 for timeline semaphores (see TransferQueue.h)
 
         VkInstanceCreateInfo createInfo = {};
 
@@ -155,7 +173,7 @@ namespace engine {
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.transferFamily };
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -170,15 +188,34 @@ namespace engine {
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+        // Uploads are tracked with timeline semaphores
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &timelineFeatures;
 
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+        // VK_EXT_memory_budget is optional, the allocator falls back to the heap sizes without it
+        std::vector<const char*> enabledExtensions = deviceExtensions;
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+                memoryBudgetSupported = true;
+                enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            }
+        }
+
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         // might not really be necessary anymore because 
         // device specific validation layers have been deprecated
@@ -196,6 +233,9 @@ namespace engine {
 
         vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
         vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+        vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+        std::cout << (indices.transferFamily != indices.graphicsFamily
+            ? "Uploads run on a dedicated transfer queue" : "Uploads run on the graphics queue") << std::endl;
     }
 
     // In Vulkan, command buffers are objects used to record commands that the GPU will execute
@@ -239,8 +279,18 @@ namespace engine {
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+
         return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-            supportedFeatures.samplerAnisotropy;
+            supportedFeatures.samplerAnisotropy && deviceProperties.apiVersion >= VK_API_VERSION_1_2 &&
+            timelineFeatures.timelineSemaphore;
     }
 
     //This just populates our debug validation layer messages
@@ -377,6 +427,22 @@ namespace engine {
             i++;
         }
 
+        // Uploads prefer a family that can only transfer, those are the DMA engines that copy
+        // without taking anything away from rendering. Any family without graphics comes next.
+        indices.transferFamily = indices.graphicsFamily;
+        int best = 0;
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if (queueFamilies[family].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+                continue;
+            }
+            int score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+            if (score > best) {
+                best = score;
+                indices.transferFamily = family;
+            }
+        }
+
         return indices;
     }
 
@@ -444,8 +510,10 @@ namespace engine {
         VkDeviceSize size,
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
+        MemoryCategory category,
         VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory) {
+        MemoryAllocation& bufferMemory,
+        bool dedicated) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -461,18 +529,27 @@ namespace engine {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-        // Now we allocate the memory using the properties argument and the requirements
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
+        // Now we get a range of memory using the properties argument and the requirements.
+        // Buffers are linear resources, so they share blocks with other buffers only.
+        uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+        try {
+            bufferMemory = allocator->allocate(memRequirements, memoryType, true, category, dedicated);
         }
+        catch (...) {
+            vkDestroyBuffer(device_, buffer, nullptr);
+            throw;
+        }
+
+        // Now we bind the buffer to the range we just got
+        vkBindBufferMemory(device_, buffer, bufferMemory.memory, bufferMemory.offset);
+    }
 
-        // Now we bind the buffer to the memeory we just allocated
-        vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+    // Frames in flight and running uploads may still use the buffer, so it only goes once they are done
+    void Device::destroyBuffer(VkBuffer buffer, const MemoryAllocation& memory) {
+        deletionQueue->push([this, buffer, memory]() {
+            vkDestroyBuffer(device_, buffer, nullptr);
+            allocator->free(memory);
+        });
     }
 
     VkCommandBuffer Device::beginSingleTimeCommands() {
@@ -507,16 +584,17 @@ namespace engine {
         vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
     }
 
+    // This goes through the transfer queue and only waits for this one copy, not for the whole queue
     void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        TransferQueue::Batch batch = transferQueue->begin();
 
         VkBufferCopy copyRegion{};
         copyRegion.srcOffset = 0;  // Optional
         copyRegion.dstOffset = 0;  // Optional
         copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+        batch.copyBuffer(srcBuffer, dstBuffer, 1, &copyRegion);
 
-        endSingleTimeCommands(commandBuffer);
+        transferQueue->wait(transferQueue->submit(batch));
     }
 
     void Device::copyBufferToImage(
@@ -549,8 +627,9 @@ namespace engine {
     void Device::createImageWithInfo(
         const VkImageCreateInfo& imageInfo,
         VkMemoryPropertyFlags properties,
+        MemoryCategory category,
         VkImage& image,
-        VkDeviceMemory& imageMemory) {
+        MemoryAllocation& imageMemory) {
 
         if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
@@ -559,16 +638,12 @@ namespace engine {
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+        // Optimal tiling images get blocks of their own, which keeps them a whole
+        // bufferImageGranularity page away from any buffer
+        uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+        imageMemory = allocator->allocate(memRequirements, memoryType, imageInfo.tiling == VK_IMAGE_TILING_LINEAR, category);
 
-        if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+        if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
             throw std::runtime_error("failed to bind image memory!");
         }
     }
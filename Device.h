@@ -14,11 +14,18 @@
 #pragma once
 
 #include "Window.h"
+#include "DeletionQueue.h"
+#include "MemoryAllocator.h"
+#include "TransferQueue.h"
 
 //std lib headers
+#include <memory>
 #include <vector>
 
 namespace engine {
+    class GeometryHeap;
+    class MaterialTable;
+    class UploadContext;
 
     struct SwapChainSupportDetails {
         VkSurfaceCapabilitiesKHR capabilities;
@@ -29,6 +36,7 @@ namespace engine {
     struct QueueFamilyIndices {
         uint32_t graphicsFamily;
         uint32_t presentFamily;
+        uint32_t transferFamily;        // A family without graphics when there is one, otherwise the graphics family
         bool graphicsFamilyHasValue = false;
         bool presentFamilyHasValue = false;
         bool isComplete() {
@@ -65,11 +73,27 @@ namespace engine {
           VkSurfaceKHR surface_;
           VkQueue graphicsQueue_;
           VkQueue presentQueue_;
+          VkQueue transferQueue_;
 
           VkFence fence;
 
+          // Every buffer and image gets its memory from here (see MemoryAllocator.h)
+          std::unique_ptr<MemoryAllocator> allocator;
+          // The vertices and indices of every model (see GeometryHeap.h)
+          std::unique_ptr<GeometryHeap> geometryHeap;
+          // The materials of every model (see MaterialTable.h)
+          std::unique_ptr<MaterialTable> materialTable;
+          // Every upload goes through here (see TransferQueue.h)
+          std::unique_ptr<TransferQueue> transferQueue;
+          // The staging ring models are uploaded through (see UploadContext.h)
+          std::unique_ptr<UploadContext> uploadContext;
+          // Buffers and heap ranges wait here until no frame or upload uses them (see DeletionQueue.h)
+          std::unique_ptr<DeletionQueue> deletionQueue;
+
           const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
           const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+          // Enabled when the device has it, the allocator then gets real budgets from the driver
+          bool memoryBudgetSupported = false;
      
     public:
         #ifdef NDEBUG
@@ -99,13 +123,32 @@ namespace engine {
           VkFormat findSupportedFormat(
               const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
-          // Buffer Helper Functions
+          // Buffer Helper Functions. The memory is a range of a larger block unless dedicated is
+          // set, then it gets a vkAllocateMemory call of its own. Give it back with freeMemory.
+          // The category says what the memory is used for in the budget stats.
           void createBuffer(
               VkDeviceSize size,
               VkBufferUsageFlags usage,
               VkMemoryPropertyFlags properties,
+              MemoryCategory category,
               VkBuffer &buffer,
-              VkDeviceMemory &bufferMemory);
+              MemoryAllocation &bufferMemory,
+              bool dedicated = false);
+          void freeMemory(const MemoryAllocation &memory) { allocator->free(memory); }
+          // Destroys the buffer and frees its memory once the GPU is done with it, never waits
+          void destroyBuffer(VkBuffer buffer, const MemoryAllocation &memory);
+          MemoryAllocator &getAllocator() { return *allocator; }
+          MemoryAllocator::Stats getMemoryStats() const { return allocator->getStats(); }
+          // Usage and budget of every heap and what each category takes up (see MemoryAllocator.h)
+          MemoryAllocator::BudgetStats getMemoryBudget() const { return allocator->getBudget(); }
+          void setMemoryBudgetCallback(MemoryAllocator::BudgetCallback callback, float threshold = 0.9f) {
+              allocator->setBudgetCallback(std::move(callback), threshold);
+          }
+          GeometryHeap &getGeometryHeap() { return *geometryHeap; }
+          MaterialTable &getMaterialTable() { return *materialTable; }
+          TransferQueue &getTransferQueue() { return *transferQueue; }
+          UploadContext &getUploadContext() { return *uploadContext; }
+          DeletionQueue &getDeletionQueue() { return *deletionQueue; }
           VkCommandBuffer beginSingleTimeCommands();
           void endSingleTimeCommands(VkCommandBuffer commandBuffer);
           void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -115,8 +158,9 @@ namespace engine {
           void createImageWithInfo(
               const VkImageCreateInfo &imageInfo,
               VkMemoryPropertyFlags properties,
+              MemoryCategory category,
               VkImage &image,
-              VkDeviceMemory &imageMemory);
+              MemoryAllocation &imageMemory);
 
           VkPhysicalDeviceProperties properties;
     };
@@ -0,0 +1,61 @@
+#include "FrameAllocator.h"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace engine {
+	FrameAllocator::FrameAllocator(Device& device, uint32_t frameCount, VkDeviceSize frameSize) {
+		uniformAlignment = std::max<VkDeviceSize>(1, device.properties.limits.minUniformBufferOffsetAlignment);
+		storageAlignment = std::max<VkDeviceSize>(1, device.properties.limits.minStorageBufferOffsetAlignment);
+
+		// Not host coherent on purpose, a frame's writes are flushed together at the end of it
+		frames.resize(frameCount);
+		for (std::unique_ptr<Buffer>& frame : frames) {
+			frame = std::make_unique<Buffer>(
+				device,
+				frameSize,
+				1,
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				MemoryCategory::Uniform);
+			frame->map();
+		}
+		stats.frameSize = frameSize;
+	}
+
+	void FrameAllocator::beginFrame(int frameIndex) {
+		assert(frameIndex >= 0 && frameIndex < static_cast<int>(frames.size()) && "Frame index out of range");
+		currentFrame = frameIndex;
+		offset = 0;
+		stats.used = 0;
+		stats.allocations = 0;
+	}
+
+	void FrameAllocator::flush() {
+		if (offset == 0) return;
+		frames[currentFrame]->flush(offset, 0);
+		stats.flushes++;
+	}
+
+	FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		VkDeviceSize start = (offset + alignment - 1) / alignment * alignment;
+		if (start + size > stats.frameSize) {
+			throw std::runtime_error("frame allocator is out of memory for this frame!");
+		}
+		offset = start + size;
+		stats.used = offset;
+		stats.peak = std::max(stats.peak, offset);
+		stats.allocations++;
+
+		Buffer& frame = *frames[currentFrame];
+		Allocation allocation{};
+		allocation.buffer = frame.getBuffer();
+		allocation.offset = start;
+		allocation.size = size;
+		allocation.mapped = static_cast<char*>(frame.getMappedMemory()) + start;
+		return allocation;
+	}
+}
@@ -0,0 +1,92 @@
+//**********************************************************************
+// Data that only lives for one frame, like uniforms, instance data and
+// vertices built on the CPU every frame, used to need a Buffer of its
+// own for every frame in flight. The frame allocator has one host
+// visible buffer per frame in flight and hands out ranges of it by
+// bumping an offset, so systems can take as many as they like without
+// any vkAllocateMemory. A frame's buffer is only reused once the GPU
+// is done with that frame: the renderer resets it in beginFrame, after
+// the swap chain has waited for the frame's in flight fence, and
+// flushes everything written to it with one call in endFrame.
+//
+// Ranges respect minUniformBufferOffsetAlignment and the storage buffer
+// alignment, so they can go straight into dynamic descriptors, and the
+// flush is rounded out to nonCoherentAtomSize (see Buffer::flush).
+//**********************************************************************
+
+#pragma once
+
+#include "Buffer.h"
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace engine {
+	class FrameAllocator {
+	public:
+		static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 4 * 1024 * 1024;
+		// Enough for any vertex attribute
+		static constexpr VkDeviceSize VERTEX_ALIGNMENT = 16;
+
+		// A range of the current frame's buffer, only valid until the frame is submitted
+		struct Allocation {
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			VkDeviceSize offset{ 0 };
+			VkDeviceSize size{ 0 };
+			void* mapped{ nullptr };
+
+			VkDescriptorBufferInfo descriptorInfo() const { return VkDescriptorBufferInfo{ buffer, offset, size }; }
+			// The offset for a dynamic uniform or storage buffer descriptor
+			uint32_t getDynamicOffset() const { return static_cast<uint32_t>(offset); }
+		};
+
+		struct Stats {
+			VkDeviceSize frameSize{ 0 };
+			VkDeviceSize used{ 0 };			// In the current frame, alignment padding included
+			VkDeviceSize peak{ 0 };			// The most any frame has used
+			uint32_t allocations{ 0 };		// In the current frame
+			uint64_t flushes{ 0 };
+		};
+
+		FrameAllocator(Device& device, uint32_t frameCount, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+
+		FrameAllocator(const FrameAllocator&) = delete;
+		FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+		// Starts handing out the frame's buffer from the beginning. The GPU must be done with
+		// the last frame that used it.
+		void beginFrame(int frameIndex);
+		// Makes everything written in the current frame visible to the GPU, once per frame
+		void flush();
+
+		// Throws when the frame's buffer is full
+		Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+		Allocation allocateUniform(VkDeviceSize size) { return allocate(size, uniformAlignment); }
+		Allocation allocateStorage(VkDeviceSize size) { return allocate(size, storageAlignment); }
+		Allocation allocateVertices(VkDeviceSize size) { return allocate(size, VERTEX_ALIGNMENT); }
+
+		// Copies data into a new uniform range
+		template <typename T>
+		Allocation writeUniform(const T& data) {
+			Allocation allocation = allocateUniform(sizeof(T));
+			std::memcpy(allocation.mapped, &data, sizeof(T));
+			return allocation;
+		}
+
+		// The buffer behind a frame's ranges, for descriptors that are written once and then
+		// only given a dynamic offset every frame
+		VkBuffer getBuffer(int frameIndex) const { return frames[frameIndex]->getBuffer(); }
+		const Stats& getStats() const { return stats; }
+
+	private:
+		std::vector<std::unique_ptr<Buffer>> frames{};
+		int currentFrame{ 0 };
+		VkDeviceSize offset{ 0 };
+		VkDeviceSize uniformAlignment{ 1 };
+		VkDeviceSize storageAlignment{ 1 };
+		Stats stats{};
+	};
+}
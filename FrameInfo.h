@@ -7,6 +7,7 @@
 
 #include "Camera.h"
 #include "GameObject.h"
+#include "ModelRegistry.h"
 
 #include <vulkan/vulkan.h>
 
@@ -45,6 +46,8 @@ namespace engine {
 		VkCommandBuffer commandBuffer;
 		Camera& camera;
 		VkDescriptorSet globalDescriptorSet;
+		uint32_t globalUboOffset;				// Dynamic offset of the GlobalUbo in the frame allocator
 		GameObject::Map& gameObjects;
+		const ModelRegistry& modelRegistry;		// Resolves the model handles of the game objects
 	};
 }
\ No newline at end of file
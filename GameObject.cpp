@@ -1,7 +1,7 @@
 #include "GameObject.h"
 
 namespace engine {
-	glm::mat4 TransformComponent::mat4() {
+	glm::mat4 TransformComponent::mat4() const {
 		const float c3 = glm::cos(rotation.z);
 		const float s3 = glm::sin(rotation.z);
 		const float c2 = glm::cos(rotation.x);
@@ -30,7 +30,7 @@ namespace engine {
 			{translation.x, translation.y, translation.z, 1.0f} 
 		};
 	}
-	glm::mat3 TransformComponent::normalMatrix() {
+	glm::mat3 TransformComponent::normalMatrix() const {
 		const float c3 = glm::cos(rotation.z);
 		const float s3 = glm::sin(rotation.z);
 		const float c2 = glm::cos(rotation.x);
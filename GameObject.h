@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Model.h"
+#include "ModelRegistry.h"
 
 #include <glm/gtc/matrix_transform.hpp> // This helps us construct 4x4 transformation matrices
 #include <memory>
@@ -17,8 +17,8 @@ namespace engine {
 		// 4x4 affined transformation matrix which is translate * Ry * Rx * Rz * scale transformation
 		// Rotation convention uses tait-bryan angles with axis order Y(1), X(2), Z(3) in that order
 		// More information: https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
-		glm::mat4 mat4();
-		glm::mat3 normalMatrix();
+		glm::mat4 mat4() const;
+		glm::mat3 normalMatrix() const;
 	};
 
 	struct PointLightComponent {
@@ -48,8 +48,8 @@ namespace engine {
 		glm::vec3 color{};
 		TransformComponent transform{};
 
-		// Optional pointer components
-		std::shared_ptr<Model> model{};
+		// Optional components. The model is a handle into the ModelRegistry, it may still be loading.
+		ModelRegistry::Handle model{};
 		std::unique_ptr<PointLightComponent> pointLight = nullptr;
 
 	private:
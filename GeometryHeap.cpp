@@ -0,0 +1,169 @@
+#include "GeometryHeap.h"
+#include "Model.h"
+
+// std
+#include <cassert>
+
+namespace engine {
+	namespace {
+		// Every region starts on this, which covers the alignment of any vertex attribute and index
+		constexpr VkDeviceSize REGION_ALIGNMENT = 256;
+
+		VkDeviceSize alignRegion(VkDeviceSize offset) {
+			return (offset + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+		}
+	}
+
+	GeometryHeap::Range::~Range() {
+		GeometryHeap* owner = &heap;
+		uint32_t pools[2] = { vertexPool, indexPool };
+		uint32_t handles[2] = { vertexHandle, indexHandle };
+		heap.deletionQueue.push([owner, pools, handles]() { owner->free(pools[0], handles[0], pools[1], handles[1]); });
+	}
+
+	GeometryHeap::GeometryHeap(Device& device, const Options& options) : deletionQueue{ device.getDeletionQueue() } {
+		// The regions are laid out back to back, positions and attributes of the standard pool
+		// first and then the compact ones, each pool sized for its capacity
+		const uint32_t vertexCapacities[2] = { options.standardVertexCapacity, options.compactVertexCapacity };
+		VkDeviceSize vertexBytes = 0;
+		for (Model::VertexFormat format : { Model::VertexFormat::Standard, Model::VertexFormat::Compact }) {
+			VertexPool& pool = vertexPools[static_cast<int>(format)];
+			uint32_t capacity = vertexCapacities[static_cast<int>(format)];
+			pool.positionSize = Model::getPositionSize(format);
+			pool.attributeSize = Model::getVertexSize(format) - pool.positionSize;
+			pool.ranges = std::make_unique<TlsfAllocator>(capacity);
+			pool.positionOffset = vertexBytes;
+			pool.attributeOffset = alignRegion(pool.positionOffset + static_cast<VkDeviceSize>(capacity) * pool.positionSize);
+			vertexBytes = alignRegion(pool.attributeOffset + static_cast<VkDeviceSize>(capacity) * pool.attributeSize);
+		}
+
+		const uint32_t indexCapacities[2] = { options.shortIndexCapacity, options.indexCapacity };
+		VkDeviceSize indexBytes = 0;
+		for (uint32_t i = 0; i < 2; i++) {
+			IndexPool& pool = indexPools[i];
+			pool.indexSize = i == 0 ? sizeof(uint16_t) : sizeof(uint32_t);
+			pool.ranges = std::make_unique<TlsfAllocator>(indexCapacities[i]);
+			pool.offset = indexBytes;
+			indexBytes = alignRegion(pool.offset + static_cast<VkDeviceSize>(indexCapacities[i]) * pool.indexSize);
+		}
+
+		vertexBuffer = std::make_unique<Buffer>(
+			device,
+			vertexBytes,
+			1,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Mesh);
+		indexBuffer = std::make_unique<Buffer>(
+			device,
+			indexBytes,
+			1,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Mesh);
+	}
+
+	GeometryHeap::~GeometryHeap() {}
+
+	std::unique_ptr<GeometryHeap::Range> GeometryHeap::allocate(uint32_t vertexPool, uint32_t vertexCount,
+		VkIndexType indexType, uint32_t indexCount) {
+		assert(vertexPool < 2 && vertexCount > 0 && "Vertex pool out of range or no vertices");
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		TlsfAllocator::Allocation vertices = vertexPools[vertexPool].ranges->allocate(vertexCount);
+		if (vertices.handle == TlsfAllocator::INVALID_HANDLE) return nullptr;
+
+		// Models without indices draw their vertices in order and only need the vertex range
+		TlsfAllocator::Allocation indices{};
+		if (indexCount > 0) {
+			indices = indexPools[getIndexPool(indexType)].ranges->allocate(indexCount);
+			if (indices.handle == TlsfAllocator::INVALID_HANDLE) {
+				vertexPools[vertexPool].ranges->free(vertices.handle);
+				return nullptr;
+			}
+		}
+
+		std::unique_ptr<Range> range{ new Range{ *this } };
+		range->vertexPool = vertexPool;
+		range->indexPool = getIndexPool(indexType);
+		range->vertexCount = vertexCount;
+		range->indexCount = indexCount;
+		range->firstVertex = static_cast<uint32_t>(vertices.offset);
+		range->firstIndex = static_cast<uint32_t>(indices.offset);
+		range->vertexHandle = vertices.handle;
+		range->indexHandle = indices.handle;
+		return range;
+	}
+
+	void GeometryHeap::addFallback() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		fallbacks++;
+	}
+
+	void GeometryHeap::free(uint32_t vertexPool, uint32_t vertexHandle, uint32_t indexPool, uint32_t indexHandle) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		vertexPools[vertexPool].ranges->free(vertexHandle);
+		if (indexHandle != TlsfAllocator::INVALID_HANDLE) {
+			indexPools[indexPool].ranges->free(indexHandle);
+		}
+	}
+
+	void GeometryHeap::recordVertexCopy(TransferQueue::Batch& batch, VkBuffer stagingBuffer,
+		VkDeviceSize sourceOffset, const Range& range) const {
+		const VertexPool& pool = vertexPools[range.vertexPool];
+		VkBufferCopy copyRegions[2]{};
+		copyRegions[0].srcOffset = sourceOffset;
+		copyRegions[0].dstOffset = pool.positionOffset + static_cast<VkDeviceSize>(range.firstVertex) * pool.positionSize;
+		copyRegions[0].size = static_cast<VkDeviceSize>(range.vertexCount) * pool.positionSize;
+		copyRegions[1].srcOffset = sourceOffset + copyRegions[0].size;
+		copyRegions[1].dstOffset = pool.attributeOffset + static_cast<VkDeviceSize>(range.firstVertex) * pool.attributeSize;
+		copyRegions[1].size = static_cast<VkDeviceSize>(range.vertexCount) * pool.attributeSize;
+		batch.copyBuffer(stagingBuffer, vertexBuffer->getBuffer(), 2, copyRegions);
+	}
+
+	void GeometryHeap::recordIndexCopy(TransferQueue::Batch& batch, VkBuffer stagingBuffer,
+		VkDeviceSize sourceOffset, const Range& range) const {
+		assert(range.indexCount > 0 && "The range has no indices");
+		const IndexPool& pool = indexPools[range.indexPool];
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = sourceOffset;
+		copyRegion.dstOffset = pool.offset + static_cast<VkDeviceSize>(range.firstIndex) * pool.indexSize;
+		copyRegion.size = static_cast<VkDeviceSize>(range.indexCount) * pool.indexSize;
+		batch.copyBuffer(stagingBuffer, indexBuffer->getBuffer(), 1, &copyRegion);
+	}
+
+	void GeometryHeap::bindVertices(VkCommandBuffer commandBuffer, uint32_t vertexPool, bool positionsOnly) const {
+		const VertexPool& pool = vertexPools[vertexPool];
+		VkBuffer buffers[] = { vertexBuffer->getBuffer(), vertexBuffer->getBuffer() };
+		VkDeviceSize offsets[] = { pool.positionOffset, pool.attributeOffset };
+		vkCmdBindVertexBuffers(commandBuffer, 0, positionsOnly ? 1 : 2, buffers, offsets);
+	}
+
+	void GeometryHeap::bindIndices(VkCommandBuffer commandBuffer, VkIndexType indexType) const {
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), indexPools[getIndexPool(indexType)].offset, indexType);
+	}
+
+	GeometryHeap::Stats GeometryHeap::getStats() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats{};
+		stats.fallbacks = fallbacks;
+		stats.capacityBytes = vertexBuffer->getBufferSize() + indexBuffer->getBufferSize();
+
+		auto poolStats = [](const TlsfAllocator& ranges) {
+			TlsfAllocator::Stats rangeStats = ranges.getStats();
+			PoolStats pool{};
+			pool.capacity = rangeStats.size;
+			pool.used = rangeStats.usedBytes;
+			pool.rangeCount = rangeStats.allocationCount;
+			pool.largestFreeRange = rangeStats.largestFreeRange;
+			return pool;
+		};
+		for (uint32_t i = 0; i < 2; i++) {
+			stats.vertexPools[i] = poolStats(*vertexPools[i].ranges);
+			stats.usedBytes += stats.vertexPools[i].used * (vertexPools[i].positionSize + vertexPools[i].attributeSize);
+			stats.indexPools[i] = poolStats(*indexPools[i].ranges);
+			stats.usedBytes += stats.indexPools[i].used * indexPools[i].indexSize;
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,138 @@
+//**********************************************************************
+// Every model used to own a vertex and an index buffer, so drawing a
+// scene meant binding both again for every object. The geometry heap
+// is one large vertex buffer and one large index buffer on the GPU
+// that the models take ranges out of instead. A model is then only a
+// first vertex and a first index, which go into the vertexOffset and
+// firstIndex of its draws, and the render system binds the heap once
+// and only again when the vertex format or index type changes.
+//
+// The vertex buffer has a pool for every Model::VertexFormat, and every
+// pool keeps its positions and its other attributes in two separate
+// regions (see Model::VertexLayout). Both regions are indexed by the
+// same vertex number, so one vertexOffset works for both bindings. The
+// index buffer has a region for 16 bit and one for 32 bit indices.
+// Ranges are handed out by a TlsfAllocator per pool, counted in vertices
+// and indices. Models that don't fit fall back to buffers of their own.
+//**********************************************************************
+
+#pragma once
+
+#include "Buffer.h"
+#include "TlsfAllocator.h"
+#include "TransferQueue.h"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace engine {
+	class GeometryHeap {
+	public:
+		// How many vertices of each format and indices of each type fit. Standard vertices
+		// take 44 bytes, compact ones 20, so the defaults are about 110 MB altogether.
+		struct Options {
+			uint32_t standardVertexCapacity{ 512 * 1024 };
+			uint32_t compactVertexCapacity{ 2 * 1024 * 1024 };
+			uint32_t shortIndexCapacity{ 8 * 1024 * 1024 };
+			uint32_t indexCapacity{ 8 * 1024 * 1024 };
+		};
+
+		// Occupancy of one pool of vertices or indices, counted in vertices or indices
+		struct PoolStats {
+			uint64_t capacity{ 0 };
+			uint64_t used{ 0 };				// Rounded up to TlsfAllocator::GRANULARITY per range
+			uint32_t rangeCount{ 0 };
+			uint64_t largestFreeRange{ 0 };
+		};
+
+		struct Stats {
+			PoolStats vertexPools[2]{};		// Indexed by Model::VertexFormat
+			PoolStats indexPools[2]{};		// 16 bit, then 32 bit
+			VkDeviceSize capacityBytes{ 0 };
+			VkDeviceSize usedBytes{ 0 };
+			uint32_t fallbacks{ 0 };		// Models that didn't fit and got buffers of their own
+		};
+
+		// A model's vertices and indices in the heap. They go back to the heap once it's destroyed
+		// and no frame in flight draws from them anymore (see DeletionQueue.h).
+		class Range {
+		public:
+			~Range();
+
+			Range(const Range&) = delete;
+			Range& operator=(const Range&) = delete;
+
+			uint32_t getFirstVertex() const { return firstVertex; }
+			uint32_t getFirstIndex() const { return firstIndex; }
+
+		private:
+			friend class GeometryHeap;
+			Range(GeometryHeap& tempHeap) : heap{ tempHeap } {}
+
+			GeometryHeap& heap;
+			uint32_t vertexPool{ 0 };
+			uint32_t indexPool{ 0 };
+			uint32_t vertexCount{ 0 };
+			uint32_t indexCount{ 0 };
+			uint32_t firstVertex{ 0 };
+			uint32_t firstIndex{ 0 };
+			uint32_t vertexHandle{ TlsfAllocator::INVALID_HANDLE };
+			uint32_t indexHandle{ TlsfAllocator::INVALID_HANDLE };
+		};
+
+		GeometryHeap(Device& device, const Options& options = Options{});
+		~GeometryHeap();
+
+		GeometryHeap(const GeometryHeap&) = delete;
+		GeometryHeap& operator=(const GeometryHeap&) = delete;
+
+		// vertexPool is the model's Model::VertexFormat. Returns nullptr when either pool is out
+		// of room, the caller then makes buffers of its own. Thread safe, models are created
+		// on the loader threads.
+		std::unique_ptr<Range> allocate(uint32_t vertexPool, uint32_t vertexCount, VkIndexType indexType, uint32_t indexCount);
+		// Counts a model that didn't fit, for the stats
+		void addFallback();
+
+		// The copies of a model's split vertex streams and indices into the heap. sourceOffset is
+		// where the positions start in the staging buffer, the attributes follow right after them.
+		void recordVertexCopy(TransferQueue::Batch& batch, VkBuffer stagingBuffer, VkDeviceSize sourceOffset, const Range& range) const;
+		void recordIndexCopy(TransferQueue::Batch& batch, VkBuffer stagingBuffer, VkDeviceSize sourceOffset, const Range& range) const;
+
+		// Binds the position and attribute regions of a pool to bindings 0 and 1. A depth only
+		// pass only needs the positions (see Pipeline::enableDepthOnly).
+		void bindVertices(VkCommandBuffer commandBuffer, uint32_t vertexPool, bool positionsOnly = false) const;
+		void bindIndices(VkCommandBuffer commandBuffer, VkIndexType indexType) const;
+
+		Stats getStats() const;
+
+	private:
+		struct VertexPool {
+			uint32_t positionSize{ 0 };
+			uint32_t attributeSize{ 0 };
+			VkDeviceSize positionOffset{ 0 };	// Where the regions start in the vertex buffer
+			VkDeviceSize attributeOffset{ 0 };
+			std::unique_ptr<TlsfAllocator> ranges;
+		};
+
+		struct IndexPool {
+			uint32_t indexSize{ 0 };
+			VkDeviceSize offset{ 0 };
+			std::unique_ptr<TlsfAllocator> ranges;
+		};
+
+		static uint32_t getIndexPool(VkIndexType indexType) { return indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1; }
+		void free(uint32_t vertexPool, uint32_t vertexHandle, uint32_t indexPool, uint32_t indexHandle);
+
+		DeletionQueue& deletionQueue;
+		std::unique_ptr<Buffer> vertexBuffer;
+		std::unique_ptr<Buffer> indexBuffer;
+		VertexPool vertexPools[2]{};
+		IndexPool indexPools[2]{};
+
+		mutable std::mutex mutex;
+		uint32_t fallbacks{ 0 };
+	};
+}
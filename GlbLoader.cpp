@@ -0,0 +1,756 @@
+#include "GlbLoader.h"
+#include "ThreadPool.h"
+
+// libs
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		constexpr uint32_t GLB_MAGIC = 0x46546C67;		// "glTF"
+		constexpr uint32_t GLB_VERSION = 2;
+		constexpr uint32_t CHUNK_JSON = 0x4E4F534A;		// "JSON"
+		constexpr uint32_t CHUNK_BIN = 0x004E4942;		// "BIN\0"
+		constexpr size_t MODE_TRIANGLES = 4;
+
+		// Accessor component types
+		constexpr int BYTE = 5120;
+		constexpr int UNSIGNED_BYTE = 5121;
+		constexpr int SHORT = 5122;
+		constexpr int UNSIGNED_SHORT = 5123;
+		constexpr int UNSIGNED_INT = 5125;
+		constexpr int FLOAT = 5126;
+
+		// Vertices handed to one thread pool job, and converted on the stack a batch at a time
+		constexpr uint32_t VERTEX_BLOCK_SIZE = 16384;
+		constexpr uint32_t VERTEX_BATCH_SIZE = 256;
+
+		// Just enough JSON for the glb header chunk. Objects keep their keys in
+		// order and look them up with a linear search, glTF objects are small.
+		struct JsonValue {
+			enum class Type { Null, Boolean, Number, String, Array, Object };
+
+			Type type{ Type::Null };
+			bool boolean{ false };
+			double number{ 0.0 };
+			std::string string{};
+			std::vector<JsonValue> elements{};		// Array elements or object values
+			std::vector<std::string> keys{};		// Object keys, one for every value
+
+			// Missing keys and elements come back as null
+			const JsonValue& get(const char *key) const {
+				for (size_t i = 0; i < keys.size(); i++) {
+					if (keys[i] == key) return elements[i];
+				}
+				return null();
+			}
+			const JsonValue& at(size_t index) const {
+				return type == Type::Array && index < elements.size() ? elements[index] : null();
+			}
+			size_t size() const { return type == Type::Array ? elements.size() : 0; }
+			bool isNull() const { return type == Type::Null; }
+
+			double asNumber(double fallback) const { return type == Type::Number ? number : fallback; }
+			// Array indices, counts and byte offsets. Anything that isn't a whole positive number gets the fallback.
+			size_t asSize(size_t fallback) const {
+				if (type != Type::Number || number < 0.0 || number != static_cast<double>(static_cast<uint64_t>(number))) {
+					return fallback;
+				}
+				return static_cast<size_t>(number);
+			}
+
+			static const JsonValue& null() {
+				static const JsonValue value{};
+				return value;
+			}
+		};
+
+		class JsonParser {
+		public:
+			JsonParser(const char *begin, const char *end) : cursor{ begin }, end{ end } {}
+
+			// Trailing bytes are ignored, the chunk is padded to 4 bytes
+			JsonValue parse() { return parseValue(0); }
+
+		private:
+			static constexpr int MAX_DEPTH = 64;
+
+			const char *cursor;
+			const char *end;
+
+			[[noreturn]] void fail(const char *reason) const {
+				throw std::runtime_error(std::string("invalid JSON, ") + reason);
+			}
+
+			void skipWhitespace() {
+				while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')) cursor++;
+			}
+
+			bool consume(char c) {
+				skipWhitespace();
+				if (cursor < end && *cursor == c) {
+					cursor++;
+					return true;
+				}
+				return false;
+			}
+
+			void expect(char c) {
+				if (!consume(c)) fail("unexpected character");
+			}
+
+			bool consumeWord(const char *word) {
+				size_t length = std::strlen(word);
+				if (static_cast<size_t>(end - cursor) < length || std::memcmp(cursor, word, length) != 0) return false;
+				cursor += length;
+				return true;
+			}
+
+			JsonValue parseValue(int depth) {
+				if (depth > MAX_DEPTH) fail("nested too deeply");
+				skipWhitespace();
+				if (cursor >= end) fail("unexpected end");
+
+				JsonValue value{};
+				char c = *cursor;
+				if (c == '{') {
+					cursor++;
+					value.type = JsonValue::Type::Object;
+					if (consume('}')) return value;
+					do {
+						skipWhitespace();
+						value.keys.push_back(parseString());
+						expect(':');
+						value.elements.push_back(parseValue(depth + 1));
+					} while (consume(','));
+					expect('}');
+				}
+				else if (c == '[') {
+					cursor++;
+					value.type = JsonValue::Type::Array;
+					if (consume(']')) return value;
+					do {
+						value.elements.push_back(parseValue(depth + 1));
+					} while (consume(','));
+					expect(']');
+				}
+				else if (c == '"') {
+					value.type = JsonValue::Type::String;
+					value.string = parseString();
+				}
+				else if (consumeWord("true")) {
+					value.type = JsonValue::Type::Boolean;
+					value.boolean = true;
+				}
+				else if (consumeWord("false")) {
+					value.type = JsonValue::Type::Boolean;
+				}
+				else if (consumeWord("null")) {
+					value.type = JsonValue::Type::Null;
+				}
+				else {
+					value.type = JsonValue::Type::Number;
+					value.number = parseNumber();
+				}
+				return value;
+			}
+
+			double parseNumber() {
+				char text[64];
+				size_t length = 0;
+				while (cursor < end && length + 1 < sizeof(text) &&
+					(std::isdigit(static_cast<unsigned char>(*cursor)) || *cursor == '-' || *cursor == '+' ||
+					*cursor == '.' || *cursor == 'e' || *cursor == 'E')) {
+					text[length++] = *cursor++;
+				}
+				text[length] = '\0';
+
+				char *parsedEnd = nullptr;
+				double number = std::strtod(text, &parsedEnd);
+				if (length == 0 || parsedEnd != text + length) fail("bad number");
+				return number;
+			}
+
+			std::string parseString() {
+				if (cursor >= end || *cursor != '"') fail("expected a string");
+				cursor++;
+
+				std::string result{};
+				while (cursor < end && *cursor != '"') {
+					char c = *cursor++;
+					if (c != '\\') {
+						result += c;
+						continue;
+					}
+					if (cursor >= end) break;
+					char escaped = *cursor++;
+					switch (escaped) {
+					case 'b': result += '\b'; break;
+					case 'f': result += '\f'; break;
+					case 'n': result += '\n'; break;
+					case 'r': result += '\r'; break;
+					case 't': result += '\t'; break;
+					case 'u': appendUtf8(result, parseCodePoint()); break;
+					default: result += escaped; break;		// \" \\ and \/
+					}
+				}
+				if (cursor >= end) fail("unterminated string");
+				cursor++;
+				return result;
+			}
+
+			uint32_t parseHex4() {
+				if (end - cursor < 4) fail("bad escape");
+				uint32_t value = 0;
+				for (int i = 0; i < 4; i++) {
+					char c = *cursor++;
+					value <<= 4;
+					if (c >= '0' && c <= '9') value |= c - '0';
+					else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+					else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+					else fail("bad escape");
+				}
+				return value;
+			}
+
+			// Characters outside of the basic plane are escaped as a surrogate pair
+			uint32_t parseCodePoint() {
+				uint32_t codePoint = parseHex4();
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - cursor >= 6 && cursor[0] == '\\' && cursor[1] == 'u') {
+					cursor += 2;
+					uint32_t low = parseHex4();
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				return codePoint;
+			}
+
+			static void appendUtf8(std::string &text, uint32_t codePoint) {
+				if (codePoint < 0x80) {
+					text += static_cast<char>(codePoint);
+				}
+				else if (codePoint < 0x800) {
+					text += static_cast<char>(0xC0 | (codePoint >> 6));
+					text += static_cast<char>(0x80 | (codePoint & 0x3F));
+				}
+				else if (codePoint < 0x10000) {
+					text += static_cast<char>(0xE0 | (codePoint >> 12));
+					text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+					text += static_cast<char>(0x80 | (codePoint & 0x3F));
+				}
+				else {
+					text += static_cast<char>(0xF0 | (codePoint >> 18));
+					text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+					text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+					text += static_cast<char>(0x80 | (codePoint & 0x3F));
+				}
+			}
+		};
+
+		size_t getComponentSize(int componentType) {
+			switch (componentType) {
+			case BYTE: case UNSIGNED_BYTE: return 1;
+			case SHORT: case UNSIGNED_SHORT: return 2;
+			case UNSIGNED_INT: case FLOAT: return 4;
+			default: return 0;
+			}
+		}
+
+		int getComponentCount(const std::string &type) {
+			if (type == "SCALAR") return 1;
+			if (type == "VEC2") return 2;
+			if (type == "VEC3") return 3;
+			if (type == "VEC4") return 4;
+			return 0;
+		}
+
+		glm::vec3 readVec3(const JsonValue &value, glm::vec3 fallback) {
+			if (value.size() < 3) return fallback;
+			return {
+				static_cast<float>(value.at(0).asNumber(fallback.x)),
+				static_cast<float>(value.at(1).asNumber(fallback.y)),
+				static_cast<float>(value.at(2).asNumber(fallback.z)) };
+		}
+
+		// Nodes either have a full matrix or a translation, rotation and scale
+		glm::mat4 getNodeTransform(const JsonValue &node) {
+			const JsonValue &matrix = node.get("matrix");
+			if (matrix.size() == 16) {
+				glm::mat4 transform{ 1.0f };
+				for (int i = 0; i < 16; i++) {
+					transform[i / 4][i % 4] = static_cast<float>(matrix.at(i).asNumber(i % 5 == 0 ? 1.0 : 0.0));	// Column major like glm
+				}
+				return transform;
+			}
+
+			glm::mat4 transform = glm::translate(glm::mat4{ 1.0f }, readVec3(node.get("translation"), glm::vec3{ 0.0f }));
+			const JsonValue &rotation = node.get("rotation");
+			if (rotation.size() == 4) {
+				glm::quat quaternion{
+					static_cast<float>(rotation.at(3).asNumber(1.0)),		// glTF stores x, y, z, w
+					static_cast<float>(rotation.at(0).asNumber(0.0)),
+					static_cast<float>(rotation.at(1).asNumber(0.0)),
+					static_cast<float>(rotation.at(2).asNumber(0.0)) };
+				transform = transform * glm::mat4_cast(quaternion);
+			}
+			return glm::scale(transform, readVec3(node.get("scale"), glm::vec3{ 1.0f }));
+		}
+
+		// glTF describes surfaces with a metalness and a roughness instead of a specular color
+		// and exponent. This is the usual rough conversion, smooth surfaces get a small and
+		// bright highlight and rough ones a wide and dim one.
+		Model::Material convertMaterial(const JsonValue &json) {
+			const JsonValue &pbr = json.get("pbrMetallicRoughness");
+			Model::Material material{};
+			const JsonValue &baseColor = pbr.get("baseColorFactor");
+			if (baseColor.size() == 4) {
+				for (int i = 0; i < 4; i++) material.diffuse[i] = static_cast<float>(baseColor.at(i).asNumber(1.0));
+			}
+			float roughness = glm::clamp(static_cast<float>(pbr.get("roughnessFactor").asNumber(1.0)), 0.0f, 1.0f);
+			float alpha = std::max(roughness * roughness, 0.01f);
+			float shininess = glm::clamp(2.0f / (alpha * alpha) - 2.0f, 1.0f, 512.0f);
+			material.specular = glm::vec4{ glm::vec3{ 1.0f - roughness }, shininess };
+			return material;
+		}
+	}
+
+	GlbLoader::GlbLoader(const std::string &filePath) : file{ VirtualFileSystem::shared().open(filePath) } {
+		// The chunks are read straight out of the file, so it has to be all there
+		file.waitForAll();
+		auto fail = [&](const std::string &reason) {
+			return std::runtime_error("Failed to load " + filePath + ": " + reason);
+		};
+
+		// A 12 byte header followed by chunks that each start with their length and type
+		uint32_t header[3]{};
+		if (file.size() < sizeof(header) + 8) throw fail("not a glb file");
+		std::memcpy(header, file.data(), sizeof(header));
+		if (header[0] != GLB_MAGIC) throw fail("not a glb file");
+		if (header[1] != GLB_VERSION) throw fail("glTF version " + std::to_string(header[1]) + " isn't supported");
+
+		size_t length = std::min<size_t>(header[2], file.size());
+		const char *jsonChunk = nullptr;
+		const char *binary = nullptr;
+		size_t jsonSize = 0;
+		size_t binarySize = 0;
+		for (size_t offset = sizeof(header); offset + 8 <= length;) {
+			uint32_t chunk[2]{};
+			std::memcpy(chunk, file.data() + offset, sizeof(chunk));
+			offset += sizeof(chunk);
+			if (chunk[0] > length - offset) throw fail("a chunk runs past the end of the file");
+
+			if (chunk[1] == CHUNK_JSON && jsonChunk == nullptr) {
+				jsonChunk = file.data() + offset;
+				jsonSize = chunk[0];
+			}
+			else if (chunk[1] == CHUNK_BIN && binary == nullptr) {
+				binary = file.data() + offset;
+				binarySize = chunk[0];
+			}
+			offset += (static_cast<size_t>(chunk[0]) + 3) & ~static_cast<size_t>(3);
+		}
+		if (jsonChunk == nullptr) throw fail("the file has no JSON chunk");
+
+		JsonValue document{};
+		try {
+			document = JsonParser{ jsonChunk, jsonChunk + jsonSize }.parse();
+		}
+		catch (const std::runtime_error &e) {
+			throw fail(e.what());
+		}
+
+		// Every accessor has to point into the binary chunk of this file, the arrays are read straight from the mapping
+		if (!document.get("buffers").at(0).get("uri").isNull()) throw fail("external buffers aren't supported");
+		auto readAccessor = [&](const JsonValue &index) -> Accessor {
+			Accessor accessor{};
+			if (index.isNull()) return accessor;
+
+			const JsonValue &json = document.get("accessors").at(index.asSize(SIZE_MAX));
+			if (json.isNull()) throw fail("an accessor doesn't exist");
+			if (!json.get("sparse").isNull()) throw fail("sparse accessors aren't supported");
+
+			accessor.componentType = static_cast<int>(json.get("componentType").asSize(0));
+			accessor.components = getComponentCount(json.get("type").string);
+			accessor.normalized = json.get("normalized").boolean;
+			size_t count = json.get("count").asSize(SIZE_MAX);
+			size_t elementSize = getComponentSize(accessor.componentType) * accessor.components;
+			if (elementSize == 0 || count > UINT32_MAX) throw fail("an accessor has an unsupported type");
+			accessor.count = static_cast<uint32_t>(count);
+
+			const JsonValue &view = document.get("bufferViews").at(json.get("bufferView").asSize(SIZE_MAX));
+			if (view.isNull()) throw fail("accessors without a buffer view aren't supported");
+			if (view.get("buffer").asSize(SIZE_MAX) != 0 || binary == nullptr) throw fail("a buffer view isn't in the binary chunk");
+
+			size_t viewOffset = view.get("byteOffset").asSize(0);
+			size_t viewLength = view.get("byteLength").asSize(SIZE_MAX);
+			size_t offset = json.get("byteOffset").asSize(0);
+			accessor.stride = view.get("byteStride").asSize(elementSize);
+			if (viewOffset > binarySize || viewLength > binarySize - viewOffset || accessor.stride < elementSize) {
+				throw fail("a buffer view runs past the end of the binary chunk");
+			}
+			if (count > 0 && (offset > viewLength || elementSize > viewLength - offset ||
+				(count - 1) > (viewLength - offset - elementSize) / accessor.stride)) {
+				throw fail("an accessor runs past the end of its buffer view");
+			}
+			accessor.data = binary + viewOffset + offset;
+
+			const JsonValue &min = json.get("min");
+			const JsonValue &max = json.get("max");
+			if (min.size() >= 3 && max.size() >= 3) {
+				accessor.hasBounds = true;
+				accessor.min = readVec3(min, glm::vec3{ 0.0f });
+				accessor.max = readVec3(max, glm::vec3{ 0.0f });
+			}
+			return accessor;
+		};
+
+		const JsonValue &materialList = document.get("materials");
+		for (size_t i = 0; i < materialList.size(); i++) {
+			materials.push_back(convertMaterial(materialList.at(i)));
+		}
+		uint32_t defaultMaterial = static_cast<uint32_t>(materials.size());
+
+		// Every mesh that hangs off the default scene along with the transform of its node.
+		// Files without a scene get every mesh once as it is.
+		std::vector<std::pair<size_t, glm::mat4>> meshInstances{};
+		const JsonValue &nodes = document.get("nodes");
+		const JsonValue &scene = document.get("scenes").at(document.get("scene").asSize(0));
+		if (scene.isNull()) {
+			for (size_t mesh = 0; mesh < document.get("meshes").size(); mesh++) meshInstances.push_back({ mesh, glm::mat4{ 1.0f } });
+		}
+		else {
+			std::vector<std::pair<size_t, glm::mat4>> stack{};
+			const JsonValue &roots = scene.get("nodes");
+			for (size_t i = 0; i < roots.size(); i++) stack.push_back({ roots.at(i).asSize(SIZE_MAX), glm::mat4{ 1.0f } });
+
+			// Nodes form a tree, so visiting more of them than there are means there's a cycle
+			size_t visited = 0;
+			while (!stack.empty()) {
+				auto [nodeIndex, parentTransform] = stack.back();
+				stack.pop_back();
+				const JsonValue &node = nodes.at(nodeIndex);
+				if (node.isNull()) throw fail("a node doesn't exist");
+				if (++visited > nodes.size()) throw fail("the node hierarchy has a cycle");
+
+				glm::mat4 transform = parentTransform * getNodeTransform(node);
+				size_t mesh = node.get("mesh").asSize(SIZE_MAX);
+				if (mesh != SIZE_MAX) meshInstances.push_back({ mesh, transform });
+				const JsonValue &children = node.get("children");
+				for (size_t i = 0; i < children.size(); i++) stack.push_back({ children.at(i).asSize(SIZE_MAX), transform });
+			}
+		}
+
+		for (const auto &[meshIndex, transform] : meshInstances) {
+			const JsonValue &mesh = document.get("meshes").at(meshIndex);
+			if (mesh.isNull()) throw fail("a mesh doesn't exist");
+
+			const JsonValue &primitiveList = mesh.get("primitives");
+			for (size_t i = 0; i < primitiveList.size(); i++) {
+				const JsonValue &json = primitiveList.at(i);
+				// Points and lines are left out, the engine only draws triangle lists
+				if (json.get("mode").asSize(MODE_TRIANGLES) != MODE_TRIANGLES) continue;
+
+				const JsonValue &attributes = json.get("attributes");
+				Primitive primitive{};
+				primitive.position = readAccessor(attributes.get("POSITION"));
+				primitive.normal = readAccessor(attributes.get("NORMAL"));
+				primitive.uv = readAccessor(attributes.get("TEXCOORD_0"));
+				primitive.color = readAccessor(attributes.get("COLOR_0"));
+				primitive.indices = readAccessor(json.get("indices"));
+				if (primitive.position.data == nullptr || primitive.position.components < 3 ||
+					(primitive.normal.data != nullptr && primitive.normal.components < 3) ||
+					(primitive.uv.data != nullptr && primitive.uv.components < 2) ||
+					(primitive.color.data != nullptr && primitive.color.components < 3)) {
+					throw fail("a primitive has attributes with too few components");
+				}
+				if (primitive.indices.data != nullptr && (primitive.indices.components != 1 ||
+					primitive.indices.componentType == BYTE || primitive.indices.componentType == SHORT ||
+					primitive.indices.componentType == FLOAT)) {
+					throw fail("a primitive has indices of an unsupported type");
+				}
+
+				primitive.indexCount = primitive.indices.data != nullptr ? primitive.indices.count : primitive.position.count;
+				primitive.indexCount -= primitive.indexCount % 3;
+				if (primitive.indexCount == 0) continue;
+
+				size_t material = json.get("material").asSize(SIZE_MAX);
+				primitive.material = material < defaultMaterial ? static_cast<uint32_t>(material) : defaultMaterial;
+				primitive.transform = transform;
+				primitive.normalTransform = glm::transpose(glm::inverse(glm::mat3{ transform }));
+				primitive.identity = transform == glm::mat4{ 1.0f };
+				primitives.push_back(primitive);
+			}
+		}
+		if (primitives.empty()) throw fail("the file has no triangles");
+
+		// The primitives are ordered by material so every material is one range of the index buffer
+		std::stable_sort(primitives.begin(), primitives.end(), [](const Primitive &a, const Primitive &b) {
+			return a.material < b.material;
+		});
+		uint64_t totalVertices = 0;
+		uint64_t totalIndices = 0;
+		for (auto current = primitives.begin(); current != primitives.end(); ++current) {
+			Primitive &primitive = *current;
+			auto shared = std::find_if(primitives.begin(), current, [&](const Primitive &other) {
+				return other.ownsVertices && other.position.data == primitive.position.data &&
+					other.position.count == primitive.position.count && other.normal.data == primitive.normal.data &&
+					other.uv.data == primitive.uv.data && other.color.data == primitive.color.data &&
+					other.transform == primitive.transform;
+			});
+			primitive.ownsVertices = shared == current;
+			primitive.firstVertex = primitive.ownsVertices ? static_cast<uint32_t>(totalVertices) : shared->firstVertex;
+			primitive.firstIndex = static_cast<uint32_t>(totalIndices);
+			if (primitive.ownsVertices) totalVertices += primitive.position.count;
+			totalIndices += primitive.indexCount;
+			if (totalVertices > UINT32_MAX || totalIndices > UINT32_MAX) throw fail("the model has too many vertices");
+
+			if (!subMeshes.empty() && subMeshes.back().material == primitive.material) {
+				subMeshes.back().indexCount += primitive.indexCount;
+			}
+			else {
+				subMeshes.push_back({ primitive.firstIndex, primitive.indexCount, primitive.material });
+			}
+			if (primitive.material == defaultMaterial && materials.size() == defaultMaterial) {
+				materials.push_back(Model::Material{});
+			}
+		}
+		vertexCount = static_cast<uint32_t>(totalVertices);
+		indexCount = static_cast<uint32_t>(totalIndices);
+		if (vertexCount < 3) throw fail("the file has no triangles");
+
+		// Positions have to come with their min and max, so most of the time the
+		// box is known without reading a single vertex
+		bool first = true;
+		for (const Primitive &primitive : primitives) {
+			if (!primitive.ownsVertices) continue;
+			glm::vec3 primitiveMin{ std::numeric_limits<float>::max() };
+			glm::vec3 primitiveMax{ std::numeric_limits<float>::lowest() };
+			if (primitive.identity && primitive.position.hasBounds) {
+				primitiveMin = primitive.position.min;
+				primitiveMax = primitive.position.max;
+			}
+			else {
+				for (uint32_t v = 0; v < primitive.position.count; v++) {
+					glm::vec3 position{ primitive.transform * glm::vec4{ glm::vec3{ readVector(primitive.position, v) }, 1.0f } };
+					primitiveMin = glm::min(primitiveMin, position);
+					primitiveMax = glm::max(primitiveMax, position);
+				}
+			}
+			bounds.min = first ? primitiveMin : glm::min(bounds.min, primitiveMin);
+			bounds.max = first ? primitiveMax : glm::max(bounds.max, primitiveMax);
+			first = false;
+		}
+	}
+
+	void GlbLoader::writeVertices(const Model::VertexStreams &streams) const {
+		struct Block {
+			const Primitive *primitive;
+			uint32_t first;
+			uint32_t count;
+		};
+		std::vector<Block> blocks{};
+		for (const Primitive &primitive : primitives) {
+			if (!primitive.ownsVertices) continue;
+			for (uint32_t first = 0; first < primitive.position.count; first += VERTEX_BLOCK_SIZE) {
+				blocks.push_back({ &primitive, first, std::min(VERTEX_BLOCK_SIZE, primitive.position.count - first) });
+			}
+		}
+
+		ThreadPool::shared().parallelFor(blocks.size(), [&](size_t i) {
+			const Block &block = blocks[i];
+			writeVertexBlock(*block.primitive, block.first, block.count, streams);
+		});
+	}
+
+	void GlbLoader::writeVertexBlock(const Primitive &primitive, uint32_t first, uint32_t count,
+		const Model::VertexStreams &streams) const {
+		size_t target = static_cast<size_t>(primitive.firstVertex) + first;
+		// Already laid out like the vertex buffer, so it's copied straight out of the mapped file
+		if (streams.format == Model::VertexFormat::Standard && isVertexLayout(primitive)) {
+			streams.write(target, primitive.position.data + first * primitive.position.stride, count);
+			return;
+		}
+
+		Model::Vertex batch[VERTEX_BATCH_SIZE];
+		for (uint32_t start = 0; start < count; start += VERTEX_BATCH_SIZE) {
+			uint32_t batchCount = std::min(VERTEX_BATCH_SIZE, count - start);
+			for (uint32_t i = 0; i < batchCount; i++) {
+				uint32_t index = first + start + i;
+				Model::Vertex &vertex = batch[i];
+				vertex.position = glm::vec3{ readVector(primitive.position, index) };
+				vertex.normal = primitive.normal.data != nullptr ? glm::vec3{ readVector(primitive.normal, index) } : glm::vec3{ 0.0f };
+				vertex.uv = primitive.uv.data != nullptr ? glm::vec2{ readVector(primitive.uv, index) } : glm::vec2{ 0.0f };
+				// Vertex colors default to white like they do for OBJ files
+				vertex.color = primitive.color.data != nullptr ? glm::vec3{ readVector(primitive.color, index) } : glm::vec3{ 1.0f };
+				if (!primitive.identity) {
+					vertex.position = glm::vec3{ primitive.transform * glm::vec4{ vertex.position, 1.0f } };
+					if (primitive.normal.data != nullptr) vertex.normal = glm::normalize(primitive.normalTransform * vertex.normal);
+				}
+			}
+			streams.encode(target + start, batch, batchCount, bounds);
+		}
+	}
+
+	void GlbLoader::writeIndices(void *destination, VkIndexType indexType) const {
+		size_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		int matchingType = indexType == VK_INDEX_TYPE_UINT16 ? UNSIGNED_SHORT : UNSIGNED_INT;
+		std::atomic<bool> outOfRange{ false };
+
+		ThreadPool::shared().parallelFor(primitives.size(), [&](size_t p) {
+			const Primitive &primitive = primitives[p];
+			const Accessor &indices = primitive.indices;
+			char *target = static_cast<char*>(destination) + static_cast<size_t>(primitive.firstIndex) * indexSize;
+
+			// Indices into vertices at the start of the buffer need nothing added, so when they are already the
+			// right size they're copied as they are. They're only checked afterwards, from the
+			// mapped file because staging memory can be very slow to read back.
+			bool copy = indices.data != nullptr && primitive.firstVertex == 0 &&
+				indices.componentType == matchingType && indices.stride == indexSize;
+			if (copy) std::memcpy(target, indices.data, primitive.indexCount * indexSize);
+
+			uint32_t largest = 0;
+			for (uint32_t i = 0; i < primitive.indexCount; i++) {
+				uint32_t index = indices.data != nullptr ? readIndex(indices, i) : i;
+				largest = std::max(largest, index);
+				if (copy) continue;
+
+				uint32_t value = primitive.firstVertex + index;
+				if (indexType == VK_INDEX_TYPE_UINT16) reinterpret_cast<uint16_t*>(target)[i] = static_cast<uint16_t>(value);
+				else reinterpret_cast<uint32_t*>(target)[i] = value;
+			}
+			if (largest >= primitive.position.count) outOfRange = true;
+		});
+		if (outOfRange) throw std::runtime_error("Failed to load a glb file: an index points past the vertices of its primitive");
+	}
+
+	uint32_t GlbLoader::getCopiedPrimitiveCount(Model::VertexFormat format) const {
+		if (format != Model::VertexFormat::Standard) return 0;
+		return static_cast<uint32_t>(std::count_if(primitives.begin(), primitives.end(), [](const Primitive &primitive) {
+			return primitive.ownsVertices && isVertexLayout(primitive);
+		}));
+	}
+
+	bool GlbLoader::isVertexLayout(const Primitive &primitive) {
+		const Accessor &position = primitive.position;
+		auto matches = [&](const Accessor &accessor, size_t offset, int components) {
+			return accessor.data == position.data + offset && accessor.stride == sizeof(Model::Vertex) &&
+				accessor.componentType == FLOAT && accessor.components == components;
+		};
+		return primitive.identity &&
+			matches(position, offsetof(Model::Vertex, position), 3) &&
+			matches(primitive.color, offsetof(Model::Vertex, color), 3) &&
+			matches(primitive.normal, offsetof(Model::Vertex, normal), 3) &&
+			matches(primitive.uv, offsetof(Model::Vertex, uv), 2);
+	}
+
+	glm::vec4 GlbLoader::readVector(const Accessor &accessor, uint32_t index) {
+		const char *element = accessor.data + static_cast<size_t>(index) * accessor.stride;
+		glm::vec4 result{ 0.0f, 0.0f, 0.0f, 1.0f };
+		for (int c = 0; c < accessor.components && c < 4; c++) {
+			switch (accessor.componentType) {
+			case FLOAT: {
+				float value;
+				std::memcpy(&value, element + c * sizeof(float), sizeof(value));
+				result[c] = value;
+				break;
+			}
+			case UNSIGNED_BYTE: {
+				uint8_t value = static_cast<uint8_t>(element[c]);
+				result[c] = accessor.normalized ? value / 255.0f : value;
+				break;
+			}
+			case BYTE: {
+				int8_t value = static_cast<int8_t>(element[c]);
+				result[c] = accessor.normalized ? std::max(value / 127.0f, -1.0f) : value;
+				break;
+			}
+			case UNSIGNED_SHORT: {
+				uint16_t value;
+				std::memcpy(&value, element + c * sizeof(uint16_t), sizeof(value));
+				result[c] = accessor.normalized ? value / 65535.0f : value;
+				break;
+			}
+			case SHORT: {
+				int16_t value;
+				std::memcpy(&value, element + c * sizeof(int16_t), sizeof(value));
+				result[c] = accessor.normalized ? std::max(value / 32767.0f, -1.0f) : value;
+				break;
+			}
+			case UNSIGNED_INT: {
+				uint32_t value;
+				std::memcpy(&value, element + c * sizeof(uint32_t), sizeof(value));
+				result[c] = static_cast<float>(value);
+				break;
+			}
+			}
+		}
+		return result;
+	}
+
+	uint32_t GlbLoader::readIndex(const Accessor &accessor, uint32_t index) {
+		const char *element = accessor.data + static_cast<size_t>(index) * accessor.stride;
+		switch (accessor.componentType) {
+		case UNSIGNED_BYTE:
+			return static_cast<uint8_t>(*element);
+		case UNSIGNED_SHORT: {
+			uint16_t value;
+			std::memcpy(&value, element, sizeof(value));
+			return value;
+		}
+		default: {
+			uint32_t value;
+			std::memcpy(&value, element, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	std::unique_ptr<Model> GlbLoader::createModel(
+		Device &device, const std::string &filePath, Model::VertexFormat format, bool deferUpload, bool buildBvh) {
+		GlbLoader glb{ filePath };
+		auto model = std::make_unique<Model>(
+			device, glb.getVertexCount(), glb.getIndexCount(), glb.getBoundingBox(),
+			{}, {}, glb.getSubMeshes(), glb.getMaterials(), format,
+			[&](const Model::VertexStreams &vertices, void *indices) {
+				glb.writeVertices(vertices);
+				glb.writeIndices(indices, Model::getIndexType(glb.getVertexCount()));
+			},
+			deferUpload);
+
+		// The staging buffers may hold compact vertices and 16 bit indices, so the
+		// hierarchy gets its own full precision copy written out of the file
+		if (buildBvh) {
+			std::vector<Model::Vertex> vertices(glb.getVertexCount());
+			std::vector<uint32_t> indices(glb.getIndexCount());
+			glb.writeVertices(vertices.data(), Model::VertexFormat::Standard);
+			glb.writeIndices(indices.data(), VK_INDEX_TYPE_UINT32);
+			model->setBvh(std::make_unique<MeshBvh>(&vertices[0].position, sizeof(Model::Vertex),
+				glb.getVertexCount(), indices.data(), glb.getIndexCount()));
+		}
+
+		std::ostringstream message{};
+		message << filePath << ": " << glb.getPrimitiveCount() << " primitive(s), "
+			<< glb.getCopiedPrimitiveCount(format) << " copied without converting, "
+			<< glb.getSubMeshes().size() << " sub mesh(es)";
+		std::cout << message.str() << std::endl;
+		return model;
+	}
+
+	bool GlbLoader::isGlbFile(const std::string &filePath) {
+		std::string extension = std::filesystem::path(filePath).extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return extension == ".glb";
+	}
+}
@@ -0,0 +1,120 @@
+//**********************************************************************
+// The glb loader reads binary glTF 2.0 files. Unlike an OBJ file, a glb
+// file already holds its vertices and indices as arrays in a binary
+// chunk, described by accessors and buffer views in a small JSON chunk.
+// The file is opened through the VirtualFileSystem (mapped, unless it
+// had to be inflated out of an archive) and only the JSON is parsed,
+// the arrays are copied from it straight into the staging buffers. Where the
+// attributes are already laid out like Model::Vertex the vertices are
+// copied as one block, otherwise they are put together a vertex at a
+// time on the way in. Indices are copied as they are (only the offset
+// of their primitive is added) so nothing is welded or re-indexed.
+// Every triangle primitive of every mesh in the default scene becomes
+// part of the model, moved by the transform of its node, and its
+// material becomes a sub mesh. Levels of detail, meshlets and the mesh
+// optimizer are skipped, the file is expected to come out of an
+// exporter that already did that work.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class GlbLoader {
+	public:
+		// Maps the file and reads its JSON chunk. Throws std::runtime_error when the
+		// file isn't a glb file, uses something we don't support (sparse accessors,
+		// external buffers) or an accessor points outside of the binary chunk.
+		explicit GlbLoader(const std::string &filePath);
+
+		GlbLoader(const GlbLoader&) = delete;
+		GlbLoader& operator=(const GlbLoader&) = delete;
+
+		// Writes getVertexCount() vertices in the streams' format to the streams. The
+		// primitives are split into blocks that are written on the shared thread pool.
+		void writeVertices(const Model::VertexStreams &streams) const;
+		// Writes them as whole vertices in the given format to destination
+		void writeVertices(void *destination, Model::VertexFormat format) const {
+			writeVertices(Model::VertexStreams::interleaved(destination, format));
+		}
+		// Writes getIndexCount() indices of the given type to destination. Throws when an
+		// index points past the vertices of its primitive.
+		void writeIndices(void *destination, VkIndexType indexType) const;
+
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+		const Model::BoundingBox& getBoundingBox() const { return bounds; }
+		// Sorted by material, one for every material the primitives use
+		const std::vector<Model::SubMesh>& getSubMeshes() const { return subMeshes; }
+		const std::vector<Model::Material>& getMaterials() const { return materials; }
+
+		// Primitives whose vertices writeVertices copies as one block in the given format,
+		// the vertices of the others are converted
+		uint32_t getCopiedPrimitiveCount(Model::VertexFormat format) const;
+		uint32_t getPrimitiveCount() const { return static_cast<uint32_t>(primitives.size()); }
+
+		// Loads the whole file into a new model, see Model::createModelFromFile
+		static std::unique_ptr<Model> createModel(
+			Device &device, const std::string &filePath, Model::VertexFormat format, bool deferUpload, bool buildBvh = false);
+
+		static bool isGlbFile(const std::string &filePath);
+
+	private:
+		// Where the values of one attribute or of the indices are in the binary chunk
+		struct Accessor {
+			const char *data{ nullptr };
+			size_t stride{ 0 };
+			uint32_t count{ 0 };
+			int componentType{ 0 };
+			int components{ 0 };
+			bool normalized{ false };
+			bool hasBounds{ false };		// min and max are optional for everything but positions
+			glm::vec3 min{ 0.0f };
+			glm::vec3 max{ 0.0f };
+		};
+
+		// One primitive placed by one node, a mesh used by two nodes shows up twice
+		struct Primitive {
+			Accessor position{};
+			Accessor normal{};		// data is nullptr when the attribute is missing
+			Accessor uv{};
+			Accessor color{};
+			Accessor indices{};		// Without indices every three vertices are a triangle
+			glm::mat4 transform{ 1.0f };	// Of the node, into model space
+			glm::mat3 normalTransform{ 1.0f };
+			bool identity{ true };
+			// Primitives of one mesh often share their vertices and only differ in their indices
+			// and material, only the first of them writes the vertices
+			bool ownsVertices{ true };
+			uint32_t material{ 0 };
+			uint32_t firstVertex{ 0 };
+			uint32_t firstIndex{ 0 };
+			uint32_t indexCount{ 0 };
+		};
+
+		void writeVertexBlock(const Primitive &primitive, uint32_t first, uint32_t count,
+			const Model::VertexStreams &streams) const;
+		// True when the attributes are interleaved exactly like Model::Vertex
+		static bool isVertexLayout(const Primitive &primitive);
+		// Components that are missing come out as 0, apart from w which is 1
+		static glm::vec4 readVector(const Accessor &accessor, uint32_t index);
+		static uint32_t readIndex(const Accessor &accessor, uint32_t index);
+
+		VirtualFileSystem::File file;
+		std::vector<Primitive> primitives{};
+		std::vector<Model::SubMesh> subMeshes{};
+		std::vector<Model::Material> materials{};
+		Model::BoundingBox bounds{};
+		uint32_t vertexCount{ 0 };
+		uint32_t indexCount{ 0 };
+	};
+}
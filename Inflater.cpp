@@ -0,0 +1,320 @@
+#include "Inflater.h"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace engine {
+	namespace {
+		constexpr int MAX_CODE_LENGTH = 15;
+		constexpr int FAST_BITS = 10;
+		constexpr uint32_t FAST_MASK = (1u << FAST_BITS) - 1;
+
+		// Base values and extra bits of the length symbols 257 to 285 and the distance symbols 0 to 29
+		constexpr uint16_t LENGTH_BASE[29]{
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		constexpr uint8_t LENGTH_EXTRA[29]{
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		constexpr uint16_t DISTANCE_BASE[30]{
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		constexpr uint8_t DISTANCE_EXTRA[30]{
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		// The order the code length code lengths are stored in a dynamic block
+		constexpr uint8_t CODE_LENGTH_ORDER[19]{ 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		[[noreturn]] void fail(const char *reason) {
+			throw std::runtime_error(std::string("Corrupt deflate stream: ") + reason);
+		}
+
+		// Deflate packs its bits starting from the lowest bit of every byte. Up to 64 of them
+		// are kept in a register, past the end of the input it reads zeros, which is caught
+		// by checking how far it got at the end of every block.
+		struct BitReader {
+			const uint8_t *data;
+			size_t size;
+			size_t position{ 0 };		// The next byte that isn't in bits yet
+			uint64_t bits{ 0 };
+			int count{ 0 };
+
+			void refill() {
+				if (position + 8 <= size) {
+					uint64_t word;
+					std::memcpy(&word, data + position, sizeof(word));	// Little endian, like every platform we build for
+					bits |= word << count;
+					position += (63 - count) >> 3;
+					count |= 56;
+					return;
+				}
+				while (count <= 56) {
+					uint64_t byte = position < size ? data[position] : 0;
+					position++;
+					bits |= byte << count;
+					count += 8;
+				}
+			}
+
+			uint32_t read(int n) {
+				if (count < n) refill();
+				uint32_t value = static_cast<uint32_t>(bits & ((uint64_t{ 1 } << n) - 1));
+				bits >>= n;
+				count -= n;
+				return value;
+			}
+
+			// Bytes of the input that have really been used up
+			size_t consumed() const { return position - count / 8; }
+		};
+
+		struct Huffman {
+			// symbol << 4 | length for every code up to FAST_BITS long, looked up by the next bits
+			// of the input. 0 means the code is longer and has to be found in counts and symbols.
+			uint16_t fast[1u << FAST_BITS];
+			uint16_t counts[MAX_CODE_LENGTH + 1];
+			uint16_t symbols[288];
+
+			// Builds the canonical code for the code lengths. Incomplete codes are allowed,
+			// a missing code only turns into an error if the stream actually uses it.
+			void build(const uint8_t *lengths, int symbolCount) {
+				std::fill(std::begin(counts), std::end(counts), static_cast<uint16_t>(0));
+				for (int i = 0; i < symbolCount; i++) counts[lengths[i]]++;
+				counts[0] = 0;
+
+				int left = 1;
+				for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+					left = (left << 1) - counts[length];
+					if (left < 0) fail("over-subscribed code");
+				}
+
+				uint16_t offsets[MAX_CODE_LENGTH + 2]{};
+				for (int length = 1; length <= MAX_CODE_LENGTH; length++) offsets[length + 1] = offsets[length] + counts[length];
+				for (int i = 0; i < symbolCount; i++) {
+					if (lengths[i] != 0) symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+				}
+
+				// Codes are stored starting with their highest bit, so they're reversed for the table
+				std::fill(std::begin(fast), std::end(fast), static_cast<uint16_t>(0));
+				uint32_t code = 0;
+				int index = 0;
+				for (int length = 1; length <= FAST_BITS; length++) {
+					for (int i = 0; i < counts[length]; i++, code++) {
+						uint32_t reversed = 0;
+						for (int bit = 0; bit < length; bit++) reversed |= ((code >> bit) & 1u) << (length - 1 - bit);
+						uint16_t entry = static_cast<uint16_t>(symbols[index++] << 4 | length);
+						for (uint32_t slot = reversed; slot <= FAST_MASK; slot += 1u << length) fast[slot] = entry;
+					}
+					code <<= 1;
+				}
+			}
+
+			int decode(BitReader &reader) const {
+				if (reader.count < MAX_CODE_LENGTH) reader.refill();
+				uint16_t entry = fast[reader.bits & FAST_MASK];
+				if (entry != 0) {
+					int length = entry & 15;
+					reader.bits >>= length;
+					reader.count -= length;
+					return entry >> 4;
+				}
+
+				// One bit at a time through the canonical code, the same way puff.c does it
+				int code = 0, first = 0, index = 0;
+				for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+					code |= static_cast<int>((reader.bits >> (length - 1)) & 1);
+					int count = counts[length];
+					if (code - count < first) {
+						reader.bits >>= length;
+						reader.count -= length;
+						return symbols[index + (code - first)];
+					}
+					index += count;
+					first = (first + count) << 1;
+					code <<= 1;
+				}
+				fail("unknown code");
+			}
+		};
+
+		const Huffman& getFixedLiterals() {
+			static const Huffman table = []() {
+				uint8_t lengths[288];
+				std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+				std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+				std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+				std::fill(lengths + 280, lengths + 288, static_cast<uint8_t>(8));
+				Huffman huffman{};
+				huffman.build(lengths, 288);
+				return huffman;
+			}();
+			return table;
+		}
+
+		const Huffman& getFixedDistances() {
+			static const Huffman table = []() {
+				uint8_t lengths[30];
+				std::fill(lengths, lengths + 30, static_cast<uint8_t>(5));
+				Huffman huffman{};
+				huffman.build(lengths, 30);
+				return huffman;
+			}();
+			return table;
+		}
+
+		void readDynamicTables(BitReader &reader, Huffman &literals, Huffman &distances) {
+			int literalCount = static_cast<int>(reader.read(5)) + 257;
+			int distanceCount = static_cast<int>(reader.read(5)) + 1;
+			int codeLengthCount = static_cast<int>(reader.read(4)) + 4;
+			if (literalCount > 286 || distanceCount > 30) fail("too many codes");
+
+			uint8_t codeLengthLengths[19]{};
+			for (int i = 0; i < codeLengthCount; i++) codeLengthLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(reader.read(3));
+			Huffman codeLengths{};
+			codeLengths.build(codeLengthLengths, 19);
+
+			// Literal and distance lengths are one run, repeats may cross from one into the other
+			uint8_t lengths[286 + 30]{};
+			int total = literalCount + distanceCount;
+			for (int i = 0; i < total;) {
+				int symbol = codeLengths.decode(reader);
+				if (symbol < 16) {
+					lengths[i++] = static_cast<uint8_t>(symbol);
+					continue;
+				}
+				uint8_t value = 0;
+				int repeat;
+				if (symbol == 16) {
+					if (i == 0) fail("repeat without a length");
+					value = lengths[i - 1];
+					repeat = 3 + static_cast<int>(reader.read(2));
+				}
+				else if (symbol == 17) {
+					repeat = 3 + static_cast<int>(reader.read(3));
+				}
+				else {
+					repeat = 11 + static_cast<int>(reader.read(7));
+				}
+				if (i + repeat > total) fail("too many lengths");
+				std::fill(lengths + i, lengths + i + repeat, value);
+				i += repeat;
+			}
+			if (lengths[256] == 0) fail("no end of block code");
+
+			literals.build(lengths, literalCount);
+			distances.build(lengths + literalCount, distanceCount);
+		}
+
+		std::array<uint32_t, 256> makeCrcTable() {
+			std::array<uint32_t, 256> table{};
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+				table[i] = crc;
+			}
+			return table;
+		}
+	}
+
+	void Inflater::inflate(const void *input, size_t inputSize, void *output, size_t outputSize,
+		const Progress &progress) {
+		BitReader reader{ static_cast<const uint8_t*>(input), inputSize };
+		uint8_t *out = static_cast<uint8_t*>(output);
+		size_t written = 0;
+		size_t reported = 0;
+
+		Huffman dynamicLiterals{};
+		Huffman dynamicDistances{};
+		bool last = false;
+		while (!last) {
+			last = reader.read(1) != 0;
+			uint32_t type = reader.read(2);
+
+			if (type == 0) {
+				// A stored block starts at the next byte with its length and the length's complement
+				reader.read(reader.count & 7);
+				uint32_t length = reader.read(16);
+				uint32_t complement = reader.read(16);
+				if ((length ^ 0xFFFF) != complement) fail("stored block length doesn't match");
+
+				size_t start = reader.consumed();
+				if (length > inputSize - std::min(start, inputSize) || start > inputSize) fail("stored block is truncated");
+				if (length > outputSize - written) fail("more data than expected");
+				std::memcpy(out + written, reader.data + start, length);
+				written += length;
+				reader.position = start + length;
+				reader.bits = 0;
+				reader.count = 0;
+			}
+			else if (type == 1 || type == 2) {
+				const Huffman *literals = &getFixedLiterals();
+				const Huffman *distances = &getFixedDistances();
+				if (type == 2) {
+					readDynamicTables(reader, dynamicLiterals, dynamicDistances);
+					literals = &dynamicLiterals;
+					distances = &dynamicDistances;
+				}
+
+				while (true) {
+					int symbol = literals->decode(reader);
+					if (symbol < 256) {
+						if (written == outputSize) fail("more data than expected");
+						out[written++] = static_cast<uint8_t>(symbol);
+						continue;
+					}
+					if (symbol == 256) break;
+
+					symbol -= 257;
+					if (symbol >= 29) fail("bad length code");
+					size_t length = LENGTH_BASE[symbol] + reader.read(LENGTH_EXTRA[symbol]);
+					int distanceSymbol = distances->decode(reader);
+					if (distanceSymbol >= 30) fail("bad distance code");
+					size_t distance = DISTANCE_BASE[distanceSymbol] + reader.read(DISTANCE_EXTRA[distanceSymbol]);
+					if (distance > written) fail("distance before the start of the data");
+					if (length > outputSize - written) fail("more data than expected");
+
+					// Overlapping copies repeat the bytes they just wrote, so they go one byte at a time
+					uint8_t *target = out + written;
+					const uint8_t *source = target - distance;
+					if (distance >= length) {
+						std::memcpy(target, source, length);
+					}
+					else {
+						for (size_t i = 0; i < length; i++) target[i] = source[i];
+					}
+					written += length;
+
+					if (progress && written - reported >= PROGRESS_INTERVAL) {
+						reported = written;
+						progress(reported);
+					}
+				}
+			}
+			else {
+				fail("invalid block type");
+			}
+
+			if (reader.consumed() > inputSize) fail("the stream is truncated");
+			if (progress && written - reported >= PROGRESS_INTERVAL) {
+				reported = written;
+				progress(reported);
+			}
+		}
+
+		if (written != outputSize) fail("less data than expected");
+		if (progress) progress(written);
+	}
+
+	uint32_t Inflater::updateCrc32(uint32_t crc, const void *data, size_t size) {
+		static const std::array<uint32_t, 256> table = makeCrcTable();
+		const uint8_t *bytes = static_cast<const uint8_t*>(data);
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+}
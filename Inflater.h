@@ -0,0 +1,39 @@
+//**********************************************************************
+// A small inflater for the deflate streams inside zip files (RFC 1951).
+// The project doesn't depend on zlib, and the zip entries we read
+// always know their uncompressed size up front, so this only has to
+// cover the simple case of inflating one whole stream into a buffer
+// that is already the right size. Back references simply point into
+// that buffer, there's no separate sliding window to manage. Huffman
+// codes up to 10 bits long are decoded with a single table lookup,
+// only the rare longer ones are walked a bit at a time.
+//**********************************************************************
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace engine {
+	class Inflater {
+	public:
+		// Called every so often with the number of bytes at the start of the output that are
+		// finished. It's also called once more at the very end with the full output size.
+		using Progress = std::function<void(size_t finished)>;
+
+		// Inflates a raw deflate stream into output, which has to be exactly as large as the
+		// inflated data. Throws std::runtime_error when the stream is corrupt, truncated or
+		// doesn't inflate to exactly outputSize bytes.
+		static void inflate(const void *input, size_t inputSize, void *output, size_t outputSize,
+			const Progress &progress = nullptr);
+
+		// The CRC-32 zip files store for every entry. Pass the previous result back in as crc
+		// to checksum data that arrives in pieces, start with 0.
+		static uint32_t updateCrc32(uint32_t crc, const void *data, size_t size);
+
+		// How often progress is reported while inflating
+		static constexpr size_t PROGRESS_INTERVAL = 256 * 1024;
+	};
+}
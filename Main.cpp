@@ -1,15 +1,52 @@
 #include "Application.h"
+#include "AssetPacker.h"
+#include "Benchmarks.h"
+#include "VirtualFileSystem.h"
 
 //std includes
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 int main(int argc, char** argv) {
+	// The test models ship as a zip file, mounting it lets them load without extracting it.
+	// Anything that has been extracted next to it still wins over the archive.
+	if (std::filesystem::exists("TestModels/Models.zip")) {
+		try {
+			engine::VirtualFileSystem::shared().mount("TestModels/Models.zip", "TestModels");
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
 
-	engine::Application app{};
+	// Runs the benchmarks instead of the engine, see Benchmarks.h
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		return engine::runBenchmarks(std::vector<std::string>(argv + 2, argv + argc));
+	}
+	if (argc > 1 && std::string(argv[1]) == "--memory-benchmark") {
+		return engine::runMemoryBenchmark();
+	}
+	if (argc > 1 && std::string(argv[1]) == "--stream-test") {
+		return engine::runStreamingTest(std::vector<std::string>(argv + 2, argv + argc));
+	}
+	// Cooks and packs the startup assets, see AssetPacker.h
+	if (argc > 1 && std::string(argv[1]) == "--pack") {
+		return engine::runPacker(std::vector<std::string>(argv + 2, argv + argc));
+	}
 
 	try {
+		// Once the assets have been packed the engine reads them from the archive. The
+		// packer and the benchmarks above work on the loose files and leave it alone.
+		if (std::filesystem::exists("Assets.pak")) {
+			engine::VirtualFileSystem::shared().mount("Assets.pak", "");
+		}
+
+		engine::Application app{};
 		app.run();
 	}
 	catch (const std::exception& e) {
@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace engine {
+	MappedFile::MappedFile(const std::string& filePath) {
+	#ifdef _WIN32
+		HANDLE file = CreateFileA(
+			filePath.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,	// We mostly read front to back
+			nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Failed to open file: " + filePath);
+		}
+		fileHandle = file;
+
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		size_ = static_cast<size_t>(fileSize.QuadPart);
+
+		// Windows refuses to create a mapping of an empty file, so
+		// we simply leave data_ as a nullptr with a size of zero
+		if (size_ == 0) return;
+
+		mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappingHandle == nullptr) {
+			close();
+			throw std::runtime_error("Failed to map file: " + filePath);
+		}
+		data_ = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (data_ == nullptr) {
+			close();
+			throw std::runtime_error("Failed to map file: " + filePath);
+		}
+	#else
+		fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) {
+			throw std::runtime_error("Failed to open file: " + filePath);
+		}
+
+		struct stat fileInfo {};
+		if (fstat(fileDescriptor, &fileInfo) != 0) {
+			close();
+			throw std::runtime_error("Failed to read file size: " + filePath);
+		}
+		size_ = static_cast<size_t>(fileInfo.st_size);
+		if (size_ == 0) return;
+
+		void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping == MAP_FAILED) {
+			close();
+			throw std::runtime_error("Failed to map file: " + filePath);
+		}
+		// Let the kernel know that it can read ahead aggressively
+		madvise(mapping, size_, MADV_SEQUENTIAL);
+		data_ = static_cast<const char*>(mapping);
+	#endif
+	}
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept {
+		*this = std::move(other);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+		if (this != &other) {
+			close();
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+		#ifdef _WIN32
+			fileHandle = std::exchange(other.fileHandle, nullptr);
+			mappingHandle = std::exchange(other.mappingHandle, nullptr);
+		#else
+			fileDescriptor = std::exchange(other.fileDescriptor, -1);
+		#endif
+		}
+		return *this;
+	}
+
+	size_t MappedFile::prefetch(std::vector<Range> ranges) const {
+		if (data_ == nullptr) return 0;
+
+		// Sorted and merged so neighbouring assets turn into one long read
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.offset < b.offset; });
+		std::vector<Range> merged{};
+		for (const Range& range : ranges) {
+			if (range.offset >= size_ || range.size == 0) continue;
+			size_t end = std::min(range.offset + range.size, size_);
+			if (!merged.empty() && range.offset <= merged.back().offset + merged.back().size + PREFETCH_MERGE_GAP) {
+				merged.back().size = std::max(merged.back().size, end - merged.back().offset);
+			}
+			else {
+				merged.push_back({ range.offset, end - range.offset });
+			}
+		}
+		if (merged.empty()) return 0;
+
+	#ifdef _WIN32
+		// Windows takes every range in a single call
+		std::vector<WIN32_MEMORY_RANGE_ENTRY> entries{};
+		entries.reserve(merged.size());
+		for (const Range& range : merged) {
+			entries.push_back({ const_cast<char*>(data_) + range.offset, range.size });
+		}
+		PrefetchVirtualMemory(GetCurrentProcess(), entries.size(), entries.data(), 0);
+		return 1;
+	#else
+		// madvise wants page aligned addresses, the mapping itself always starts on a page
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		for (const Range& range : merged) {
+			size_t start = range.offset / pageSize * pageSize;
+			madvise(const_cast<char*>(data_) + start, range.offset + range.size - start, MADV_WILLNEED);
+		}
+		return merged.size();
+	#endif
+	}
+
+	void MappedFile::close() {
+	#ifdef _WIN32
+		if (data_) UnmapViewOfFile(data_);
+		if (mappingHandle) CloseHandle(mappingHandle);
+		if (fileHandle) CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+	#else
+		if (data_) munmap(const_cast<char*>(data_), size_);
+		if (fileDescriptor >= 0) ::close(fileDescriptor);
+		fileDescriptor = -1;
+	#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+}
@@ -0,0 +1,60 @@
+//**********************************************************************
+// This class maps a file on disk straight into our address space so
+// that we can read it like a regular block of memory. The operating
+// system pages the data in on demand, which means we never have to
+// copy the whole file into a std::vector or std::string before we
+// start working on it. The mapping is read only and is released when
+// the object goes out of scope.
+//**********************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class MappedFile {
+	private:
+		const char* data_ = nullptr;
+		size_t size_ = 0;
+
+	#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+	#else
+		int fileDescriptor = -1;
+	#endif
+
+		void close();
+
+	public:
+		struct Range {
+			size_t offset{ 0 };
+			size_t size{ 0 };
+		};
+
+		// Ranges closer together than this are prefetched as one
+		static constexpr size_t PREFETCH_MERGE_GAP = 64 * 1024;
+
+		MappedFile() = default;
+		explicit MappedFile(const std::string& filePath);
+		~MappedFile();
+
+		// A mapping owns operating system handles so we only allow it to be moved
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+		// Tells the operating system that the ranges will be read soon so it can start
+		// reading them in the background, in as few calls as it can. Nothing is read
+		// on the calling thread. Returns the number of system calls that took.
+		size_t prefetch(std::vector<Range> ranges) const;
+	};
+}
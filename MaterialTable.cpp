@@ -0,0 +1,109 @@
+#include "MaterialTable.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace engine {
+	MaterialTable::MaterialTable(Device &tempDevice) : device{ tempDevice } {
+		buffer = std::make_unique<Buffer>(
+			device,
+			sizeof(Model::Material),
+			MAX_MATERIALS,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			// Materials are written rarely and read every frame, coherent memory saves us the flushes
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Material);
+		buffer->map();
+
+		setLayout = DescriptorSetLayout::Builder(device)
+			.addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.build();
+		pool = DescriptorPool::Builder(device)
+			.setMaxSets(1)
+			.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+			.build();
+
+		auto bufferInfo = buffer->descriptorInfo();
+		if (!DescriptorWriter(*setLayout, *pool).writeBuffer(0, &bufferInfo).build(descriptorSet)) {
+			throw std::runtime_error("Failed to allocate the material table descriptor set");
+		}
+
+		add({ Model::Material{} });
+	}
+
+	uint32_t MaterialTable::add(const std::vector<Model::Material> &materials) {
+		if (materials.empty()) return 0;
+		uint32_t count = static_cast<uint32_t>(materials.size());
+
+		uint32_t first = MAX_MATERIALS;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			// The first freed range that fits, then the untouched end of the table
+			auto range = std::find_if(freeRanges.begin(), freeRanges.end(),
+				[count](const FreeRange &freeRange) { return freeRange.count >= count; });
+			if (range != freeRanges.end()) {
+				first = range->first;
+				range->first += count;
+				range->count -= count;
+				if (range->count == 0) freeRanges.erase(range);
+			}
+			else if (count <= MAX_MATERIALS - end) {
+				first = end;
+				end += count;
+			}
+			else {
+				throw std::runtime_error("The material table is full!");
+			}
+			materialCount += count;
+		}
+
+		std::memcpy(
+			static_cast<char*>(buffer->getMappedMemory()) + first * sizeof(Model::Material),
+			materials.data(),
+			materials.size() * sizeof(Model::Material));
+		return first;
+	}
+
+	void MaterialTable::release(uint32_t first, uint32_t count) {
+		if (count == 0) return;
+		device.getDeletionQueue().push([this, first, count]() { free(first, count); });
+	}
+
+	uint32_t MaterialTable::getMaterialCount() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		return materialCount;
+	}
+
+	void MaterialTable::free(uint32_t first, uint32_t count) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		materialCount -= count;
+
+		// Keep the list sorted and merge the range with the ones right before and after it
+		auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), first,
+			[](const FreeRange &freeRange, uint32_t slot) { return freeRange.first < slot; });
+		if (next != freeRanges.begin() && std::prev(next)->first + std::prev(next)->count == first) {
+			auto previous = std::prev(next);
+			previous->count += count;
+			if (next != freeRanges.end() && previous->first + previous->count == next->first) {
+				previous->count += next->count;
+				freeRanges.erase(next);
+			}
+		}
+		else if (next != freeRanges.end() && first + count == next->first) {
+			next->first = first;
+			next->count += count;
+		}
+		else {
+			freeRanges.insert(next, FreeRange{ first, count });
+		}
+
+		// A range that reaches the end just moves the end back
+		if (!freeRanges.empty() && freeRanges.back().first + freeRanges.back().count == end) {
+			end = freeRanges.back().first;
+			freeRanges.pop_back();
+		}
+	}
+}
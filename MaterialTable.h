@@ -0,0 +1,71 @@
+//**********************************************************************
+// The material table holds the materials of every model in a single
+// storage buffer on the GPU. A model's materials are copied in the
+// first time it's drawn and it remembers where they start, each sub
+// mesh then only needs that offset plus its own material number. The
+// table has its own descriptor set (set 1 in SimpleShader.frag), so
+// it's bound once a frame and switching materials between draws is a
+// single push constant instead of another pipeline or descriptor set.
+//
+// The device owns the table so it outlives every model. A destroyed
+// model's slots go on a free list once no frame in flight reads them
+// anymore (see DeletionQueue.h) and later models reuse them.
+//**********************************************************************
+
+#pragma once
+
+#include "Buffer.h"
+#include "Descriptors.h"
+#include "Device.h"
+#include "Model.h"
+
+// std
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace engine {
+	class MaterialTable {
+	public:
+		// 32 bytes each, so the whole table is 128 KB
+		static constexpr uint32_t MAX_MATERIALS = 4096;
+
+		explicit MaterialTable(Device &device);
+
+		MaterialTable(const MaterialTable&) = delete;
+		MaterialTable& operator=(const MaterialTable&) = delete;
+
+		// Copies the materials into the table and returns the slot of the first one. Throws
+		// when there is no free range big enough. The buffer is host coherent and only
+		// slots nobody uses are written, so this is safe while earlier frames are still
+		// reading the table.
+		uint32_t add(const std::vector<Model::Material> &materials);
+		// Gives the slots back once the frames that could still read them are done. Thread
+		// safe, models are destroyed on the loader threads too.
+		void release(uint32_t first, uint32_t count);
+
+		// Slots in use, slot 0 always holds the default material
+		uint32_t getMaterialCount() const;
+		VkDescriptorSetLayout getDescriptorSetLayout() const { return setLayout->getDescriptorSetLayout(); }
+		VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+
+	private:
+		Device &device;
+		std::unique_ptr<Buffer> buffer;
+		std::unique_ptr<DescriptorSetLayout> setLayout;
+		std::unique_ptr<DescriptorPool> pool;
+		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+
+		struct FreeRange {
+			uint32_t first{ 0 };
+			uint32_t count{ 0 };
+		};
+
+		void free(uint32_t first, uint32_t count);
+
+		mutable std::mutex mutex;
+		std::vector<FreeRange> freeRanges{};	// Sorted by first, neighbours are merged
+		uint32_t end{ 0 };						// Everything from here on has never been used
+		uint32_t materialCount{ 0 };
+	};
+}
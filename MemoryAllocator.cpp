@@ -0,0 +1,327 @@
+#include "MemoryAllocator.h"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+			return (value + alignment - 1) / alignment * alignment;
+		}
+	}
+
+	const char* getMemoryCategoryName(MemoryCategory category) {
+		switch (category) {
+		case MemoryCategory::Mesh: return "mesh";
+		case MemoryCategory::Staging: return "staging";
+		case MemoryCategory::Uniform: return "uniform";
+		case MemoryCategory::Material: return "material";
+		case MemoryCategory::Depth: return "depth";
+		default: return "other";
+		}
+	}
+
+	MemoryAllocator::MemoryAllocator(VkDevice tempDevice, VkPhysicalDevice tempPhysicalDevice, bool tempMemoryBudget)
+		: device{ tempDevice }, physicalDevice{ tempPhysicalDevice }, memoryBudget{ tempMemoryBudget } {
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		heapAllocated.resize(memoryProperties.memoryHeapCount, 0);
+		heapWarned.resize(memoryProperties.memoryHeapCount, false);
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+		// Small heaps, like the 256 MB of device local host visible memory some cards have,
+		// would be used up by a few blocks, so their blocks get smaller
+		pools.resize(memoryProperties.memoryTypeCount * 2);
+		for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+			VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[type].heapIndex].size;
+			VkDeviceSize blockSize = std::min(BLOCK_SIZE, alignUp(heapSize / 8, TlsfAllocator::GRANULARITY));
+			pools[type * 2].blockSize = blockSize;
+			pools[type * 2 + 1].blockSize = blockSize;
+		}
+	}
+
+	MemoryAllocator::~MemoryAllocator() {
+		for (uint32_t i = 0; i < pools.size(); i++) {
+			for (Block& block : pools[i].blocks) {
+				if (block.memory != VK_NULL_HANDLE) freeDeviceMemory(block.memory, block.mapped, pools[i].blockSize, i / 2);
+			}
+		}
+	}
+
+	bool MemoryAllocator::isHostVisible(uint32_t memoryType) const {
+		return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	}
+
+	VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+		uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+		checkBudget(heap, size);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		deviceAllocations++;
+		heapAllocated[heap] += size;
+
+		*mapped = nullptr;
+		if (isHostVisible(memoryType) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+			vkFreeMemory(device, memory, nullptr);
+			heapAllocated[heap] -= size;
+			throw std::runtime_error("failed to map device memory!");
+		}
+		return memory;
+	}
+
+	void MemoryAllocator::freeDeviceMemory(VkDeviceMemory memory, void* mapped, VkDeviceSize size, uint32_t memoryType) {
+		if (mapped != nullptr) vkUnmapMemory(device, memory);
+		vkFreeMemory(device, memory, nullptr);
+		heapAllocated[memoryProperties.memoryTypes[memoryType].heapIndex] -= size;
+	}
+
+	void MemoryAllocator::queryBudget(std::vector<HeapBudget>& heaps) const {
+		heaps.resize(memoryProperties.memoryHeapCount);
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		if (memoryBudget) {
+			VkPhysicalDeviceMemoryProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties2.pNext = &budgetProperties;
+			vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+		}
+
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+			HeapBudget& heap = heaps[i];
+			heap.size = memoryProperties.memoryHeaps[i].size;
+			heap.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			heap.allocated = heapAllocated[i];
+			// Without the extension nothing is known about the other processes, so some
+			// room is left for them and the driver
+			heap.budget = memoryBudget ? budgetProperties.heapBudget[i] : heap.size / 10 * 8;
+			heap.usage = memoryBudget ? budgetProperties.heapUsage[i] : heap.allocated;
+		}
+	}
+
+	void MemoryAllocator::checkBudget(uint32_t heap, VkDeviceSize size) {
+		std::vector<HeapBudget> heaps{};
+		queryBudget(heaps);
+		VkDeviceSize usage = heaps[heap].usage + size;
+		VkDeviceSize threshold = static_cast<VkDeviceSize>(heaps[heap].budget * static_cast<double>(budgetThreshold));
+		if (usage <= threshold) {
+			heapWarned[heap] = false;
+			return;
+		}
+		if (heapWarned[heap]) return;
+
+		heapWarned[heap] = true;
+		budgetWarnings++;
+		pendingWarnings.push_back({ heap, usage, heaps[heap].budget });
+	}
+
+	void MemoryAllocator::reportBudgetWarnings() {
+		std::vector<BudgetWarning> warnings{};
+		BudgetCallback callback{};
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (pendingWarnings.empty()) return;
+			warnings.swap(pendingWarnings);
+			callback = budgetCallback;
+		}
+
+		for (const BudgetWarning& warning : warnings) {
+			if (callback) {
+				callback(warning.heap, warning.usage, warning.budget);
+				continue;
+			}
+			std::cerr << "GPU memory: heap " << warning.heap << " is at " << warning.usage / (1024 * 1024) << " of its "
+				<< warning.budget / (1024 * 1024) << " MB budget" << std::endl;
+		}
+	}
+
+	MemoryAllocator::BudgetStats MemoryAllocator::getBudget() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		BudgetStats stats{};
+		stats.fromExtension = memoryBudget;
+		queryBudget(stats.heaps);
+		for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); i++) {
+			stats.categoryBytes[i] = categoryBytes[i];
+			stats.categoryAllocations[i] = categoryAllocations[i];
+		}
+		stats.budgetWarnings = budgetWarnings;
+		return stats;
+	}
+
+	void MemoryAllocator::setBudgetCallback(BudgetCallback callback, float threshold) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		budgetCallback = std::move(callback);
+		budgetThreshold = threshold;
+	}
+
+	MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType,
+		bool linear, MemoryCategory category, bool dedicated) {
+		// The budget callback may call back into the allocator, so the warnings are only
+		// reported once the lock is released. That includes allocations that failed.
+		MemoryAllocation allocation{};
+		try {
+			allocation = allocateLocked(requirements, memoryType, linear, category, dedicated);
+		}
+		catch (...) {
+			reportBudgetWarnings();
+			throw;
+		}
+		reportBudgetWarnings();
+		return allocation;
+	}
+
+	MemoryAllocation MemoryAllocator::allocateLocked(const VkMemoryRequirements& requirements, uint32_t memoryType,
+		bool linear, MemoryCategory category, bool dedicated) {
+		assert(memoryType < memoryProperties.memoryTypeCount && "Memory type out of range");
+		std::lock_guard<std::mutex> lock{ mutex };
+		totalAllocations++;
+
+		// Flushes and invalidates work in whole atoms, so host visible ranges start and
+		// end on an atom. That way a flush never touches a neighbour.
+		VkDeviceSize alignment = requirements.alignment;
+		VkDeviceSize size = requirements.size;
+		if (isHostVisible(memoryType)) {
+			alignment = std::max(alignment, nonCoherentAtomSize);
+			size = alignUp(size, nonCoherentAtomSize);
+		}
+
+		uint32_t poolIndex = memoryType * 2 + (linear ? 0 : 1);
+		Pool& pool = pools[poolIndex];
+		MemoryAllocation allocation{};
+		allocation.memoryType = memoryType;
+		allocation.category = category;
+		if (dedicated || size > pool.blockSize / 2) {
+			allocation.memory = allocateDeviceMemory(size, memoryType, &allocation.mapped);
+			allocation.size = size;
+			dedicatedCount++;
+			dedicatedBytes += size;
+			addToCategory(allocation);
+			return allocation;
+		}
+
+		// The first block with a range that fits wins, which keeps the early blocks full
+		uint32_t emptySlot = UINT32_MAX;
+		for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+			Block& block = pool.blocks[i];
+			if (block.memory == VK_NULL_HANDLE) {
+				if (emptySlot == UINT32_MAX) emptySlot = i;
+				continue;
+			}
+			TlsfAllocator::Allocation range = block.ranges->allocate(size, alignment);
+			if (range.handle == TlsfAllocator::INVALID_HANDLE) continue;
+			allocation.memory = block.memory;
+			allocation.offset = range.offset;
+			allocation.size = range.size;
+			allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+			allocation.pool = poolIndex;
+			allocation.block = i;
+			allocation.handle = range.handle;
+			addToCategory(allocation);
+			return allocation;
+		}
+
+		// None of them had room, so the pool grows by a block
+		if (emptySlot == UINT32_MAX) {
+			emptySlot = static_cast<uint32_t>(pool.blocks.size());
+			pool.blocks.emplace_back();
+		}
+		Block& block = pool.blocks[emptySlot];
+		block.memory = allocateDeviceMemory(pool.blockSize, memoryType, &block.mapped);
+		block.ranges = std::make_unique<TlsfAllocator>(pool.blockSize);
+
+		TlsfAllocator::Allocation range = block.ranges->allocate(size, alignment);
+		assert(range.handle != TlsfAllocator::INVALID_HANDLE && "Half a block always fits into an empty one");
+		allocation.memory = block.memory;
+		allocation.offset = range.offset;
+		allocation.size = range.size;
+		allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+		allocation.pool = poolIndex;
+		allocation.block = emptySlot;
+		allocation.handle = range.handle;
+		addToCategory(allocation);
+		return allocation;
+	}
+
+	void MemoryAllocator::free(const MemoryAllocation& allocation) {
+		if (allocation.memory == VK_NULL_HANDLE) return;
+		std::lock_guard<std::mutex> lock{ mutex };
+		categoryBytes[static_cast<uint32_t>(allocation.category)] -= allocation.size;
+		categoryAllocations[static_cast<uint32_t>(allocation.category)]--;
+
+		if (allocation.isDedicated()) {
+			freeDeviceMemory(allocation.memory, allocation.mapped, allocation.size, allocation.memoryType);
+			dedicatedCount--;
+			dedicatedBytes -= allocation.size;
+			return;
+		}
+
+		Pool& pool = pools[allocation.pool];
+		Block& block = pool.blocks[allocation.block];
+		block.ranges->free(allocation.handle);
+
+		// Empty blocks go back to the driver, except for one per pool so that a resource
+		// that is destroyed and created again every frame doesn't allocate every frame
+		if (!block.ranges->isEmpty()) return;
+		uint32_t liveBlocks = 0;
+		for (const Block& other : pool.blocks) liveBlocks += other.memory != VK_NULL_HANDLE ? 1 : 0;
+		if (liveBlocks <= 1) return;
+		freeDeviceMemory(block.memory, block.mapped, pool.blockSize, allocation.memoryType);
+		block = Block{};
+	}
+
+	VkMappedMemoryRange MemoryAllocator::getMappedRange(const MemoryAllocation& allocation,
+		VkDeviceSize size, VkDeviceSize offset) const {
+		assert(offset <= allocation.size && "Offset is outside of the allocation");
+		VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.size : std::min(offset + size, allocation.size);
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = allocation.offset + offset / nonCoherentAtomSize * nonCoherentAtomSize;
+		// Host visible allocations are whole atoms, so rounding up never leaves the allocation
+		range.size = allocation.offset + alignUp(end, nonCoherentAtomSize) - range.offset;
+		return range;
+	}
+
+	MemoryAllocator::Stats MemoryAllocator::getStats() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats stats{};
+		stats.dedicatedCount = dedicatedCount;
+		stats.allocationCount = dedicatedCount;
+		stats.reservedBytes = dedicatedBytes;
+		stats.usedBytes = dedicatedBytes;
+		stats.totalAllocations = totalAllocations;
+		stats.deviceAllocations = deviceAllocations;
+
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeSum = 0;
+		for (const Pool& pool : pools) {
+			for (const Block& block : pool.blocks) {
+				if (block.memory == VK_NULL_HANDLE) continue;
+				TlsfAllocator::Stats blockStats = block.ranges->getStats();
+				stats.blockCount++;
+				stats.allocationCount += blockStats.allocationCount;
+				stats.reservedBytes += blockStats.size;
+				stats.usedBytes += blockStats.usedBytes;
+				stats.freeRangeCount += blockStats.freeRangeCount;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, blockStats.largestFreeRange);
+				freeBytes += blockStats.size - blockStats.usedBytes;
+				largestFreeSum += blockStats.largestFreeRange;
+			}
+		}
+		// The share of free bytes that isn't in the largest range of its block
+		if (freeBytes > 0) stats.fragmentation = 1.0f - static_cast<float>(largestFreeSum) / freeBytes;
+		return stats;
+	}
+}
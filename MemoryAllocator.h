@@ -0,0 +1,193 @@
+//**********************************************************************
+// Every buffer and image used to get its own vkAllocateMemory call.
+// Drivers only allow a few thousand of those (maxMemoryAllocationCount)
+// and each one is slow, so the memory allocator takes large blocks of
+// VkDeviceMemory instead and hands out ranges of them with a
+// TlsfAllocator. There are separate blocks for every memory type, and
+// buffers and optimal tiling images never share a block, so neighbours
+// can't break the bufferImageGranularity rule. Host visible blocks are
+// mapped once when they are created and stay mapped, since a
+// VkDeviceMemory can only be mapped once at a time. Resources larger
+// than half a block get memory of their own. All of it is thread safe,
+// models create their buffers on the loader threads.
+//
+// Every allocation is tagged with a MemoryCategory, so the stats can
+// tell how much each part of the engine uses. Before new device memory
+// is allocated, the heap it comes from is checked against its budget:
+// the one VK_EXT_memory_budget reports when the device has it, otherwise
+// 80% of the heap size. Going over the warning threshold calls the
+// budget callback, or prints a warning when there is none.
+//**********************************************************************
+
+#pragma once
+
+#include "TlsfAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace engine {
+	// What an allocation is used for, for the per category stats
+	enum class MemoryCategory : uint32_t {
+		Mesh,		// Vertex and index buffers, the geometry heap
+		Staging,	// Host visible sources of uploads
+		Uniform,	// Uniform buffers and other per frame data (see FrameAllocator.h)
+		Material,	// The material table
+		Depth,		// Depth attachments
+		Other,
+		Count
+	};
+	const char* getMemoryCategoryName(MemoryCategory category);
+
+	// A range of device memory that a buffer or image is bound to
+	struct MemoryAllocation {
+		VkDeviceMemory memory{ VK_NULL_HANDLE };
+		VkDeviceSize offset{ 0 };
+		VkDeviceSize size{ 0 };
+		void* mapped{ nullptr };		// The start of the range when the memory is host visible
+		uint32_t memoryType{ 0 };
+		uint32_t pool{ UINT32_MAX };	// UINT32_MAX for memory of its own
+		uint32_t block{ 0 };
+		uint32_t handle{ TlsfAllocator::INVALID_HANDLE };
+		MemoryCategory category{ MemoryCategory::Other };
+
+		bool isDedicated() const { return pool == UINT32_MAX; }
+	};
+
+	class MemoryAllocator {
+	public:
+		// Blocks are this large unless the heap is small, then they're an eighth of it
+		static constexpr VkDeviceSize BLOCK_SIZE = 64ull * 1024 * 1024;
+
+		struct Stats {
+			uint32_t blockCount{ 0 };
+			uint32_t dedicatedCount{ 0 };
+			uint32_t allocationCount{ 0 };
+			VkDeviceSize reservedBytes{ 0 };		// Every block and dedicated allocation
+			VkDeviceSize usedBytes{ 0 };			// What the resources take up, with their alignment
+			uint32_t freeRangeCount{ 0 };
+			VkDeviceSize largestFreeRange{ 0 };
+			// How much of the free space in the blocks is split up. 0 when every block has its
+			// free space in one piece, close to 1 when it's scattered in small ranges.
+			float fragmentation{ 0.0f };
+			uint64_t totalAllocations{ 0 };			// Since the allocator was created
+			uint64_t deviceAllocations{ 0 };		// vkAllocateMemory calls among them
+		};
+
+		struct HeapBudget {
+			VkDeviceSize size{ 0 };
+			VkDeviceSize budget{ 0 };		// What the process can use before it gets into trouble
+			VkDeviceSize usage{ 0 };		// By the whole process with the extension, otherwise allocated
+			VkDeviceSize allocated{ 0 };	// Blocks and dedicated memory of this allocator
+			bool deviceLocal{ false };
+		};
+
+		struct BudgetStats {
+			bool fromExtension{ false };	// VK_EXT_memory_budget, otherwise the heap sizes
+			std::vector<HeapBudget> heaps{};
+			// What the resources of each category take up and how many there are
+			VkDeviceSize categoryBytes[static_cast<uint32_t>(MemoryCategory::Count)]{};
+			uint32_t categoryAllocations[static_cast<uint32_t>(MemoryCategory::Count)]{};
+			uint64_t budgetWarnings{ 0 };
+		};
+
+		// Called with the heap, its usage after the allocation and its budget when an allocation
+		// is about to take a heap over the warning threshold. It runs on the allocating thread once
+		// the allocation is done and the allocator is unlocked again, so it may call into it.
+		using BudgetCallback = std::function<void(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget)>;
+
+		// memoryBudget is true when VK_EXT_memory_budget is enabled on the device
+		MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, bool memoryBudget);
+		~MemoryAllocator();
+
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		// linear is true for buffers and linear tiling images, false for optimal tiling images.
+		// dedicated skips the blocks and calls vkAllocateMemory, the way it used to be done.
+		// Throws std::runtime_error when the device is out of memory.
+		MemoryAllocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType,
+			bool linear, MemoryCategory category, bool dedicated = false);
+		void free(const MemoryAllocation& allocation);
+
+		// The range to flush or invalidate for size bytes at offset into the allocation, widened
+		// to nonCoherentAtomSize and kept inside the allocation. Pass VK_WHOLE_SIZE for all of it.
+		VkMappedMemoryRange getMappedRange(const MemoryAllocation& allocation,
+			VkDeviceSize size, VkDeviceSize offset) const;
+
+		// What the memory type really is, which can be more than was asked for
+		VkMemoryPropertyFlags getMemoryTypeFlags(uint32_t memoryType) const {
+			return memoryProperties.memoryTypes[memoryType].propertyFlags;
+		}
+		VkDeviceSize getNonCoherentAtomSize() const { return nonCoherentAtomSize; }
+
+		Stats getStats() const;
+		BudgetStats getBudget() const;
+		// threshold is the share of the budget a heap may use before the callback is called
+		void setBudgetCallback(BudgetCallback callback, float threshold = 0.9f);
+
+	private:
+		struct Block {
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			void* mapped{ nullptr };
+			std::unique_ptr<TlsfAllocator> ranges;
+		};
+
+		// The blocks of one memory type for either linear or optimal resources
+		struct Pool {
+			std::vector<Block> blocks{};
+			VkDeviceSize blockSize{ 0 };
+		};
+
+		VkDevice device;
+		VkPhysicalDevice physicalDevice;
+		bool memoryBudget;
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		VkDeviceSize nonCoherentAtomSize{ 1 };
+		std::vector<Pool> pools{};		// Two for every memory type, linear first
+
+		mutable std::mutex mutex;
+		uint32_t dedicatedCount{ 0 };
+		VkDeviceSize dedicatedBytes{ 0 };
+		uint64_t totalAllocations{ 0 };
+		uint64_t deviceAllocations{ 0 };
+		std::vector<VkDeviceSize> heapAllocated{};
+		std::vector<bool> heapWarned{};		// Warned once until the heap drops below the threshold again
+		VkDeviceSize categoryBytes[static_cast<uint32_t>(MemoryCategory::Count)]{};
+		uint32_t categoryAllocations[static_cast<uint32_t>(MemoryCategory::Count)]{};
+		BudgetCallback budgetCallback{};
+		float budgetThreshold{ 0.9f };
+		uint64_t budgetWarnings{ 0 };
+
+		struct BudgetWarning {
+			uint32_t heap;
+			VkDeviceSize usage;
+			VkDeviceSize budget;
+		};
+		std::vector<BudgetWarning> pendingWarnings{};	// Reported once allocate has unlocked
+
+		// Does the work of allocate with the allocator locked
+		MemoryAllocation allocateLocked(const VkMemoryRequirements& requirements, uint32_t memoryType,
+			bool linear, MemoryCategory category, bool dedicated);
+		// Calls vkAllocateMemory and maps the memory if it is host visible
+		VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+		void freeDeviceMemory(VkDeviceMemory memory, void* mapped, VkDeviceSize size, uint32_t memoryType);
+		// Usage and budget of every heap, needs the lock
+		void queryBudget(std::vector<HeapBudget>& heaps) const;
+		// Needs the lock, a heap that goes over the threshold is added to pendingWarnings
+		void checkBudget(uint32_t heap, VkDeviceSize size);
+		// Calls the budget callback, or prints, for the pending warnings. Must not hold the lock.
+		void reportBudgetWarnings();
+		void addToCategory(const MemoryAllocation& allocation) {
+			categoryBytes[static_cast<uint32_t>(allocation.category)] += allocation.size;
+			categoryAllocations[static_cast<uint32_t>(allocation.category)]++;
+		}
+		bool isHostVisible(uint32_t memoryType) const;
+	};
+}
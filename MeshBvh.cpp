@@ -0,0 +1,515 @@
+#include "MeshBvh.h"
+#include "GameObject.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace engine {
+	static_assert(sizeof(MeshBvh::Node) == 32, "Two sibling nodes are meant to fit in one cache line");
+
+	namespace {
+		// Subtrees with fewer triangles than this are built by one thread from start to finish
+		constexpr uint32_t PARALLEL_MIN_TRIANGLES = 8192;
+		constexpr size_t TRIANGLE_BLOCK_SIZE = 16384;
+
+		// The cost of visiting a node compared to testing a triangle, for the surface area heuristic
+		constexpr float TRAVERSAL_COST = 1.0f;
+
+		struct Bounds {
+			glm::vec3 min{ FLT_MAX };
+			glm::vec3 max{ -FLT_MAX };
+
+			void grow(const glm::vec3 &point) {
+				min = glm::min(min, point);
+				max = glm::max(max, point);
+			}
+			void grow(const Bounds &other) {
+				min = glm::min(min, other.min);
+				max = glm::max(max, other.max);
+			}
+			float area() const {
+				if (min.x > max.x) return 0.0f;
+				glm::vec3 extent = max - min;
+				return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+			}
+		};
+
+		struct BuildTriangle {
+			Bounds bounds{};
+			glm::vec3 centroid{ 0.0f };
+		};
+
+		// A subtree whose splits haven't been made yet, see TreeBuilder::split
+		struct Subtree {
+			uint32_t node{ 0 };
+			uint32_t first{ 0 };
+			uint32_t count{ 0 };
+			uint32_t depth{ 0 };
+		};
+
+		class TreeBuilder {
+		public:
+			TreeBuilder(const std::vector<BuildTriangle> &triangles, std::vector<uint32_t> &order)
+				: triangles{ triangles }, order{ order } {}
+
+			// Makes node the root of the triangles order[first, first + count) and splits it until the
+			// leaves are small enough. With subtrees set, parts smaller than PARALLEL_MIN_TRIANGLES are
+			// left as they are and added to it instead. Returns the depth of the deepest leaf.
+			uint32_t split(std::vector<MeshBvh::Node> &nodes, uint32_t node, uint32_t first, uint32_t count,
+				uint32_t depth, std::vector<Subtree> *subtrees) const {
+				Bounds bounds{};
+				Bounds centroidBounds{};
+				for (uint32_t i = first; i < first + count; i++) {
+					const BuildTriangle &triangle = triangles[order[i]];
+					bounds.grow(triangle.bounds);
+					centroidBounds.grow(triangle.centroid);
+				}
+				nodes[node].min = bounds.min;
+				nodes[node].max = bounds.max;
+
+				if (subtrees != nullptr && count < PARALLEL_MIN_TRIANGLES) {
+					subtrees->push_back({ node, first, count, depth });
+					return depth;
+				}
+
+				uint32_t axis = 0;
+				uint32_t splitBin = 0;
+				float splitCost = FLT_MAX;
+				if (count > 1 && depth + 1 < MeshBvh::MAX_DEPTH) {
+					findSplit(first, count, centroidBounds, axis, splitBin, splitCost);
+				}
+
+				// A leaf when splitting isn't worth it. Larger leaves are only left when every centroid is
+				// in the same place (the heuristic found nothing to split) or the tree is too deep.
+				float leafCost = bounds.area() * count;
+				bool canSplit = splitCost != FLT_MAX;
+				if (depth + 1 >= MeshBvh::MAX_DEPTH || count <= 1 ||
+					(count <= MeshBvh::MAX_LEAF_TRIANGLES && (!canSplit || leafCost <= TRAVERSAL_COST * bounds.area() + splitCost))) {
+					nodes[node].leftFirst = first;
+					nodes[node].triangleCount = count;
+					return depth;
+				}
+
+				uint32_t leftCount = count / 2;
+				if (canSplit) {
+					float scale = MeshBvh::BIN_COUNT / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+					float offset = centroidBounds.min[axis];
+					auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](uint32_t triangle) {
+						return getBin(triangles[triangle].centroid[axis], offset, scale) < splitBin;
+					});
+					leftCount = static_cast<uint32_t>(middle - (order.begin() + first));
+				}
+
+				uint32_t left = static_cast<uint32_t>(nodes.size());
+				nodes.resize(nodes.size() + 2);
+				nodes[node].leftFirst = left;
+				nodes[node].triangleCount = 0;
+				uint32_t leftDepth = split(nodes, left, first, leftCount, depth + 1, subtrees);
+				uint32_t rightDepth = split(nodes, left + 1, first + leftCount, count - leftCount, depth + 1, subtrees);
+				return std::max(leftDepth, rightDepth);
+			}
+
+		private:
+			static uint32_t getBin(float centroid, float offset, float scale) {
+				return std::min(MeshBvh::BIN_COUNT - 1, static_cast<uint32_t>((centroid - offset) * scale));
+			}
+
+			// The cheapest split between two bins on any axis. Triangles in bins below splitBin go left.
+			void findSplit(uint32_t first, uint32_t count, const Bounds &centroidBounds,
+				uint32_t &bestAxis, uint32_t &bestBin, float &bestCost) const {
+				struct Bin {
+					Bounds bounds{};
+					uint32_t count{ 0 };
+				};
+
+				for (uint32_t axis = 0; axis < 3; axis++) {
+					float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+					if (!(extent > 0.0f)) continue;
+					float scale = MeshBvh::BIN_COUNT / extent;
+					float offset = centroidBounds.min[axis];
+
+					Bin bins[MeshBvh::BIN_COUNT]{};
+					for (uint32_t i = first; i < first + count; i++) {
+						const BuildTriangle &triangle = triangles[order[i]];
+						Bin &bin = bins[getBin(triangle.centroid[axis], offset, scale)];
+						bin.bounds.grow(triangle.bounds);
+						bin.count++;
+					}
+
+					// Sweep once from the left to get the area and count below every split, then once from the right
+					float leftArea[MeshBvh::BIN_COUNT - 1];
+					uint32_t leftCount[MeshBvh::BIN_COUNT - 1];
+					Bounds leftBounds{};
+					uint32_t leftSum = 0;
+					for (uint32_t i = 0; i + 1 < MeshBvh::BIN_COUNT; i++) {
+						leftBounds.grow(bins[i].bounds);
+						leftSum += bins[i].count;
+						leftArea[i] = leftBounds.area();
+						leftCount[i] = leftSum;
+					}
+					Bounds rightBounds{};
+					uint32_t rightSum = 0;
+					for (uint32_t i = MeshBvh::BIN_COUNT - 1; i > 0; i--) {
+						rightBounds.grow(bins[i].bounds);
+						rightSum += bins[i].count;
+						if (leftCount[i - 1] == 0 || rightSum == 0) continue;
+						float cost = leftArea[i - 1] * leftCount[i - 1] + rightBounds.area() * rightSum;
+						if (cost < bestCost) {
+							bestCost = cost;
+							bestAxis = axis;
+							bestBin = i;
+						}
+					}
+				}
+			}
+
+			const std::vector<BuildTriangle> &triangles;
+			std::vector<uint32_t> &order;
+		};
+
+		// Slab test, returns where the ray enters the box or FLT_MAX when it misses it before maxDistance
+		float intersectBox(const MeshBvh::Node &node, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance) {
+			glm::vec3 t1 = (node.min - origin) * inverseDirection;
+			glm::vec3 t2 = (node.max - origin) * inverseDirection;
+			glm::vec3 tMin = glm::min(t1, t2);
+			glm::vec3 tMax = glm::max(t1, t2);
+			float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+			float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+			return enter <= exit ? enter : FLT_MAX;
+		}
+
+		// Möller-Trumbore, u and v are the weights of b and c
+		bool intersectTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+			const glm::vec3 &origin, const glm::vec3 &direction, float &t, float &u, float &v) {
+			glm::vec3 edge1 = b - a;
+			glm::vec3 edge2 = c - a;
+			glm::vec3 p = glm::cross(direction, edge2);
+			float determinant = glm::dot(edge1, p);
+			if (determinant == 0.0f) return false;		// Parallel to the triangle, or the triangle has no area
+			float inverse = 1.0f / determinant;
+			glm::vec3 s = origin - a;
+			u = glm::dot(s, p) * inverse;
+			if (u < 0.0f || u > 1.0f) return false;
+			glm::vec3 q = glm::cross(s, edge1);
+			v = glm::dot(direction, q) * inverse;
+			if (v < 0.0f || u + v > 1.0f) return false;
+			t = glm::dot(edge2, q) * inverse;
+			return t >= 0.0f;
+		}
+
+		float boxDistanceSquared(const MeshBvh::Node &node, const glm::vec3 &point) {
+			glm::vec3 outside = glm::max(glm::max(node.min - point, point - node.max), glm::vec3(0.0f));
+			return glm::dot(outside, outside);
+		}
+
+		// From Real-Time Collision Detection (Ericson), 5.1.5: finds the feature of the
+		// triangle (a vertex, an edge or the face) whose region the point is in
+		glm::vec3 closestPointOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+			glm::vec3 ab = b - a;
+			glm::vec3 ac = c - a;
+			glm::vec3 ap = p - a;
+			float d1 = glm::dot(ab, ap);
+			float d2 = glm::dot(ac, ap);
+			if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+			glm::vec3 bp = p - b;
+			float d3 = glm::dot(ab, bp);
+			float d4 = glm::dot(ac, bp);
+			if (d3 >= 0.0f && d4 <= d3) return b;
+
+			float vc = d1 * d4 - d3 * d2;
+			if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+			glm::vec3 cp = p - c;
+			float d5 = glm::dot(ab, cp);
+			float d6 = glm::dot(ac, cp);
+			if (d6 >= 0.0f && d5 <= d6) return c;
+
+			float vb = d5 * d2 - d1 * d6;
+			if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+			float va = d3 * d6 - d5 * d4;
+			if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+			float denominator = 1.0f / (va + vb + vc);
+			return a + ab * (vb * denominator) + ac * (vc * denominator);
+		}
+	}
+
+	MeshBvh::MeshBvh(const void *tempPositions, size_t stride, uint32_t vertexCount,
+		const uint32_t *indices, uint32_t indexCount, ThreadPool &pool) {
+		positions.resize(vertexCount);
+		const char *source = static_cast<const char*>(tempPositions);
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			std::memcpy(&positions[i], source + i * stride, sizeof(glm::vec3));
+		}
+
+		uint32_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) return;
+
+		// The bounds and centroids are all the splits look at
+		std::vector<BuildTriangle> buildTriangles(triangleCount);
+		std::atomic<bool> outOfRange{ false };
+		size_t blockCount = (triangleCount + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE;
+		pool.parallelFor(blockCount, [&](size_t block) {
+			size_t end = std::min<size_t>(triangleCount, (block + 1) * TRIANGLE_BLOCK_SIZE);
+			for (size_t t = block * TRIANGLE_BLOCK_SIZE; t < end; t++) {
+				const uint32_t *corners = &indices[t * 3];
+				if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount) {
+					outOfRange = true;
+					return;
+				}
+				BuildTriangle &triangle = buildTriangles[t];
+				for (int corner = 0; corner < 3; corner++) triangle.bounds.grow(positions[corners[corner]]);
+				triangle.centroid = (triangle.bounds.min + triangle.bounds.max) * 0.5f;
+			}
+		});
+		if (outOfRange) throw std::runtime_error("Can't build a BVH over indices that point past the vertices");
+
+		std::vector<uint32_t> order(triangleCount);
+		for (uint32_t t = 0; t < triangleCount; t++) order[t] = t;
+
+		// The top of the tree is split on this thread until the parts are small enough, then
+		// every part is built into its own nodes in parallel and appended to the tree afterwards
+		TreeBuilder builder{ buildTriangles, order };
+		nodes.reserve(triangleCount / MAX_LEAF_TRIANGLES * 2 + 1);
+		nodes.resize(1);
+		std::vector<Subtree> subtrees{};
+		depth = builder.split(nodes, 0, 0, triangleCount, 0, &subtrees);
+
+		std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+		std::vector<uint32_t> subtreeDepths(subtrees.size());
+		pool.parallelFor(subtrees.size(), [&](size_t i) {
+			const Subtree &subtree = subtrees[i];
+			std::vector<Node> &local = subtreeNodes[i];
+			local.reserve(subtree.count / MAX_LEAF_TRIANGLES * 2 + 1);
+			local.resize(1);
+			subtreeDepths[i] = builder.split(local, 0, subtree.first, subtree.count, subtree.depth, nullptr);
+		});
+		for (size_t i = 0; i < subtrees.size(); i++) {
+			// The root of the part replaces the node that was left for it, the rest moves
+			// down by one because of that
+			const std::vector<Node> &local = subtreeNodes[i];
+			uint32_t base = static_cast<uint32_t>(nodes.size()) - 1;
+			auto place = [&](Node node) {
+				if (!node.isLeaf()) node.leftFirst += base;
+				return node;
+			};
+			nodes[subtrees[i].node] = place(local[0]);
+			for (size_t j = 1; j < local.size(); j++) nodes.push_back(place(local[j]));
+			depth = std::max(depth, subtreeDepths[i]);
+		}
+		nodes.shrink_to_fit();
+		for (const Node &node : nodes) leafCount += node.isLeaf() ? 1 : 0;
+
+		// Stored in the order of the leaves, so a leaf's triangles are next to each other
+		triangles.resize(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			const uint32_t *corners = &indices[order[i] * 3];
+			triangles[i] = glm::uvec3(corners[0], corners[1], corners[2]);
+		}
+		triangleIds = std::move(order);
+	}
+
+	bool MeshBvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit, float maxDistance) const {
+		if (triangles.empty()) return false;
+		glm::vec3 inverseDirection = 1.0f / direction;
+		float best = maxDistance;
+		uint32_t bestTriangle = NO_TRIANGLE;
+		glm::vec2 bestBarycentric{ 0.0f };
+
+		struct Entry {
+			uint32_t node;
+			float distance;
+		};
+		Entry stack[MAX_DEPTH];
+		uint32_t stackSize = 0;
+		uint32_t nodeIndex = 0;
+		auto pop = [&]() {
+			while (stackSize > 0) {
+				const Entry &entry = stack[--stackSize];
+				if (entry.distance < best) {
+					nodeIndex = entry.node;
+					return true;
+				}
+			}
+			return false;
+		};
+
+		if (intersectBox(nodes[0], origin, inverseDirection, best) == FLT_MAX) return false;
+		while (true) {
+			const Node &node = nodes[nodeIndex];
+			if (node.isLeaf()) {
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) {
+					const glm::uvec3 &triangle = triangles[i];
+					float t, u, v;
+					if (intersectTriangle(positions[triangle.x], positions[triangle.y], positions[triangle.z],
+						origin, direction, t, u, v) && t < best) {
+						best = t;
+						bestTriangle = i;
+						bestBarycentric = { u, v };
+					}
+				}
+				if (!pop()) break;
+				continue;
+			}
+
+			// The nearer child first, the other one waits on the stack in case it's still needed
+			uint32_t nearChild = node.leftFirst;
+			uint32_t farChild = node.leftFirst + 1;
+			float nearDistance = intersectBox(nodes[nearChild], origin, inverseDirection, best);
+			float farDistance = intersectBox(nodes[farChild], origin, inverseDirection, best);
+			if (farDistance < nearDistance) {
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+			if (nearDistance == FLT_MAX) {
+				if (!pop()) break;
+				continue;
+			}
+			if (farDistance != FLT_MAX) stack[stackSize++] = { farChild, farDistance };
+			nodeIndex = nearChild;
+		}
+
+		if (bestTriangle == NO_TRIANGLE) return false;
+		const glm::uvec3 &triangle = triangles[bestTriangle];
+		const glm::vec3 &a = positions[triangle.x];
+		hit.distance = best;
+		hit.triangle = triangleIds[bestTriangle];
+		hit.barycentric = bestBarycentric;
+		hit.point = origin + direction * best;
+		hit.normal = glm::normalize(glm::cross(positions[triangle.y] - a, positions[triangle.z] - a));
+		return true;
+	}
+
+	bool MeshBvh::raycast(const TransformComponent &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+		RayHit &hit, float maxDistance) const {
+		// The direction isn't normalized after moving it into model space, so a distance along
+		// the model space ray is the same distance along the world space ray
+		glm::mat4 inverse = glm::inverse(transform.mat4());
+		glm::vec3 modelOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+		glm::vec3 modelDirection = glm::mat3(inverse) * direction;
+		if (!raycast(modelOrigin, modelDirection, hit, maxDistance)) return false;
+		hit.point = origin + direction * hit.distance;
+		hit.normal = glm::normalize(transform.normalMatrix() * hit.normal);
+		return true;
+	}
+
+	template <typename TestTriangle>
+	void MeshBvh::findNearest(const glm::vec3 &point, float boxScale, float &bestSquared, const TestTriangle &testTriangle) const {
+		if (triangles.empty()) return;
+		float scaleSquared = boxScale * boxScale;
+
+		struct Entry {
+			uint32_t node;
+			float distanceSquared;
+		};
+		Entry stack[MAX_DEPTH];
+		uint32_t stackSize = 0;
+		uint32_t nodeIndex = 0;
+		auto pop = [&]() {
+			while (stackSize > 0) {
+				const Entry &entry = stack[--stackSize];
+				if (entry.distanceSquared < bestSquared) {
+					nodeIndex = entry.node;
+					return true;
+				}
+			}
+			return false;
+		};
+
+		if (boxDistanceSquared(nodes[0], point) * scaleSquared >= bestSquared) return;
+		while (true) {
+			const Node &node = nodes[nodeIndex];
+			if (node.isLeaf()) {
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++) testTriangle(i, bestSquared);
+				if (!pop()) break;
+				continue;
+			}
+
+			uint32_t nearChild = node.leftFirst;
+			uint32_t farChild = node.leftFirst + 1;
+			float nearDistance = boxDistanceSquared(nodes[nearChild], point) * scaleSquared;
+			float farDistance = boxDistanceSquared(nodes[farChild], point) * scaleSquared;
+			if (farDistance < nearDistance) {
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+			if (nearDistance >= bestSquared) {
+				if (!pop()) break;
+				continue;
+			}
+			if (farDistance < bestSquared) stack[stackSize++] = { farChild, farDistance };
+			nodeIndex = nearChild;
+		}
+	}
+
+	bool MeshBvh::findClosestPoint(const glm::vec3 &point, ClosestPoint &result, float maxDistance) const {
+		float bestSquared = maxDistance < std::sqrt(FLT_MAX) ? maxDistance * maxDistance : FLT_MAX;
+		uint32_t bestTriangle = NO_TRIANGLE;
+		glm::vec3 bestPoint{ 0.0f };
+		findNearest(point, 1.0f, bestSquared, [&](uint32_t i, float &best) {
+			const glm::uvec3 &triangle = triangles[i];
+			glm::vec3 closest = closestPointOnTriangle(point, positions[triangle.x], positions[triangle.y], positions[triangle.z]);
+			glm::vec3 offset = closest - point;
+			float distanceSquared = glm::dot(offset, offset);
+			if (distanceSquared < best) {
+				best = distanceSquared;
+				bestTriangle = i;
+				bestPoint = closest;
+			}
+		});
+
+		if (bestTriangle == NO_TRIANGLE) return false;
+		result.distance = std::sqrt(bestSquared);
+		result.triangle = triangleIds[bestTriangle];
+		result.point = bestPoint;
+		return true;
+	}
+
+	bool MeshBvh::findClosestPoint(const TransformComponent &transform, const glm::vec3 &point,
+		ClosestPoint &result, float maxDistance) const {
+		// With a scale that isn't the same on every axis the closest point in model space isn't the
+		// closest one in world space, so the triangles are moved into world space to be measured.
+		// The model matrix is a rotation times the scale, so it makes no distance in model space
+		// shorter than the smallest scale factor times that distance. That keeps the boxes in
+		// model space good enough to skip the parts of the tree that can't be closer.
+		glm::mat4 model = transform.mat4();
+		glm::vec3 modelPoint = glm::vec3(glm::inverse(model) * glm::vec4(point, 1.0f));
+		glm::vec3 scale = glm::abs(transform.scale);
+		float minScale = std::min(scale.x, std::min(scale.y, scale.z));
+
+		float bestSquared = maxDistance < std::sqrt(FLT_MAX) ? maxDistance * maxDistance : FLT_MAX;
+		uint32_t bestTriangle = NO_TRIANGLE;
+		glm::vec3 bestPoint{ 0.0f };
+		findNearest(modelPoint, minScale, bestSquared, [&](uint32_t i, float &best) {
+			const glm::uvec3 &triangle = triangles[i];
+			glm::vec3 a = glm::vec3(model * glm::vec4(positions[triangle.x], 1.0f));
+			glm::vec3 b = glm::vec3(model * glm::vec4(positions[triangle.y], 1.0f));
+			glm::vec3 c = glm::vec3(model * glm::vec4(positions[triangle.z], 1.0f));
+			glm::vec3 closest = closestPointOnTriangle(point, a, b, c);
+			glm::vec3 offset = closest - point;
+			float distanceSquared = glm::dot(offset, offset);
+			if (distanceSquared < best) {
+				best = distanceSquared;
+				bestTriangle = i;
+				bestPoint = closest;
+			}
+		});
+
+		if (bestTriangle == NO_TRIANGLE) return false;
+		result.distance = std::sqrt(bestSquared);
+		result.triangle = triangleIds[bestTriangle];
+		result.point = bestPoint;
+		return true;
+	}
+
+	size_t MeshBvh::getMemorySize() const {
+		return positions.size() * sizeof(glm::vec3) + triangles.size() * sizeof(glm::uvec3) +
+			triangleIds.size() * sizeof(uint32_t) + nodes.size() * sizeof(Node);
+	}
+}
@@ -0,0 +1,111 @@
+//**********************************************************************
+// A bounding volume hierarchy over the full detail triangles of a
+// model, for the questions the GPU can't answer for us: which triangle
+// does a ray hit first (picking, line of sight) and where is the
+// closest point on the surface (gameplay, collision). Once a model is
+// uploaded its vertices only live in GPU memory, so the hierarchy keeps
+// its own compact copy: the positions and the triangles, nothing else.
+// Models only build one when they're loaded with buildBvh set, see
+// Model::createModelFromFile.
+//
+// The tree is binary and split with the surface area heuristic over a
+// few bins of the triangle centroids. The first splits are made one at
+// a time, after that the subtrees are built in parallel on the thread
+// pool. The triangles are stored in the order of the leaves and the
+// two children of a node are next to each other, so a node is 32 bytes
+// and two siblings share a cache line.
+//**********************************************************************
+
+#pragma once
+
+#include "ThreadPool.h"
+
+#define GLM_FORCE_RADIANS				// All GLM functions will expect angles in radians
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE		// GLM will expect or depth buffer values to range from 0 - 1
+#include <glm/glm.hpp>
+
+// std
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	struct TransformComponent;
+
+	class MeshBvh {
+	public:
+		static constexpr uint32_t BIN_COUNT = 16;
+		// Leaves hold at most this many triangles, unless the heuristic can't separate them
+		static constexpr uint32_t MAX_LEAF_TRIANGLES = 4;
+		// Deep enough for any model we load, the traversal stacks are this size
+		static constexpr uint32_t MAX_DEPTH = 64;
+		static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+
+		struct Node {
+			glm::vec3 min;
+			uint32_t leftFirst;			// The left child of an inner node, the first triangle of a leaf
+			glm::vec3 max;
+			uint32_t triangleCount;		// 0 for inner nodes, the right child is leftFirst + 1
+
+			bool isLeaf() const { return triangleCount != 0; }
+		};
+
+		struct RayHit {
+			float distance{ FLT_MAX };			// Along the ray, in lengths of its direction
+			uint32_t triangle{ NO_TRIANGLE };	// Index of the triangle in the model's full detail level
+			glm::vec2 barycentric{ 0.0f };		// Weights of the triangle's second and third vertex
+			glm::vec3 point{ 0.0f };
+			glm::vec3 normal{ 0.0f };			// Of the triangle, normalized, it may face either way
+		};
+
+		struct ClosestPoint {
+			float distance{ FLT_MAX };
+			uint32_t triangle{ NO_TRIANGLE };
+			glm::vec3 point{ 0.0f };
+		};
+
+		// Copies the positions (vertexCount of them, stride bytes apart) and the triangles out of
+		// the indices, then builds the tree. indexCount has to be a multiple of 3.
+		MeshBvh(const void *positions, size_t stride, uint32_t vertexCount,
+			const uint32_t *indices, uint32_t indexCount, ThreadPool &pool = ThreadPool::shared());
+
+		MeshBvh(const MeshBvh&) = delete;
+		MeshBvh& operator=(const MeshBvh&) = delete;
+
+		// Finds the first triangle the ray hits before maxDistance, both sides of a triangle count.
+		// The ray is in model space, direction doesn't need to be normalized.
+		bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit, float maxDistance = FLT_MAX) const;
+		// The same with a ray in world space, for a model placed by transform. The distance stays
+		// in lengths of the world space direction, the point and normal are in world space.
+		bool raycast(const TransformComponent &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+			RayHit &hit, float maxDistance = FLT_MAX) const;
+
+		// Finds the closest point on the surface that is closer than maxDistance
+		bool findClosestPoint(const glm::vec3 &point, ClosestPoint &result, float maxDistance = FLT_MAX) const;
+		// The same in world space, the distance is measured in world space so scaling is taken into account
+		bool findClosestPoint(const TransformComponent &transform, const glm::vec3 &point,
+			ClosestPoint &result, float maxDistance = FLT_MAX) const;
+
+		uint32_t getTriangleCount() const { return static_cast<uint32_t>(triangles.size()); }
+		uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+		uint32_t getLeafCount() const { return leafCount; }
+		uint32_t getDepth() const { return depth; }
+		const Node& getRoot() const { return nodes[0]; }
+		// Of the positions, triangles and nodes
+		size_t getMemorySize() const;
+
+	private:
+		// Walks the nodes nearest first and calls testTriangle(triangle, bestSquared) for every triangle
+		// of a leaf that could still be closer. Box distances are multiplied by boxScale.
+		template <typename TestTriangle>
+		void findNearest(const glm::vec3 &point, float boxScale, float &bestSquared, const TestTriangle &testTriangle) const;
+
+		std::vector<glm::vec3> positions{};
+		std::vector<glm::uvec3> triangles{};		// In the order of the leaves
+		std::vector<uint32_t> triangleIds{};		// Where each of them is in the model
+		std::vector<Node> nodes{};
+		uint32_t leafCount{ 0 };
+		uint32_t depth{ 0 };
+	};
+}
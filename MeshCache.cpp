@@ -0,0 +1,389 @@
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "ObjParser.h"
+#include "Utils.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace engine {
+	// This is the very start of every cache file. The encoded vertices follow right after
+	// the header, then the encoded indices, the levels of detail, the meshlets, the sub meshes,
+	// the materials and the material libraries, all tightly packed.
+	struct MeshCache::Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceSize;			// Size of the OBJ file in bytes
+		int64_t sourceModifiedTime;		// Last write time of the OBJ file
+		uint64_t sourceHash;			// hashBytes over the whole OBJ file
+		uint64_t sourceNameHash;		// hashBytes over the OBJ file name
+		uint32_t vertexSize;			// sizeof(Model::Vertex) when the file was written
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t lodCount;
+		uint32_t meshletCount;
+		uint32_t subMeshCount;
+		uint32_t materialCount;
+		uint32_t libraryCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint64_t vertexDataSize;		// Of the encoded vertices in bytes
+		uint64_t indexDataSize;			// Of the encoded indices in bytes
+		uint64_t libraryDataSize;		// Of the library records and their names in bytes
+	};
+
+	// One for every mtllib entry, followed by the entry as written in the OBJ file
+	struct MeshCache::LibraryRecord {
+		uint64_t size;					// MISSING_LIBRARY when the file wasn't there
+		int64_t modifiedTime;
+		uint64_t hash;					// hashBytes over the whole file
+		uint32_t nameLength;
+		uint32_t padding;
+	};
+
+	namespace {
+		constexpr uint32_t MAGIC = 0x48534d45;	// "EMSH" in a little endian file
+		constexpr uint64_t MISSING_LIBRARY = UINT64_MAX;
+
+		std::atomic<uint32_t> hits{ 0 };
+		std::atomic<uint32_t> misses{ 0 };
+		std::atomic<uint32_t> writes{ 0 };
+
+		struct SourceInfo {
+			uint64_t size;
+			int64_t modifiedTime;
+			uint64_t nameHash;
+		};
+
+		bool getSourceInfo(const std::string& sourcePath, SourceInfo& info) {
+			VirtualFileSystem::FileInfo file{};
+			if (!VirtualFileSystem::shared().getInfo(sourcePath, file)) return false;
+			info.size = file.size;
+			info.modifiedTime = file.modifiedTime;
+
+			std::string name = std::filesystem::path(sourcePath).filename().string();
+			info.nameHash = hashBytes(name.data(), name.size());
+			return true;
+		}
+
+		uint64_t hashFile(const std::string& filePath) {
+			VirtualFileSystem::File file = VirtualFileSystem::shared().open(filePath);
+			file.waitForAll();
+			return hashBytes(file.data(), file.size());
+		}
+	}
+
+	// Libraries are small, so one whose time changed is simply hashed again every time
+	bool MeshCache::librariesMatch(const std::string& sourcePath, const char* records, uint64_t size, uint32_t count) {
+		const char* end = records + size;
+		for (uint32_t i = 0; i < count; i++) {
+			LibraryRecord record{};
+			if (static_cast<uint64_t>(end - records) < sizeof(LibraryRecord)) return false;
+			std::memcpy(&record, records, sizeof(LibraryRecord));
+			records += sizeof(LibraryRecord);
+			if (static_cast<uint64_t>(end - records) < record.nameLength) return false;
+			std::string libraryPath = ObjParser::getMaterialLibraryPath(sourcePath, std::string(records, record.nameLength));
+			records += record.nameLength;
+
+			VirtualFileSystem::FileInfo info{};
+			bool exists = VirtualFileSystem::shared().getInfo(libraryPath, info);
+			if (!exists || record.size == MISSING_LIBRARY) {
+				if (exists || record.size != MISSING_LIBRARY) return false;
+				continue;
+			}
+			if (info.size != record.size) return false;
+			if (info.modifiedTime != record.modifiedTime && hashFile(libraryPath) != record.hash) return false;
+		}
+		return records == end;
+	}
+
+	std::unique_ptr<MeshCache> MeshCache::open(const std::string& sourcePath) {
+		std::string cachePath = getCachePath(sourcePath);
+		VirtualFileSystem& fileSystem = VirtualFileSystem::shared();
+		VirtualFileSystem::FileInfo cacheInfo{};
+		if (!fileSystem.getInfo(cachePath, cacheInfo)) {
+			misses++;
+			return nullptr;
+		}
+
+		// Meshes cooked into an archive may ship without their source, then they're used as they are
+		SourceInfo source{};
+		bool hasSource = getSourceInfo(sourcePath, source);
+		if (!hasSource && !cacheInfo.inArchive) {
+			misses++;
+			return nullptr;
+		}
+
+		try {
+			VirtualFileSystem::File file = fileSystem.open(cachePath);
+			file.waitForAll();
+			if (file.size() < sizeof(Header)) {
+				misses++;
+				return nullptr;
+			}
+
+			Header header{};
+			std::memcpy(&header, file.data(), sizeof(Header));
+			// The encoded sizes come from the file, so they're checked against its size before adding them up
+			bool sizesFit = header.vertexDataSize <= file.size() && header.indexDataSize <= file.size()
+				&& header.libraryDataSize <= file.size();
+			uint64_t expectedSize = sizeof(Header)
+				+ header.vertexDataSize
+				+ header.indexDataSize
+				+ static_cast<uint64_t>(header.lodCount) * sizeof(Model::Lod)
+				+ static_cast<uint64_t>(header.meshletCount) * sizeof(Model::Meshlet)
+				+ static_cast<uint64_t>(header.subMeshCount) * sizeof(Model::SubMesh)
+				+ static_cast<uint64_t>(header.materialCount) * sizeof(Model::Material)
+				+ header.libraryDataSize;
+			bool valid =
+				header.magic == MAGIC &&
+				header.version == VERSION &&
+				header.vertexSize == sizeof(Model::Vertex) &&
+				sizesFit &&
+				file.size() == expectedSize &&
+				(!hasSource || (header.sourceNameHash == source.nameHash && header.sourceSize == source.size));
+			if (!valid) {
+				misses++;
+				return nullptr;
+			}
+
+			// A library that changed means different materials, whatever the OBJ file says
+			if (hasSource && !librariesMatch(sourcePath, file.data() + expectedSize - header.libraryDataSize,
+				header.libraryDataSize, header.libraryCount)) {
+				misses++;
+				return nullptr;
+			}
+
+			// The file was touched without its size changing, so we only trust
+			// the cache if the contents still hash to the same value
+			if (hasSource && header.sourceModifiedTime != source.modifiedTime) {
+				if (hashFile(sourcePath) != header.sourceHash) {
+					misses++;
+					return nullptr;
+				}
+
+				// Store the new time so the next launch can skip the hashing. The file
+				// has to be unmapped first because Windows won't let us write to it otherwise.
+				// Archives are never written to, they simply get hashed every time.
+				if (!cacheInfo.inArchive) {
+					file = VirtualFileSystem::File{};
+					std::fstream patch{ cachePath, std::ios::binary | std::ios::in | std::ios::out };
+					if (patch) {
+						patch.seekp(offsetof(Header, sourceModifiedTime));
+						patch.write(reinterpret_cast<const char*>(&source.modifiedTime), sizeof(source.modifiedTime));
+					}
+					patch.close();
+					file = fileSystem.open(cachePath);
+					if (file.size() != expectedSize) {
+						misses++;
+						return nullptr;
+					}
+				}
+			}
+
+			hits++;
+			return std::make_unique<MeshCache>(std::move(file));
+		}
+		catch (const std::runtime_error&) {
+			misses++;
+			return nullptr;
+		}
+	}
+
+	bool MeshCache::write(const std::string& sourcePath, const Model::Builder& builder) {
+		SourceInfo source{};
+		if (!getSourceInfo(sourcePath, source)) return false;
+
+		Header header{};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.sourceSize = source.size;
+		header.sourceModifiedTime = source.modifiedTime;
+		header.sourceNameHash = source.nameHash;
+		header.vertexSize = sizeof(Model::Vertex);
+		header.vertexCount = static_cast<uint32_t>(builder.vertices.size());
+		header.indexCount = static_cast<uint32_t>(builder.indices.size());
+		header.lodCount = static_cast<uint32_t>(builder.lods.size());
+		header.meshletCount = static_cast<uint32_t>(builder.meshlets.size());
+		header.subMeshCount = static_cast<uint32_t>(builder.subMeshes.size());
+		header.materialCount = static_cast<uint32_t>(builder.materials.size());
+		header.libraryCount = static_cast<uint32_t>(builder.materialLibraries.size());
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = builder.bounds.min[i];
+			header.boundsMax[i] = builder.bounds.max[i];
+		}
+
+		std::string cachePath = getCachePath(sourcePath);
+		std::string tempPath = cachePath + ".tmp";
+		try {
+			header.sourceHash = hashFile(sourcePath);
+
+			std::vector<uint8_t> vertexData = MeshCodec::encodeVertices(
+				builder.vertices.data(), builder.vertices.size(), sizeof(Model::Vertex));
+			std::vector<uint8_t> indexData = MeshCodec::encodeIndices(builder.indices.data(), builder.indices.size());
+			header.vertexDataSize = vertexData.size();
+			header.indexDataSize = indexData.size();
+
+			std::vector<char> libraryData{};
+			for (const std::string& library : builder.materialLibraries) {
+				std::string libraryPath = ObjParser::getMaterialLibraryPath(sourcePath, library);
+				LibraryRecord record{};
+				record.size = MISSING_LIBRARY;
+				record.nameLength = static_cast<uint32_t>(library.size());
+				VirtualFileSystem::FileInfo info{};
+				if (VirtualFileSystem::shared().getInfo(libraryPath, info)) {
+					record.size = info.size;
+					record.modifiedTime = info.modifiedTime;
+					record.hash = hashFile(libraryPath);
+				}
+				const char* bytes = reinterpret_cast<const char*>(&record);
+				libraryData.insert(libraryData.end(), bytes, bytes + sizeof(record));
+				libraryData.insert(libraryData.end(), library.begin(), library.end());
+			}
+			header.libraryDataSize = libraryData.size();
+
+			// We write to a temporary file and rename it afterwards so a crash
+			// half way through can never leave a broken cache file behind
+			{
+				std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+				if (!out) return false;
+				out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				out.write(reinterpret_cast<const char*>(vertexData.data()), vertexData.size());
+				out.write(reinterpret_cast<const char*>(indexData.data()), indexData.size());
+				out.write(reinterpret_cast<const char*>(builder.lods.data()),
+					builder.lods.size() * sizeof(Model::Lod));
+				out.write(reinterpret_cast<const char*>(builder.meshlets.data()),
+					builder.meshlets.size() * sizeof(Model::Meshlet));
+				out.write(reinterpret_cast<const char*>(builder.subMeshes.data()),
+					builder.subMeshes.size() * sizeof(Model::SubMesh));
+				out.write(reinterpret_cast<const char*>(builder.materials.data()),
+					builder.materials.size() * sizeof(Model::Material));
+				out.write(libraryData.data(), libraryData.size());
+				if (!out) {
+					out.close();
+					std::error_code error;
+					std::filesystem::remove(tempPath, error);
+					return false;
+				}
+			}
+
+			std::error_code error;
+			std::filesystem::rename(tempPath, cachePath, error);
+			if (error) {
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+		catch (const std::exception&) {
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		writes++;
+		return true;
+	}
+
+	std::string MeshCache::getCachePath(const std::string& sourcePath) {
+		return sourcePath + ".mesh";
+	}
+
+	MeshCache::Stats MeshCache::getStats() {
+		return { hits.load(), misses.load(), writes.load() };
+	}
+
+	void MeshCache::resetStats() {
+		hits = 0;
+		misses = 0;
+		writes = 0;
+	}
+
+	MeshCache::MeshCache(VirtualFileSystem::File&& file) : file{ std::move(file) } {}
+
+	const MeshCache::Header& MeshCache::header() const {
+		static_assert(sizeof(Header) == 120, "The mesh cache header must not change size by accident");
+		return *reinterpret_cast<const Header*>(file.data());
+	}
+
+	const char* MeshCache::getModelData() const {
+		return file.data() + sizeof(Header) + header().vertexDataSize + header().indexDataSize;
+	}
+
+	void MeshCache::writeVertices(Model::Vertex* destination) const {
+		MeshCodec::decodeVertices(destination, header().vertexCount, sizeof(Model::Vertex),
+			reinterpret_cast<const uint8_t*>(file.data() + sizeof(Header)), header().vertexDataSize);
+	}
+
+	void MeshCache::writeVertices(const Model::VertexStreams& streams) const {
+		Model::BoundingBox bounds = getBoundingBox();
+		MeshCodec::decodeVertexBlocks([&](const uint8_t* block, size_t first, size_t count) {
+				streams.encode(first, reinterpret_cast<const Model::Vertex*>(block), count, bounds);
+			},
+			header().vertexCount, sizeof(Model::Vertex),
+			reinterpret_cast<const uint8_t*>(file.data() + sizeof(Header)), header().vertexDataSize);
+	}
+
+	uint32_t MeshCache::getVertexCount() const {
+		return header().vertexCount;
+	}
+
+	void MeshCache::writeIndices(void* destination, VkIndexType indexType) const {
+		size_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		MeshCodec::decodeIndices(destination, header().indexCount, indexSize,
+			reinterpret_cast<const uint8_t*>(file.data() + sizeof(Header) + header().vertexDataSize),
+			header().indexDataSize);
+	}
+
+	uint32_t MeshCache::getIndexCount() const {
+		return header().indexCount;
+	}
+
+	uint64_t MeshCache::getEncodedSize() const {
+		return header().vertexDataSize + header().indexDataSize;
+	}
+
+	std::vector<Model::Lod> MeshCache::getLods() const {
+		std::vector<Model::Lod> lods(header().lodCount);
+		std::memcpy(lods.data(), getModelData(), lods.size() * sizeof(Model::Lod));
+		return lods;
+	}
+
+	std::vector<Model::Meshlet> MeshCache::getMeshlets() const {
+		std::vector<Model::Meshlet> meshlets(header().meshletCount);
+		std::memcpy(meshlets.data(),
+			getModelData() + header().lodCount * sizeof(Model::Lod),
+			meshlets.size() * sizeof(Model::Meshlet));
+		return meshlets;
+	}
+
+	std::vector<Model::SubMesh> MeshCache::getSubMeshes() const {
+		std::vector<Model::SubMesh> subMeshes(header().subMeshCount);
+		std::memcpy(subMeshes.data(),
+			getModelData() + header().lodCount * sizeof(Model::Lod) + header().meshletCount * sizeof(Model::Meshlet),
+			subMeshes.size() * sizeof(Model::SubMesh));
+		return subMeshes;
+	}
+
+	std::vector<Model::Material> MeshCache::getMaterials() const {
+		std::vector<Model::Material> materials(header().materialCount);
+		std::memcpy(materials.data(),
+			getModelData() + header().lodCount * sizeof(Model::Lod) + header().meshletCount * sizeof(Model::Meshlet)
+				+ header().subMeshCount * sizeof(Model::SubMesh),
+			materials.size() * sizeof(Model::Material));
+		return materials;
+	}
+
+	Model::BoundingBox MeshCache::getBoundingBox() const {
+		Model::BoundingBox bounds{};
+		bounds.min = { header().boundsMin[0], header().boundsMin[1], header().boundsMin[2] };
+		bounds.max = { header().boundsMax[0], header().boundsMax[1], header().boundsMax[2] };
+		return bounds;
+	}
+}
@@ -0,0 +1,90 @@
+//**********************************************************************
+// The mesh cache stores the finished, de-duplicated vertices and
+// indices of a model in a small binary file right next to the OBJ
+// file (Koenigsegg.obj gets Koenigsegg.obj.mesh). On the next launch
+// the cache file is memory mapped and its vertices and indices are
+// decoded straight into the staging buffers, so no parsing or
+// de-duplication happens. They're stored encoded with the MeshCodec,
+// which makes the file about half the size.
+// A cache file is only used when it was written by the same format
+// version for the same source file name, size and modification time.
+// If only the modification time differs (a fresh checkout for example)
+// the contents of the source are hashed and compared instead. The
+// materials come from the OBJ's mtllib files, so the size, time and
+// hash of each library are stored too and a changed library is a miss.
+// Cache files are opened through the VirtualFileSystem, which is how
+// the meshes the AssetPacker cooked into a packed archive get loaded.
+// Those are trusted even when their source isn't shipped alongside.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class MeshCache {
+	public:
+		// Bump this whenever the file layout, the contents of Model::Vertex or the
+		// processing done before the cache is written change
+		// 2: vertices and indices are run through the MeshOptimizer
+		// 3: the levels of detail are stored after the indices
+		// 4: the meshlets are stored after the levels of detail
+		// 5: the sub meshes and materials are stored after the meshlets
+		// 6: the vertices and indices are encoded with the MeshCodec
+		// 7: the material libraries are stored after the materials
+		static constexpr uint32_t VERSION = 7;
+
+		struct Stats {
+			uint32_t hits{ 0 };
+			uint32_t misses{ 0 };
+			uint32_t writes{ 0 };
+		};
+
+		// Returns nullptr when there is no usable cache file for the source
+		static std::unique_ptr<MeshCache> open(const std::string& sourcePath);
+
+		// Writes the cache file for the source. Failing to write it is not an error,
+		// the model simply gets parsed again on the next launch.
+		static bool write(const std::string& sourcePath, const Model::Builder& builder);
+
+		static std::string getCachePath(const std::string& sourcePath);
+		static Stats getStats();
+		static void resetStats();
+
+		explicit MeshCache(VirtualFileSystem::File&& file);
+
+		// Decodes getVertexCount() standard vertices into destination
+		void writeVertices(Model::Vertex* destination) const;
+		// Decodes them a block at a time, converts them to the streams' format and writes them out
+		void writeVertices(const Model::VertexStreams& streams) const;
+		uint32_t getVertexCount() const;
+		// Decodes getIndexCount() indices of the given type into destination
+		void writeIndices(void* destination, VkIndexType indexType) const;
+		uint32_t getIndexCount() const;
+		// Of the vertices and indices together, as they are stored in the file
+		uint64_t getEncodedSize() const;
+		Model::BoundingBox getBoundingBox() const;
+		std::vector<Model::Lod> getLods() const;
+		std::vector<Model::Meshlet> getMeshlets() const;
+		std::vector<Model::SubMesh> getSubMeshes() const;
+		std::vector<Model::Material> getMaterials() const;
+
+	private:
+		struct Header;
+		struct LibraryRecord;
+
+		static bool librariesMatch(const std::string& sourcePath, const char* records, uint64_t size, uint32_t count);
+		const Header& header() const;
+		// Where the levels of detail start, the rest of the model follows them
+		const char* getModelData() const;
+
+		VirtualFileSystem::File file;
+	};
+}
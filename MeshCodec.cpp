@@ -0,0 +1,517 @@
+#include "MeshCodec.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MESH_CODEC_SSE2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define MESH_CODEC_AVX2_FUNCTION
+	#else
+		// GCC and Clang only emit AVX2 instructions in functions that ask for them
+		#define MESH_CODEC_AVX2_FUNCTION __attribute__((target("avx2")))
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define MESH_CODEC_NEON
+	#include <arm_neon.h>
+#endif
+
+namespace engine {
+	namespace {
+		constexpr size_t GROUP_SIZE = 16;
+		// Every group fits in one 16 byte register, so the buffers are aligned for those
+		constexpr size_t ROW_ALIGNMENT = 32;
+
+		// The first byte of every stream, so vertices can't be decoded as indices or the other
+		// way around, and data from a later version of the format is refused
+		constexpr uint8_t VERTEX_STREAM = 0xA1;
+		constexpr uint8_t INDEX_STREAM = 0xB1;
+
+		// The payload bytes of a group of 16 values stored with 0, 2, 4 or 8 bits each
+		constexpr size_t MODE_BYTES[4] = { 0, 4, 8, 16 };
+
+		uint8_t zigzag(uint8_t value) {
+			return static_cast<uint8_t>((value << 1) ^ (static_cast<int8_t>(value) >> 7));
+		}
+
+		uint8_t unzigzag(uint8_t value) {
+			return static_cast<uint8_t>((value >> 1) ^ (0 - (value & 1)));
+		}
+
+		uint32_t zigzag32(uint32_t value) {
+			return (value << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(value) >> 31);
+		}
+
+		uint32_t unzigzag32(uint32_t value) {
+			return (value >> 1) ^ (0 - (value & 1));
+		}
+
+		// The bytes of one block that share a position in the vertex. One row per byte of a
+		// 4 byte chunk, which is how much of the vertex is put back together at once.
+		struct alignas(ROW_ALIGNMENT) Rows {
+			uint8_t row[MeshCodec::STRIDE_ALIGNMENT][MeshCodec::BLOCK_VERTICES];
+		};
+
+		void encodeStream(std::vector<uint8_t> &out, uint8_t streamType, const uint8_t *vertices, size_t count, size_t stride) {
+			if (stride == 0 || stride % MeshCodec::STRIDE_ALIGNMENT != 0 || stride > MeshCodec::MAX_STRIDE) {
+				throw std::runtime_error("The mesh codec needs a vertex size that is a multiple of 4 and at most 256 bytes");
+			}
+			out.push_back(streamType);
+
+			std::vector<uint8_t> previous(stride, 0);
+			uint8_t values[MeshCodec::BLOCK_VERTICES];
+			for (size_t first = 0; first < count; first += MeshCodec::BLOCK_VERTICES) {
+				size_t blockCount = std::min(MeshCodec::BLOCK_VERTICES, count - first);
+				size_t groupCount = (blockCount + GROUP_SIZE - 1) / GROUP_SIZE;
+				for (size_t byte = 0; byte < stride; byte++) {
+					std::memset(values, 0, sizeof(values));
+					for (size_t i = 0; i < blockCount; i++) {
+						uint8_t value = vertices[(first + i) * stride + byte];
+						values[i] = zigzag(static_cast<uint8_t>(value - previous[byte]));
+						previous[byte] = value;
+					}
+
+					// The modes of 4 groups share a byte, then come the groups themselves
+					size_t modeOffset = out.size();
+					out.resize(out.size() + (groupCount + 3) / 4, 0);
+					for (size_t group = 0; group < groupCount; group++) {
+						const uint8_t *groupValues = values + group * GROUP_SIZE;
+						uint8_t largest = *std::max_element(groupValues, groupValues + GROUP_SIZE);
+						uint32_t mode = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+						out[modeOffset + group / 4] |= static_cast<uint8_t>(mode << (group % 4 * 2));
+
+						// The first value of a byte goes into its highest bits
+						size_t payload = out.size();
+						out.resize(out.size() + MODE_BYTES[mode], 0);
+						for (size_t i = 0; i < GROUP_SIZE && mode != 0; i++) {
+							if (mode == 1) out[payload + i / 4] |= static_cast<uint8_t>(groupValues[i] << (6 - i % 4 * 2));
+							else if (mode == 2) out[payload + i / 2] |= static_cast<uint8_t>(groupValues[i] << (4 - i % 2 * 4));
+							else out[payload + i] = groupValues[i];
+						}
+					}
+				}
+			}
+		}
+
+		// The parts of the decoder that have a version for every instruction set.
+		// Unpacks the groups of one byte of the vertex into a row.
+		using UnpackGroups = void (*)(const uint8_t *modes, const uint8_t *payload, size_t groupCount, uint8_t *row);
+		// Turns the rows back into the 4 bytes at offset of vertexCount vertices in block.
+		// carry holds the bytes of the vertex before the block. vertexCount is a multiple of 16
+		// and may go past the real vertices, the rows and block have room for that.
+		using Reconstruct = void (*)(const Rows &rows, size_t vertexCount, uint8_t *block, size_t stride,
+			size_t offset, uint32_t carry);
+
+		void unpackGroupsScalar(const uint8_t *modes, const uint8_t *payload, size_t groupCount, uint8_t *row) {
+			for (size_t group = 0; group < groupCount; group++) {
+				uint32_t mode = (modes[group / 4] >> (group % 4 * 2)) & 3;
+				uint8_t *out = row + group * GROUP_SIZE;
+				for (size_t i = 0; i < GROUP_SIZE; i++) {
+					if (mode == 0) out[i] = 0;
+					else if (mode == 1) out[i] = (payload[i / 4] >> (6 - i % 4 * 2)) & 3;
+					else if (mode == 2) out[i] = (payload[i / 2] >> (4 - i % 2 * 4)) & 15;
+					else out[i] = payload[i];
+				}
+				payload += MODE_BYTES[mode];
+			}
+		}
+
+		void reconstructScalar(const Rows &rows, size_t vertexCount, uint8_t *block, size_t stride,
+			size_t offset, uint32_t carry) {
+			uint8_t previous[4];
+			std::memcpy(previous, &carry, 4);
+			for (size_t i = 0; i < vertexCount; i++) {
+				for (size_t byte = 0; byte < 4; byte++) {
+					previous[byte] = static_cast<uint8_t>(previous[byte] + unzigzag(rows.row[byte][i]));
+				}
+				std::memcpy(block + i * stride + offset, previous, 4);
+			}
+		}
+
+	#ifdef MESH_CODEC_SSE2
+		void unpackGroupsSse2(const uint8_t *modes, const uint8_t *payload, size_t groupCount, uint8_t *row) {
+			const __m128i lowNibbles = _mm_set1_epi8(15);
+			const __m128i lowPairs = _mm_set1_epi8(3);
+			for (size_t group = 0; group < groupCount; group++) {
+				uint32_t mode = (modes[group / 4] >> (group % 4 * 2)) & 3;
+				__m128i values;
+				if (mode == 0) {
+					values = _mm_setzero_si128();
+				}
+				else if (mode == 3) {
+					values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(payload));
+				}
+				else {
+					// Shifting 16 bit lanes moves the high nibble of every byte into its low nibble, and
+					// interleaving that with the original bytes puts the high nibble first
+					__m128i bytes;
+					if (mode == 2) {
+						bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(payload));
+					}
+					else {
+						int32_t word;
+						std::memcpy(&word, payload, 4);
+						bytes = _mm_cvtsi32_si128(word);
+					}
+					__m128i nibbles = _mm_unpacklo_epi8(_mm_srli_epi16(bytes, 4), bytes);
+					if (mode == 2) {
+						values = _mm_and_si128(nibbles, lowNibbles);
+					}
+					else {
+						// The same again to split every nibble into two pairs of bits
+						values = _mm_and_si128(_mm_unpacklo_epi8(_mm_srli_epi16(nibbles, 2), nibbles), lowPairs);
+					}
+				}
+				_mm_store_si128(reinterpret_cast<__m128i*>(row + group * GROUP_SIZE), values);
+				payload += MODE_BYTES[mode];
+			}
+		}
+
+		inline __m128i unzigzagSse2(__m128i values) {
+			__m128i half = _mm_and_si128(_mm_srli_epi16(values, 1), _mm_set1_epi8(0x7F));
+			__m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(values, _mm_set1_epi8(1)));
+			return _mm_xor_si128(half, sign);
+		}
+
+		inline void storeWordsSse2(__m128i words, uint8_t *out, size_t stride) {
+			for (int i = 0; i < 4; i++) {
+				int32_t word = _mm_cvtsi128_si32(words);
+				std::memcpy(out + i * stride, &word, 4);
+				words = _mm_srli_si128(words, 4);
+			}
+		}
+
+		void reconstructSse2(const Rows &rows, size_t vertexCount, uint8_t *block, size_t stride,
+			size_t offset, uint32_t carry) {
+			__m128i previous = _mm_set1_epi32(static_cast<int32_t>(carry));
+			for (size_t i = 0; i < vertexCount; i += 16) {
+				__m128i row0 = unzigzagSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(rows.row[0] + i)));
+				__m128i row1 = unzigzagSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(rows.row[1] + i)));
+				__m128i row2 = unzigzagSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(rows.row[2] + i)));
+				__m128i row3 = unzigzagSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(rows.row[3] + i)));
+
+				// Transposes the 4 rows of 16 bytes into 16 words of 4 bytes, one per vertex
+				__m128i low01 = _mm_unpacklo_epi8(row0, row1);
+				__m128i high01 = _mm_unpackhi_epi8(row0, row1);
+				__m128i low23 = _mm_unpacklo_epi8(row2, row3);
+				__m128i high23 = _mm_unpackhi_epi8(row2, row3);
+				__m128i words[4] = {
+					_mm_unpacklo_epi16(low01, low23),
+					_mm_unpackhi_epi16(low01, low23),
+					_mm_unpacklo_epi16(high01, high23),
+					_mm_unpackhi_epi16(high01, high23)
+				};
+
+				// A running sum of the differences over the vertices, byte by byte
+				for (int j = 0; j < 4; j++) {
+					__m128i sum = _mm_add_epi8(words[j], _mm_slli_si128(words[j], 4));
+					sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 8));
+					sum = _mm_add_epi8(sum, previous);
+					previous = _mm_shuffle_epi32(sum, 0xFF);
+					storeWordsSse2(sum, block + (i + j * 4) * stride + offset, stride);
+				}
+			}
+		}
+
+		MESH_CODEC_AVX2_FUNCTION
+		void reconstructAvx2(const Rows &rows, size_t vertexCount, uint8_t *block, size_t stride,
+			size_t offset, uint32_t carry) {
+			const __m256i lowBits = _mm256_set1_epi8(1);
+			const __m256i highBits = _mm256_set1_epi8(0x7F);
+			const __m256i lastWord = _mm256_set1_epi32(7);
+			__m256i previous = _mm256_set1_epi32(static_cast<int32_t>(carry));
+			for (size_t i = 0; i < vertexCount; i += 32) {
+				__m256i row[4];
+				for (int j = 0; j < 4; j++) {
+					__m256i values = _mm256_load_si256(reinterpret_cast<const __m256i*>(rows.row[j] + i));
+					row[j] = _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(values, 1), highBits),
+						_mm256_sub_epi8(_mm256_setzero_si256(), _mm256_and_si256(values, lowBits)));
+				}
+
+				// The unpacks stay inside their 128 bit lanes, so the lanes hold vertices 0-15 and 16-31
+				__m256i low01 = _mm256_unpacklo_epi8(row[0], row[1]);
+				__m256i high01 = _mm256_unpackhi_epi8(row[0], row[1]);
+				__m256i low23 = _mm256_unpacklo_epi8(row[2], row[3]);
+				__m256i high23 = _mm256_unpackhi_epi8(row[2], row[3]);
+				__m256i words0 = _mm256_unpacklo_epi16(low01, low23);		// 0-3 and 16-19
+				__m256i words1 = _mm256_unpackhi_epi16(low01, low23);		// 4-7 and 20-23
+				__m256i words2 = _mm256_unpacklo_epi16(high01, high23);		// 8-11 and 24-27
+				__m256i words3 = _mm256_unpackhi_epi16(high01, high23);		// 12-15 and 28-31
+				__m256i words[4] = {
+					_mm256_permute2x128_si256(words0, words1, 0x20),
+					_mm256_permute2x128_si256(words2, words3, 0x20),
+					_mm256_permute2x128_si256(words0, words1, 0x31),
+					_mm256_permute2x128_si256(words2, words3, 0x31)
+				};
+
+				for (int j = 0; j < 4; j++) {
+					__m256i sum = _mm256_add_epi8(words[j], _mm256_slli_si256(words[j], 4));
+					sum = _mm256_add_epi8(sum, _mm256_slli_si256(sum, 8));
+					// The upper lane still needs the total of the lower one
+					__m256i lowerTotal = _mm256_shuffle_epi32(sum, 0xFF);
+					sum = _mm256_add_epi8(sum, _mm256_permute2x128_si256(lowerTotal, lowerTotal, 0x08));
+					sum = _mm256_add_epi8(sum, previous);
+					previous = _mm256_permutevar8x32_epi32(sum, lastWord);
+
+					uint8_t *out = block + (i + j * 8) * stride + offset;
+					storeWordsSse2(_mm256_castsi256_si128(sum), out, stride);
+					storeWordsSse2(_mm256_extracti128_si256(sum, 1), out + 4 * stride, stride);
+				}
+			}
+		}
+
+		bool hasAvx2() {
+		#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			// The OS has to save the upper halves of the registers too
+			bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+			if (!osSavesAvx || (info[2] & (1 << 28)) == 0) return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		#else
+			return __builtin_cpu_supports("avx2");
+		#endif
+		}
+	#endif
+
+	#ifdef MESH_CODEC_NEON
+		void unpackGroupsNeon(const uint8_t *modes, const uint8_t *payload, size_t groupCount, uint8_t *row) {
+			for (size_t group = 0; group < groupCount; group++) {
+				uint32_t mode = (modes[group / 4] >> (group % 4 * 2)) & 3;
+				uint8x16_t values;
+				if (mode == 0) {
+					values = vdupq_n_u8(0);
+				}
+				else if (mode == 3) {
+					values = vld1q_u8(payload);
+				}
+				else {
+					// Splits every byte into its two nibbles, the high one first
+					uint64_t word = 0;
+					std::memcpy(&word, payload, mode == 2 ? 8 : 4);
+					uint8x8_t bytes = vcreate_u8(word);
+					uint8x8x2_t nibbles = vzip_u8(vshr_n_u8(bytes, 4), vand_u8(bytes, vdup_n_u8(15)));
+					if (mode == 2) {
+						values = vcombine_u8(nibbles.val[0], nibbles.val[1]);
+					}
+					else {
+						// The same again to split every nibble into two pairs of bits
+						uint8x8x2_t pairs = vzip_u8(vshr_n_u8(nibbles.val[0], 2), vand_u8(nibbles.val[0], vdup_n_u8(3)));
+						values = vcombine_u8(pairs.val[0], pairs.val[1]);
+					}
+				}
+				vst1q_u8(row + group * GROUP_SIZE, values);
+				payload += MODE_BYTES[mode];
+			}
+		}
+
+		void reconstructNeon(const Rows &rows, size_t vertexCount, uint8_t *block, size_t stride,
+			size_t offset, uint32_t carry) {
+			const uint8x16_t zero = vdupq_n_u8(0);
+			const uint8x16_t one = vdupq_n_u8(1);
+			uint32x4_t previous = vdupq_n_u32(carry);
+			for (size_t i = 0; i < vertexCount; i += 16) {
+				uint8x16_t row[4];
+				for (int j = 0; j < 4; j++) {
+					uint8x16_t values = vld1q_u8(rows.row[j] + i);
+					uint8x16_t sign = vreinterpretq_u8_s8(vnegq_s8(vreinterpretq_s8_u8(vandq_u8(values, one))));
+					row[j] = veorq_u8(vshrq_n_u8(values, 1), sign);
+				}
+
+				uint8x16_t low01 = vzip1q_u8(row[0], row[1]);
+				uint8x16_t high01 = vzip2q_u8(row[0], row[1]);
+				uint8x16_t low23 = vzip1q_u8(row[2], row[3]);
+				uint8x16_t high23 = vzip2q_u8(row[2], row[3]);
+				uint8x16_t words[4] = {
+					vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(low01), vreinterpretq_u16_u8(low23))),
+					vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(low01), vreinterpretq_u16_u8(low23))),
+					vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(high01), vreinterpretq_u16_u8(high23))),
+					vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(high01), vreinterpretq_u16_u8(high23)))
+				};
+
+				for (int j = 0; j < 4; j++) {
+					uint8x16_t sum = vaddq_u8(words[j], vextq_u8(zero, words[j], 12));
+					sum = vaddq_u8(sum, vextq_u8(zero, sum, 8));
+					sum = vaddq_u8(sum, vreinterpretq_u8_u32(previous));
+					previous = vdupq_laneq_u32(vreinterpretq_u32_u8(sum), 3);
+
+					uint32_t out[4];
+					vst1q_u32(out, vreinterpretq_u32_u8(sum));
+					for (int k = 0; k < 4; k++) std::memcpy(block + (i + j * 4 + k) * stride + offset, &out[k], 4);
+				}
+			}
+		}
+	#endif
+
+		struct Kernels {
+			UnpackGroups unpack;
+			Reconstruct reconstruct;
+			size_t vertexStep;		// reconstruct works on multiples of this
+		};
+
+		Kernels getKernels(MeshCodec::Decoder decoder) {
+			if (!MeshCodec::isSupported(decoder)) throw std::runtime_error(std::string("The ") +
+				MeshCodec::getName(decoder) + " mesh decoder isn't supported on this CPU");
+			switch (decoder) {
+		#ifdef MESH_CODEC_SSE2
+			case MeshCodec::Decoder::Sse2: return { unpackGroupsSse2, reconstructSse2, 16 };
+			case MeshCodec::Decoder::Avx2: return { unpackGroupsSse2, reconstructAvx2, 32 };
+		#endif
+		#ifdef MESH_CODEC_NEON
+			case MeshCodec::Decoder::Neon: return { unpackGroupsNeon, reconstructNeon, 16 };
+		#endif
+			default: return { unpackGroupsScalar, reconstructScalar, 16 };
+			}
+		}
+
+		// Decodes the stream a block at a time and hands every block to writeBlock(block, first, count)
+		template <typename WriteBlock>
+		void decodeStream(uint8_t streamType, const uint8_t *data, size_t size, size_t count, size_t stride,
+			MeshCodec::Decoder decoder, const WriteBlock &writeBlock) {
+			if (stride == 0 || stride % MeshCodec::STRIDE_ALIGNMENT != 0 || stride > MeshCodec::MAX_STRIDE) {
+				throw std::runtime_error("The mesh codec needs a vertex size that is a multiple of 4 and at most 256 bytes");
+			}
+			auto corrupted = []() { return std::runtime_error("The encoded mesh data is corrupted"); };
+			const uint8_t *end = data + size;
+			if (size == 0 || *data++ != streamType) throw corrupted();
+
+			Kernels kernels = getKernels(decoder);
+			Rows rows{};
+			std::vector<uint8_t> block(MeshCodec::BLOCK_VERTICES * stride);
+			std::vector<uint32_t> carry(stride / 4, 0);
+			for (size_t first = 0; first < count; first += MeshCodec::BLOCK_VERTICES) {
+				size_t blockCount = std::min(MeshCodec::BLOCK_VERTICES, count - first);
+				size_t groupCount = (blockCount + GROUP_SIZE - 1) / GROUP_SIZE;
+				size_t modeBytes = (groupCount + 3) / 4;
+				size_t vertexCount = (blockCount + kernels.vertexStep - 1) / kernels.vertexStep * kernels.vertexStep;
+
+				for (size_t chunk = 0; chunk < stride / 4; chunk++) {
+					for (size_t byte = 0; byte < 4; byte++) {
+						if (static_cast<size_t>(end - data) < modeBytes) throw corrupted();
+						const uint8_t *modes = data;
+						data += modeBytes;
+						size_t payloadBytes = 0;
+						for (size_t group = 0; group < groupCount; group++) {
+							payloadBytes += MODE_BYTES[(modes[group / 4] >> (group % 4 * 2)) & 3];
+						}
+						if (static_cast<size_t>(end - data) < payloadBytes) throw corrupted();
+						kernels.unpack(modes, data, groupCount, rows.row[byte]);
+						data += payloadBytes;
+					}
+					kernels.reconstruct(rows, vertexCount, block.data(), stride, chunk * 4, carry[chunk]);
+					std::memcpy(&carry[chunk], &block[(blockCount - 1) * stride + chunk * 4], 4);
+				}
+				writeBlock(block.data(), first, blockCount);
+			}
+			if (data != end) throw corrupted();
+		}
+	}
+
+	std::vector<uint8_t> MeshCodec::encodeVertices(const void *vertices, size_t count, size_t stride) {
+		std::vector<uint8_t> out{};
+		out.reserve(count * stride / 2 + 1);
+		encodeStream(out, VERTEX_STREAM, static_cast<const uint8_t*>(vertices), count, stride);
+		out.shrink_to_fit();
+		return out;
+	}
+
+	void MeshCodec::decodeVertices(void *destination, size_t count, size_t stride,
+		const uint8_t *data, size_t size, Decoder decoder) {
+		uint8_t *out = static_cast<uint8_t*>(destination);
+		decodeStream(VERTEX_STREAM, data, size, count, stride, decoder, [&](const uint8_t *block, size_t first, size_t blockCount) {
+			std::memcpy(out + first * stride, block, blockCount * stride);
+		});
+	}
+
+	void MeshCodec::decodeVertexBlocks(const BlockWriter &writeBlock, size_t count, size_t stride,
+		const uint8_t *data, size_t size, Decoder decoder) {
+		decodeStream(VERTEX_STREAM, data, size, count, stride, decoder, writeBlock);
+	}
+
+	std::vector<uint8_t> MeshCodec::encodeIndices(const uint32_t *indices, size_t count) {
+		// After the MeshOptimizer neighbouring triangles share vertices, so the
+		// differences between neighbouring indices are small
+		std::vector<uint32_t> differences(count);
+		uint32_t previous = 0;
+		for (size_t i = 0; i < count; i++) {
+			differences[i] = zigzag32(indices[i] - previous);
+			previous = indices[i];
+		}
+		std::vector<uint8_t> out{};
+		out.reserve(count + 1);
+		encodeStream(out, INDEX_STREAM, reinterpret_cast<const uint8_t*>(differences.data()), count, sizeof(uint32_t));
+		out.shrink_to_fit();
+		return out;
+	}
+
+	void MeshCodec::decodeIndices(void *destination, size_t count, size_t indexSize,
+		const uint8_t *data, size_t size, Decoder decoder) {
+		if (indexSize != sizeof(uint16_t) && indexSize != sizeof(uint32_t)) {
+			throw std::runtime_error("Indices are either 2 or 4 bytes");
+		}
+		uint32_t previous = 0;
+		decodeStream(INDEX_STREAM, data, size, count, sizeof(uint32_t), decoder, [&](const uint8_t *block, size_t first, size_t blockCount) {
+			uint32_t differences[BLOCK_VERTICES];
+			std::memcpy(differences, block, blockCount * sizeof(uint32_t));
+			if (indexSize == sizeof(uint16_t)) {
+				uint16_t indices[BLOCK_VERTICES];
+				for (size_t i = 0; i < blockCount; i++) {
+					previous += unzigzag32(differences[i]);
+					indices[i] = static_cast<uint16_t>(previous);
+				}
+				std::memcpy(static_cast<uint16_t*>(destination) + first, indices, blockCount * sizeof(uint16_t));
+			}
+			else {
+				for (size_t i = 0; i < blockCount; i++) {
+					previous += unzigzag32(differences[i]);
+					differences[i] = previous;
+				}
+				std::memcpy(static_cast<uint32_t*>(destination) + first, differences, blockCount * sizeof(uint32_t));
+			}
+		});
+	}
+
+	MeshCodec::Decoder MeshCodec::getBestDecoder() {
+		static const Decoder best = []() {
+			if (isSupported(Decoder::Avx2)) return Decoder::Avx2;
+			if (isSupported(Decoder::Sse2)) return Decoder::Sse2;
+			if (isSupported(Decoder::Neon)) return Decoder::Neon;
+			return Decoder::Scalar;
+		}();
+		return best;
+	}
+
+	bool MeshCodec::isSupported(Decoder decoder) {
+		switch (decoder) {
+		case Decoder::Scalar: return true;
+	#ifdef MESH_CODEC_SSE2
+		case Decoder::Sse2: return true;
+		case Decoder::Avx2: {
+			static const bool avx2 = hasAvx2();
+			return avx2;
+		}
+	#endif
+	#ifdef MESH_CODEC_NEON
+		case Decoder::Neon: return true;
+	#endif
+		default: return false;
+		}
+	}
+
+	const char* MeshCodec::getName(Decoder decoder) {
+		switch (decoder) {
+		case Decoder::Sse2: return "SSE2";
+		case Decoder::Avx2: return "AVX2";
+		case Decoder::Neon: return "NEON";
+		default: return "scalar";
+		}
+	}
+}
@@ -0,0 +1,69 @@
+//**********************************************************************
+// The mesh codec shrinks vertex and index data for the mesh cache, and
+// for anything else that keeps geometry around before uploading it, in
+// the style of the meshoptimizer codecs. Vertices are split into blocks
+// of up to 256 and every byte of the vertex is encoded on its own: its
+// difference to the same byte of the previous vertex is zigzag encoded
+// (small negative differences become small numbers) and the results
+// are stored in groups of 16 with 0, 2, 4 or 8 bits each. Neighbouring
+// vertices are usually close, so most groups need only a few bits. The
+// indices are turned into zigzag encoded differences to the previous
+// index first and then encoded the same way, as 4 byte vertices.
+//
+// Decoding is the part that runs on every load, so it has SSE2, AVX2
+// and NEON versions next to the plain one, picked when the program
+// starts. Every block is put back together in a small buffer that
+// stays in the L1 cache and is then copied out in one go, which suits
+// write combined memory like the mapped staging buffers. Nothing is
+// read past the end of the encoded data and corrupted data throws
+// std::runtime_error instead of writing out of bounds.
+//**********************************************************************
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace engine {
+	class MeshCodec {
+	public:
+		static constexpr size_t BLOCK_VERTICES = 256;
+		// The vertex size has to be a multiple of this, every 4 bytes are put back together at once
+		static constexpr size_t STRIDE_ALIGNMENT = 4;
+		static constexpr size_t MAX_STRIDE = 256;
+
+		enum class Decoder {
+			Scalar,
+			Sse2,
+			Avx2,
+			Neon
+		};
+
+		// count vertices of stride bytes each
+		static std::vector<uint8_t> encodeVertices(const void *vertices, size_t count, size_t stride);
+		// Writes count vertices of stride bytes each to destination, count and stride have to be
+		// the ones the data was encoded with
+		static void decodeVertices(void *destination, size_t count, size_t stride,
+			const uint8_t *data, size_t size, Decoder decoder = getBestDecoder());
+		// Hands every decoded block of up to BLOCK_VERTICES vertices to writeBlock in order, for
+		// callers that convert or split the vertices on their way out. block is only valid
+		// during the call.
+		using BlockWriter = std::function<void(const uint8_t *block, size_t first, size_t count)>;
+		static void decodeVertexBlocks(const BlockWriter &writeBlock, size_t count, size_t stride,
+			const uint8_t *data, size_t size, Decoder decoder = getBestDecoder());
+
+		static std::vector<uint8_t> encodeIndices(const uint32_t *indices, size_t count);
+		// Writes count indices of indexSize bytes each (2 or 4) to destination. With 2 bytes every
+		// index has to fit, which Model::getIndexType guarantees for the models we encode.
+		static void decodeIndices(void *destination, size_t count, size_t indexSize,
+			const uint8_t *data, size_t size, Decoder decoder = getBestDecoder());
+
+		// The fastest decoder this CPU supports
+		static Decoder getBestDecoder();
+		static bool isSupported(Decoder decoder);
+		static const char* getName(Decoder decoder);
+	};
+}
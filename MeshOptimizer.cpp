@@ -0,0 +1,286 @@
+#include "MeshOptimizer.h"
+
+// std
+#include <algorithm>
+#include <numeric>
+
+namespace engine {
+	namespace {
+		// For every vertex, the list of triangles that use it, stored back to back
+		struct Adjacency {
+			std::vector<uint32_t> offsets{};	// vertexCount + 1 entries
+			std::vector<uint32_t> triangles{};
+		};
+
+		Adjacency buildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount) {
+			Adjacency adjacency{};
+			adjacency.offsets.assign(vertexCount + 1, 0);
+			for (uint32_t index : indices) adjacency.offsets[index + 1]++;
+			for (size_t v = 0; v < vertexCount; v++) adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+			adjacency.triangles.resize(indices.size());
+			std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++) {
+				adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+			return adjacency;
+		}
+
+		// Runs the FIFO cache simulation over a range of triangles and returns the misses
+		class CacheSimulator {
+		public:
+			CacheSimulator(size_t vertexCount, uint32_t cacheSize) : cachedAt(vertexCount, 0), cacheSize{ cacheSize } {}
+
+			uint32_t addTriangle(const uint32_t* triangle) {
+				uint32_t misses = 0;
+				for (int corner = 0; corner < 3; corner++) {
+					uint32_t v = triangle[corner];
+					// cachedAt holds time + 1 of when the vertex entered the cache, 0 means never
+					if (cachedAt[v] == 0 || time - (cachedAt[v] - 1) >= cacheSize) {
+						cachedAt[v] = ++time;
+						misses++;
+					}
+				}
+				return misses;
+			}
+
+			// Moving time forward by a whole cache worth of vertices evicts everything
+			void flush() { time += cacheSize; }
+
+		private:
+			std::vector<uint64_t> cachedAt;
+			uint64_t time{ 0 };
+			uint32_t cacheSize;
+		};
+	}
+
+	MeshOptimizer::Report MeshOptimizer::optimize(Model::Builder& builder) {
+		return optimize(builder, Options{});
+	}
+
+	MeshOptimizer::Report MeshOptimizer::optimize(Model::Builder& builder, const Options& options) {
+		Report report{};
+		report.before = analyzeVertexCache(builder.indices, builder.vertices.size(), options.cacheSize);
+
+		// Triangles are only reordered within their sub mesh so they keep their material
+		if (builder.subMeshes.size() <= 1) {
+			optimizeVertexCache(builder.indices, builder.vertices.size(), options.cacheSize);
+			if (options.reduceOverdraw) {
+				optimizeOverdraw(builder.indices, builder.vertices, options.cacheSize, options.overdrawThreshold);
+			}
+		}
+		else {
+			for (const Model::SubMesh& subMesh : builder.subMeshes) {
+				auto first = builder.indices.begin() + subMesh.firstIndex;
+				std::vector<uint32_t> subMeshIndices(first, first + subMesh.indexCount);
+				optimizeVertexCache(subMeshIndices, builder.vertices.size(), options.cacheSize);
+				if (options.reduceOverdraw) {
+					optimizeOverdraw(subMeshIndices, builder.vertices, options.cacheSize, options.overdrawThreshold);
+				}
+				std::copy(subMeshIndices.begin(), subMeshIndices.end(), first);
+			}
+		}
+		optimizeVertexFetch(builder.vertices, builder.indices);
+
+		report.after = analyzeVertexCache(builder.indices, builder.vertices.size(), options.cacheSize);
+		return report;
+	}
+
+	MeshOptimizer::VertexCacheStats MeshOptimizer::analyzeVertexCache(
+		const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+		VertexCacheStats stats{};
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) return stats;
+
+		CacheSimulator cache{ vertexCount, cacheSize };
+		std::vector<bool> used(vertexCount, false);
+		uint64_t misses = 0;
+		size_t usedCount = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			misses += cache.addTriangle(&indices[t * 3]);
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t v = indices[t * 3 + corner];
+				if (!used[v]) {
+					used[v] = true;
+					usedCount++;
+				}
+			}
+		}
+
+		stats.acmr = static_cast<float>(misses) / triangleCount;
+		stats.atvr = static_cast<float>(misses) / usedCount;
+		return stats;
+	}
+
+	// This follows the Tipsify algorithm from "Fast Triangle Reordering for Vertex Locality and
+	// Reduced Overdraw" (Sander, Nehab and Barczak 2007). It fans around one vertex at a time, emitting
+	// every triangle that still uses it, and then moves on to a vertex that was used recently
+	// enough to still be in the cache once its remaining triangles are emitted.
+	void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || vertexCount == 0) return;
+
+		Adjacency adjacency = buildAdjacency(indices, vertexCount);
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+		}
+
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> deadEnd{};		// Recently used vertices to fall back on
+		std::vector<uint32_t> candidates{};
+		std::vector<uint32_t> output{};
+		output.reserve(indices.size());
+
+		uint32_t time = cacheSize + 1;
+		size_t cursor = 0;					// Next vertex to try when everything else runs dry
+		int64_t fanning = 0;
+
+		while (fanning >= 0) {
+			candidates.clear();
+			uint32_t v = static_cast<uint32_t>(fanning);
+			for (uint32_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++) {
+				uint32_t triangle = adjacency.triangles[a];
+				if (emitted[triangle]) continue;
+				emitted[triangle] = true;
+
+				for (int corner = 0; corner < 3; corner++) {
+					uint32_t u = indices[triangle * 3 + corner];
+					output.push_back(u);
+					deadEnd.push_back(u);
+					candidates.push_back(u);
+					liveTriangles[u]--;
+					if (time - cacheTime[u] > cacheSize) {
+						cacheTime[u] = time++;
+					}
+				}
+			}
+
+			// Pick the candidate that has been in the cache the longest but will still be in it
+			// after all of its remaining triangles are emitted (each of them adds 2 more vertices)
+			int64_t next = -1;
+			int64_t bestPriority = -1;
+			for (uint32_t u : candidates) {
+				if (liveTriangles[u] == 0) continue;
+				int64_t priority = 0;
+				if (time - cacheTime[u] + 2 * liveTriangles[u] <= cacheSize) {
+					priority = time - cacheTime[u];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = u;
+				}
+			}
+
+			// Dead end, first try the vertices we touched most recently and
+			// then just walk through the vertices in order for a fresh start
+			if (next == -1) {
+				while (!deadEnd.empty()) {
+					uint32_t u = deadEnd.back();
+					deadEnd.pop_back();
+					if (liveTriangles[u] > 0) {
+						next = u;
+						break;
+					}
+				}
+			}
+			if (next == -1) {
+				while (cursor < vertexCount && liveTriangles[cursor] == 0) cursor++;
+				if (cursor < vertexCount) next = static_cast<int64_t>(cursor);
+			}
+			fanning = next;
+		}
+
+		indices = std::move(output);
+	}
+
+	// The triangles that Tipsify emitted are cut into clusters wherever the cache was close
+	// to as efficient as it is for the whole mesh. Every cluster is measured starting from an
+	// empty cache, so the clusters can be drawn in any order without losing much of the cache
+	// benefit. Clusters that sit further out along their own facing direction
+	// are more likely to cover the rest of the model, so they are drawn first.
+	void MeshOptimizer::optimizeOverdraw(
+		std::vector<uint32_t>& indices,
+		const std::vector<Model::Vertex>& vertices,
+		uint32_t cacheSize,
+		float threshold) {
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) return;
+
+		float targetAcmr = analyzeVertexCache(indices, vertices.size(), cacheSize).acmr * threshold;
+
+		std::vector<size_t> clusterStarts{ 0 };
+		CacheSimulator cache{ vertices.size(), cacheSize };
+		uint32_t clusterMisses = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			clusterMisses += cache.addTriangle(&indices[t * 3]);
+			size_t clusterTriangles = t + 1 - clusterStarts.back();
+			if (t + 1 < triangleCount && clusterMisses <= targetAcmr * clusterTriangles) {
+				clusterStarts.push_back(t + 1);
+				clusterMisses = 0;
+				cache.flush();
+			}
+		}
+		clusterStarts.push_back(triangleCount);
+
+		glm::vec3 meshCenter{ 0.0f };
+		for (const auto& vertex : vertices) meshCenter += vertex.position;
+		if (!vertices.empty()) meshCenter /= static_cast<float>(vertices.size());
+
+		// Area weighted center and facing direction of every cluster
+		size_t clusterCount = clusterStarts.size() - 1;
+		std::vector<float> sortKeys(clusterCount, 0.0f);
+		for (size_t c = 0; c < clusterCount; c++) {
+			glm::vec3 center{ 0.0f };
+			glm::vec3 normal{ 0.0f };
+			float area = 0.0f;
+			for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+				const glm::vec3& a = vertices[indices[t * 3 + 0]].position;
+				const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+				const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+				glm::vec3 triangleNormal = glm::cross(b - a, d - a);	// Length is twice the area
+				float triangleArea = glm::length(triangleNormal);
+				center += (a + b + d) * (triangleArea / 3.0f);
+				normal += triangleNormal;
+				area += triangleArea;
+			}
+			if (area > 0.0f) center /= area;
+			float normalLength = glm::length(normal);
+			if (normalLength > 0.0f) normal /= normalLength;
+			sortKeys[c] = glm::dot(center - meshCenter, normal);
+		}
+
+		std::vector<size_t> clusterOrder(clusterCount);
+		std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+		std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) {
+			return sortKeys[a] > sortKeys[b];
+		});
+
+		std::vector<uint32_t> output{};
+		output.reserve(indices.size());
+		for (size_t c : clusterOrder) {
+			output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+		}
+		indices = std::move(output);
+	}
+
+	void MeshOptimizer::optimizeVertexFetch(std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices) {
+		if (indices.empty()) return;
+
+		constexpr uint32_t UNUSED = UINT32_MAX;
+		std::vector<uint32_t> remap(vertices.size(), UNUSED);
+		std::vector<Model::Vertex> reordered{};
+		reordered.reserve(vertices.size());
+
+		// Vertices that no triangle uses are dropped along the way
+		for (uint32_t& index : indices) {
+			if (remap[index] == UNUSED) {
+				remap[index] = static_cast<uint32_t>(reordered.size());
+				reordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices = std::move(reordered);
+	}
+}
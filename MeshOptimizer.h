@@ -0,0 +1,63 @@
+//**********************************************************************
+// The mesh optimizer reorders the triangles and vertices of a model
+// after it has been loaded, just before it is uploaded to the GPU. It
+// doesn't change what gets drawn, only the order it's drawn in:
+// 1. Vertex cache: triangles are reordered with Tipsify (Sander et al.
+//    2007) so recently shaded vertices get reused by the triangles
+//    that follow instead of being shaded again.
+// 2. Overdraw (optional): the reordered triangles are cut into small
+//    clusters and the clusters that face outwards are drawn first, so
+//    more of the hidden surfaces fail the depth test early.
+// 3. Vertex fetch: vertices are renumbered in the order the index
+//    buffer first uses them so the GPU reads memory front to back.
+// The vertex cache efficiency is measured as ACMR (average cache miss
+// ratio, shaded vertices per triangle) and ATVR (average transformed
+// vertex ratio, shaded vertices per unique vertex). Lower is better
+// and 1.0 is the best ATVR possible.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	class MeshOptimizer {
+	public:
+		struct VertexCacheStats {
+			float acmr{ 0.0f };
+			float atvr{ 0.0f };
+		};
+
+		struct Options {
+			uint32_t cacheSize{ 16 };			// Vertices in the simulated post transform cache
+			bool reduceOverdraw{ true };
+			float overdrawThreshold{ 1.05f };	// How much worse the ACMR may get to allow more clusters
+		};
+
+		struct Report {
+			VertexCacheStats before{};
+			VertexCacheStats after{};
+		};
+
+		// Runs every pass on the builder and measures the vertex cache before and after
+		static Report optimize(Model::Builder& builder);
+		static Report optimize(Model::Builder& builder, const Options& options);
+
+		// Simulates a FIFO post transform cache of the given size
+		static VertexCacheStats analyzeVertexCache(
+			const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize);
+
+		static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize);
+		static void optimizeOverdraw(
+			std::vector<uint32_t>& indices,
+			const std::vector<Model::Vertex>& vertices,
+			uint32_t cacheSize,
+			float threshold);
+		static void optimizeVertexFetch(std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices);
+	};
+}
@@ -0,0 +1,454 @@
+#include "MeshSimplifier.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+namespace engine {
+	namespace {
+		// How much more a border plane counts than a face plane of the same size. This
+		// keeps open edges from wandering inwards as the faces next to them collapse.
+		constexpr double BORDER_WEIGHT = 10.0;
+		constexpr uint32_t NO_TARGET = UINT32_MAX;
+
+		enum class VertexKind : uint8_t {
+			Manifold,	// Surrounded by triangles, can collapse along any edge
+			Border,		// On an open edge, can only collapse along that edge
+			Locked		// Where borders meet or the mesh isn't manifold, never collapses
+		};
+
+		// The symmetric 4x4 matrix of a quadric, only the upper triangle is stored
+		struct Quadric {
+			double a00{ 0 }, a01{ 0 }, a02{ 0 }, a03{ 0 };
+			double a11{ 0 }, a12{ 0 }, a13{ 0 };
+			double a22{ 0 }, a23{ 0 };
+			double a33{ 0 };
+			double weight{ 0 };		// Sum of the weights of every plane that was added
+
+			// The plane is every point p where dot(normal, p) + d == 0
+			void addPlane(const glm::vec3& normal, float d, double planeWeight) {
+				double x = normal.x, y = normal.y, z = normal.z, w = d;
+				a00 += planeWeight * x * x; a01 += planeWeight * x * y; a02 += planeWeight * x * z; a03 += planeWeight * x * w;
+				a11 += planeWeight * y * y; a12 += planeWeight * y * z; a13 += planeWeight * y * w;
+				a22 += planeWeight * z * z; a23 += planeWeight * z * w;
+				a33 += planeWeight * w * w;
+				weight += planeWeight;
+			}
+
+			Quadric& operator+=(const Quadric& other) {
+				a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+				a11 += other.a11; a12 += other.a12; a13 += other.a13;
+				a22 += other.a22; a23 += other.a23;
+				a33 += other.a33;
+				weight += other.weight;
+				return *this;
+			}
+
+			// Weighted mean of the squared distances from the point to every plane
+			double error(const glm::vec3& point) const {
+				if (weight <= 0.0) return 0.0;
+				double x = point.x, y = point.y, z = point.z;
+				double sum =
+					a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+					a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+					a22 * z * z + 2.0 * a23 * z +
+					a33;
+				return std::max(sum, 0.0) / weight;
+			}
+		};
+
+		struct Collapse {
+			double cost;
+			uint32_t from;
+			uint32_t to;
+		};
+
+		// One side of a triangle in position space. The key is the same for both
+		// directions (smaller id in the high half), forward tells which one it is.
+		struct Edge {
+			uint64_t key;
+			uint32_t triangle;
+			uint32_t forward;
+		};
+
+		glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+			return glm::cross(b - a, c - a);
+		}
+
+		// How different two vertices at the same position look, used to pick the closest
+		// vertex to collapse into when there's no vertex across the edge to take
+		float attributeDistance(const Model::Vertex& a, const Model::Vertex& b) {
+			glm::vec3 color = a.color - b.color;
+			glm::vec2 uv = a.uv - b.uv;
+			return (1.0f - glm::dot(a.normal, b.normal)) + glm::dot(color, color) + glm::dot(uv, uv);
+		}
+
+		// Everything the collapses need to carry on where the previous run stopped, so
+		// several levels of detail can come out of one simplification
+		class Simplifier {
+		public:
+			Simplifier(const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& indices)
+				: vertices{ vertices },
+				result(indices.begin(), indices.begin() + indices.size() / 3 * 3),
+				remap(vertices.size(), NO_TARGET) {
+				groupPositions();
+				size_t positionCount = positions.size();
+				quadrics.resize(positionCount);
+				kinds.resize(positionCount);
+				borderEdges.resize(positionCount);
+				touched.resize(positionCount);
+
+				// The errors are measured against the bounding sphere of the triangles we were given
+				glm::vec3 boundsMin{ FLT_MAX };
+				glm::vec3 boundsMax{ -FLT_MAX };
+				for (uint32_t index : result) {
+					boundsMin = glm::min(boundsMin, vertices[index].position);
+					boundsMax = glm::max(boundsMax, vertices[index].position);
+				}
+				radius = result.empty() ? 0.0 : 0.5 * glm::length(boundsMax - boundsMin);
+
+				buildTopology();
+				addPlanes();
+			}
+
+			// Collapses until there are no more than targetIndexCount indices left or
+			// no collapse is cheaper than the error, which is relative to the radius
+			void run(size_t targetIndexCount, float targetError) {
+				if (radius <= 0.0) return;
+				double errorLimit = static_cast<double>(targetError) * radius;
+				double costLimit = errorLimit * errorLimit;
+
+				// Each pass collapses the cheapest edges that don't share any triangles with
+				// each other, then rebuilds the index list and the topology for the next pass
+				while (result.size() > targetIndexCount) {
+					size_t triangleCount = result.size() / 3;
+					classifyVertices();
+					findCollapses(costLimit);
+
+					// Every collapse removes about two triangles
+					size_t collapseLimit = targetIndexCount == 0
+						? SIZE_MAX : (triangleCount - targetIndexCount / 3) / 2 + 1;
+					if (applyCollapses(collapseLimit) == 0) break;
+					rewriteIndices();
+					buildTopology();
+				}
+			}
+
+			const std::vector<uint32_t>& getIndices() const { return result; }
+			float getError() const { return radius > 0.0 ? static_cast<float>(std::sqrt(maxCost) / radius) : 0.0f; }
+
+		private:
+			// Gives every vertex the id of its position, so vertices that only
+			// differ in their normal, color or uv end up with the same id
+			void groupPositions() {
+				std::vector<uint32_t> order(vertices.size());
+				std::iota(order.begin(), order.end(), 0);
+				std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+					const glm::vec3& pa = vertices[a].position;
+					const glm::vec3& pb = vertices[b].position;
+					if (pa.x != pb.x) return pa.x < pb.x;
+					if (pa.y != pb.y) return pa.y < pb.y;
+					return pa.z < pb.z;
+				});
+
+				positionIds.resize(vertices.size());
+				for (uint32_t vertex : order) {
+					const glm::vec3& position = vertices[vertex].position;
+					if (positions.empty() || positions.back() != position) positions.push_back(position);
+					positionIds[vertex] = static_cast<uint32_t>(positions.size() - 1);
+				}
+			}
+
+			// Sorts the sides of every triangle so both directions of an edge sit next to
+			// each other, and lists the triangles around every position
+			void buildTopology() {
+				size_t triangleCount = result.size() / 3;
+				edges.resize(result.size());
+				offsets.assign(positions.size() + 1, 0);
+				for (size_t t = 0; t < triangleCount; t++) {
+					for (int corner = 0; corner < 3; corner++) {
+						uint32_t from = positionIds[result[t * 3 + corner]];
+						uint32_t to = positionIds[result[t * 3 + (corner + 1) % 3]];
+						uint64_t key = from < to
+							? static_cast<uint64_t>(from) << 32 | to
+							: static_cast<uint64_t>(to) << 32 | from;
+						edges[t * 3 + corner] = { key, static_cast<uint32_t>(t), from < to ? 1u : 0u };
+						offsets[from + 1]++;
+					}
+				}
+				std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.key < b.key; });
+
+				for (size_t p = 0; p < positions.size(); p++) offsets[p + 1] += offsets[p];
+				triangles.resize(result.size());
+				std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < result.size(); i++) {
+					triangles[fill[positionIds[result[i]]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			// Calls the function once for every edge with how often each direction is used
+			template <typename Function>
+			void forEachEdge(Function&& function) const {
+				for (size_t i = 0; i < edges.size();) {
+					size_t end = i;
+					uint32_t forward = 0;
+					while (end < edges.size() && edges[end].key == edges[i].key) forward += edges[end++].forward;
+					uint32_t low = static_cast<uint32_t>(edges[i].key >> 32);
+					uint32_t high = static_cast<uint32_t>(edges[i].key);
+					function(low, high, forward, static_cast<uint32_t>(end - i) - forward, edges[i].triangle);
+					i = end;
+				}
+			}
+
+			// Every position starts out with the planes of the triangles around it, and the
+			// planes standing up along any open edge it's on. The collapses never move a
+			// vertex, so these stay valid, they only get added together.
+			void addPlanes() {
+				for (size_t t = 0; t < result.size() / 3; t++) {
+					glm::vec3 normal = normalOf(static_cast<uint32_t>(t));
+					float length = glm::length(normal);
+					if (length == 0.0f) continue;
+					normal /= length;
+					float d = -glm::dot(normal, positions[positionIds[result[t * 3]]]);
+					for (int corner = 0; corner < 3; corner++) {
+						quadrics[positionIds[result[t * 3 + corner]]].addPlane(normal, d, 0.5 * length);
+					}
+				}
+
+				forEachEdge([&](uint32_t low, uint32_t high, uint32_t forward, uint32_t backward, uint32_t triangle) {
+					if (forward + backward != 1) return;
+					glm::vec3 normal = normalOf(triangle);
+					float length = glm::length(normal);
+					if (length == 0.0f) return;
+
+					uint32_t from = forward ? low : high;
+					uint32_t to = forward ? high : low;
+					glm::vec3 edge = positions[to] - positions[from];
+					glm::vec3 borderNormal = glm::cross(edge, normal / length);
+					float borderLength = glm::length(borderNormal);
+					if (borderLength == 0.0f) return;
+					borderNormal /= borderLength;
+					float d = -glm::dot(borderNormal, positions[from]);
+					double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+					quadrics[from].addPlane(borderNormal, d, weight);
+					quadrics[to].addPlane(borderNormal, d, weight);
+				});
+			}
+
+			glm::vec3 normalOf(uint32_t triangle) const {
+				return triangleNormal(
+					positions[positionIds[result[triangle * 3]]],
+					positions[positionIds[result[triangle * 3 + 1]]],
+					positions[positionIds[result[triangle * 3 + 2]]]);
+			}
+
+			void classifyVertices() {
+				std::fill(borderEdges.begin(), borderEdges.end(), uint8_t{ 0 });
+				std::fill(kinds.begin(), kinds.end(), VertexKind::Manifold);
+				forEachEdge([&](uint32_t low, uint32_t high, uint32_t forward, uint32_t backward, uint32_t) {
+					if (forward + backward == 1) {
+						borderEdges[low] = static_cast<uint8_t>(std::min(borderEdges[low] + 1, 255));
+						borderEdges[high] = static_cast<uint8_t>(std::min(borderEdges[high] + 1, 255));
+					}
+					else if (forward != 1 || backward != 1) {
+						kinds[low] = VertexKind::Locked;
+						kinds[high] = VertexKind::Locked;
+					}
+				});
+				for (size_t p = 0; p < positions.size(); p++) {
+					if (kinds[p] == VertexKind::Locked) continue;
+					if (borderEdges[p] > 2) kinds[p] = VertexKind::Locked;
+					else if (borderEdges[p] > 0) kinds[p] = VertexKind::Border;
+				}
+			}
+
+			// Every edge can collapse either way, we keep the cheaper direction that's allowed
+			void findCollapses(double costLimit) {
+				collapses.clear();
+				forEachEdge([&](uint32_t low, uint32_t high, uint32_t forward, uint32_t backward, uint32_t) {
+					bool border = forward + backward == 1;
+					Quadric quadric = quadrics[low];
+					quadric += quadrics[high];
+
+					Collapse best{ DBL_MAX, low, high };
+					auto consider = [&](uint32_t from, uint32_t to) {
+						bool allowed = kinds[from] == VertexKind::Manifold || (kinds[from] == VertexKind::Border && border);
+						if (!allowed) return;
+						double cost = quadric.error(positions[to]);
+						if (cost < best.cost) best = { cost, from, to };
+					};
+					consider(low, high);
+					consider(high, low);
+					if (best.cost <= costLimit) collapses.push_back(best);
+				});
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+					return a.cost < b.cost;
+				});
+			}
+
+			// Every vertex at the collapsing position needs a vertex at the target position to
+			// turn into. We take the one it shares a triangle with across the edge, so seams
+			// stay where they are. A vertex without one, like every vertex of a flat shaded
+			// model, takes the vertex at the target that looks the most like it.
+			bool findWedges(uint32_t from, uint32_t to) {
+				wedges.clear();
+				for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++) {
+					const uint32_t* triangle = &result[triangles[a] * 3];
+					uint32_t fromIndex = NO_TARGET;
+					uint32_t toIndex = NO_TARGET;
+					for (int corner = 0; corner < 3; corner++) {
+						if (positionIds[triangle[corner]] == from) fromIndex = triangle[corner];
+						if (positionIds[triangle[corner]] == to) toIndex = triangle[corner];
+					}
+
+					auto wedge = std::find_if(wedges.begin(), wedges.end(),
+						[&](const std::pair<uint32_t, uint32_t>& w) { return w.first == fromIndex; });
+					if (wedge == wedges.end()) wedges.push_back({ fromIndex, toIndex });
+					else if (wedge->second == NO_TARGET) wedge->second = toIndex;
+				}
+
+				for (auto& wedge : wedges) {
+					if (wedge.second != NO_TARGET) continue;
+					float bestDistance = FLT_MAX;
+					for (uint32_t a = offsets[to]; a < offsets[to + 1]; a++) {
+						const uint32_t* triangle = &result[triangles[a] * 3];
+						for (int corner = 0; corner < 3; corner++) {
+							if (positionIds[triangle[corner]] != to) continue;
+							float distance = attributeDistance(vertices[wedge.first], vertices[triangle[corner]]);
+							if (distance < bestDistance) {
+								bestDistance = distance;
+								wedge.second = triangle[corner];
+							}
+						}
+					}
+					if (wedge.second == NO_TARGET) return false;
+				}
+				return !wedges.empty();
+			}
+
+			// The triangles that stay around the collapsing position must not flip over
+			bool flips(uint32_t from, uint32_t to) const {
+				for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++) {
+					uint32_t t = triangles[a];
+					glm::vec3 corners[3];
+					bool hasTarget = false;
+					for (int corner = 0; corner < 3; corner++) {
+						uint32_t id = positionIds[result[t * 3 + corner]];
+						hasTarget |= id == to;
+						corners[corner] = positions[id];
+					}
+					if (hasTarget) continue;
+
+					glm::vec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+					for (int corner = 0; corner < 3; corner++) {
+						if (positionIds[result[t * 3 + corner]] == from) corners[corner] = positions[to];
+					}
+					glm::vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+					if (glm::dot(before, before) > 0.0f && glm::dot(before, after) <= 0.0f) return true;
+				}
+				return false;
+			}
+
+			size_t applyCollapses(size_t collapseLimit) {
+				size_t collapsed = 0;
+				std::fill(touched.begin(), touched.end(), false);
+				remapped.clear();
+
+				for (const Collapse& collapse : collapses) {
+					if (collapsed >= collapseLimit) break;
+					uint32_t from = collapse.from;
+					uint32_t to = collapse.to;
+					if (touched[from] || touched[to]) continue;
+					if (flips(from, to) || !findWedges(from, to)) continue;
+
+					for (const auto& wedge : wedges) {
+						remap[wedge.first] = wedge.second;
+						remapped.push_back(wedge.first);
+					}
+					quadrics[to] += quadrics[from];
+					maxCost = std::max(maxCost, collapse.cost);
+					collapsed++;
+
+					// Locking everything around the collapse keeps every triangle
+					// to at most one change per pass, so the flip test stays correct
+					for (uint32_t a = offsets[from]; a < offsets[from + 1]; a++) {
+						for (int corner = 0; corner < 3; corner++) {
+							touched[positionIds[result[triangles[a] * 3 + corner]]] = true;
+						}
+					}
+				}
+				return collapsed;
+			}
+
+			// Points the collapsed vertices at their targets and drops the triangles that
+			// lost an edge, they are the ones with two corners at the same position now
+			void rewriteIndices() {
+				size_t output = 0;
+				for (size_t t = 0; t < result.size() / 3; t++) {
+					uint32_t triangle[3];
+					for (int corner = 0; corner < 3; corner++) {
+						uint32_t index = result[t * 3 + corner];
+						triangle[corner] = remap[index] == NO_TARGET ? index : remap[index];
+					}
+					uint32_t p0 = positionIds[triangle[0]];
+					uint32_t p1 = positionIds[triangle[1]];
+					uint32_t p2 = positionIds[triangle[2]];
+					if (p0 == p1 || p1 == p2 || p0 == p2) continue;
+					for (int corner = 0; corner < 3; corner++) result[output++] = triangle[corner];
+				}
+				result.resize(output);
+				for (uint32_t index : remapped) remap[index] = NO_TARGET;
+			}
+
+			const std::vector<Model::Vertex>& vertices;
+			std::vector<uint32_t> result;
+			std::vector<uint32_t> positionIds{};
+			std::vector<glm::vec3> positions{};
+			std::vector<Quadric> quadrics{};
+			double radius{ 0.0 };
+			double maxCost{ 0.0 };
+
+			std::vector<Edge> edges{};
+			std::vector<uint32_t> offsets{};	// positionCount + 1 entries into triangles
+			std::vector<uint32_t> triangles{};
+			std::vector<VertexKind> kinds{};
+			std::vector<uint8_t> borderEdges{};
+			std::vector<Collapse> collapses{};
+			std::vector<bool> touched{};
+			std::vector<uint32_t> remap;
+			std::vector<uint32_t> remapped{};
+			std::vector<std::pair<uint32_t, uint32_t>> wedges{};
+		};
+	}
+
+	std::vector<uint32_t> MeshSimplifier::simplify(
+		const std::vector<Model::Vertex>& vertices,
+		const std::vector<uint32_t>& indices,
+		size_t targetIndexCount,
+		float targetError,
+		float* resultError) {
+		Simplifier simplifier{ vertices, indices };
+		simplifier.run(targetIndexCount, targetError);
+		if (resultError) *resultError = simplifier.getError();
+		return simplifier.getIndices();
+	}
+
+	std::vector<MeshSimplifier::Level> MeshSimplifier::simplifyLevels(
+		const std::vector<Model::Vertex>& vertices,
+		const std::vector<uint32_t>& indices,
+		const std::vector<float>& targetErrors) {
+		std::vector<float> sortedErrors = targetErrors;
+		std::sort(sortedErrors.begin(), sortedErrors.end());
+
+		Simplifier simplifier{ vertices, indices };
+		std::vector<Level> levels{};
+		for (float targetError : sortedErrors) {
+			simplifier.run(0, targetError);
+			levels.push_back({ simplifier.getIndices(), simplifier.getError() });
+		}
+		return levels;
+	}
+}
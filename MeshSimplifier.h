@@ -0,0 +1,52 @@
+//**********************************************************************
+// The mesh simplifier removes triangles from a model by collapsing
+// edges, one vertex is merged into a neighbouring vertex and the
+// triangles that shared the edge disappear. Every collapse picks the
+// edge that moves the surface the least, measured with the quadric
+// error metric from "Surface Simplification Using Quadric Error
+// Metrics" (Garland and Heckbert 1997).
+// Vertices are only ever merged into vertices that already exist, so
+// the simplified indices still point into the original vertex buffer
+// and every level of detail of a model can share one vertex buffer.
+// Open borders, and seams where a position has several vertices with
+// different normals, colors or uvs, only collapse along themselves so
+// the outline and the attributes of the model stay intact.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	class MeshSimplifier {
+	public:
+		// Collapses edges until the indices are down to targetIndexCount or the next
+		// collapse would move the surface further than targetError. Errors are relative to
+		// the radius of the mesh's bounding sphere, so 0.01 is 1% of the radius. The largest
+		// error of any collapse that was made is written to resultError.
+		static std::vector<uint32_t> simplify(
+			const std::vector<Model::Vertex>& vertices,
+			const std::vector<uint32_t>& indices,
+			size_t targetIndexCount,
+			float targetError,
+			float* resultError = nullptr);
+
+		struct Level {
+			std::vector<uint32_t> indices{};
+			float error{ 0.0f };
+		};
+
+		// Gives the same levels as calling simplify once for every error target, from the
+		// smallest to the largest, except that each level carries on collapsing where the
+		// one before it stopped instead of starting over from the full model
+		static std::vector<Level> simplifyLevels(
+			const std::vector<Model::Vertex>& vertices,
+			const std::vector<uint32_t>& indices,
+			const std::vector<float>& targetErrors);
+	};
+}
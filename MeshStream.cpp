@@ -0,0 +1,118 @@
+#include "MeshStream.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		constexpr size_t MIN_WINDOW_SIZE = 64 * 1024;
+		constexpr size_t MAX_WINDOW_SIZE = 64 * 1024 * 1024;
+
+		// Memory a window needs while it is parsed and welded, on top of its staging slot. The
+		// window's bytes, the attributes defined inside of it (a 'v' line is at least 8 bytes
+		// and turns into 24 bytes of position and color), and for every corner the parsed,
+		// resolved and unique corners, the weld table and the index, with spare capacity.
+		constexpr size_t WINDOW_BYTES_FACTOR = 4;
+		constexpr size_t BYTES_PER_CORNER = 64;
+
+		// At the end of the first pass the attributes are copied out of the per window blocks
+		// into their final arrays. The allocator doesn't always hand the freed blocks back to
+		// the system right away, so for a moment they can count twice.
+		constexpr size_t ATTRIBUTE_SHARE_NUMERATOR = 3;
+		constexpr size_t ATTRIBUTE_SHARE_DENOMINATOR = 8;
+	}
+
+	size_t MeshStream::getWindowSize(size_t memoryBudget) {
+		return std::clamp(memoryBudget / 64, MIN_WINDOW_SIZE, MAX_WINDOW_SIZE);
+	}
+
+	MeshStream::MeshStream(const std::string &filePath, const Options &options)
+		: filePath{ filePath }, options{ options } {
+		size_t windowSize = getWindowSize(options.memoryBudget);
+		layout = ObjParser::scanFile(filePath, windowSize,
+			options.memoryBudget / ATTRIBUTE_SHARE_DENOMINATOR * ATTRIBUTE_SHARE_NUMERATOR);
+		if (layout.windows.empty()) throw std::runtime_error("OBJ file has no faces: " + filePath);
+
+		// Every window gets its own range of the vertex and index buffers, in file order
+		VkDeviceSize vertexSize = Model::getVertexSize(options.format);
+		uint64_t totalVertices = 0;
+		uint64_t totalIndices = 0;
+		size_t maxCorners = 0;
+		ranges.resize(layout.windows.size());
+		for (size_t i = 0; i < ranges.size(); i++) {
+			const ObjWindow& window = layout.windows[i];
+			WindowRange& range = ranges[i];
+			range.firstVertex = static_cast<uint32_t>(totalVertices);
+			range.vertexCount = static_cast<uint32_t>(window.uniqueCornerCount);
+			range.firstIndex = static_cast<uint32_t>(totalIndices);
+			range.indexCount = static_cast<uint32_t>(window.cornerCount);
+			totalVertices += window.uniqueCornerCount;
+			totalIndices += window.cornerCount;
+			maxCorners = std::max(maxCorners, window.cornerCount);
+			if (totalVertices > std::numeric_limits<uint32_t>::max() || totalIndices > std::numeric_limits<uint32_t>::max()) {
+				throw std::runtime_error("OBJ file has too many vertices to stream into one model: " + filePath);
+			}
+		}
+		vertexCount = static_cast<uint32_t>(totalVertices);
+		indexCount = static_cast<uint32_t>(totalIndices);
+
+		// The index size depends on the vertex count of the whole model, so the
+		// slot layout can only be worked out once every window has been counted
+		VkDeviceSize indexSize = getIndexType() == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		for (WindowRange& range : ranges) {
+			range.indexOffset = (range.vertexCount * vertexSize + 3) & ~VkDeviceSize{ 3 };
+			range.uploadSize = range.indexOffset + range.indexCount * indexSize;
+			slotSize = std::max(slotSize, range.uploadSize);
+		}
+		// Keeps every slot of the staging ring aligned for the vertices written into it
+		slotSize = (slotSize + 15) & ~VkDeviceSize{ 15 };
+
+		const ObjData& attributes = layout.attributes;
+		if (!attributes.positions.empty()) {
+			bounds.min = bounds.max = glm::vec3{ attributes.positions[0], attributes.positions[1], attributes.positions[2] };
+			for (size_t i = 0; i + 2 < attributes.positions.size(); i += 3) {
+				glm::vec3 position{ attributes.positions[i], attributes.positions[i + 1], attributes.positions[i + 2] };
+				bounds.min = glm::min(bounds.min, position);
+				bounds.max = glm::max(bounds.max, position);
+			}
+		}
+
+		size_t attributeBytes = (attributes.positions.size() + attributes.colors.size() +
+			attributes.normals.size() + attributes.texcoords.size()) * sizeof(float);
+		size_t parseBytes = WINDOW_BYTES_FACTOR * windowSize + BYTES_PER_CORNER * maxCorners;
+		size_t scanEstimate = 2 * attributeBytes + windowSize + parseBytes;
+		size_t streamEstimate = attributeBytes + options.windowsInFlight * (static_cast<size_t>(slotSize) + parseBytes);
+		memoryEstimate = std::max(scanEstimate, streamEstimate);
+		if (memoryEstimate > options.memoryBudget) {
+			throw std::runtime_error("Streaming " + filePath + " needs " + std::to_string(memoryEstimate / (1024 * 1024)) +
+				" MB, which is more than the budget of " + std::to_string(options.memoryBudget / (1024 * 1024)) + " MB");
+		}
+	}
+
+	void MeshStream::writeWindow(size_t window, void *destination) const {
+		std::vector<ObjIndex> uniqueCorners{};
+		std::vector<uint32_t> indices{};
+		ObjParser::readWindow(filePath, layout, window, uniqueCorners, indices);
+
+		const WindowRange& range = ranges[window];
+		auto bytes = static_cast<char*>(destination);
+		Model::encodeVertices(layout.attributes, uniqueCorners.data(), uniqueCorners.size(), options.format, bounds, bytes);
+
+		// The indices of a window start at 0, the window's first vertex moves them into place
+		if (getIndexType() == VK_INDEX_TYPE_UINT16) {
+			auto shortIndices = reinterpret_cast<uint16_t*>(bytes + range.indexOffset);
+			for (size_t i = 0; i < indices.size(); i++) {
+				shortIndices[i] = static_cast<uint16_t>(range.firstVertex + indices[i]);
+			}
+		}
+		else {
+			auto longIndices = reinterpret_cast<uint32_t*>(bytes + range.indexOffset);
+			for (size_t i = 0; i < indices.size(); i++) {
+				longIndices[i] = range.firstVertex + indices[i];
+			}
+		}
+	}
+}
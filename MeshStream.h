@@ -0,0 +1,90 @@
+//**********************************************************************
+// The mesh stream loads OBJ files that are too large to hold in memory
+// all at once. The regular path keeps the parsed file, every corner,
+// the welded vertices and a full size staging buffer around at the
+// same time, which is several times the size of the finished mesh.
+// Here the file is read in windows instead. The first pass (the
+// constructor) keeps only the attributes and works out how many
+// vertices and indices every window turns into, so the buffers on the
+// GPU can be created at their final size. After that every window is
+// turned into finished vertices and indices on its own and written
+// straight into a slot of a small staging ring (see
+// ModelLoader::loadModelStreaming).
+// Vertices are only de-duplicated within their window, and the mesh
+// optimizer, levels of detail and meshlets are skipped because they
+// all need the whole mesh at once.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+#include "ObjParser.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class MeshStream {
+	public:
+		struct Options {
+			// The most memory the load may use, the staging ring included. A window is
+			// 1/64th of it and the attributes may take up to 3/8ths.
+			size_t memoryBudget{ 256 * 1024 * 1024 };
+			Model::VertexFormat format{ Model::VertexFormat::Compact };
+			// Windows being parsed or uploaded at the same time, one staging slot each
+			size_t windowsInFlight{ 2 };
+		};
+
+		// Where one window's data goes. In the staging slot the vertices come first and the
+		// indices start at indexOffset, uploadSize is the whole thing.
+		struct WindowRange {
+			uint32_t firstVertex{ 0 };
+			uint32_t vertexCount{ 0 };
+			uint32_t firstIndex{ 0 };
+			uint32_t indexCount{ 0 };
+			VkDeviceSize indexOffset{ 0 };
+			VkDeviceSize uploadSize{ 0 };
+		};
+
+		// Runs the first pass. Throws if the load would need more than the memory budget.
+		MeshStream(const std::string &filePath, const Options &options);
+
+		MeshStream(const MeshStream&) = delete;
+		MeshStream& operator=(const MeshStream&) = delete;
+
+		// Parses one window and writes its vertices and indices (already pointing at the
+		// right vertices of the whole model) to destination, which needs room for
+		// getWindowRange(window).uploadSize bytes. Safe to call from several threads at once.
+		void writeWindow(size_t window, void *destination) const;
+
+		const std::string& getFilePath() const { return filePath; }
+		const Options& getOptions() const { return options; }
+		size_t getWindowCount() const { return ranges.size(); }
+		const WindowRange& getWindowRange(size_t window) const { return ranges[window]; }
+		VkDeviceSize getSlotSize() const { return slotSize; }
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+		const Model::BoundingBox& getBoundingBox() const { return bounds; }
+		VkIndexType getIndexType() const { return Model::getIndexType(vertexCount); }
+
+		// The most memory the load uses at once, either at the end of the first pass or
+		// later on with every window slot busy
+		size_t getMemoryEstimate() const { return memoryEstimate; }
+
+		static size_t getWindowSize(size_t memoryBudget);
+
+	private:
+		std::string filePath;
+		Options options;
+		ObjStreamLayout layout{};
+		std::vector<WindowRange> ranges{};
+		VkDeviceSize slotSize{ 0 };		// The largest upload of any window
+		uint32_t vertexCount{ 0 };
+		uint32_t indexCount{ 0 };
+		Model::BoundingBox bounds{};
+		size_t memoryEstimate{ 0 };
+	};
+}
@@ -0,0 +1,188 @@
+#include "MeshletBuilder.h"
+
+// std
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace engine {
+	namespace {
+		// Below this the triangles of a meshlet face too many different ways
+		// for there to be a camera position that sees none of them
+		constexpr float MIN_CONE_SPREAD = 0.1f;
+
+		// How much a triangle facing the other way counts against it compared to a new vertex
+		constexpr float CONE_WEIGHT = 0.5f;
+	}
+
+	std::vector<Model::Meshlet> MeshletBuilder::build(
+		const std::vector<Model::Vertex>& vertices,
+		std::vector<uint32_t>& indices,
+		uint32_t firstIndex,
+		uint32_t indexCount,
+		size_t maxVertices,
+		size_t maxTriangles) {
+		std::vector<Model::Meshlet> meshlets{};
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) return meshlets;
+		const uint32_t* input = &indices[firstIndex];
+
+		// For every vertex, the triangles that use it, stored back to back
+		std::vector<uint32_t> offsets(vertices.size() + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) offsets[input[i] + 1]++;
+		for (size_t v = 0; v < vertices.size(); v++) offsets[v + 1] += offsets[v];
+		std::vector<uint32_t> adjacency(triangleCount * 3);
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[input[i]]++] = static_cast<uint32_t>(i / 3);
+
+		std::vector<glm::vec3> normals(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::vec3& a = vertices[input[t * 3]].position;
+			const glm::vec3& b = vertices[input[t * 3 + 1]].position;
+			const glm::vec3& c = vertices[input[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			normals[t] = length > 0.0f ? normal / length : glm::vec3{ 0.0f };
+		}
+
+		// usedBy holds the number of the meshlet that last took the vertex, which
+		// tells us how many new vertices a triangle would add without clearing anything
+		std::vector<uint32_t> usedBy(vertices.size(), UINT32_MAX);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> meshletVertices{};
+		std::vector<uint32_t> output{};
+		output.reserve(triangleCount * 3);
+
+		Model::Meshlet meshlet{};
+		meshlet.firstIndex = firstIndex;
+		uint32_t meshletNumber = 0;
+		glm::vec3 normalSum{ 0.0f };
+		size_t cursor = 0;		// Where to look for a new starting triangle
+
+		auto countNewVertices = [&](size_t t) {
+			size_t count = 0;
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t index = input[t * 3 + corner];
+				bool repeated = (corner > 0 && input[t * 3] == index) || (corner == 2 && input[t * 3 + 1] == index);
+				if (!repeated && usedBy[index] != meshletNumber) count++;
+			}
+			return count;
+		};
+
+		while (true) {
+			// Grow the meshlet with the neighbouring triangle that adds the fewest vertices,
+			// and out of those the one facing the closest to the rest of the meshlet
+			int64_t next = -1;
+			float bestScore = FLT_MAX;
+			float axisLength = glm::length(normalSum);
+			glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3{ 0.0f };
+			for (uint32_t vertex : meshletVertices) {
+				for (uint32_t a = offsets[vertex]; a < offsets[vertex + 1]; a++) {
+					uint32_t t = adjacency[a];
+					if (emitted[t]) continue;
+					size_t newVertices = countNewVertices(t);
+					if (meshletVertices.size() + newVertices > maxVertices) continue;
+					float score = newVertices + CONE_WEIGHT * (1.0f - glm::dot(normals[t], axis));
+					if (score < bestScore) {
+						bestScore = score;
+						next = t;
+					}
+				}
+			}
+
+			bool full = meshlet.indexCount / 3 >= maxTriangles;
+			if (next == -1 && !full) {
+				// No neighbour fits, small disconnected pieces still go into the same meshlet
+				while (cursor < triangleCount && emitted[cursor]) cursor++;
+				if (cursor < triangleCount && meshletVertices.size() + countNewVertices(cursor) <= maxVertices) {
+					next = static_cast<int64_t>(cursor);
+				}
+			}
+			if (next == -1 || full) {
+				if (meshlet.indexCount > 0) {
+					meshlets.push_back(meshlet);
+					meshlet = {};
+					meshlet.firstIndex = firstIndex + static_cast<uint32_t>(output.size());
+					meshletVertices.clear();
+					normalSum = glm::vec3{ 0.0f };
+					meshletNumber++;
+				}
+
+				// Nothing left to grow into, start over from the next triangle in the old order
+				while (cursor < triangleCount && emitted[cursor]) cursor++;
+				if (cursor == triangleCount) break;
+				next = static_cast<int64_t>(cursor);
+			}
+
+			emitted[next] = true;
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t index = input[next * 3 + corner];
+				if (usedBy[index] != meshletNumber) {
+					usedBy[index] = meshletNumber;
+					meshletVertices.push_back(index);
+				}
+				output.push_back(index);
+			}
+			normalSum += normals[next];
+			meshlet.indexCount += 3;
+		}
+		if (meshlet.indexCount > 0) meshlets.push_back(meshlet);
+
+		// Every meshlet is a range of the index buffer now
+		std::copy(output.begin(), output.end(), indices.begin() + firstIndex);
+		for (auto& result : meshlets) computeBounds(vertices, indices, result);
+		return meshlets;
+	}
+
+	void MeshletBuilder::computeBounds(
+		const std::vector<Model::Vertex>& vertices,
+		const std::vector<uint32_t>& indices,
+		Model::Meshlet& meshlet) {
+		uint32_t end = meshlet.firstIndex + meshlet.indexCount;
+
+		// The sphere is centered on the bounding box, which is close enough for culling
+		glm::vec3 boxMin{ FLT_MAX };
+		glm::vec3 boxMax{ -FLT_MAX };
+		for (uint32_t i = meshlet.firstIndex; i < end; i++) {
+			boxMin = glm::min(boxMin, vertices[indices[i]].position);
+			boxMax = glm::max(boxMax, vertices[indices[i]].position);
+		}
+		meshlet.center = (boxMin + boxMax) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (uint32_t i = meshlet.firstIndex; i < end; i++) {
+			glm::vec3 offset = vertices[indices[i]].position - meshlet.center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		meshlet.radius = std::sqrt(radiusSquared);
+
+		// The cone axis is the average facing direction, and the cutoff comes from the
+		// triangle that faces the furthest away from it
+		std::vector<glm::vec3> normals{};
+		glm::vec3 axis{ 0.0f };
+		for (uint32_t i = meshlet.firstIndex; i < end; i += 3) {
+			const glm::vec3& a = vertices[indices[i]].position;
+			const glm::vec3& b = vertices[indices[i + 1]].position;
+			const glm::vec3& c = vertices[indices[i + 2]].position;
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			if (length == 0.0f) continue;
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+
+		meshlet.coneAxis = glm::vec3{ 0.0f, 0.0f, 1.0f };
+		meshlet.coneCutoff = 1.0f;	// Never back facing
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f) return;
+		axis /= axisLength;
+
+		float minimumDot = 1.0f;
+		for (const glm::vec3& normal : normals) minimumDot = std::min(minimumDot, glm::dot(normal, axis));
+		if (minimumDot <= MIN_CONE_SPREAD) return;
+
+		// Every normal is within acos(minimumDot) of the axis. A view direction makes every
+		// triangle face away once it's within 90 degrees minus that angle of the axis.
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+	}
+}
@@ -0,0 +1,46 @@
+//**********************************************************************
+// The meshlet builder cuts the index buffer of a model into small
+// clusters of triangles (meshlets) so the render system can throw away
+// the parts of a large model that can't be seen before drawing it.
+// A meshlet grows from one triangle into the neighbouring triangles
+// that share the most vertices with it and face the same way. The
+// triangles are then reordered so every meshlet is a range of the
+// index buffer that a regular indexed draw can draw, no mesh shaders
+// are needed. Every meshlet gets a bounding sphere for frustum culling
+// and a normal cone, the range of directions its triangles face, for
+// back face culling of the whole cluster at once.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	class MeshletBuilder {
+	public:
+		static constexpr size_t MAX_VERTICES = 64;
+		static constexpr size_t MAX_TRIANGLES = 124;
+
+		// Splits indices [firstIndex, firstIndex + indexCount) into meshlets of at most
+		// maxVertices unique vertices and maxTriangles triangles each. The triangles in
+		// that range are reordered, meshlet after meshlet.
+		static std::vector<Model::Meshlet> build(
+			const std::vector<Model::Vertex>& vertices,
+			std::vector<uint32_t>& indices,
+			uint32_t firstIndex,
+			uint32_t indexCount,
+			size_t maxVertices = MAX_VERTICES,
+			size_t maxTriangles = MAX_TRIANGLES);
+
+		// Fills in the bounding sphere and normal cone of a meshlet from its triangles
+		static void computeBounds(
+			const std::vector<Model::Vertex>& vertices,
+			const std::vector<uint32_t>& indices,
+			Model::Meshlet& meshlet);
+	};
+}
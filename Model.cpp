@@ -1,144 +1,665 @@
 #include "Model.h"
-#include "Utils.h"
+#include "GlbLoader.h"
+#include "MaterialTable.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "ObjParser.h"
+#include "VertexWelder.h"
+#include "VirtualFileSystem.h"
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
-#define GLM_ENABLE_EXPERIMENTAL // This will help us hash the individual glm vec components
-#include <glm/gtx/hash.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
-#include <unordered_map>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
 
-namespace std {
-	template <>
+namespace engine {
+	namespace {
+		// The simplification error of every level of detail after the full model, relative
+		// to the radius of the model. The last one is only meant for a few pixels on screen.
+		const std::vector<float> LOD_ERRORS{ 0.002f, 0.008f, 0.03f, 0.1f };
+
+		// A level has to get rid of at least this share of the previous
+		// level's triangles, otherwise it isn't worth the index memory
+		constexpr float LOD_MIN_REDUCTION = 0.2f;
+
+		// Smaller models are culled as a whole, splitting them up would only add draw calls
+		constexpr size_t MESHLET_MIN_TRIANGLES = 16 * MeshletBuilder::MAX_TRIANGLES;
+
+		// Lets tiny object loader find its mtllib files through the virtual file system, relative
+		// to the folder of the OBJ file like its own MaterialFileReader. A missing library only
+		// leaves a warning, the same as before.
+		class VirtualMaterialReader : public tinyobj::MaterialReader {
+		public:
+			explicit VirtualMaterialReader(const std::string& folder) : folder{ folder } {}
 
-	// With this we can take an instance of the Vertex struct and hash it to a single 
-	// value type size_t, which can then be used by an unordered map as the key
-	struct hash<engine::Model::Vertex> {
-		size_t operator()(engine::Model::Vertex const& vertex) const {
-			size_t seed = 0;		// This will store the final hash value
-			engine::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
-			return seed;
+			bool operator()(const std::string& materialId, std::vector<tinyobj::material_t>* materials,
+				std::map<std::string, int>* materialMap, std::string* warn, std::string* error) override {
+				std::string filePath = (std::filesystem::path(folder) / materialId).string();
+				VirtualFileSystem& fileSystem = VirtualFileSystem::shared();
+				if (!fileSystem.exists(filePath)) {
+					if (warn) *warn += "Material file [ " + filePath + " ] not found.\n";
+					return false;
+				}
+				VirtualFileSystem::File file = fileSystem.open(filePath);
+				file.waitForAll();
+				std::istringstream stream{ std::string(file.data(), file.size()) };
+				tinyobj::LoadMtl(materialMap, materials, &stream, warn, error);
+				return true;
+			}
+
+		private:
+			std::string folder;
+		};
+
+		// Folds a unit vector onto an octahedron and unfolds that into a square, which
+		// keeps the precision even across every direction with only two values
+		glm::vec2 encodeOctahedral(glm::vec3 normal) {
+			float sum = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+			if (sum == 0.0f) return glm::vec2{ 0.0f };
+			normal /= sum;
+
+			glm::vec2 encoded{ normal.x, normal.y };
+			if (normal.z < 0.0f) {
+				encoded.x = (1.0f - glm::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+				encoded.y = (1.0f - glm::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+			}
+			return encoded;
 		}
-	};
-}
 
-namespace engine {
-	Model::Model(Device &tempDevice, const Model::Builder &builder) : device{tempDevice}{
-		createVertexBuffers(builder.vertices);
-		createIndexBuffers(builder.indices);
+		Model::CompactVertex encodeCompactVertex(const Model::Vertex& vertex, const Model::BoundingBox& bounds) {
+			glm::vec3 extent = bounds.max - bounds.min;
+			glm::vec3 position = vertex.position - bounds.min;
+			for (int i = 0; i < 3; i++) {
+				position[i] = extent[i] > 0.0f ? position[i] / extent[i] : 0.0f;
+			}
+
+			Model::CompactVertex compact{};
+			uint64_t packedPosition = glm::packUnorm4x16(glm::vec4{ position, 0.0f });
+			std::memcpy(compact.position, &packedPosition, sizeof(packedPosition));
+			compact.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+			compact.uv = glm::packHalf2x16(vertex.uv);
+			compact.color = glm::packUnorm4x8(glm::vec4{ vertex.color, 1.0f });
+			return compact;
+		}
+
+		// Builds the full vertex of one face corner
+		Model::Vertex vertexFromObj(const ObjData& obj, const ObjIndex& index) {
+			Model::Vertex vertex{};
+			// The vertex index is the first value of the face element and says
+			// what position value to use. Index values are optional and a negative
+			// value indicates that no index was provided. If one is we continue
+			if (index.vertexIndex >= 0) {
+				// Each vertex has 3 values that are tightly packed in the positions
+				// array. To read the corresponding position, we need to multiply by 3 and
+				// then add 0 for the initial component, followed by 1 and 2 for Z and Y. 
+				vertex.position = {
+					obj.positions[3 * index.vertexIndex + 0],
+					obj.positions[3 * index.vertexIndex + 1],
+					obj.positions[3 * index.vertexIndex + 2]
+				};
+				// We use the last index because color attributes are optional
+				// and this is a convenient way to check that a color has been
+				// provided and the index is in bounds. In some formats, the
+				// RGB information will be right after the last vertex position
+				vertex.color = {
+					obj.colors[3 * index.vertexIndex + 0],
+					obj.colors[3 * index.vertexIndex + 1],
+					obj.colors[3 * index.vertexIndex + 2]
+				};
+			}
+			if (index.normalIndex >= 0) {
+				vertex.normal = {
+					obj.normals[3 * index.normalIndex + 0],
+					obj.normals[3 * index.normalIndex + 1],
+					obj.normals[3 * index.normalIndex + 2]
+				};
+			}
+			// UVs only have two values
+			if (index.texcoordIndex >= 0) {
+				vertex.uv = {
+					obj.texcoords[2 * index.texcoordIndex + 0],
+					obj.texcoords[2 * index.texcoordIndex + 1]
+				};
+			}
+			return vertex;
+		}
+	}
+
+	Model::Model(Device &tempDevice, const Model::Builder &builder, VertexFormat format, bool deferUpload)
+		: Model{ tempDevice,
+			builder.vertices.data(), static_cast<uint32_t>(builder.vertices.size()),
+			builder.indices.data(), static_cast<uint32_t>(builder.indices.size()),
+			builder.bounds, builder.lods, builder.meshlets, builder.subMeshes, builder.materials,
+			format, deferUpload } {}
+
+	Model::Model(Device &tempDevice, const Vertex *vertices, uint32_t vertexCount,
+		const uint32_t *indices, uint32_t indexCount, const BoundingBox &bounds,
+		const std::vector<Lod> &tempLods, const std::vector<Meshlet> &tempMeshlets,
+		const std::vector<SubMesh> &tempSubMeshes, const std::vector<Material> &tempMaterials, VertexFormat format,
+		bool deferUpload)
+		: device{tempDevice}, boundingBox{bounds}, lods{tempLods}, meshlets{tempMeshlets},
+		subMeshes{tempSubMeshes}, materials{tempMaterials}, vertexFormat{format} {
+		// The shader reads compact positions as 0 to 1 inside the bounding
+		// box, this matrix stretches them back out to the original size
+		if (vertexFormat == VertexFormat::Compact) {
+			positionTransform = glm::scale(
+				glm::translate(glm::mat4{ 1.0f }, boundingBox.min),
+				boundingBox.max - boundingBox.min);
+		}
+		allocateBuffers(vertexCount, indexCount);
+		writeVertices(vertices);
+		writeIndices(indices);
+		finishConstruction(deferUpload);
+	}
+	Model::Model(Device &tempDevice, uint32_t tempVertexCount, uint32_t tempIndexCount, const BoundingBox &bounds,
+		const std::vector<Lod> &tempLods, const std::vector<Meshlet> &tempMeshlets,
+		const std::vector<SubMesh> &tempSubMeshes, const std::vector<Material> &tempMaterials,
+		VertexFormat format, const StagingWriter &writeStaging, bool deferUpload)
+		: device{tempDevice}, boundingBox{bounds}, lods{tempLods}, meshlets{tempMeshlets},
+		subMeshes{tempSubMeshes}, materials{tempMaterials}, vertexFormat{format} {
+		assert(tempIndexCount >= 3 && "Models written through a staging writer need indices");
+		if (vertexFormat == VertexFormat::Compact) {
+			positionTransform = glm::scale(
+				glm::translate(glm::mat4{ 1.0f }, boundingBox.min),
+				boundingBox.max - boundingBox.min);
+		}
+		allocateBuffers(tempVertexCount, tempIndexCount);
+
+		// The writers split their vertices into the two streams of the staging memory themselves
+		writeStaging(
+			VertexStreams::split(vertexStagingBuffer->getMappedMemory(), vertexCount, vertexFormat),
+			indexStagingBuffer->getMappedMemory());
+		finishConstruction(deferUpload);
+	}
+	void Model::finishConstruction(bool deferUpload) {
+		// Models without levels of detail get a single level with all of their indices
+		if (lods.empty()) lods.push_back({ 0, indexCount, 0.0f, 0, static_cast<uint32_t>(subMeshes.size()) });
+
+		// Models without sub meshes draw every level as a single range with the default material
+		if (subMeshes.empty()) {
+			for (Lod& lod : lods) {
+				lod.firstSubMesh = static_cast<uint32_t>(subMeshes.size());
+				lod.subMeshCount = 1;
+				subMeshes.push_back({ lod.firstIndex, lod.indexCount, 0 });
+			}
+		}
+		if (materials.empty()) materials.push_back(Material{});
+
+		// Both buffers go over in one submit
+		if (!deferUpload) {
+			UploadContext& uploadContext = device.getUploadContext();
+			recordUpload(uploadContext);
+			uploadContext.finish();
+			releaseStagingBuffers();
+		}
+	}
+	Model::Model(Device &tempDevice, uint32_t tempVertexCount, uint32_t tempIndexCount, const BoundingBox &bounds,
+		VertexFormat format)
+		: device{tempDevice}, vertexCount{tempVertexCount}, indexCount{tempIndexCount}, boundingBox{bounds}, vertexFormat{format},
+		vertexLayout{VertexLayout::Interleaved} {
+		assert(vertexCount >= 3 && indexCount >= 3 && "Streamed models need at least one triangle");
+		if (vertexFormat == VertexFormat::Compact) {
+			positionTransform = glm::scale(
+				glm::translate(glm::mat4{ 1.0f }, boundingBox.min),
+				boundingBox.max - boundingBox.min);
+		}
+
+		vertexBuffer = std::make_unique<Buffer>(
+			device,
+			getVertexSize(vertexFormat),
+			vertexCount,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Mesh);
+
+		hasIndexBuffer = true;
+		indexType = getIndexType(vertexCount);
+		indexBuffer = std::make_unique<Buffer>(
+			device,
+			indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t),
+			indexCount,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Mesh);
+
+		lods.push_back({ 0, 0, 0.0f });
+		subMeshes.push_back({ 0, 0, 0 });
+		materials.push_back(Material{});
+	}
+	Model::~Model() {
+		if (materialOffset != NO_MATERIAL_OFFSET) {
+			device.getMaterialTable().release(materialOffset, static_cast<uint32_t>(materials.size()));
+		}
 	}
-	Model::~Model() {}
 
 	std::unique_ptr<Model> Model::createModelFromFile(
-		Device& device, const std::string& filePath) {
+		Device& device, const std::string& filePath, VertexFormat format, bool deferUpload, bool buildBvh) {
+		// glb files already hold finished vertex and index arrays, they're read
+		// straight out of the mapped file and don't need the mesh cache
+		if (GlbLoader::isGlbFile(filePath)) {
+			return GlbLoader::createModel(device, filePath, format, deferUpload, buildBvh);
+		}
+
+		// On a warm start the mesh cache already holds the finished vertices and indices,
+		// they're decoded out of the mapped file on their way into the staging buffers
+		if (auto cache = MeshCache::open(filePath)) {
+			uint32_t cacheVertexCount = cache->getVertexCount();
+			BoundingBox bounds = cache->getBoundingBox();
+
+			// The BVH keeps the full precision vertices, so they're decoded here first and the model
+			// is written from them. Otherwise the vertices are decoded straight into the staging memory.
+			std::vector<Vertex> vertices{};
+			std::vector<uint32_t> indices{};
+			if (buildBvh) {
+				vertices.resize(cacheVertexCount);
+				cache->writeVertices(vertices.data());
+				indices.resize(cache->getIndexCount());
+				cache->writeIndices(indices.data(), VK_INDEX_TYPE_UINT32);
+			}
+
+			auto model = std::make_unique<Model>(
+				device, cacheVertexCount, cache->getIndexCount(), bounds,
+				cache->getLods(), cache->getMeshlets(), cache->getSubMeshes(), cache->getMaterials(), format,
+				[&](const VertexStreams &vertexStaging, void *indexStaging) {
+					if (vertices.empty()) cache->writeVertices(vertexStaging);
+					else vertexStaging.encode(0, vertices.data(), cacheVertexCount, bounds);
+					cache->writeIndices(indexStaging, getIndexType(cacheVertexCount));
+				},
+				deferUpload);
+			if (buildBvh) {
+				model->setBvh(std::make_unique<MeshBvh>(
+					&vertices[0].position, sizeof(Vertex), cacheVertexCount,
+					indices.data() + model->getLod(0).firstIndex, model->getLod(0).indexCount));
+			}
+			return model;
+		}
+
 		Builder builder{};
-		builder.loadModel(filePath);
-		return std::make_unique<Model>(device, builder);
+		builder.cook(filePath);
+		MeshCache::write(filePath, builder);
+		auto model = std::make_unique<Model>(device, builder, format, deferUpload);
+		if (buildBvh) {
+			model->setBvh(std::make_unique<MeshBvh>(
+				&builder.vertices[0].position, sizeof(Vertex), static_cast<uint32_t>(builder.vertices.size()),
+				builder.indices.data() + model->getLod(0).firstIndex, model->getLod(0).indexCount));
+		}
+		return model;
 	}
 
-	void Model::createVertexBuffers(const std::vector<Vertex>& vertices) {
-		vertexCount = static_cast<uint32_t>(vertices.size());
+	void Model::Builder::cook(const std::string& filePath) {
+		loadModel(filePath);
+
+		// Reordering only happens on a cold load, the mesh cache stores the optimized order
+		MeshOptimizer::Report report = MeshOptimizer::optimize(*this);
+		std::ostringstream message{};
+		message << std::fixed << std::setprecision(3) << filePath
+			<< ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+			<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr;
+		std::cout << message.str() << std::endl;
+
+		generateLods(LOD_ERRORS);
+		if (lods[0].indexCount / 3 >= MESHLET_MIN_TRIANGLES) generateMeshlets();
+		message.str("");
+		message << filePath << ": " << lods.size() << " LOD(s),";
+		for (const Lod& lod : lods) message << " " << lod.indexCount / 3;
+		message << " triangles, " << meshlets.size() << " meshlet(s), "
+			<< lods[0].subMeshCount << " sub mesh(es)";
+		std::cout << message.str() << std::endl;
+	}
+
+	void Model::writeVertices(const Vertex *vertices) {
+		VertexStreams::split(vertexStagingBuffer->getMappedMemory(), vertexCount, vertexFormat)
+			.encode(0, vertices, vertexCount, boundingBox);
+	}
+
+	// This is identical to the writeVertices function except that we are writing indices
+	void Model::writeIndices(const uint32_t *indices) {
+		if (!hasIndexBuffer) return;
+
+		if (indexType == VK_INDEX_TYPE_UINT16) {
+			auto shortIndices = static_cast<uint16_t*>(indexStagingBuffer->getMappedMemory());
+			for (uint32_t i = 0; i < indexCount; i++) {
+				shortIndices[i] = static_cast<uint16_t>(indices[i]);
+			}
+		}
+		else {
+			std::memcpy(indexStagingBuffer->getMappedMemory(), indices, getIndexBufferSize());
+		}
+	}
+
+	void Model::allocateBuffers(uint32_t tempVertexCount, uint32_t tempIndexCount) {
+		vertexCount = tempVertexCount;
+		indexCount = tempIndexCount;
 		assert(vertexCount >= 3 && "Vertex count must be at least 3");
 
-		// Total number of bytes required for our vertex buffer to store all the vertices of the model
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-		uint32_t vertexSize = sizeof(vertices[0]);
+		// Checks
+		hasIndexBuffer = indexCount > 0;
+		assert((!hasIndexBuffer || indexCount >= 3) && "Index count must be at least 3");
+		indexType = getIndexType(vertexCount);
 
-		// We create a stage buffer so that we can use local memory which more efficient
-		// We destroy this after we're done copying it to the main vertex buffer.
-		Buffer stagingBuffer{
-			device,
-			vertexSize,
-			vertexCount,
-			// This tells Vulkan that the buffer we are creating is going to be
-			// used just as the source location for our memory transfer operation
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			// Host visible bit tells Vulkan that we want the allocated memory to be accessible from our
-			// host (aka the CPU). This is necessary for our host to be able to to write the device memory.
-			// The host coherent bit property keeps the host and device memory regions consistent with each
-			// other. If this property is absent, then we are required to call vkFlushMappedMemoryRanges
-			// in order to propagate changes from host to device memory.
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		};
+		// Number of bytes every vertex and index takes up on the GPU
+		uint32_t vertexSize = getVertexSize(vertexFormat);
+		uint32_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		attributeStreamOffset = static_cast<VkDeviceSize>(vertexCount) * getPositionSize(vertexFormat);
+
+		// We stage the data so that we can use local memory which more efficient. The staging
+		// ranges come out of the upload context's ring, which is host visible, host coherent and
+		// always mapped, and go back to it once the copies to the GPU are done.
+		UploadContext& uploadContext = device.getUploadContext();
+		vertexStagingBuffer = uploadContext.allocate(static_cast<VkDeviceSize>(vertexSize) * vertexCount);
+		if (hasIndexBuffer) {
+			indexStagingBuffer = uploadContext.allocate(static_cast<VkDeviceSize>(indexSize) * indexCount);
+		}
 
-		// This function call creates a region of post memory mapped to device 
-		// memory and sets data to the beginning of the mapped memory range.
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)vertices.data());
+		// The vertices and indices go into the shared geometry heap, so drawing this model
+		// doesn't need buffers of its own bound
+		GeometryHeap& heap = device.getGeometryHeap();
+		heapRange = heap.allocate(static_cast<uint32_t>(vertexFormat), vertexCount, indexType, indexCount);
+		if (heapRange) {
+			firstVertex = heapRange->getFirstVertex();
+			firstIndex = heapRange->getFirstIndex();
+			return;
+		}
 
+		// The heap is full, this model gets buffers of its own like it used to
+		heap.addFallback();
 		vertexBuffer = std::make_unique<Buffer>(
 			device,
 			vertexSize,
 			vertexCount,
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);	// This is most optimal local memory according to Vulkan
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,	// This is most optimal local memory according to Vulkan
+			MemoryCategory::Mesh);
+		if (hasIndexBuffer) {
+			indexBuffer = std::make_unique<Buffer>(
+				device,
+				indexSize,
+				indexCount,
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				MemoryCategory::Mesh);
+		}
+	}
+
+	void Model::recordUpload(UploadContext& uploadContext) {
+		assert(isUploadPending() && "The model has already been uploaded");
 
-		device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+		// The two vertex streams land in separate regions of the heap
+		if (heapRange) {
+			GeometryHeap& heap = device.getGeometryHeap();
+			heap.recordVertexCopy(uploadContext.record(*vertexStagingBuffer),
+				vertexStagingBuffer->getBuffer(), vertexStagingBuffer->getOffset(), *heapRange);
+			if (hasIndexBuffer) {
+				heap.recordIndexCopy(uploadContext.record(*indexStagingBuffer),
+					indexStagingBuffer->getBuffer(), indexStagingBuffer->getOffset(), *heapRange);
+			}
+			return;
+		}
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = vertexStagingBuffer->getOffset();
+		copyRegion.size = getVertexBufferSize();
+		uploadContext.record(*vertexStagingBuffer).copyBuffer(
+			vertexStagingBuffer->getBuffer(), vertexBuffer->getBuffer(), 1, &copyRegion);
+		if (hasIndexBuffer) {
+			copyRegion.srcOffset = indexStagingBuffer->getOffset();
+			copyRegion.size = getIndexBufferSize();
+			uploadContext.record(*indexStagingBuffer).copyBuffer(
+				indexStagingBuffer->getBuffer(), indexBuffer->getBuffer(), 1, &copyRegion);
+		}
 	}
 
-	// This is identical to the createVertexBuffers function except that we are creating indices
-	void Model::createIndexBuffers(const std::vector<uint32_t> &indices) {
-		indexCount = static_cast<uint32_t>(indices.size());
-		
-		// Checks
-		hasIndexBuffer = indexCount > 0;
-		if (!hasIndexBuffer) return;
-		assert(indexCount >= 3 && "Index count must be at least 3");
+	void Model::releaseStagingBuffers() {
+		vertexStagingBuffer.reset();
+		indexStagingBuffer.reset();
+	}
 
-		// Total number of bytes required for our index buffer to store all the indices of the model
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-		uint32_t indexSize = sizeof(indices[0]);
+	void Model::recordRangeUpload(TransferQueue::Batch& batch, VkBuffer stagingBuffer,
+		VkDeviceSize vertexOffset, uint32_t firstVertex, uint32_t rangeVertexCount,
+		VkDeviceSize indexOffset, uint32_t firstIndex, uint32_t rangeIndexCount) {
+		assert(firstVertex + rangeVertexCount <= vertexCount && firstIndex + rangeIndexCount <= indexCount
+			&& "Range is outside of the model");
 
-		Buffer stagingBuffer{
-			device,
-			indexSize,
-			indexCount,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		};
+		VkDeviceSize vertexSize = getVertexSize(vertexFormat);
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = vertexOffset;
+		copyRegion.dstOffset = firstVertex * vertexSize;
+		copyRegion.size = rangeVertexCount * vertexSize;
+		if (copyRegion.size > 0) {
+			batch.copyBuffer(stagingBuffer, vertexBuffer->getBuffer(), 1, &copyRegion);
+		}
 
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)indices.data());
+		VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+		copyRegion.srcOffset = indexOffset;
+		copyRegion.dstOffset = firstIndex * indexSize;
+		copyRegion.size = rangeIndexCount * indexSize;
+		if (copyRegion.size > 0) {
+			batch.copyBuffer(stagingBuffer, indexBuffer->getBuffer(), 1, &copyRegion);
+		}
+	}
 
-		indexBuffer = std::make_unique<Buffer>(
-			device,
-			indexSize,
-			indexCount,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	void Model::setResidentIndexCount(uint32_t count) {
+		assert(count <= indexCount && "More indices than the model has");
+		lods[0].indexCount = count;
+		subMeshes[0].indexCount = count;
+	}
 
-		device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+	void Model::encodeVertices(const ObjData& obj, const ObjIndex* corners, size_t count,
+		VertexFormat format, const BoundingBox& bounds, void* destination) {
+		if (format == VertexFormat::Compact) {
+			auto compactVertices = static_cast<CompactVertex*>(destination);
+			for (size_t i = 0; i < count; i++) {
+				compactVertices[i] = encodeCompactVertex(vertexFromObj(obj, corners[i]), bounds);
+			}
+		}
+		else {
+			auto vertices = static_cast<Vertex*>(destination);
+			for (size_t i = 0; i < count; i++) {
+				vertices[i] = vertexFromObj(obj, corners[i]);
+			}
+		}
+	}
+
+	void Model::encodeVertices(const Vertex* vertices, size_t count,
+		VertexFormat format, const BoundingBox& bounds, void* destination) {
+		if (format == VertexFormat::Compact) {
+			auto compactVertices = static_cast<CompactVertex*>(destination);
+			for (size_t i = 0; i < count; i++) {
+				compactVertices[i] = encodeCompactVertex(vertices[i], bounds);
+			}
+		}
+		else {
+			std::memcpy(destination, vertices, count * sizeof(Vertex));
+		}
+	}
+
+	uint32_t Model::getVertexSize(VertexFormat format) {
+		return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+	}
+
+	uint32_t Model::getPositionSize(VertexFormat format) {
+		return format == VertexFormat::Compact ? sizeof(CompactVertex::position) : sizeof(Vertex::position);
+	}
+
+	Model::VertexStreams Model::VertexStreams::split(void* destination, size_t count, VertexFormat format) {
+		VertexStreams streams{};
+		streams.positionStride = getPositionSize(format);
+		streams.attributeStride = getVertexSize(format) - streams.positionStride;
+		streams.positions = static_cast<char*>(destination);
+		streams.attributes = streams.positions + count * streams.positionStride;
+		streams.format = format;
+		return streams;
+	}
+
+	Model::VertexStreams Model::VertexStreams::interleaved(void* destination, VertexFormat format) {
+		VertexStreams streams{};
+		streams.positionStride = getVertexSize(format);
+		streams.attributeStride = streams.positionStride;
+		streams.positions = static_cast<char*>(destination);
+		streams.attributes = streams.positions + getPositionSize(format);
+		streams.format = format;
+		return streams;
+	}
+
+	void Model::VertexStreams::write(size_t first, const void* vertices, size_t count) const {
+		const size_t vertexSize = getVertexSize(format);
+		const size_t positionSize = getPositionSize(format);
+		const size_t attributeSize = vertexSize - positionSize;
+		auto source = static_cast<const char*>(vertices);
+
+		char* positionTarget = positions + first * positionStride;
+		if (positionStride == vertexSize) {
+			// Interleaved, the vertices go over as they are
+			std::memcpy(positionTarget, source, count * vertexSize);
+			return;
+		}
+
+		// Both streams are written front to back, which keeps write combined staging memory happy
+		for (size_t i = 0; i < count; i++) {
+			std::memcpy(positionTarget + i * positionStride, source + i * vertexSize, positionSize);
+		}
+		char* attributeTarget = attributes + first * attributeStride;
+		for (size_t i = 0; i < count; i++) {
+			std::memcpy(attributeTarget + i * attributeStride, source + i * vertexSize + positionSize, attributeSize);
+		}
+	}
+
+	void Model::VertexStreams::encode(size_t first, const Vertex* vertices, size_t count, const BoundingBox& bounds) const {
+		if (format == VertexFormat::Standard) {
+			write(first, vertices, count);
+			return;
+		}
+
+		// 5 KB, so the whole model never needs a converted copy
+		constexpr size_t BATCH_SIZE = 256;
+		CompactVertex batch[BATCH_SIZE];
+		for (size_t start = 0; start < count; start += BATCH_SIZE) {
+			size_t batchCount = std::min(BATCH_SIZE, count - start);
+			encodeVertices(vertices + start, batchCount, format, bounds, batch);
+			write(first + start, batch, batchCount);
+		}
+	}
+
+	std::vector<VkVertexInputBindingDescription> Model::getBindingDescriptions(VertexFormat format, VertexLayout layout) {
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions = format == VertexFormat::Compact
+			? CompactVertex::getBindingDescriptions() : Vertex::getBindingDescriptions();
+		if (layout == VertexLayout::Interleaved) return bindingDescriptions;
+
+		uint32_t positionSize = getPositionSize(format);
+		bindingDescriptions[0].stride = positionSize;
+		bindingDescriptions.push_back({ 1, getVertexSize(format) - positionSize, VK_VERTEX_INPUT_RATE_VERTEX });
+		return bindingDescriptions;
+	}
+
+	// Split models read the position from binding 0 at offset 0, every other attribute
+	// moves to binding 1 and loses the bytes of the position in front of it
+	std::vector<VkVertexInputAttributeDescription> Model::getAttributeDescriptions(VertexFormat format, VertexLayout layout) {
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions = format == VertexFormat::Compact
+			? CompactVertex::getAttributeDescriptions() : Vertex::getAttributeDescriptions();
+		if (layout == VertexLayout::Interleaved) return attributeDescriptions;
+
+		uint32_t positionSize = getPositionSize(format);
+		for (auto& attribute : attributeDescriptions) {
+			if (attribute.location == 0) continue;
+			attribute.binding = 1;
+			attribute.offset -= positionSize;
+		}
+		return attributeDescriptions;
 	}
 
 	void Model::draw(VkCommandBuffer commandBuffer) {
+		draw(commandBuffer, 0);
+	}
+
+	void Model::draw(VkCommandBuffer commandBuffer, uint32_t lod) {
+		assert(lod < lods.size() && "Level of detail out of range");
+
 		// If the model has an index buffer, there's no need to call both functions as
 		// the draw indexed function will call whatever is bound to the command buffer
 		// This includes the vertex buffer, so we only need to call one of these.
+		// Every level of detail uses the same vertices, only the index range changes.
+		// Models in the geometry heap add where they start in it to every draw.
+		if (hasIndexBuffer) {
+			vkCmdDrawIndexed(commandBuffer, lods[lod].indexCount, 1, firstIndex + lods[lod].firstIndex,
+				static_cast<int32_t>(firstVertex), 0);
+		}
+		else {
+			vkCmdDraw(commandBuffer, vertexCount, 1, firstVertex, 0);
+		}
+	}
+
+	void Model::drawIndexRange(VkCommandBuffer commandBuffer, uint32_t rangeFirstIndex, uint32_t rangeIndexCount) {
+		assert(hasIndexBuffer && "Index ranges need an index buffer");
+		vkCmdDrawIndexed(commandBuffer, rangeIndexCount, 1, firstIndex + rangeFirstIndex, static_cast<int32_t>(firstVertex), 0);
+	}
+
+	void Model::drawSubMesh(VkCommandBuffer commandBuffer, const SubMesh& subMesh) {
 		if (hasIndexBuffer) {
-			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, subMesh.indexCount, 1, firstIndex + subMesh.firstIndex,
+				static_cast<int32_t>(firstVertex), 0);
 		}
 		else {
-			vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+			vkCmdDraw(commandBuffer, vertexCount, 1, firstVertex, 0);
 		}
 	}
 
+	uint32_t Model::getTriangleCount(uint32_t lod) const {
+		return hasIndexBuffer ? lods[lod].indexCount / 3 : vertexCount / 3;
+	}
+
 	// This basically makes the buffers available to Vulkan
 	void Model::bind(VkCommandBuffer commandBuffer) {
+		if (heapRange) {
+			GeometryHeap& heap = device.getGeometryHeap();
+			heap.bindVertices(commandBuffer, static_cast<uint32_t>(vertexFormat));
+			if (hasIndexBuffer) heap.bindIndices(commandBuffer, indexType);
+			return;
+		}
+
 		// This function will record to our command buffer to bind one vertex buffer 
 		// starting at binding 0 with an offset of 0 into the buffer. When we want to 
 		// add multiple bindings, we can add additional elements to these arrays.
-		VkBuffer buffers[] = { vertexBuffer->getBuffer()};
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+		// Split models bind the same buffer twice, binding 1 starts where the positions end.
+		VkBuffer buffers[] = { vertexBuffer->getBuffer(), vertexBuffer->getBuffer() };
+		VkDeviceSize offsets[] = { 0, attributeStreamOffset };
+		vkCmdBindVertexBuffers(commandBuffer, 0, vertexLayout == VertexLayout::Split ? 2 : 1, buffers, offsets);
 
 		if (hasIndexBuffer) {
 			// Index type need to match the type of the indices vector, for smaller 
 			// models you can save memory by using a smaller index type. 16 bits allow 
 			// for around 65,000 vertices, whereas 32 bit allows for over 4 million.
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
+		}
+	}
+
+	void Model::bindPositions(VkCommandBuffer commandBuffer) {
+		if (heapRange) {
+			GeometryHeap& heap = device.getGeometryHeap();
+			heap.bindVertices(commandBuffer, static_cast<uint32_t>(vertexFormat), true);
+			if (hasIndexBuffer) heap.bindIndices(commandBuffer, indexType);
+			return;
+		}
+
+		VkBuffer buffers[] = { vertexBuffer->getBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+
+		if (hasIndexBuffer) {
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
 		}
 	}
 
@@ -169,73 +690,231 @@ namespace engine {
 		return attributeDescriptions;
 	}
 
-	// Here we load in the models using tiny object loader
+	// The compact vertex uses the same binding and locations as the standard one, only
+	// the formats change. Vulkan converts the normalized and half float values back to
+	// regular floats before the shader sees them.
+	std::vector<VkVertexInputBindingDescription> Model::CompactVertex::getBindingDescriptions() {
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+		bindingDescriptions[0].binding = 0;
+		bindingDescriptions[0].stride = sizeof(CompactVertex);
+		bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> Model::CompactVertex::getAttributeDescriptions() {
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+		attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, position) });
+		attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, color) });
+		attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) });
+		attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) });
+		return attributeDescriptions;
+	}
+
+	// Here we load in the models using our own OBJ parser (see ObjParser.h). The file is
+	// parsed on all of our cores and then turned into vertices and indices the same way
+	// the tiny object loader version below does it, so both give back the exact same data.
 	void Model::Builder::loadModel(const std::string& filePath) {
+		ObjData obj = ObjParser::parseFile(filePath);
+		if (!obj.materials.empty()) materialLibraries = obj.materialLibraries;
+		buildFromObj(obj);
+	}
+
+	// Here we load in the models using tiny object loader
+	void Model::Builder::loadModelTinyObj(const std::string& filePath) {
 		// This records the position, color, normal and texture coordinate data
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;	// Contains the index values for each face element
 		std::vector<tinyobj::material_t> materials;
 		std::string warn, error;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, filePath.c_str())) {
+		// tinyobj only reads from disk or a stream, so files that may be inside an archive are handed over as a stream
+		VirtualFileSystem::File file = VirtualFileSystem::shared().open(filePath);
+		file.waitForAll();
+		std::istringstream stream{ std::string(file.data(), file.size()) };
+		VirtualMaterialReader materialReader{ std::filesystem::path(filePath).parent_path().string() };
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, &stream, &materialReader)) {
 			throw std::runtime_error(warn + " " + error);
 		}
-		vertices.clear();
-		indices.clear();
-
-		// This map will keep track of the vertices which have already been added to the
-		// builder.vertices vector and store the position at which the vertex was originally added
-		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
 
+		// We move the tinyobj data over into the same layout our own parser uses
+		// so that both paths share the rest of the model building code
+		ObjData obj{};
+		obj.positions = std::move(attrib.vertices);
+		obj.colors = std::move(attrib.colors);
+		obj.normals = std::move(attrib.normals);
+		obj.texcoords = std::move(attrib.texcoords);
+		for (const auto& material : materials) {
+			ObjMaterial objMaterial{ material.name };
+			for (int i = 0; i < 3; i++) {
+				objMaterial.diffuse[i] = material.diffuse[i];
+				objMaterial.specular[i] = material.specular[i];
+			}
+			objMaterial.shininess = material.shininess;
+			objMaterial.dissolve = material.dissolve;
+			obj.materials.push_back(objMaterial);
+		}
 		for (const auto& shape : shapes) {
-			// Loop through each face element in the model getting the index values
-			for (const auto& index : shape.mesh.indices) {
-				Vertex vertex{};
-				// The vertex index is the first value of the face element and says
-				// what position value to use. Index values are optional and a negative
-				// value indicates that no index was provided. If one is we continue
-				if (index.vertex_index >= 0) {
-					// Each vertex has 3 values that are tightly packed in the attrib.vertices
-					// array. To read the corresponding position, we need to multiply by 3 and
-					// then add 0 for the initial component, followed by 1 and 2 for Z and Y. 
-					vertex.position = {
-						attrib.vertices[3 * index.vertex_index + 0],
-						attrib.vertices[3 * index.vertex_index + 1],
-						attrib.vertices[3 * index.vertex_index + 2]
-					};
-					// We use the last index because color attributes are optional
-					// and this is a convenient way to check that a color has been
-					// provided and the index is in bounds. In some formats, the
-					// RGB information will be right after the last vertex position
-					vertex.color = {
-						attrib.colors[3 * index.vertex_index + 0],
-						attrib.colors[3 * index.vertex_index + 1],
-						attrib.colors[3 * index.vertex_index + 2]
-					};
-				}
-				if (index.normal_index >= 0) {
-					vertex.normal = {
-						attrib.normals[3 * index.normal_index + 0],
-						attrib.normals[3 * index.normal_index + 1],
-						attrib.normals[3 * index.normal_index + 2]
-					};
+			for (size_t face = 0; face < shape.mesh.material_ids.size(); face++) {
+				int material = shape.mesh.material_ids[face];
+				if (obj.materialRanges.empty() ? material >= 0 : obj.materialRanges.back().material != material) {
+					obj.materialRanges.push_back({ obj.indices.size() + face * 3, material });
 				}
-				// UVs only have two values
-				if (index.texcoord_index >= 0) {
-					vertex.uv = {
-						attrib.texcoords[2 * index.texcoord_index + 0],
-						attrib.texcoords[2 * index.texcoord_index + 1]
-					};
-				}
-				// If the vertex is new, we add it to the unique vertices map
-				if (uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
+			}
+			for (const auto& index : shape.mesh.indices) {
+				obj.indices.push_back({ index.vertex_index, index.normal_index, index.texcoord_index });
+			}
+		}
+		buildFromObj(obj);
+	}
+
+	void Model::Builder::generateLods(const std::vector<float>& targetErrors) {
+		if (subMeshes.empty()) subMeshes.push_back({ 0, static_cast<uint32_t>(indices.size()), 0 });
+		const std::vector<SubMesh> fullDetail = subMeshes;
+		lods.clear();
+		lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f, 0, static_cast<uint32_t>(fullDetail.size()) });
+
+		// The simplifier measures its errors against the triangles it was given, but the
+		// levels are picked by the radius of the whole model. So every sub mesh gets its
+		// targets scaled up by how much smaller it is, and its errors scaled back down.
+		std::vector<float> sortedErrors = targetErrors;
+		std::sort(sortedErrors.begin(), sortedErrors.end());
+		float modelRadius = 0.5f * glm::length(bounds.max - bounds.min);
+		std::vector<float> scales(fullDetail.size(), 1.0f);
+		std::vector<std::vector<MeshSimplifier::Level>> subMeshLevels(fullDetail.size());
+
+		// All levels of a sub mesh come out of one simplification run that raises its error
+		// limit from one target to the next. Sub meshes don't share triangles, so they run in parallel.
+		ThreadPool::shared().parallelFor(fullDetail.size(), [&](size_t s) {
+			const SubMesh& subMesh = fullDetail[s];
+			std::vector<uint32_t> subMeshIndices(
+				indices.begin() + subMesh.firstIndex, indices.begin() + subMesh.firstIndex + subMesh.indexCount);
+			if (fullDetail.size() > 1 && !subMeshIndices.empty()) {
+				glm::vec3 boundsMin = vertices[subMeshIndices[0]].position;
+				glm::vec3 boundsMax = boundsMin;
+				for (uint32_t index : subMeshIndices) {
+					boundsMin = glm::min(boundsMin, vertices[index].position);
+					boundsMax = glm::max(boundsMax, vertices[index].position);
 				}
-				// With this we add the position of the 
-				// vertex to the builder's indices vector
-				indices.push_back(uniqueVertices[vertex]);
+				float radius = 0.5f * glm::length(boundsMax - boundsMin);
+				if (radius > 0.0f && modelRadius > 0.0f) scales[s] = radius / modelRadius;
 			}
+			std::vector<float> subMeshErrors{};
+			for (float error : sortedErrors) subMeshErrors.push_back(error / scales[s]);
+			subMeshLevels[s] = MeshSimplifier::simplifyLevels(vertices, subMeshIndices, subMeshErrors);
+		});
+
+		for (size_t level = 0; level < sortedErrors.size(); level++) {
+			size_t levelIndexCount = 0;
+			for (const auto& levels : subMeshLevels) levelIndexCount += levels[level].indices.size();
+			if (levelIndexCount == 0 || levelIndexCount > lods.back().indexCount * (1.0f - LOD_MIN_REDUCTION)) continue;
+
+			Lod lod{ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(levelIndexCount), 0.0f,
+				static_cast<uint32_t>(subMeshes.size()), 0 };
+			for (size_t s = 0; s < fullDetail.size(); s++) {
+				MeshSimplifier::Level& subMeshLevel = subMeshLevels[s][level];
+				std::vector<uint32_t>& lodIndices = subMeshLevel.indices;
+				if (lodIndices.empty()) continue;	// The whole sub mesh collapsed away
+
+				// The simplified triangles come out in no particular order
+				MeshOptimizer::optimizeVertexCache(lodIndices, vertices.size(), MeshOptimizer::Options{}.cacheSize);
+				subMeshes.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()), fullDetail[s].material });
+				indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+				lod.error = std::max(lod.error, subMeshLevel.error * scales[s]);
+				lod.subMeshCount++;
+			}
+			lods.push_back(lod);
+		}
+	}
+
+	void Model::Builder::generateMeshlets() {
+		// A model without sub meshes yet is a single one with the first material
+		std::vector<SubMesh> fullDetail{ subMeshes.begin(), subMeshes.begin() + (lods.empty() ? subMeshes.size() : lods[0].subMeshCount) };
+		if (fullDetail.empty()) {
+			fullDetail.push_back({ 0, lods.empty() ? static_cast<uint32_t>(indices.size()) : lods[0].indexCount, 0 });
+		}
+
+		meshlets.clear();
+		for (const SubMesh& subMesh : fullDetail) {
+			for (Meshlet& meshlet : MeshletBuilder::build(vertices, indices, subMesh.firstIndex, subMesh.indexCount)) {
+				meshlet.material = subMesh.material;
+				meshlets.push_back(meshlet);
+			}
+		}
+	}
+
+	void Model::Builder::buildFromObj(const ObjData& obj) {
+		// First we build the full vertex of every face corner. The corners don't depend
+		// on each other so they are filled in on all of our cores, a block at a time.
+		std::vector<Vertex> corners(obj.indices.size());
+		constexpr size_t CORNERS_PER_JOB = 64 * 1024;
+		size_t jobCount = (corners.size() + CORNERS_PER_JOB - 1) / CORNERS_PER_JOB;
+		ThreadPool::shared().parallelFor(jobCount, [&](size_t job) {
+			size_t end = std::min(corners.size(), (job + 1) * CORNERS_PER_JOB);
+			for (size_t i = job * CORNERS_PER_JOB; i < end; i++) {
+				corners[i] = vertexFromObj(obj, obj.indices[i]);
+			}
+		});
+
+		// Then the welder keeps one copy of every distinct vertex, in the order they first
+		// show up, and gives us the position of each corner's vertex in the indices vector
+		VertexWelder::weld(corners.data(), corners.size(), vertices, indices);
+		groupByMaterial(obj);
+
+		// The bounding box is used by the mesh cache and for culling later on
+		bounds = {};
+		if (!vertices.empty()) {
+			bounds.min = bounds.max = vertices[0].position;
+			for (const auto& vertex : vertices) {
+				bounds.min = glm::min(bounds.min, vertex.position);
+				bounds.max = glm::max(bounds.max, vertex.position);
+			}
+		}
+	}
+
+	// Sorts the triangles by material with a stable counting sort, so every material ends up
+	// as one sub mesh and the triangles keep their order within it. Only the materials that
+	// are actually used are kept, triangles before the first usemtl get the default material.
+	void Model::Builder::groupByMaterial(const ObjData& obj) {
+		subMeshes.clear();
+		materials.clear();
+
+		std::vector<ObjMaterialRange> ranges{};
+		if (obj.materialRanges.empty() || obj.materialRanges[0].firstCorner > 0) ranges.push_back({ 0, -1 });
+		ranges.insert(ranges.end(), obj.materialRanges.begin(), obj.materialRanges.end());
+
+		// Slot 0 is for the triangles without a material, the OBJ materials follow
+		std::vector<uint32_t> slotCounts(obj.materials.size() + 1, 0);
+		for (size_t r = 0; r < ranges.size(); r++) {
+			size_t end = r + 1 < ranges.size() ? ranges[r + 1].firstCorner : indices.size();
+			slotCounts[ranges[r].material + 1] += static_cast<uint32_t>(end - ranges[r].firstCorner);
 		}
+
+		std::vector<uint32_t> slotOffsets(slotCounts.size(), 0);
+		uint32_t offset = 0;
+		for (size_t slot = 0; slot < slotCounts.size(); slot++) {
+			slotOffsets[slot] = offset;
+			if (slotCounts[slot] == 0) continue;
+
+			Material material{};
+			if (slot > 0) {
+				const ObjMaterial& objMaterial = obj.materials[slot - 1];
+				material.diffuse = { objMaterial.diffuse[0], objMaterial.diffuse[1], objMaterial.diffuse[2], objMaterial.dissolve };
+				material.specular = { objMaterial.specular[0], objMaterial.specular[1], objMaterial.specular[2], objMaterial.shininess };
+			}
+			subMeshes.push_back({ offset, slotCounts[slot], static_cast<uint32_t>(materials.size()) });
+			materials.push_back(material);
+			offset += slotCounts[slot];
+		}
+
+		// Everything already is in order when there's only one material
+		if (subMeshes.size() <= 1) return;
+		std::vector<uint32_t> grouped(indices.size());
+		for (size_t r = 0; r < ranges.size(); r++) {
+			size_t end = r + 1 < ranges.size() ? ranges[r + 1].firstCorner : indices.size();
+			uint32_t& slotOffset = slotOffsets[ranges[r].material + 1];
+			std::copy(indices.begin() + ranges[r].firstCorner, indices.begin() + end, grouped.begin() + slotOffset);
+			slotOffset += static_cast<uint32_t>(end - ranges[r].firstCorner);
+		}
+		indices = std::move(grouped);
 	}
-}
\ No newline at end of file
+}
@@ -8,18 +8,28 @@
 
 #include "Device.h"
 #include "Buffer.h"
+#include "GeometryHeap.h"
+#include "UploadContext.h"
+#include "MeshBvh.h"
 
 #define GLM_FORCE_RADIANS				// All GLM functions will expect angles in radians 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE		// GLM will expect or depth buffer values to range from 0 - 1
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <vector>
 #include <memory>
 
 namespace engine {
+	struct ObjData;
+	struct ObjIndex;
+
 	class Model {
 	private:
 		Device &device;
+		// Most models live in the device's geometry heap and leave the two buffers empty. Models
+		// that don't fit, and streamed ones, still get a vertex and an index buffer of their own.
+		std::unique_ptr<GeometryHeap::Range> heapRange;
 		std::unique_ptr<Buffer> vertexBuffer;
 		uint32_t vertexCount;
 
@@ -29,10 +39,31 @@ namespace engine {
 		std::unique_ptr<Buffer> indexBuffer;
 		uint32_t indexCount;
 
+		// Models with 65536 vertices or fewer use 16 bit indices to halve the index buffer
+		VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+
 		struct Vertex;
 
-		void createVertexBuffers(const std::vector<Vertex> &vertices);
-		void createIndexBuffers(const std::vector<uint32_t> &indices);
+		// The staging ranges hold the data until recordUpload has copied it into the
+		// vertex and index buffers, after that releaseStagingBuffers hands them back
+		std::unique_ptr<UploadContext::Allocation> vertexStagingBuffer;
+		std::unique_ptr<UploadContext::Allocation> indexStagingBuffer;
+
+		// Where the attribute stream of a split model starts in its own vertex buffer
+		VkDeviceSize attributeStreamOffset{ 0 };
+
+		// Where the model starts in the geometry heap, both are 0 for models with buffers of
+		// their own. Every draw adds them to its vertexOffset and firstIndex.
+		uint32_t firstVertex{ 0 };
+		uint32_t firstIndex{ 0 };
+
+		// Fill in the staging memory, the vertices split into their two streams
+		void writeVertices(const Vertex *vertices);
+		void writeIndices(const uint32_t *indices);
+		// Takes staging ranges out of the upload context and a range of the geometry heap, or creates
+		// buffers on the GPU when the heap is full. The callers fill in the staging memory.
+		void allocateBuffers(uint32_t tempVertexCount, uint32_t tempIndexCount);
+		void finishConstruction(bool deferUpload);
 	public:
 		// In this struct, we set the attributes for each vertex to be rendered
 		struct Vertex {
@@ -52,15 +83,179 @@ namespace engine {
 			}
 		};
 
+		// The smaller vertex layout we upload when a model is created with VertexFormat::Compact.
+		// It is 20 bytes instead of 44 and is read by CompactShader.vert:
+		// - position: unsigned normalized 16 bit xyz, 0 to 1 across the model's bounding box
+		// - normal: octahedral encoded into two signed normalized 16 bit values
+		// - uv: two 16 bit half floats
+		// - color: 8 bit RGBA
+		struct CompactVertex {
+			uint16_t position[4]{};		// w is unused and only there for the 4 byte alignment
+			uint32_t normal{ 0 };
+			uint32_t uv{ 0 };
+			uint32_t color{ 0 };
+
+			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		};
+
+		enum class VertexFormat {
+			Standard,	// Model::Vertex, full 32 bit floats
+			Compact		// Model::CompactVertex
+		};
+
+		// How the vertices sit in the vertex buffer. Split models keep every position first as
+		// one tightly packed stream for binding 0 and the rest of each vertex after it for
+		// binding 1, so a depth only pass reads 12 (or 8 compact) bytes per vertex instead of
+		// the whole vertex. The attributes keep their order and formats in both layouts.
+		enum class VertexLayout {
+			Interleaved,	// One binding with whole vertices, only streamed models use it
+			Split			// Positions at binding 0, everything else at binding 1
+		};
+
+		// Axis aligned box around every vertex position of the model in model space
+		struct BoundingBox {
+			glm::vec3 min{ 0.0f };
+			glm::vec3 max{ 0.0f };
+		};
+
+		// How a part of the model is shaded. The render system copies the materials of every
+		// model into one table on the GPU (see MaterialTable.h), so the layout has to match
+		// the Material struct in SimpleShader.frag.
+		struct Material {
+			glm::vec4 diffuse{ 1.0f };							// Kd, w is the opacity
+			glm::vec4 specular{ 1.0f, 1.0f, 1.0f, 512.0f };		// Ks, w is the shininess
+		};
+
+		// A range of the index buffer that is drawn with one material. OBJ files switch
+		// materials with usemtl, the triangles are grouped so every material is one range.
+		struct SubMesh {
+			uint32_t firstIndex{ 0 };
+			uint32_t indexCount{ 0 };
+			uint32_t material{ 0 };		// Into the model's materials
+		};
+
+		// One level of detail, a range of the shared index buffer. Level 0 is the full
+		// model and every level after it has fewer triangles. error is how far the
+		// simplified surface may be from the full one, relative to the radius of the
+		// model's bounding sphere. The sub meshes of the level cover the same range.
+		struct Lod {
+			uint32_t firstIndex{ 0 };
+			uint32_t indexCount{ 0 };
+			float error{ 0.0f };
+			uint32_t firstSubMesh{ 0 };
+			uint32_t subMeshCount{ 1 };
+		};
+
+		// A small cluster of the full detail triangles, a range of the index buffer (see
+		// MeshletBuilder.h). Everything is in model space.
+		struct Meshlet {
+			glm::vec3 center{ 0.0f };			// Bounding sphere
+			float radius{ 0.0f };
+			glm::vec3 coneAxis{ 0.0f };			// Average facing direction of the triangles
+			float coneCutoff{ 1.0f };			// 1 means the cone is too wide to ever cull
+			uint32_t firstIndex{ 0 };
+			uint32_t indexCount{ 0 };
+			uint32_t material{ 0 };				// Meshlets never cross sub meshes, so they have one material
+
+			// True when the camera can only see the back of every triangle in the meshlet
+			bool facesAway(const glm::vec3& cameraPosition) const {
+				glm::vec3 toCenter = center - cameraPosition;
+				return glm::dot(toCenter, coneAxis) >= coneCutoff * glm::length(toCenter) + radius;
+			}
+		};
+
 		// This will be used as a temporary helper object storing our vertex and index information 
 		// until it can be copied over into the model's vertex and index buffer memory
 		struct Builder {
 			std::vector<Vertex> vertices{};
 			std::vector<uint32_t> indices{};
+			BoundingBox bounds{};
+			// Empty until generateLods is called, a model without any is drawn at full detail
+			std::vector<Lod> lods{};
+			// Empty until generateMeshlets is called, only the full detail level gets them
+			std::vector<Meshlet> meshlets{};
+			// The sub meshes of every level of detail back to back, there is always at least one
+			std::vector<SubMesh> subMeshes{};
+			std::vector<Material> materials{};
+			// The mtllib entries the materials were read from, as written in the OBJ file. Empty
+			// when the file has no usemtl, the libraries don't matter then.
+			std::vector<std::string> materialLibraries{};
+
+			// Reads the file with our multithreaded OBJ parser
 			void loadModel(const std::string &filePath);
+
+			// The old single threaded tiny object loader path. The output is identical to
+			// loadModel, we only keep it around so the benchmarks have something to compare to
+			void loadModelTinyObj(const std::string &filePath);
+
+			// Simplifies the indices once for every error target (see MeshSimplifier.h) and
+			// appends each level after the full model. Levels that barely remove anything
+			// are skipped. Call this after the MeshOptimizer, it expects a single level.
+			// Every sub mesh is simplified on its own so no triangle changes its material.
+			void generateLods(const std::vector<float> &targetErrors);
+
+			// Splits the sub meshes of the full detail level into meshlets (see MeshletBuilder.h)
+			void generateMeshlets();
+
+			// Everything a cold load does before the model is cached: loads the file, runs the
+			// MeshOptimizer and generates the levels of detail and meshlets. This is exactly what
+			// ends up in the mesh cache, and in the cooked meshes of a packed archive.
+			void cook(const std::string &filePath);
+
+		private:
+			void buildFromObj(const ObjData &obj);
+			void groupByMaterial(const ObjData &obj);
 		};
 
-		Model(Device &tempDevice, const Model::Builder &builder);
+		// With deferUpload the data is only written to the staging buffers and the
+		// model can't be drawn until recordUpload has run on the GPU (see ModelLoader.h).
+		// Otherwise the constructor copies it over and waits for the copy to finish.
+		Model(Device &tempDevice, const Model::Builder &builder,
+			VertexFormat format = VertexFormat::Standard, bool deferUpload = false);
+		// Builds the model straight from vertex and index data that lives somewhere
+		// else, for example a builder that isn't kept around. Without
+		// any sub meshes every level of detail is drawn with one default material.
+		Model(Device &tempDevice, const Vertex *vertices, uint32_t vertexCount,
+			const uint32_t *indices, uint32_t indexCount, const BoundingBox &bounds,
+			const std::vector<Lod> &tempLods, const std::vector<Meshlet> &tempMeshlets,
+			const std::vector<SubMesh> &tempSubMeshes, const std::vector<Material> &tempMaterials,
+			VertexFormat format = VertexFormat::Standard, bool deferUpload = false);
+		// Where vertices in one format go: the position and the other attributes of every vertex
+		// each have their own pointer and stride. The split layout puts every position first and
+		// the attributes after them, the interleaved one keeps whole vertices together. Writers
+		// hand over whole vertices a block at a time, blocks that don't overlap can be written
+		// from several threads.
+		struct VertexStreams {
+			char *positions{ nullptr };
+			char *attributes{ nullptr };
+			size_t positionStride{ 0 };
+			size_t attributeStride{ 0 };
+			VertexFormat format{ VertexFormat::Standard };
+
+			// count vertices in the split layout starting at destination
+			static VertexStreams split(void *destination, size_t count, VertexFormat format);
+			static VertexStreams interleaved(void *destination, VertexFormat format);
+
+			// Copies count whole vertices, already in format, to the streams starting at vertex first
+			void write(size_t first, const void *vertices, size_t count) const;
+			// Converts count vertices to format through a small buffer on the stack and writes them
+			void encode(size_t first, const Vertex *vertices, size_t count, const BoundingBox &bounds) const;
+		};
+		// Writes the vertices (in the model's vertex format) to the streams of the staging memory and
+		// the indices (getIndexType(vertexCount)) straight into it. indexCount has to be at least 3.
+		using StagingWriter = std::function<void(const VertexStreams &vertices, void *indices)>;
+		// Creates the buffers and lets writeStaging fill them, for loaders whose data only needs
+		// converting or decoding on its way into the staging buffers (see GlbLoader.h and MeshCache.h)
+		Model(Device &tempDevice, uint32_t tempVertexCount, uint32_t tempIndexCount, const BoundingBox &bounds,
+			const std::vector<Lod> &tempLods, const std::vector<Meshlet> &tempMeshlets,
+			const std::vector<SubMesh> &tempSubMeshes, const std::vector<Material> &tempMaterials,
+			VertexFormat format, const StagingWriter &writeStaging, bool deferUpload = false);
+		// An empty model with buffers for vertexCount vertices and indexCount indices that are
+		// filled a range at a time with recordRangeUpload. Used for streaming (see MeshStream.h),
+		// nothing is drawn until setResidentIndexCount says which indices have arrived.
+		Model(Device &tempDevice, uint32_t tempVertexCount, uint32_t tempIndexCount, const BoundingBox &bounds,
+			VertexFormat format);
 		~Model();
 
 		// We must delete the copy constructors because the Model 
@@ -70,11 +265,119 @@ namespace engine {
 		Model(Model&&) = default;
 		Model& operator=(Model&&) = default;
 
+		// Nothing in here touches a queue when deferUpload is set, so that
+		// version can run on a worker thread (see ModelLoader::loadModelAsync).
+		// With buildBvh the model also keeps a MeshBvh of its full detail level.
 		static std::unique_ptr<Model> createModelFromFile(
-			Device& device, const std::string& filePath);
+			Device& device, const std::string& filePath,
+			VertexFormat format = VertexFormat::Compact, bool deferUpload = false, bool buildBvh = false);
+
+		// Records the copies from the staging ranges into the vertex and index buffers. They go
+		// with the context's next flush, and the ranges have to stay alive until it is complete.
+		void recordUpload(UploadContext &uploadContext);
+		void releaseStagingBuffers();
+		bool isUploadPending() const { return vertexStagingBuffer != nullptr; }
+		VkDeviceSize getUploadSize() const { return getVertexBufferSize() + getIndexBufferSize(); }
+
+		// Copies vertices and indices that are already in the right format out of a staging buffer
+		// into their place in the vertex and index buffers. The indices must already point at
+		// the right vertices, nothing is added to them.
+		void recordRangeUpload(TransferQueue::Batch &batch, VkBuffer stagingBuffer,
+			VkDeviceSize vertexOffset, uint32_t firstVertex, uint32_t rangeVertexCount,
+			VkDeviceSize indexOffset, uint32_t firstIndex, uint32_t rangeIndexCount);
+		// Only the first indexCount indices are drawn, streamed models grow as their ranges arrive
+		void setResidentIndexCount(uint32_t count);
+
+		// Builds the vertices for OBJ face corners and writes them to destination in the given
+		// format, the same way Builder::loadModel builds them
+		static void encodeVertices(const ObjData &obj, const ObjIndex *corners, size_t count,
+			VertexFormat format, const BoundingBox &bounds, void *destination);
+		// Writes count vertices to destination in the given format
+		static void encodeVertices(const Vertex *vertices, size_t count,
+			VertexFormat format, const BoundingBox &bounds, void *destination);
+		static uint32_t getVertexSize(VertexFormat format);
+		// The bytes of a vertex that belong to its position, they always come first
+		static uint32_t getPositionSize(VertexFormat format);
+		// Splits count whole vertices in the given format into the split layout: every
+		// position, then the other attributes of every vertex in the same order
+		static void writeVertexStreams(const void *vertices, size_t count, VertexFormat format, void *destination) {
+			VertexStreams::split(destination, count, format).write(0, vertices, count);
+		}
+		// The vertex input of a model with this format and layout, binding 0 always holds the positions
+		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(VertexFormat format, VertexLayout layout);
+		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexFormat format, VertexLayout layout);
+		// Every index is smaller than the vertex count, so when there are no more than 65536
+		// vertices all of them fit in 16 bits. Otherwise we need the full 32 bits.
+		static VkIndexType getIndexType(uint32_t vertexCount) {
+			return vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		}
 
+		// Models in the geometry heap bind the heap's pool for their format, so drawing several of
+		// them only needs this once. The render system checks isInGeometryHeap and skips it.
 		void bind(VkCommandBuffer commandBuffer);
+		// Only binds the positions and the indices, for passes that don't read anything else
+		// (see Pipeline::enableDepthOnly). Interleaved models still bind whole vertices.
+		void bindPositions(VkCommandBuffer commandBuffer);
+		bool isInGeometryHeap() const { return heapRange != nullptr; }
+		bool hasIndices() const { return hasIndexBuffer; }
+		VkIndexType getIndexType() const { return indexType; }
 		void draw(VkCommandBuffer commandBuffer);
+		void draw(VkCommandBuffer commandBuffer, uint32_t lod);
+		// Draws part of the index buffer, used to draw the meshlets that survived culling
+		void drawIndexRange(VkCommandBuffer commandBuffer, uint32_t firstIndex, uint32_t indexCount);
+		// Models without an index buffer only have one sub mesh, it draws every vertex
+		void drawSubMesh(VkCommandBuffer commandBuffer, const SubMesh &subMesh);
 
+		const BoundingBox& getBoundingBox() const { return boundingBox; }
+		VertexFormat getVertexFormat() const { return vertexFormat; }
+		VertexLayout getVertexLayout() const { return vertexLayout; }
+		uint32_t getVertexCount() const { return vertexCount; }
+		uint32_t getIndexCount() const { return indexCount; }
+		// What the vertices and indices would take up as full float vertices and 32 bit
+		// indices, compare it to the buffer sizes to see how much the model saved
+		VkDeviceSize getFullPrecisionSize() const {
+			return static_cast<VkDeviceSize>(vertexCount) * sizeof(Vertex) +
+				static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+		}
+		uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+		const Lod& getLod(uint32_t lod) const { return lods[lod]; }
+		uint32_t getTriangleCount(uint32_t lod) const;
+		const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+		const std::vector<SubMesh>& getSubMeshes() const { return subMeshes; }
+		const std::vector<Material>& getMaterials() const { return materials; }
+
+		// Where the model's materials start in the device's material table. It's set the
+		// first time the model is drawn and is NO_MATERIAL_OFFSET until then, the slots
+		// are released when the model is destroyed.
+		static constexpr uint32_t NO_MATERIAL_OFFSET = UINT32_MAX;
+		uint32_t getMaterialOffset() const { return materialOffset; }
+		void setMaterialOffset(uint32_t offset) { materialOffset = offset; }
+		// What the vertices and indices take up on the GPU, in the heap or in buffers of their own
+		VkDeviceSize getVertexBufferSize() const { return static_cast<VkDeviceSize>(vertexCount) * getVertexSize(vertexFormat); }
+		VkDeviceSize getIndexBufferSize() const {
+			return hasIndexBuffer ? static_cast<VkDeviceSize>(indexCount) * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4) : 0;
+		}
+
+		// Compact vertices store their positions inside the bounding box, so this has to
+		// be applied before the model matrix. It's the identity for standard vertices.
+		const glm::mat4& getPositionTransform() const { return positionTransform; }
+
+		// The CPU side copy of the triangles for ray casts and closest point queries, in model
+		// space. nullptr unless the model was loaded with buildBvh.
+		const MeshBvh* getBvh() const { return bvh.get(); }
+		void setBvh(std::unique_ptr<MeshBvh> tempBvh) { bvh = std::move(tempBvh); }
+
+	private:
+		BoundingBox boundingBox{};
+		std::vector<Lod> lods{};	// Always at least one, level 0 covers the full model
+		std::vector<Meshlet> meshlets{};
+		std::vector<SubMesh> subMeshes{};	// Always at least one for every level of detail
+		std::vector<Material> materials{};	// Always at least one
+		uint32_t materialOffset{ NO_MATERIAL_OFFSET };
+		VertexFormat vertexFormat{ VertexFormat::Standard };
+		// Streamed models are filled a range of whole vertices at a time and stay interleaved
+		VertexLayout vertexLayout{ VertexLayout::Split };
+		glm::mat4 positionTransform{ 1.0f };
+		std::unique_ptr<MeshBvh> bvh;
 	};
 }
\ No newline at end of file
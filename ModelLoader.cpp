@@ -0,0 +1,335 @@
+#include "ModelLoader.h"
+#include "ThreadPool.h"
+
+// std
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		const std::string EMPTY_STRING{};
+	}
+
+	ModelHandle::ModelHandle(std::shared_ptr<Model> model) {
+		if (model == nullptr) return;
+		state = std::make_shared<State>();
+		state->model = std::move(model);
+		state->status = Status::Resident;
+	}
+
+	ModelHandle::Status ModelHandle::getStatus() const {
+		return state ? state->status.load(std::memory_order_acquire) : Status::Empty;
+	}
+
+	Model* ModelHandle::get() const {
+		Status status = getStatus();
+		return status == Status::Resident || status == Status::Loading ? state->model.get() : nullptr;
+	}
+
+	std::shared_ptr<Model> ModelHandle::getShared() const {
+		Status status = getStatus();
+		return status == Status::Resident || status == Status::Loading ? state->model : nullptr;
+	}
+
+	const std::string& ModelHandle::getFilePath() const {
+		return state ? state->filePath : EMPTY_STRING;
+	}
+
+	const std::string& ModelHandle::getError() const {
+		return getStatus() == Status::Failed ? state->error : EMPTY_STRING;
+	}
+
+	float ModelHandle::getMillisecondsToResident() const {
+		return getStatus() == Status::Resident ? state->millisecondsToResident : 0.0f;
+	}
+
+	ModelLoader::ModelLoader(Device &device) : device{ device } {}
+
+	ModelLoader::~ModelLoader() {
+		// A throw out of a destructor ends the program, so a failed upload or stream is only reported
+		try {
+			waitIdle();
+		}
+		catch (const std::exception &e) {
+			std::cerr << "Model loader: failed to finish loading, " << e.what() << std::endl;
+			// The parsing jobs still have to be done before their results go away
+			for (Job &job : jobs) job.model.wait();
+		}
+	}
+
+	ModelHandle ModelLoader::loadModelAsync(const std::string &filePath, Model::VertexFormat format, bool buildBvh) {
+		auto state = std::make_shared<ModelHandle::State>();
+		state->filePath = filePath;
+		state->requested = std::chrono::high_resolution_clock::now();
+
+		// Creating buffers and writing to mapped memory is fine on any thread, only
+		// the command pool and the queue have to stay on the thread that renders
+		Device* jobDevice = &device;
+		std::future<std::unique_ptr<Model>> model = ThreadPool::shared().submit([jobDevice, filePath, format, buildBvh]() {
+			return Model::createModelFromFile(*jobDevice, filePath, format, true, buildBvh);
+		});
+		jobs.push_back({ state, std::move(model) });
+		stats.loading++;
+		return ModelHandle{ state };
+	}
+
+	ModelHandle ModelLoader::loadModelStreaming(const std::string &filePath, const MeshStream::Options &options) {
+		auto stream = std::make_unique<Stream>();
+		stream->state = std::make_shared<ModelHandle::State>();
+		stream->state->filePath = filePath;
+		stream->state->requested = std::chrono::high_resolution_clock::now();
+		stream->options = options;
+		stream->options.windowsInFlight = std::max<size_t>(1, options.windowsInFlight);
+		stream->slots.resize(stream->options.windowsInFlight);
+		MeshStream::Options streamOptions = stream->options;
+		stream->scan = ThreadPool::shared().submit([filePath, streamOptions]() {
+			return std::make_shared<MeshStream>(filePath, streamOptions);
+		});
+
+		ModelHandle handle{ stream->state };
+		streams.push_back(std::move(stream));
+		stats.loading++;
+		return handle;
+	}
+
+	void ModelLoader::update() {
+		std::vector<PendingModel> parsed{};
+		for (auto job = jobs.begin(); job != jobs.end();) {
+			if (job->model.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++job;
+				continue;
+			}
+
+			stats.loading--;
+			try {
+				parsed.push_back({ job->state, job->model.get() });
+			}
+			catch (const std::exception &e) {
+				job->state->error = e.what();
+				job->state->status.store(ModelHandle::Status::Failed, std::memory_order_release);
+				stats.failed++;
+				std::cerr << job->state->filePath << ": failed to load, " << e.what() << std::endl;
+			}
+			job = jobs.erase(job);
+		}
+		if (!parsed.empty()) submitUploads(std::move(parsed));
+
+		for (auto batch = batches.begin(); batch != batches.end();) {
+			if (!device.getTransferQueue().isComplete(batch->upload)) {
+				++batch;
+				continue;
+			}
+			finishBatch(*batch);
+			batch = batches.erase(batch);
+		}
+
+		for (auto stream = streams.begin(); stream != streams.end();) {
+			if (updateStream(**stream)) ++stream;
+			else stream = streams.erase(stream);
+		}
+	}
+
+	void ModelLoader::wait(const ModelHandle &handle) {
+		while (handle.isLoading()) {
+			for (Job &job : jobs) {
+				if (job.state == handle.state) job.model.wait();
+			}
+			update();
+
+			for (UploadBatch &batch : batches) {
+				for (PendingModel &pending : batch.models) {
+					if (pending.state != handle.state) continue;
+					device.getTransferQueue().wait(batch.upload);
+				}
+			}
+			for (auto &stream : streams) {
+				if (stream->state == handle.state) waitForStream(*stream);
+			}
+			update();
+		}
+	}
+
+	void ModelLoader::waitIdle() {
+		while (!isIdle()) {
+			for (Job &job : jobs) job.model.wait();
+			update();
+
+			for (UploadBatch &batch : batches) device.getTransferQueue().wait(batch.upload);
+			for (auto &stream : streams) waitForStream(*stream);
+			update();
+		}
+	}
+
+	void ModelLoader::submitUploads(std::vector<PendingModel> models) {
+		UploadBatch batch{};
+		batch.models = std::move(models);
+
+		// Every model's copies go into the upload context's batch and over with one submit.
+		// The transfer queue makes them visible to the frames that draw these models.
+		UploadContext &uploadContext = device.getUploadContext();
+		for (PendingModel &pending : batch.models) {
+			pending.model->recordUpload(uploadContext);
+			stats.bytesUploaded += pending.model->getUploadSize();
+		}
+		batch.upload = uploadContext.flush();
+
+		stats.uploading += static_cast<uint32_t>(batch.models.size());
+		stats.uploadBatches++;
+		batches.push_back(std::move(batch));
+	}
+
+	void ModelLoader::finishBatch(UploadBatch &batch) {
+		for (PendingModel &pending : batch.models) {
+			pending.model->releaseStagingBuffers();
+			pending.state->model = std::move(pending.model);
+			makeResident(*pending.state);
+		}
+		stats.uploading -= static_cast<uint32_t>(batch.models.size());
+	}
+
+	void ModelLoader::makeResident(ModelHandle::State &state) {
+		state.millisecondsToResident = std::chrono::duration<float, std::chrono::milliseconds::period>(
+			std::chrono::high_resolution_clock::now() - state.requested).count();
+		state.status.store(ModelHandle::Status::Resident, std::memory_order_release);
+
+		stats.resident++;
+		stats.totalMillisecondsToResident += state.millisecondsToResident;
+		stats.maxMillisecondsToResident = std::max(stats.maxMillisecondsToResident, state.millisecondsToResident);
+	}
+
+	bool ModelLoader::updateStream(Stream &stream) {
+		if (!stream.mesh) {
+			if (stream.scan.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return true;
+			try {
+				stream.mesh = stream.scan.get();
+			}
+			catch (const std::exception &e) {
+				finishStream(stream, e.what());
+				return false;
+			}
+			startStream(stream);
+		}
+		const MeshStream &mesh = *stream.mesh;
+
+		// Windows whose copies are done, strictly in order so the drawn indices are always one range
+		while (stream.windowsResident < stream.nextWindow) {
+			StreamSlot &slot = stream.slots[stream.windowsResident % stream.slots.size()];
+			if (slot.status != StreamSlot::Status::Uploading) break;
+			if (!device.getTransferQueue().isComplete(slot.upload)) break;
+			slot.status = StreamSlot::Status::Free;
+
+			const MeshStream::WindowRange &range = mesh.getWindowRange(slot.window);
+			stream.model->setResidentIndexCount(range.firstIndex + range.indexCount);
+			stream.windowsResident++;
+		}
+
+		// Windows that have been written into their slot are copied in order too
+		for (size_t window = stream.windowsResident; window < stream.nextWindow; window++) {
+			StreamSlot &slot = stream.slots[window % stream.slots.size()];
+			if (slot.status == StreamSlot::Status::Uploading) continue;
+			if (slot.job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+			try {
+				slot.job.get();
+			}
+			catch (const std::exception &e) {
+				finishStream(stream, e.what());
+				return false;
+			}
+			submitWindow(stream, slot);
+		}
+
+		// Free slots take the next windows. The slot memory is only written by the job,
+		// the render thread doesn't touch it until the job is done.
+		while (stream.nextWindow < mesh.getWindowCount()) {
+			StreamSlot &slot = stream.slots[stream.nextWindow % stream.slots.size()];
+			if (slot.status != StreamSlot::Status::Free) break;
+
+			size_t window = stream.nextWindow++;
+			size_t slotIndex = window % stream.slots.size();
+			std::shared_ptr<MeshStream> jobMesh = stream.mesh;
+			char* destination = static_cast<char*>(stream.stagingRing->getMappedMemory()) + slotIndex * mesh.getSlotSize();
+			slot.window = window;
+			slot.status = StreamSlot::Status::Parsing;
+			slot.job = ThreadPool::shared().submit([jobMesh, window, destination]() {
+				jobMesh->writeWindow(window, destination);
+			});
+		}
+
+		if (stream.windowsResident < mesh.getWindowCount()) return true;
+		finishStream(stream, "");
+		return false;
+	}
+
+	void ModelLoader::startStream(Stream &stream) {
+		const MeshStream &mesh = *stream.mesh;
+		stream.model = std::make_shared<Model>(
+			device, mesh.getVertexCount(), mesh.getIndexCount(), mesh.getBoundingBox(), stream.options.format);
+
+		stream.stagingRing = std::make_unique<Buffer>(
+			device,
+			mesh.getSlotSize(),
+			static_cast<uint32_t>(stream.slots.size()),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging);
+		stream.stagingRing->map();
+
+		// The model can be drawn from now on, it just has no indices yet
+		stream.state->model = stream.model;
+	}
+
+	void ModelLoader::submitWindow(Stream &stream, StreamSlot &slot) {
+		const MeshStream &mesh = *stream.mesh;
+		const MeshStream::WindowRange &range = mesh.getWindowRange(slot.window);
+		VkDeviceSize slotOffset = (slot.window % stream.slots.size()) * mesh.getSlotSize();
+
+		TransferQueue &transferQueue = device.getTransferQueue();
+		TransferQueue::Batch copies = transferQueue.begin();
+		stream.model->recordRangeUpload(
+			copies,
+			stream.stagingRing->getBuffer(),
+			slotOffset, range.firstVertex, range.vertexCount,
+			slotOffset + range.indexOffset, range.firstIndex, range.indexCount);
+		slot.upload = transferQueue.submit(copies);
+
+		slot.status = StreamSlot::Status::Uploading;
+		stats.windowsUploaded++;
+		stats.bytesUploaded += range.uploadSize;
+	}
+
+	void ModelLoader::waitForStream(Stream &stream) {
+		if (!stream.mesh) {
+			stream.scan.wait();
+			return;
+		}
+		for (StreamSlot &slot : stream.slots) {
+			if (slot.status == StreamSlot::Status::Parsing) slot.job.wait();
+			if (slot.status == StreamSlot::Status::Uploading) device.getTransferQueue().wait(slot.upload);
+		}
+	}
+
+	// Nothing may still be writing to the staging ring or reading from it when it's destroyed.
+	// On failure the model is kept alive by the handle because frames that are still in
+	// flight may have drawn it, the handle just stops handing it out.
+	void ModelLoader::finishStream(Stream &stream, const std::string &error) {
+		for (StreamSlot &slot : stream.slots) {
+			if (slot.status == StreamSlot::Status::Parsing && slot.job.valid()) slot.job.wait();
+			if (slot.status == StreamSlot::Status::Uploading) device.getTransferQueue().wait(slot.upload);
+		}
+		stream.slots.clear();
+		stream.stagingRing.reset();
+		stream.mesh.reset();
+		stats.loading--;
+
+		if (!error.empty()) {
+			stream.state->error = error;
+			stream.state->status.store(ModelHandle::Status::Failed, std::memory_order_release);
+			stats.failed++;
+			std::cerr << stream.state->filePath << ": failed to stream, " << error << std::endl;
+			return;
+		}
+
+		makeResident(*stream.state);
+	}
+}
@@ -0,0 +1,180 @@
+//**********************************************************************
+// The model loader loads models in the background so the window can
+// start drawing right away instead of waiting for the slowest file.
+// loadModelAsync hands back a ModelHandle straight away and does the
+// parsing, optimizing and filling of the staging buffers on a worker
+// thread. Once a frame, update collects every model that is ready and
+// copies all of them to the GPU with a single submit through the upload
+// context (see UploadContext.h).
+// The models become resident once its timeline value is complete,
+// nothing ever waits for a queue to go idle (see TransferQueue.h).
+// Until then the handle gives back a nullptr and the render system
+// skips the game object.
+// loadModelStreaming is for files too large to load in one go. The
+// model is drawable as soon as its buffers exist and grows every time
+// another window of the file lands on the GPU (see MeshStream.h).
+//**********************************************************************
+
+#pragma once
+
+#include "Buffer.h"
+#include "Device.h"
+#include "MeshStream.h"
+#include "Model.h"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class ModelLoader;
+
+	// Shared between the loader and everything that holds on to the model. Copies are
+	// cheap and all of them see the model once it becomes resident. A handle can also
+	// be made from a model that was created the blocking way, it's resident right away.
+	class ModelHandle {
+	public:
+		enum class Status {
+			Empty,		// Not pointing at any model
+			Loading,	// Being parsed or waiting for its upload to finish
+			Resident,	// Ready to be drawn
+			Failed		// Couldn't be loaded, see getError
+		};
+
+		ModelHandle() = default;
+		ModelHandle(std::shared_ptr<Model> model);
+
+		Status getStatus() const;
+		bool isLoading() const { return getStatus() == Status::Loading; }
+		bool isResident() const { return getStatus() == Status::Resident; }
+
+		// nullptr until the model can be drawn. Streamed models can be drawn while
+		// they are still loading, they show more of themselves as their windows land.
+		Model* get() const;
+		std::shared_ptr<Model> getShared() const;
+		const std::string& getFilePath() const;
+		const std::string& getError() const;
+		// How long the model took from loadModelAsync or loadModelStreaming until it was
+		// resident, 0 while it's still loading and for models created the blocking way
+		float getMillisecondsToResident() const;
+
+	private:
+		friend class ModelLoader;
+
+		struct State {
+			std::atomic<Status> status{ Status::Loading };
+			std::shared_ptr<Model> model{};		// Only set once the model can be drawn
+			std::string filePath{};
+			std::string error{};
+			std::chrono::high_resolution_clock::time_point requested{};
+			float millisecondsToResident{ 0.0f };	// Set before the status becomes Resident
+		};
+
+		explicit ModelHandle(std::shared_ptr<State> state) : state{ std::move(state) } {}
+
+		std::shared_ptr<State> state{};
+	};
+
+	class ModelLoader {
+	public:
+		struct Stats {
+			uint32_t loading{ 0 };			// Still being parsed on a worker, or still streaming
+			uint32_t uploading{ 0 };		// Waiting for their copies on the GPU
+			uint32_t resident{ 0 };
+			uint32_t failed{ 0 };
+			uint32_t uploadBatches{ 0 };	// Transfer queue submits, one per update at most
+			uint32_t windowsUploaded{ 0 };	// Windows of streamed models, each is its own submit
+			VkDeviceSize bytesUploaded{ 0 };
+			float totalMillisecondsToResident{ 0.0f };	// Divide by resident for the average
+			float maxMillisecondsToResident{ 0.0f };
+		};
+
+		explicit ModelLoader(Device &device);
+		// Waits for everything that is still loading, errors are logged instead of thrown
+		~ModelLoader();
+
+		ModelLoader(const ModelLoader&) = delete;
+		ModelLoader& operator=(const ModelLoader&) = delete;
+
+		// The asynchronous counterpart of Model::createModelFromFile
+		ModelHandle loadModelAsync(
+			const std::string &filePath, Model::VertexFormat format = Model::VertexFormat::Compact, bool buildBvh = false);
+
+		// Loads the file a window at a time without ever using more memory than the budget in the
+		// options, the staging ring included. The first pass over the file runs on a worker, then
+		// the model can be drawn right away and fills in as the windows arrive.
+		ModelHandle loadModelStreaming(const std::string &filePath, const MeshStream::Options &options = {});
+
+		// Submits the uploads of the models that finished parsing and makes the ones whose
+		// uploads are done resident. Call it once a frame from the thread that renders.
+		void update();
+
+		// Blocks until the model is resident or has failed, update is called in the meantime
+		void wait(const ModelHandle &handle);
+		void waitIdle();
+
+		bool isIdle() const { return jobs.empty() && batches.empty() && streams.empty(); }
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct Job {
+			std::shared_ptr<ModelHandle::State> state;
+			std::future<std::unique_ptr<Model>> model;
+		};
+
+		struct PendingModel {
+			std::shared_ptr<ModelHandle::State> state;
+			std::unique_ptr<Model> model;
+		};
+
+		// One transfer queue submit with the copies of every model in it
+		struct UploadBatch {
+			uint64_t upload{ 0 };		// Timeline value of the submit
+			std::vector<PendingModel> models{};
+		};
+
+		struct StreamSlot {
+			enum class Status { Free, Parsing, Uploading };
+			Status status{ Status::Free };
+			size_t window{ 0 };
+			std::future<void> job{};		// Writes the window into the slot
+			uint64_t upload{ 0 };			// Timeline value of the window's copies
+		};
+
+		struct Stream {
+			std::shared_ptr<ModelHandle::State> state;
+			MeshStream::Options options{};
+			std::future<std::shared_ptr<MeshStream>> scan{};	// The first pass
+			std::shared_ptr<MeshStream> mesh{};					// Shared with the window jobs
+			std::shared_ptr<Model> model{};
+			// One slot of the largest window's size for every window in flight. Window i always
+			// uses slot i % slots.size() and the slots are submitted in window order, so the
+			// windows become resident in order too.
+			std::unique_ptr<Buffer> stagingRing{};
+			std::vector<StreamSlot> slots{};
+			size_t nextWindow{ 0 };			// The next window to hand to a free slot
+			size_t windowsResident{ 0 };
+		};
+
+		void submitUploads(std::vector<PendingModel> models);
+		void finishBatch(UploadBatch &batch);
+		void makeResident(ModelHandle::State &state);
+
+		// Returns false once the stream is done, either resident or failed
+		bool updateStream(Stream &stream);
+		void startStream(Stream &stream);
+		void submitWindow(Stream &stream, StreamSlot &slot);
+		void waitForStream(Stream &stream);
+		void finishStream(Stream &stream, const std::string &error);
+
+		Device &device;
+		std::vector<Job> jobs{};
+		std::vector<UploadBatch> batches{};
+		std::vector<std::unique_ptr<Stream>> streams{};
+		Stats stats{};
+	};
+}
@@ -0,0 +1,208 @@
+#include "ModelRegistry.h"
+#include "ObjParser.h"
+#include "Utils.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <cassert>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+namespace engine {
+	namespace {
+		// The same file in another vertex format is a different model on the GPU
+		std::string makePathKey(const std::string &filePath, const char *kind, Model::VertexFormat format) {
+			std::error_code error;
+			std::filesystem::path path = std::filesystem::weakly_canonical(filePath, error);
+			std::string canonical = error ? filePath : path.generic_string();
+			return canonical + '|' + kind + std::to_string(static_cast<int>(format));
+		}
+
+		// The resolved path and contents of every mtllib entry, a missing library only adds its path
+		uint64_t hashMaterialLibraries(const std::string &filePath, const char *data, size_t size, uint64_t seed) {
+			VirtualFileSystem &fileSystem = VirtualFileSystem::shared();
+			for (const std::string &library : ObjParser::findMaterialLibraries(data, size)) {
+				std::string libraryPath = ObjParser::getMaterialLibraryPath(filePath, library);
+				std::error_code error;
+				std::filesystem::path path = std::filesystem::weakly_canonical(libraryPath, error);
+				std::string canonical = error ? libraryPath : path.generic_string();
+				seed = hashBytes(canonical.data(), canonical.size(), seed);
+
+				VirtualFileSystem::FileInfo info{};
+				if (!fileSystem.getInfo(libraryPath, info)) continue;
+				if (info.inArchive) {
+					uint64_t summary[2]{ info.size, info.crc32 };
+					seed = hashBytes(summary, sizeof(summary), seed);
+				}
+				else {
+					VirtualFileSystem::File file = fileSystem.open(libraryPath);
+					file.waitForAll();
+					seed = hashBytes(file.data(), file.size(), seed);
+				}
+			}
+			return seed;
+		}
+
+		// Hashing the file costs a read of it on the calling thread, which is still far less
+		// than parsing and uploading it a second time. Zip entries already come with a CRC,
+		// so they're keyed by that instead of being inflated twice. A file that can't be
+		// read gets 0 and is left to the model loader to report.
+		// Two identical OBJ files only share materials when their mtllib entries lead to the
+		// same libraries, so those go into the key too. Zip entries can't be searched for
+		// mtllib without inflating them, they're only matched with copies in the same folder,
+		// where the same entries resolve to the same libraries.
+		uint64_t makeContentKey(const std::string &filePath, Model::VertexFormat format, bool buildBvh) {
+			uint64_t seed = static_cast<uint64_t>(format) * 2 + (buildBvh ? 1 : 0) + 1;
+			try {
+				VirtualFileSystem &fileSystem = VirtualFileSystem::shared();
+				VirtualFileSystem::FileInfo info{};
+				if (!fileSystem.getInfo(filePath, info)) return 0;
+
+				uint64_t key;
+				if (info.inArchive) {
+					std::string folder = std::filesystem::path(filePath).parent_path().lexically_normal().generic_string();
+					uint64_t summary[2]{ info.size, info.crc32 };
+					key = hashBytes(summary, sizeof(summary), hashBytes(folder.data(), folder.size(), seed));
+				}
+				else {
+					VirtualFileSystem::File file = fileSystem.open(filePath);
+					key = hashBytes(file.data(), file.size(), seed);
+					key = hashMaterialLibraries(filePath, file.data(), file.size(), key);
+				}
+				return key != 0 ? key : 1;
+			}
+			catch (const std::runtime_error&) {
+				return 0;
+			}
+		}
+	}
+
+	ModelRegistry::ModelRegistry(ModelLoader &loader) : loader{ loader } {}
+
+	ModelRegistry::~ModelRegistry() {}
+
+	ModelRegistry::Handle ModelRegistry::load(const std::string &filePath, Model::VertexFormat format, bool buildBvh) {
+		stats.requests++;
+		std::string pathKey = makePathKey(filePath, buildBvh ? "bvhmodel" : "model", format);
+		auto path = byPath.find(pathKey);
+		if (path != byPath.end()) {
+			stats.pathHits++;
+			return acquire(getHandle(path->second));
+		}
+
+		uint64_t contentKey = makeContentKey(filePath, format, buildBvh);
+		auto content = contentKey != 0 ? byContent.find(contentKey) : byContent.end();
+		if (content != byContent.end()) {
+			stats.contentHits++;
+			uint32_t slot = content->second;
+			entries[slot].pathKeys.push_back(pathKey);
+			byPath[pathKey] = slot;
+			return acquire(getHandle(slot));
+		}
+
+		stats.loads++;
+		return insert(loader.loadModelAsync(filePath, format, buildBvh), pathKey, contentKey);
+	}
+
+	// Streamed files are the ones too large to read twice, so they are only matched by path
+	ModelRegistry::Handle ModelRegistry::loadStreaming(const std::string &filePath, const MeshStream::Options &options) {
+		stats.requests++;
+		std::string pathKey = makePathKey(filePath, "stream", options.format);
+		auto path = byPath.find(pathKey);
+		if (path != byPath.end()) {
+			stats.pathHits++;
+			return acquire(getHandle(path->second));
+		}
+
+		stats.loads++;
+		return insert(loader.loadModelStreaming(filePath, options), pathKey, 0);
+	}
+
+	ModelRegistry::Handle ModelRegistry::acquire(Handle handle) {
+		if (getStatus(handle) == ModelHandle::Status::Empty) return Handle{};
+		entries[handle.index].references++;
+		return handle;
+	}
+
+	void ModelRegistry::release(Handle handle) {
+		if (getStatus(handle) == ModelHandle::Status::Empty) return;
+		Entry &entry = entries[handle.index];
+		assert(entry.references > 0 && "Model released more often than it was acquired");
+		if (--entry.references > 0) return;
+
+		// Nobody can look the model up anymore. Frames in flight may still draw it, but what they
+		// use only goes once they are done, so the model itself can go right away.
+		for (const std::string &pathKey : entry.pathKeys) byPath.erase(pathKey);
+		if (entry.contentKey != 0) byContent.erase(entry.contentKey);
+		models[handle.index] = nullptr;
+		if (++generations[handle.index] == 0) generations[handle.index] = 1;
+		entry = Entry{};
+		freeSlots.push_back(handle.index);
+		stats.models--;
+		stats.unloaded++;
+	}
+
+	void ModelRegistry::update() {
+		for (size_t slot = 0; slot < entries.size(); slot++) {
+			Entry &entry = entries[slot];
+			if (entry.references == 0 || entry.settled) continue;
+
+			// Streamed models become drawable before they are resident
+			ModelHandle::Status status = entry.model.getStatus();
+			models[slot] = entry.model.get();
+			entry.settled = status == ModelHandle::Status::Resident || status == ModelHandle::Status::Failed;
+		}
+	}
+
+	ModelHandle::Status ModelRegistry::getStatus(Handle handle) const {
+		if (handle.isEmpty() || handle.index >= generations.size() || generations[handle.index] != handle.generation) {
+			return ModelHandle::Status::Empty;
+		}
+		return entries[handle.index].model.getStatus();
+	}
+
+	std::vector<ModelRegistry::ModelStats> ModelRegistry::getModelStats() const {
+		std::vector<ModelStats> result{};
+		for (const Entry &entry : entries) {
+			if (entry.references == 0) continue;
+
+			ModelStats modelStats{};
+			modelStats.filePath = entry.model.getFilePath();
+			modelStats.status = entry.model.getStatus();
+			modelStats.references = entry.references;
+			if (Model* model = entry.model.get()) {
+				modelStats.vertexBytes = model->getVertexBufferSize();
+				modelStats.indexBytes = model->getIndexBufferSize();
+				modelStats.fullPrecisionBytes = model->getFullPrecisionSize();
+				modelStats.triangles = model->getTriangleCount(0);
+			}
+			result.push_back(modelStats);
+		}
+		return result;
+	}
+
+	ModelRegistry::Handle ModelRegistry::insert(ModelHandle model, const std::string &pathKey, uint64_t contentKey) {
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			slot = static_cast<uint32_t>(entries.size());
+			entries.emplace_back();
+			models.push_back(nullptr);
+			generations.push_back(1);
+		}
+
+		Entry &entry = entries[slot];
+		entry.model = std::move(model);
+		entry.pathKeys.push_back(pathKey);
+		entry.contentKey = contentKey;
+		entry.references = 1;
+		byPath[pathKey] = slot;
+		if (contentKey != 0) byContent[contentKey] = slot;
+		stats.models++;
+		return getHandle(slot);
+	}
+}
@@ -0,0 +1,113 @@
+//**********************************************************************
+// The model registry makes sure every model file is only loaded and
+// uploaded once, no matter how many game objects use it. Requests are
+// matched by the canonical path of the file first and by a hash of
+// its contents second, so a copy of a file under another name is
+// shared too. Game objects hold a Handle, a slot number and a
+// generation packed into 8 bytes that are copied around freely without
+// any atomic reference counting. The render system turns a handle into
+// a Model pointer with one lookup in a dense table. References are
+// counted explicitly with load/acquire and release. When the last
+// reference is released the slot's generation goes up, so stale
+// handles resolve to nullptr instead of to whatever model takes the
+// slot next. The model is destroyed right away, its buffers and heap
+// range wait in the device's deletion queue until no frame in flight
+// can still be drawing them (see DeletionQueue.h).
+//**********************************************************************
+
+#pragma once
+
+#include "ModelLoader.h"
+
+// std
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace engine {
+	class ModelRegistry {
+	public:
+		struct Handle {
+			uint32_t index{ 0 };
+			uint32_t generation{ 0 };	// 0 is never handed out, so a default handle is empty
+
+			bool isEmpty() const { return generation == 0; }
+			bool operator==(const Handle &other) const { return index == other.index && generation == other.generation; }
+			bool operator!=(const Handle &other) const { return !(*this == other); }
+		};
+
+		// One entry for every model that is loaded or loading
+		struct ModelStats {
+			std::string filePath{};
+			ModelHandle::Status status{ ModelHandle::Status::Empty };
+			uint32_t references{ 0 };
+			VkDeviceSize vertexBytes{ 0 };
+			VkDeviceSize indexBytes{ 0 };
+			VkDeviceSize fullPrecisionBytes{ 0 };	// See Model::getFullPrecisionSize
+			uint32_t triangles{ 0 };	// Full detail
+		};
+
+		struct Stats {
+			uint32_t requests{ 0 };			// Calls to load and loadStreaming
+			uint32_t pathHits{ 0 };			// Shared because the canonical path matched
+			uint32_t contentHits{ 0 };		// Shared because the file contents matched
+			uint32_t loads{ 0 };			// Handed to the model loader
+			uint32_t unloaded{ 0 };			// Destroyed after their last release
+			uint32_t models{ 0 };			// Loaded or loading right now
+		};
+
+		explicit ModelRegistry(ModelLoader &loader);
+		~ModelRegistry();
+
+		ModelRegistry(const ModelRegistry&) = delete;
+		ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+		// Both hand out a handle with one reference, the model loads in the background if it's new.
+		// A model loaded with buildBvh is kept apart from the same file loaded without one.
+		Handle load(const std::string &filePath, Model::VertexFormat format = Model::VertexFormat::Compact, bool buildBvh = false);
+		Handle loadStreaming(const std::string &filePath, const MeshStream::Options &options = {});
+
+		// Adds a reference to a handle that is already loaded, for example to share it with another object
+		Handle acquire(Handle handle);
+		void release(Handle handle);
+
+		// Picks up the models the loader made drawable. Call it once a frame after ModelLoader::update.
+		void update();
+
+		// nullptr while the model is loading, after it failed and for stale handles
+		Model* get(Handle handle) const {
+			return handle.index < generations.size() && generations[handle.index] == handle.generation
+				? models[handle.index] : nullptr;
+		}
+		ModelHandle::Status getStatus(Handle handle) const;
+		bool isLoading(Handle handle) const { return getStatus(handle) == ModelHandle::Status::Loading; }
+
+		std::vector<ModelStats> getModelStats() const;
+		const Stats& getStats() const { return stats; }
+
+	private:
+		struct Entry {
+			ModelHandle model{};			// Keeps the model alive until its last release
+			std::vector<std::string> pathKeys{};	// Every path it was requested by
+			uint64_t contentKey{ 0 };		// 0 when the file couldn't be hashed
+			uint32_t references{ 0 };
+			bool settled{ false };			// Resident or failed, the dense table won't change anymore
+		};
+
+		Handle insert(ModelHandle model, const std::string &pathKey, uint64_t contentKey);
+		Handle getHandle(uint32_t slot) const { return { slot, generations[slot] }; }
+
+		ModelLoader &loader;
+		std::vector<Entry> entries{};
+
+		// The dense table the render system reads, one element per slot
+		std::vector<Model*> models{};
+		std::vector<uint32_t> generations{};
+
+		std::vector<uint32_t> freeSlots{};
+		std::unordered_map<std::string, uint32_t> byPath{};
+		std::unordered_map<uint64_t, uint32_t> byContent{};
+		Stats stats{};
+	};
+}
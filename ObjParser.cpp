@@ -0,0 +1,721 @@
+#include "ObjParser.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		// Each chunk should be big enough that the bookkeeping is negligible, but small
+		// enough that every worker gets a few of them so uneven chunks still balance out
+		constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+		constexpr size_t CHUNKS_PER_THREAD = 4;
+
+		// Flags for face indices that were written relative to the end of the
+		// attribute arrays (negative indices) and still need the chunk offset
+		constexpr uint8_t RELATIVE_VERTEX = 1 << 0;
+		constexpr uint8_t RELATIVE_NORMAL = 1 << 1;
+		constexpr uint8_t RELATIVE_TEXCOORD = 1 << 2;
+
+		struct Chunk {
+			ObjData data{};
+			std::vector<uint8_t> relativeFlags{};	// Only filled in once a relative index shows up
+		};
+
+		inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+		inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+		inline bool isTokenEnd(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+		inline const char* skipSpaces(const char* p, const char* end) {
+			while (p < end && isSpace(*p)) p++;
+			return p;
+		}
+
+		// This is the same float parser that tiny object loader uses (tryParseDouble), written
+		// against a pointer range instead of a std::string. Using the exact same arithmetic
+		// means every float we produce is bit for bit identical to what tinyobj gave us before.
+		bool tryParseDouble(const char* s, const char* end, double* result) {
+			if (s >= end) return false;
+
+			double mantissa = 0.0;
+			int exponent = 0;
+			char sign = '+';
+			char exponentSign = '+';
+			const char* curr = s;
+			int read = 0;
+			bool leadingDecimalDot = false;
+
+			if (*curr == '+' || *curr == '-') {
+				sign = *curr;
+				curr++;
+				if (curr != end && *curr == '.') leadingDecimalDot = true;
+			}
+			else if (*curr == '.') {
+				leadingDecimalDot = true;
+			}
+			else if (!isDigit(*curr)) {
+				return false;
+			}
+
+			// Integer part
+			if (!leadingDecimalDot) {
+				while (curr != end && isDigit(*curr)) {
+					mantissa *= 10;
+					mantissa += static_cast<int>(*curr - '0');
+					curr++;
+					read++;
+				}
+				if (read == 0) return false;
+			}
+
+			// Decimal part. Don't be tempted to use powf here, it destroys precision
+			if (curr != end && *curr == '.') {
+				static const double powLut[] = {
+					1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+				};
+				constexpr int lutEntries = sizeof(powLut) / sizeof(powLut[0]);
+
+				curr++;
+				read = 1;
+				while (curr != end && isDigit(*curr)) {
+					mantissa += static_cast<int>(*curr - '0') *
+						(read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+					read++;
+					curr++;
+				}
+			}
+
+			// Exponent part
+			if (curr != end && (*curr == 'e' || *curr == 'E')) {
+				curr++;
+				if (curr != end && (*curr == '+' || *curr == '-')) {
+					exponentSign = *curr;
+					curr++;
+				}
+				else if (curr == end || !isDigit(*curr)) {
+					return false;	// An empty exponent is not allowed
+				}
+
+				read = 0;
+				while (curr != end && isDigit(*curr)) {
+					if (exponent > (2147483647 / 10)) return false;	// Integer overflow
+					exponent *= 10;
+					exponent += static_cast<int>(*curr - '0');
+					curr++;
+					read++;
+				}
+				exponent *= (exponentSign == '+' ? 1 : -1);
+				if (read == 0) return false;
+			}
+
+			*result = (sign == '+' ? 1 : -1) *
+				(exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+			return true;
+		}
+
+		// Reads the next whitespace separated number. If it can't be parsed the value
+		// is left alone and false is returned, the token is consumed either way.
+		inline bool tryParseReal(const char*& p, const char* end, float& out) {
+			p = skipSpaces(p, end);
+			const char* tokenEnd = p;
+			while (tokenEnd < end && !isTokenEnd(*tokenEnd)) tokenEnd++;
+
+			double value = 0.0;
+			bool parsed = tryParseDouble(p, tokenEnd, &value);
+			if (parsed) out = static_cast<float>(value);
+			p = tokenEnd;
+			return parsed;
+		}
+
+		inline float parseReal(const char*& p, const char* end, float defaultValue) {
+			float value = defaultValue;
+			tryParseReal(p, end, value);
+			return value;
+		}
+
+		// Behaves like atoi, which is what tinyobj uses for face indices
+		inline int parseInt(const char* p, const char* end) {
+			bool negative = false;
+			if (p < end && (*p == '+' || *p == '-')) {
+				negative = *p == '-';
+				p++;
+			}
+			int value = 0;
+			while (p < end && isDigit(*p)) {
+				value = value * 10 + (*p - '0');
+				p++;
+			}
+			return negative ? -value : value;
+		}
+
+		// The rest of the line without the spaces or line ending around it, for names
+		inline std::string readName(const char* p, const char* end) {
+			p = skipSpaces(p, end);
+			while (end > p && (isSpace(end[-1]) || end[-1] == '\r')) end--;
+			return std::string(p, end);
+		}
+
+		// Material names are looked up by a linear search, files only ever have a handful
+		int findMaterial(const std::vector<ObjMaterial>& materials, const std::string& name) {
+			for (size_t i = 0; i < materials.size(); i++) {
+				if (materials[i].name == name) return static_cast<int>(i);
+			}
+			return -1;
+		}
+
+		// Every corner added from now on uses the material. A range that never got any
+		// corners is replaced instead of leaving an empty one behind.
+		void useMaterial(std::vector<ObjMaterialRange>& ranges, size_t firstCorner, int material) {
+			if (!ranges.empty() && ranges.back().firstCorner == firstCorner) ranges.pop_back();
+			if (!ranges.empty() && ranges.back().material == material) return;
+			ranges.push_back({ firstCorner, material });
+		}
+
+		inline const char* skipIndex(const char* p, const char* end) {
+			while (p < end && *p != '/' && !isTokenEnd(*p)) p++;
+			return p;
+		}
+
+		// OBJ indices start at 1, and negative values count back from the most recently
+		// read element. Zero is never valid. For negative values we store the position
+		// relative to the start of this chunk and fix it up once the chunks are merged.
+		inline int fixIndex(int index, size_t localCount, bool& relative) {
+			if (index > 0) return index - 1;
+			if (index == 0) throw std::runtime_error("OBJ face uses an index of 0, which is not allowed");
+			relative = true;
+			return static_cast<int>(localCount) + index;
+		}
+
+		// Parses a single v, v/vt, v//vn or v/vt/vn face corner
+		ObjIndex parseCorner(const char*& p, const char* end, const ObjData& data, uint8_t& relativeFlags) {
+			ObjIndex corner{};
+			bool relative = false;
+
+			corner.vertexIndex = fixIndex(parseInt(p, end), data.positions.size() / 3, relative);
+			if (relative) relativeFlags |= RELATIVE_VERTEX;
+			p = skipIndex(p, end);
+			if (p == end || *p != '/') return corner;
+			p++;
+
+			// v//vn
+			if (p < end && *p == '/') {
+				p++;
+				relative = false;
+				corner.normalIndex = fixIndex(parseInt(p, end), data.normals.size() / 3, relative);
+				if (relative) relativeFlags |= RELATIVE_NORMAL;
+				p = skipIndex(p, end);
+				return corner;
+			}
+
+			// v/vt or v/vt/vn
+			relative = false;
+			corner.texcoordIndex = fixIndex(parseInt(p, end), data.texcoords.size() / 2, relative);
+			if (relative) relativeFlags |= RELATIVE_TEXCOORD;
+			p = skipIndex(p, end);
+			if (p == end || *p != '/') return corner;
+			p++;
+
+			relative = false;
+			corner.normalIndex = fixIndex(parseInt(p, end), data.normals.size() / 3, relative);
+			if (relative) relativeFlags |= RELATIVE_NORMAL;
+			p = skipIndex(p, end);
+			return corner;
+		}
+
+		void parseChunk(const char* begin, const char* end, Chunk& chunk) {
+			ObjData& data = chunk.data;
+			std::vector<ObjIndex> face{};
+			std::vector<uint8_t> faceFlags{};
+
+			const char* line = begin;
+			while (line < end) {
+				const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+				if (lineEnd == nullptr) lineEnd = end;
+
+				const char* p = skipSpaces(line, lineEnd);
+				size_t remaining = lineEnd - p;
+
+				if (remaining >= 2 && p[0] == 'v' && isSpace(p[1])) {
+					p += 2;
+					data.positions.push_back(parseReal(p, lineEnd, 0.0f));
+					data.positions.push_back(parseReal(p, lineEnd, 0.0f));
+					data.positions.push_back(parseReal(p, lineEnd, 0.0f));
+
+					// Vertex colors are optional and default to white when they're missing
+					float r = 1.0f, g = 1.0f, b = 1.0f;
+					if (!(tryParseReal(p, lineEnd, r) && tryParseReal(p, lineEnd, g) && tryParseReal(p, lineEnd, b))) {
+						r = g = b = 1.0f;
+					}
+					data.colors.push_back(r);
+					data.colors.push_back(g);
+					data.colors.push_back(b);
+				}
+				else if (remaining >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+					p += 3;
+					data.normals.push_back(parseReal(p, lineEnd, 0.0f));
+					data.normals.push_back(parseReal(p, lineEnd, 0.0f));
+					data.normals.push_back(parseReal(p, lineEnd, 0.0f));
+				}
+				else if (remaining >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+					p += 3;
+					data.texcoords.push_back(parseReal(p, lineEnd, 0.0f));
+					data.texcoords.push_back(parseReal(p, lineEnd, 0.0f));
+				}
+				else if (remaining >= 2 && p[0] == 'f' && isSpace(p[1])) {
+					p = skipSpaces(p + 2, lineEnd);
+					face.clear();
+					faceFlags.clear();
+					while (p < lineEnd && *p != '\r') {
+						uint8_t flags = 0;
+						face.push_back(parseCorner(p, lineEnd, data, flags));
+						faceFlags.push_back(flags);
+						while (p < lineEnd && (isSpace(*p) || *p == '\r')) p++;
+					}
+
+					bool anyRelative = std::any_of(faceFlags.begin(), faceFlags.end(), [](uint8_t f) { return f != 0; });
+					if (anyRelative && chunk.relativeFlags.size() < data.indices.size()) {
+						chunk.relativeFlags.resize(data.indices.size(), 0);
+					}
+
+					// Polygons are converted into a fan of triangles around the first corner
+					for (size_t k = 2; k < face.size(); k++) {
+						const size_t corners[3] = { 0, k - 1, k };
+						for (size_t c : corners) {
+							data.indices.push_back(face[c]);
+							if (!chunk.relativeFlags.empty() || anyRelative) {
+								chunk.relativeFlags.push_back(faceFlags[c]);
+							}
+						}
+					}
+				}
+				else if (remaining >= 7 && std::memcmp(p, "usemtl", 6) == 0 && isSpace(p[6])) {
+					std::string name = readName(p + 7, lineEnd);
+					int material = findMaterial(data.materials, name);
+					if (material < 0) {
+						material = static_cast<int>(data.materials.size());
+						data.materials.push_back({ name });
+					}
+					useMaterial(data.materialRanges, data.indices.size(), material);
+				}
+				else if (remaining >= 7 && std::memcmp(p, "mtllib", 6) == 0 && isSpace(p[6])) {
+					data.materialLibraries.push_back(readName(p + 7, lineEnd));
+				}
+				// Anything else (comments, groups, lines...) is ignored
+
+				line = lineEnd + 1;
+			}
+
+			// Keep the flags array in step with the indices so the merge can index it directly
+			if (!chunk.relativeFlags.empty()) {
+				chunk.relativeFlags.resize(data.indices.size(), 0);
+			}
+		}
+
+		// The first line that starts at or after position. The data before it is waited for
+		// piece by piece, as far as it takes to find the line break in front of it.
+		size_t findLineStart(const char* data, size_t size, size_t position, const std::function<size_t(size_t)>& waitFor) {
+			if (position == 0) return 0;
+			if (position >= size) return size;
+			position--;
+			while (position < size) {
+				size_t ready = std::min(waitFor(position + 1), size);
+				const void* newline = memchr(data + position, '\n', ready - position);
+				if (newline != nullptr) return static_cast<size_t>(static_cast<const char*>(newline) - data) + 1;
+				position = ready;
+			}
+			return size;
+		}
+
+		template <typename T>
+		void copyInto(std::vector<T>& destination, size_t offset, const std::vector<T>& source) {
+			if (!source.empty()) {
+				std::memcpy(destination.data() + offset, source.data(), source.size() * sizeof(T));
+			}
+		}
+
+		// Negative indices were stored relative to the start of the chunk, this adds the
+		// number of attributes that came before it
+		inline ObjIndex resolveCorner(const Chunk& chunk, size_t corner, int vertexBase, int normalBase, int texcoordBase) {
+			ObjIndex index = chunk.data.indices[corner];
+			if (!chunk.relativeFlags.empty()) {
+				uint8_t flags = chunk.relativeFlags[corner];
+				if (flags & RELATIVE_VERTEX) index.vertexIndex += vertexBase;
+				if (flags & RELATIVE_NORMAL) index.normalIndex += normalBase;
+				if (flags & RELATIVE_TEXCOORD) index.texcoordIndex += texcoordBase;
+			}
+			return index;
+		}
+
+		// Optional indices may be -1 (not provided), anything else must be in range
+		inline void checkCorner(const ObjIndex& index, long long vertexCount, long long normalCount, long long texcoordCount) {
+			if (index.vertexIndex < 0 || index.vertexIndex >= vertexCount ||
+				index.normalIndex < -1 || index.normalIndex >= normalCount ||
+				index.texcoordIndex < -1 || index.texcoordIndex >= texcoordCount) {
+				throw std::runtime_error("OBJ face references an element that doesn't exist");
+			}
+		}
+
+		// Keeps one copy of every distinct corner. Corners with the same three indices always
+		// build the same vertex, so comparing indices is enough and a lot cheaper than
+		// comparing vertices. The table is sized up front for the number of corners.
+		void weldCorners(const std::vector<ObjIndex>& corners, std::vector<ObjIndex>& uniqueCorners, std::vector<uint32_t>& indices) {
+			constexpr uint32_t EMPTY = UINT32_MAX;
+			size_t tableSize = 1;
+			while (tableSize < corners.size() * 2) tableSize *= 2;
+			std::vector<uint32_t> table(tableSize, EMPTY);
+
+			uniqueCorners.clear();
+			indices.clear();
+			indices.reserve(corners.size());
+			for (const ObjIndex& corner : corners) {
+				uint32_t hash = static_cast<uint32_t>(corner.vertexIndex) * 0x9e3779b1u;
+				hash ^= static_cast<uint32_t>(corner.normalIndex) * 0x85ebca77u;
+				hash ^= static_cast<uint32_t>(corner.texcoordIndex) * 0xc2b2ae3du;
+				hash ^= hash >> 15;
+
+				size_t slot = hash & (tableSize - 1);
+				while (true) {
+					uint32_t entry = table[slot];
+					if (entry == EMPTY) {
+						table[slot] = static_cast<uint32_t>(uniqueCorners.size());
+						indices.push_back(table[slot]);
+						uniqueCorners.push_back(corner);
+						break;
+					}
+					const ObjIndex& existing = uniqueCorners[entry];
+					if (existing.vertexIndex == corner.vertexIndex &&
+						existing.normalIndex == corner.normalIndex &&
+						existing.texcoordIndex == corner.texcoordIndex) {
+						indices.push_back(entry);
+						break;
+					}
+					slot = (slot + 1) & (tableSize - 1);
+				}
+			}
+		}
+
+		template <typename T>
+		void appendAndRelease(std::vector<T>& destination, std::vector<T>& source) {
+			destination.insert(destination.end(), source.begin(), source.end());
+			std::vector<T>{}.swap(source);
+		}
+	}
+
+	ObjData ObjParser::parseFile(const std::string& filePath, ThreadPool& pool) {
+		ObjData obj{};
+		{
+			VirtualFileSystem::File file = VirtualFileSystem::shared().open(filePath);
+			obj = parse(file, pool);
+		}
+
+		// Library names are relative to the folder of the OBJ file. When two libraries
+		// define the same name the first one wins, the same as tiny object loader.
+		if (!obj.materials.empty()) {
+			std::vector<bool> found(obj.materials.size(), false);
+			for (const std::string& library : obj.materialLibraries) {
+				for (ObjMaterial& material : parseMaterialFile(getMaterialLibraryPath(filePath, library))) {
+					int index = findMaterial(obj.materials, material.name);
+					if (index < 0 || found[index]) continue;
+					found[index] = true;
+					obj.materials[index] = std::move(material);
+				}
+			}
+		}
+		return obj;
+	}
+
+	std::string ObjParser::getMaterialLibraryPath(const std::string& objPath, const std::string& library) {
+		return (std::filesystem::path(objPath).parent_path() / library).string();
+	}
+
+	std::vector<std::string> ObjParser::findMaterialLibraries(const char* data, size_t size) {
+		std::vector<std::string> libraries{};
+		const char* end = data + size;
+		for (const char* line = data; line < end;) {
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+			if (lineEnd == nullptr) lineEnd = end;
+			const char* p = skipSpaces(line, lineEnd);
+			if (lineEnd - p >= 7 && std::memcmp(p, "mtllib", 6) == 0 && isSpace(p[6])) {
+				libraries.push_back(readName(p + 7, lineEnd));
+			}
+			line = lineEnd + 1;
+		}
+		return libraries;
+	}
+
+	std::vector<ObjMaterial> ObjParser::parseMaterialFile(const std::string& filePath) {
+		std::vector<ObjMaterial> materials{};
+		VirtualFileSystem& fileSystem = VirtualFileSystem::shared();
+		if (!fileSystem.exists(filePath)) return materials;
+		VirtualFileSystem::File file = fileSystem.open(filePath);
+		file.waitForAll();
+
+		const char* fileEnd = file.data() + file.size();
+		for (const char* line = file.data(); line < fileEnd;) {
+			const char* end = static_cast<const char*>(memchr(line, '\n', fileEnd - line));
+			if (end == nullptr) end = fileEnd;
+			const char* p = skipSpaces(line, end);
+			size_t remaining = end - p;
+			line = end + 1;
+
+			if (remaining >= 7 && std::memcmp(p, "newmtl", 6) == 0 && isSpace(p[6])) {
+				materials.push_back({ readName(p + 7, end) });
+			}
+			else if (materials.empty()) {
+				continue;	// Nothing before the first newmtl belongs to a material
+			}
+			else if (remaining >= 3 && p[0] == 'K' && p[1] == 'd' && isSpace(p[2])) {
+				p += 3;
+				for (float& value : materials.back().diffuse) value = parseReal(p, end, value);
+			}
+			else if (remaining >= 3 && p[0] == 'K' && p[1] == 's' && isSpace(p[2])) {
+				p += 3;
+				for (float& value : materials.back().specular) value = parseReal(p, end, value);
+			}
+			else if (remaining >= 3 && p[0] == 'N' && p[1] == 's' && isSpace(p[2])) {
+				p += 3;
+				materials.back().shininess = parseReal(p, end, materials.back().shininess);
+			}
+			else if (remaining >= 2 && p[0] == 'd' && isSpace(p[1])) {
+				p += 2;
+				materials.back().dissolve = parseReal(p, end, materials.back().dissolve);
+			}
+			else if (remaining >= 3 && p[0] == 'T' && p[1] == 'r' && isSpace(p[2])) {
+				p += 3;
+				materials.back().dissolve = 1.0f - parseReal(p, end, 0.0f);
+			}
+		}
+		return materials;
+	}
+
+	ObjData ObjParser::parse(const char* data, size_t size, ThreadPool& pool) {
+		return parseChunks(data, size, pool, [size](size_t) { return size; });
+	}
+
+	ObjData ObjParser::parse(const VirtualFileSystem::File& file, ThreadPool& pool) {
+		return parseChunks(file.data(), file.size(), pool, [&file](size_t count) { return file.waitFor(count); });
+	}
+
+	ObjData ObjParser::parseChunks(const char* data, size_t size, ThreadPool& pool, const WaitFor& waitFor) {
+		if (size == 0) return ObjData{};
+
+		// Chunk i covers the lines that start in [i * chunkSize, (i + 1) * chunkSize), so every
+		// job can find its own boundaries and no line is ever cut in half. Nothing has to be
+		// scanned up front, which lets the first chunks be parsed while the data of the later
+		// ones is still coming in. The jobs are handed out in order, so they only wait when
+		// they've caught up with the inflater.
+		size_t workerCount = pool.getThreadCount() + 1;		// The calling thread helps out too
+		size_t chunkSize = std::max(MIN_CHUNK_SIZE, size / (workerCount * CHUNKS_PER_THREAD));
+		size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+
+		std::vector<Chunk> chunks(chunkCount);
+		pool.parallelFor(chunkCount, [&](size_t i) {
+			size_t begin = findLineStart(data, size, i * chunkSize, waitFor);
+			size_t end = findLineStart(data, size, (i + 1) * chunkSize, waitFor);
+			waitFor(end);
+			parseChunk(data + begin, data + end, chunks[i]);
+		});
+
+		// Prefix sums give every chunk its position in the merged arrays
+		struct Offsets { size_t positions, normals, texcoords, indices; };
+		std::vector<Offsets> offsets(chunkCount + 1, Offsets{ 0, 0, 0, 0 });
+		for (size_t i = 0; i < chunkCount; i++) {
+			const ObjData& chunk = chunks[i].data;
+			offsets[i + 1].positions = offsets[i].positions + chunk.positions.size();
+			offsets[i + 1].normals = offsets[i].normals + chunk.normals.size();
+			offsets[i + 1].texcoords = offsets[i].texcoords + chunk.texcoords.size();
+			offsets[i + 1].indices = offsets[i].indices + chunk.indices.size();
+		}
+
+		ObjData result{};
+		const Offsets& totals = offsets[chunkCount];
+		result.positions.resize(totals.positions);
+		result.colors.resize(totals.positions);
+		result.normals.resize(totals.normals);
+		result.texcoords.resize(totals.texcoords);
+		result.indices.resize(totals.indices);
+
+		const long long vertexCount = static_cast<long long>(totals.positions / 3);
+		const long long normalCount = static_cast<long long>(totals.normals / 3);
+		const long long texcoordCount = static_cast<long long>(totals.texcoords / 2);
+
+		pool.parallelFor(chunkCount, [&](size_t i) {
+			const Chunk& chunk = chunks[i];
+			const Offsets& base = offsets[i];
+			copyInto(result.positions, base.positions, chunk.data.positions);
+			copyInto(result.colors, base.positions, chunk.data.colors);
+			copyInto(result.normals, base.normals, chunk.data.normals);
+			copyInto(result.texcoords, base.texcoords, chunk.data.texcoords);
+
+			const int vertexBase = static_cast<int>(base.positions / 3);
+			const int normalBase = static_cast<int>(base.normals / 3);
+			const int texcoordBase = static_cast<int>(base.texcoords / 2);
+
+			for (size_t c = 0; c < chunk.data.indices.size(); c++) {
+				ObjIndex index = resolveCorner(chunk, c, vertexBase, normalBase, texcoordBase);
+				checkCorner(index, vertexCount, normalCount, texcoordCount);
+				result.indices[base.indices + c] = index;
+			}
+		});
+
+		// Every chunk numbered its materials on its own, so the names are matched up here. A
+		// chunk without a usemtl simply carries on with the material the one before it ended on.
+		for (size_t i = 0; i < chunkCount; i++) {
+			const ObjData& chunk = chunks[i].data;
+			for (const std::string& library : chunk.materialLibraries) result.materialLibraries.push_back(library);
+			for (const ObjMaterialRange& range : chunk.materialRanges) {
+				const std::string& name = chunk.materials[range.material].name;
+				int material = findMaterial(result.materials, name);
+				if (material < 0) {
+					material = static_cast<int>(result.materials.size());
+					result.materials.push_back({ name });
+				}
+				useMaterial(result.materialRanges, offsets[i].indices + range.firstCorner, material);
+			}
+		}
+		// A usemtl at the very end of the file doesn't cover any corners
+		if (!result.materialRanges.empty() && result.materialRanges.back().firstCorner == result.indices.size()) {
+			result.materialRanges.pop_back();
+		}
+
+		return result;
+	}
+
+	ObjStreamLayout ObjParser::scanFile(const std::string& filePath, size_t windowSize, size_t maxAttributeBytes) {
+		std::ifstream file{ filePath, std::ios::binary };
+		if (!file) throw std::runtime_error("Failed to open file: " + filePath);
+
+		// The attributes of every window are kept on their own until the end. Growing one
+		// big array instead would need up to twice its size every time it's reallocated.
+		std::vector<ObjData> blocks{};
+		ObjStreamLayout layout{};
+		size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
+		size_t attributeBytes = 0;
+
+		std::vector<char> buffer(windowSize);
+		std::vector<ObjIndex> corners{};
+		std::vector<ObjIndex> uniqueCorners{};
+		std::vector<uint32_t> indices{};
+		uint64_t offset = 0;		// Where buffer[0] is in the file
+		size_t carried = 0;			// Bytes of an unfinished line from the last window
+
+		while (true) {
+			file.read(buffer.data() + carried, static_cast<std::streamsize>(windowSize - carried));
+			size_t filled = carried + static_cast<size_t>(file.gcount());
+			if (filled == 0) break;
+
+			// Everything up to the last line break is parsed now, the rest goes into the next window
+			size_t end = filled;
+			if (filled == windowSize) {
+				size_t lastNewline = filled;
+				while (lastNewline > 0 && buffer[lastNewline - 1] != '\n') lastNewline--;
+				if (lastNewline == 0) throw std::runtime_error("OBJ line is longer than the streaming window: " + filePath);
+				end = lastNewline;
+			}
+
+			Chunk chunk{};
+			parseChunk(buffer.data(), buffer.data() + end, chunk);
+			if (!chunk.data.indices.empty()) {
+				ObjWindow window{};
+				window.offset = offset;
+				window.size = end;
+				window.positionsBefore = positionCount;
+				window.normalsBefore = normalCount;
+				window.texcoordsBefore = texcoordCount;
+				window.cornerCount = chunk.data.indices.size();
+
+				corners.resize(window.cornerCount);
+				for (size_t c = 0; c < corners.size(); c++) {
+					corners[c] = resolveCorner(chunk, c,
+						static_cast<int>(positionCount), static_cast<int>(normalCount), static_cast<int>(texcoordCount));
+				}
+				weldCorners(corners, uniqueCorners, indices);
+				window.uniqueCornerCount = uniqueCorners.size();
+				layout.windows.push_back(window);
+			}
+
+			ObjData& data = chunk.data;
+			positionCount += data.positions.size() / 3;
+			normalCount += data.normals.size() / 3;
+			texcoordCount += data.texcoords.size() / 2;
+			attributeBytes += (data.positions.size() + data.colors.size() + data.normals.size() + data.texcoords.size()) * sizeof(float);
+			if (attributeBytes > maxAttributeBytes) {
+				throw std::runtime_error("OBJ attributes don't fit in the streaming memory budget: " + filePath);
+			}
+			if (!data.positions.empty() || !data.normals.empty() || !data.texcoords.empty()) {
+				// Copies are exactly as large as they need to be, the parsed arrays have spare capacity
+				ObjData block{};
+				block.positions.assign(data.positions.begin(), data.positions.end());
+				block.colors.assign(data.colors.begin(), data.colors.end());
+				block.normals.assign(data.normals.begin(), data.normals.end());
+				block.texcoords.assign(data.texcoords.begin(), data.texcoords.end());
+				blocks.push_back(std::move(block));
+			}
+
+			std::memmove(buffer.data(), buffer.data() + end, filled - end);
+			carried = filled - end;
+			offset += end;
+		}
+
+		// Now the sizes are known, so every array is allocated once and the
+		// blocks are released as soon as they have been copied over
+		ObjData& attributes = layout.attributes;
+		attributes.positions.reserve(positionCount * 3);
+		attributes.colors.reserve(positionCount * 3);
+		attributes.normals.reserve(normalCount * 3);
+		attributes.texcoords.reserve(texcoordCount * 2);
+		for (ObjData& block : blocks) {
+			appendAndRelease(attributes.positions, block.positions);
+			appendAndRelease(attributes.colors, block.colors);
+			appendAndRelease(attributes.normals, block.normals);
+			appendAndRelease(attributes.texcoords, block.texcoords);
+		}
+		return layout;
+	}
+
+	void ObjParser::readWindow(
+		const std::string& filePath,
+		const ObjStreamLayout& layout,
+		size_t window,
+		std::vector<ObjIndex>& uniqueCorners,
+		std::vector<uint32_t>& indices) {
+		const ObjWindow& objWindow = layout.windows[window];
+		std::ifstream file{ filePath, std::ios::binary };
+		if (!file) throw std::runtime_error("Failed to open file: " + filePath);
+
+		std::vector<char> buffer(objWindow.size);
+		file.seekg(static_cast<std::streamoff>(objWindow.offset));
+		file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		if (static_cast<size_t>(file.gcount()) != buffer.size()) {
+			throw std::runtime_error("OBJ file changed while it was being streamed: " + filePath);
+		}
+
+		Chunk chunk{};
+		parseChunk(buffer.data(), buffer.data() + buffer.size(), chunk);
+		if (chunk.data.indices.size() != objWindow.cornerCount) {
+			throw std::runtime_error("OBJ file changed while it was being streamed: " + filePath);
+		}
+		std::vector<char>{}.swap(buffer);
+
+		const ObjData& attributes = layout.attributes;
+		std::vector<ObjIndex> corners(objWindow.cornerCount);
+		for (size_t c = 0; c < corners.size(); c++) {
+			corners[c] = resolveCorner(chunk, c,
+				static_cast<int>(objWindow.positionsBefore),
+				static_cast<int>(objWindow.normalsBefore),
+				static_cast<int>(objWindow.texcoordsBefore));
+			checkCorner(corners[c],
+				static_cast<long long>(attributes.positions.size() / 3),
+				static_cast<long long>(attributes.normals.size() / 3),
+				static_cast<long long>(attributes.texcoords.size() / 2));
+		}
+		chunk = Chunk{};
+		weldCorners(corners, uniqueCorners, indices);
+	}
+}
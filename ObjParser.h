@@ -0,0 +1,122 @@
+//**********************************************************************
+// This is our own wavefront OBJ reader which replaces tiny object
+// loader for the model loading path. The file is opened through the
+// VirtualFileSystem and split into chunks that each end on a line
+// break. Every chunk is parsed on its own worker thread and the results
+// are then stitched back together in file order, so the output is
+// always the same no matter how many threads took part. A file that is
+// still being inflated out of a zip archive is parsed as it comes in. Only the records the Model class
+// cares about are read (v, vn, vt, f, usemtl and mtllib), everything
+// else is skipped.
+// Files too large to keep in memory can be streamed instead, see
+// scanFile and readWindow below.
+//**********************************************************************
+
+#pragma once
+
+#include "ThreadPool.h"
+#include "VirtualFileSystem.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace engine {
+	// One corner of a face. These are zero based indices into the attribute
+	// arrays of ObjData and a value of -1 means the index was not provided.
+	struct ObjIndex {
+		int vertexIndex{ -1 };
+		int normalIndex{ -1 };
+		int texcoordIndex{ -1 };
+	};
+
+	// A newmtl entry of an MTL file. Values the library leaves out keep these
+	// defaults, which match the material of a model without any materials.
+	struct ObjMaterial {
+		std::string name{};
+		float diffuse[3]{ 1.0f, 1.0f, 1.0f };	// Kd
+		float specular[3]{ 1.0f, 1.0f, 1.0f };	// Ks
+		float shininess{ 512.0f };				// Ns
+		float dissolve{ 1.0f };					// d, or 1 - Tr
+	};
+
+	// Every corner from firstCorner on uses the material, up to the next range
+	struct ObjMaterialRange {
+		size_t firstCorner{ 0 };
+		int material{ -1 };		// Into ObjData::materials, -1 for corners before the first usemtl
+	};
+
+	// The raw contents of an OBJ file, laid out the same way as tinyobj::attrib_t
+	// so that the Model class can read it the exact same way it always has.
+	struct ObjData {
+		std::vector<float> positions{};		// 3 values per vertex
+		std::vector<float> colors{};		// 3 values per vertex, 1.0 when the file doesn't provide any
+		std::vector<float> normals{};		// 3 values per normal
+		std::vector<float> texcoords{};		// 2 values per texture coordinate
+		std::vector<ObjIndex> indices{};	// 3 corners per triangle, polygons are fan triangulated
+
+		// Every name usemtl refers to, once each in the order they first show up. parse only
+		// knows the names, parseFile fills in the values from the mtllib files.
+		std::vector<ObjMaterial> materials{};
+		std::vector<ObjMaterialRange> materialRanges{};	// Empty when the file has no usemtl
+		std::vector<std::string> materialLibraries{};	// mtllib file names, relative to the OBJ file
+	};
+
+	// A piece of a streamed file, see ObjParser::scanFile
+	struct ObjWindow {
+		uint64_t offset{ 0 };			// Where the window starts in the file
+		size_t size{ 0 };				// Always ends on a line break
+		size_t positionsBefore{ 0 };	// Attributes read before the window, for negative indices
+		size_t normalsBefore{ 0 };
+		size_t texcoordsBefore{ 0 };
+		size_t cornerCount{ 0 };		// Triangle corners in the window
+		size_t uniqueCornerCount{ 0 };	// Distinct position/normal/texcoord combinations among them
+	};
+
+	struct ObjStreamLayout {
+		ObjData attributes{};				// Every attribute of the file, the indices stay empty
+		std::vector<ObjWindow> windows{};	// Only the windows that contain faces
+	};
+
+	class ObjParser {
+	public:
+		static ObjData parseFile(const std::string& filePath, ThreadPool& pool = ThreadPool::shared());
+		static ObjData parse(const char* data, size_t size, ThreadPool& pool = ThreadPool::shared());
+		// Starts on the chunks as soon as their part of the file is ready
+		static ObjData parse(const VirtualFileSystem::File& file, ThreadPool& pool = ThreadPool::shared());
+
+		// Reads every newmtl entry of an MTL file. A missing library is not an error,
+		// the materials that would have come from it keep their default values.
+		static std::vector<ObjMaterial> parseMaterialFile(const std::string& filePath);
+		// Where an mtllib entry of the OBJ file at objPath points, it's relative to the OBJ's folder
+		static std::string getMaterialLibraryPath(const std::string& objPath, const std::string& library);
+		// Only the mtllib entries of an OBJ file, without parsing anything else
+		static std::vector<std::string> findMaterialLibraries(const char* data, size_t size);
+
+		// The first pass of a streamed load. The file is read windowSize bytes at a time instead
+		// of being mapped, the attributes are kept and the faces are only counted. Faces can use
+		// any attribute that came before them, so the attributes are the one part that has to
+		// stay in memory. Throws once they take up more than maxAttributeBytes.
+		static ObjStreamLayout scanFile(const std::string& filePath, size_t windowSize, size_t maxAttributeBytes);
+
+		// Reads the faces of one window of a scanned file. uniqueCorners gets every distinct
+		// corner once, in the order they first show up, and indices gets one entry per
+		// corner pointing into it. Windows don't depend on each other, so any number of
+		// them can be read at the same time.
+		static void readWindow(
+			const std::string& filePath,
+			const ObjStreamLayout& layout,
+			size_t window,
+			std::vector<ObjIndex>& uniqueCorners,
+			std::vector<uint32_t>& indices);
+
+	private:
+		// Blocks until the first count bytes can be read and returns how many can be read
+		using WaitFor = std::function<size_t(size_t count)>;
+
+		static ObjData parseChunks(const char* data, size_t size, ThreadPool& pool, const WaitFor& waitFor);
+	};
+}
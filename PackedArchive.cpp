@@ -0,0 +1,92 @@
+#include "PackedArchive.h"
+#include "Inflater.h"
+#include "Utils.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace engine {
+	static_assert(sizeof(PackedArchive::Header) == 32, "The packed archive header must not change size by accident");
+	static_assert(sizeof(PackedArchive::TocEntry) == 40, "The packed archive table of contents must not change size by accident");
+
+	PackedArchive::PackedArchive(const std::string &tempFilePath)
+		: filePath{ tempFilePath }, mapping{ std::make_shared<const MappedFile>(tempFilePath) } {
+		auto fail = [&](const std::string &reason) {
+			return std::runtime_error("Failed to read packed archive " + filePath + ": " + reason);
+		};
+		const char *data = mapping->data();
+		size_t size = mapping->size();
+
+		if (size < sizeof(Header)) throw fail("it's too small");
+		std::memcpy(&header, data, sizeof(Header));
+		if (header.magic != MAGIC) throw fail("it isn't a packed archive");
+		if (header.version != VERSION) throw fail("it was written by another version of the packer");
+
+		uint64_t tocSize = static_cast<uint64_t>(header.entryCount) * sizeof(TocEntry);
+		if (tocSize + header.namesSize > size - sizeof(Header) ||
+			header.dataOffset < sizeof(Header) + tocSize + header.namesSize ||
+			header.dataOffset > size || header.dataSize > size - header.dataOffset) {
+			throw fail("the table of contents doesn't fit in the file");
+		}
+		toc = reinterpret_cast<const TocEntry*>(data + sizeof(Header));
+		names = data + sizeof(Header) + tocSize;
+
+		// Checked once here so nothing that reads an asset has to
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			const TocEntry &entry = toc[i];
+			if (static_cast<uint64_t>(entry.nameOffset) + entry.nameLength > header.namesSize ||
+				entry.offset < header.dataOffset || entry.offset > size || entry.size > size - entry.offset) {
+				throw fail("an entry is outside of the file");
+			}
+			if (i > 0 && toc[i - 1].nameHash > entry.nameHash) throw fail("the table of contents isn't sorted");
+		}
+	}
+
+	const PackedArchive::TocEntry* PackedArchive::find(const std::string &name) const {
+		uint64_t hash = hashBytes(name.data(), name.size());
+		const TocEntry *end = toc + header.entryCount;
+		const TocEntry *entry = std::lower_bound(toc, end, hash,
+			[](const TocEntry &a, uint64_t b) { return a.nameHash < b; });
+		for (; entry != end && entry->nameHash == hash; ++entry) {
+			if (entry->nameLength == name.size() && std::memcmp(names + entry->nameOffset, name.data(), name.size()) == 0) {
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+
+	std::string PackedArchive::getName(const TocEntry &entry) const {
+		return std::string(names + entry.nameOffset, entry.nameLength);
+	}
+
+	bool PackedArchive::verify() const {
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			const TocEntry &entry = toc[i];
+			if (Inflater::updateCrc32(0, getData(entry), static_cast<size_t>(entry.size)) != entry.crc32) return false;
+		}
+		return true;
+	}
+
+	size_t PackedArchive::prefetch(const std::vector<const TocEntry*> &entries) const {
+		std::vector<MappedFile::Range> ranges{};
+		ranges.reserve(entries.size());
+		for (const TocEntry *entry : entries) {
+			ranges.push_back({ static_cast<size_t>(entry->offset), static_cast<size_t>(entry->size) });
+		}
+		return mapping->prefetch(std::move(ranges));
+	}
+
+	size_t PackedArchive::prefetchAll() const {
+		// The assets are stored back to back, so this is a single range
+		return mapping->prefetch({ { static_cast<size_t>(header.dataOffset), static_cast<size_t>(header.dataSize) } });
+	}
+
+	bool PackedArchive::isPackedArchive(const std::string &filePath) {
+		std::ifstream file{ filePath, std::ios::binary };
+		uint32_t magic = 0;
+		return file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) && magic == MAGIC;
+	}
+}
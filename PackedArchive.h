@@ -0,0 +1,102 @@
+//**********************************************************************
+// Our own archive format for the assets the engine needs at startup:
+// compiled shaders, cooked meshes (mesh cache files) and later on
+// textures, all in one file that is written offline by the AssetPacker.
+// Everything is stored uncompressed and aligned, so an asset is just a
+// pointer into the memory mapped archive and can be handed straight to
+// Vulkan or the staging buffers. The table of contents sits right after
+// the header, sorted by the hash of the names, so opening an archive
+// maps one file and reads a few KB, and finding an asset is a binary
+// search instead of building an index.
+//
+// Layout, little endian:
+//   Header
+//   TocEntry[entryCount]	sorted by nameHash, then by name
+//   names					not terminated, see TocEntry::nameOffset
+//   data					every asset starts on a multiple of DATA_ALIGNMENT
+//**********************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class PackedArchive {
+	public:
+		static constexpr uint32_t MAGIC = 0x4B415045;	// "EPAK" in a little endian file
+		static constexpr uint32_t VERSION = 1;
+		// Enough for SIMD loads and for Vulkan's alignment of SPIR-V and vertex data
+		static constexpr size_t DATA_ALIGNMENT = 64;
+
+		enum class Kind : uint32_t {
+			Other = 0,
+			Shader = 1,		// SPIR-V
+			Mesh = 2,		// A mesh cache file, see MeshCache.h
+			Texture = 3
+		};
+
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entryCount;
+			uint32_t namesSize;
+			uint64_t dataOffset;		// Where the first asset starts
+			uint64_t dataSize;
+		};
+
+		struct TocEntry {
+			uint64_t nameHash;		// hashBytes of the name
+			uint64_t offset;		// From the start of the file
+			uint64_t size;
+			uint32_t nameOffset;	// Into the names that follow the table of contents
+			uint32_t nameLength;
+			Kind kind;
+			uint32_t crc32;			// Of the data, see verify
+		};
+
+		// Maps the archive and checks the header and table of contents. Throws
+		// std::runtime_error when the file isn't an archive we can read.
+		explicit PackedArchive(const std::string &filePath);
+
+		PackedArchive(const PackedArchive&) = delete;
+		PackedArchive& operator=(const PackedArchive&) = delete;
+
+		// Names use forward slashes and are relative to where the archive is mounted.
+		// Returns nullptr when there is no such asset.
+		const TocEntry* find(const std::string &name) const;
+
+		const char* getData(const TocEntry &entry) const { return mapping->data() + entry.offset; }
+		std::string getName(const TocEntry &entry) const;
+		uint32_t getEntryCount() const { return header.entryCount; }
+		const TocEntry& getEntry(uint32_t index) const { return toc[index]; }
+
+		// Reads every asset and compares it against its checksum. That touches the whole
+		// file, so it's only done by the packer right after writing an archive.
+		bool verify() const;
+
+		// One batch of read ahead hints for the assets, returns the number of system calls it took
+		size_t prefetch(const std::vector<const TocEntry*> &entries) const;
+		size_t prefetchAll() const;
+
+		const std::string& getFilePath() const { return filePath; }
+		// Assets point into this, so it stays alive for as long as somebody reads from them
+		const std::shared_ptr<const MappedFile>& getMapping() const { return mapping; }
+
+		// Only looks at the first few bytes, so it's cheap to call on any file
+		static bool isPackedArchive(const std::string &filePath);
+
+	private:
+		std::string filePath;
+		std::shared_ptr<const MappedFile> mapping;
+		Header header{};
+		const TocEntry *toc = nullptr;
+		const char *names = nullptr;
+	};
+}
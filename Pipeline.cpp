@@ -2,10 +2,12 @@
 #include "Model.h"
 
 // std
-#include <fstream>
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 namespace engine {
 
@@ -23,21 +25,13 @@ namespace engine {
 		vkDestroyPipeline(device.device(), graphicsPipeline, nullptr);
 	}
 
-	std::vector<char> Pipeline::readFile(const std::string& filepath) {
+	VirtualFileSystem::File Pipeline::readFile(const std::string& filepath) {
 		
-		std::ifstream file{ filepath, std::ios::ate | std::ios::binary };	//Open the file using the file path passed in
-																			//ios ate to go to the end of the file
-		if (!file.is_open()) {
-			throw std::runtime_error("Failed to open file: " + filepath);
-		}
-		size_t fileSize = static_cast<size_t>(file.tellg());				//tellg gets the last position which is also the file size
-
-		std::vector<char> buffer(fileSize);									//Initialize this vector with the file size
-
-		file.seekg(0);								//Seek to the start of the file
-		file.read(buffer.data(), fileSize);			//Read the file into the buffer vector with the correct number of bytes.
-		file.close();								//Close the file
-		return buffer;								//Return the vector
+		// Shaders may sit on disk or inside a mounted archive, the virtual file system
+		// hides the difference. It throws if the file can't be found.
+		VirtualFileSystem::File file = VirtualFileSystem::shared().open(filepath);
+		file.waitForAll();							//Deflated entries may still be inflating
+		return file;								//A view of the mapped file, nothing is copied
 	}
 
 	// Here we read the SimpleShader files (.vert and .frag) but, we actually read the the files 
@@ -127,13 +121,22 @@ namespace engine {
 		}
 	}
 
-	void Pipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
+	void Pipeline::createShaderModule(const VirtualFileSystem::File& code, VkShaderModule* shaderModule) {
 		VkShaderModuleCreateInfo createInfo{};
 
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 		createInfo.codeSize = code.size();
 		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
+		//SPIR-V has to be 4 byte aligned. Mapped files and packed assets always are,
+		//only a shader stored in a zip file can land anywhere and has to be copied
+		std::vector<uint32_t> aligned{};
+		if (reinterpret_cast<uintptr_t>(code.data()) % alignof(uint32_t) != 0) {
+			aligned.resize((code.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+			std::memcpy(aligned.data(), code.data(), code.size());
+			createInfo.pCode = aligned.data();
+		}
+
 		if (vkCreateShaderModule(device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create shader module");
 		}
@@ -274,4 +277,20 @@ namespace engine {
 		configInfo.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 		configInfo.colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 	}
+
+	// Drops every vertex binding and attribute but the position. Vulkan only fetches what
+	// the vertex input describes, so the other attributes are never read for this pass.
+	void Pipeline::enableDepthOnly(PipelineConfigInfo& configInfo) {
+		auto& bindings = configInfo.bindingDescriptions;
+		auto& attributes = configInfo.attributeDescriptions;
+		bindings.erase(std::remove_if(bindings.begin(), bindings.end(),
+			[](const VkVertexInputBindingDescription& binding) { return binding.binding != 0; }), bindings.end());
+		attributes.erase(std::remove_if(attributes.begin(), attributes.end(),
+			[](const VkVertexInputAttributeDescription& attribute) { return attribute.location != 0; }), attributes.end());
+		assert(attributes.size() == 1 && attributes[0].binding == 0 && "The position has to be read from binding 0");
+
+		// The depth test still runs and writes, only the color attachment is left alone
+		configInfo.colorBlendAttachment.colorWriteMask = 0;
+		configInfo.colorBlendAttachment.blendEnable = VK_FALSE;
+	}
 }
\ No newline at end of file
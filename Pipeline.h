@@ -8,6 +8,7 @@
 #pragma once
 
 #include "Device.h"
+#include "VirtualFileSystem.h"
 
 #include <string>
 #include <vector>
@@ -46,14 +47,14 @@ namespace engine {
 		VkShaderModule vertShaderModule;
 		VkShaderModule fragShaderModule;
 
-		static std::vector<char> readFile(const std::string& vertFilepath);
+		static VirtualFileSystem::File readFile(const std::string& vertFilepath);
 
 		void createGraphicsPipeline(const std::string& vertFilepath, 
 			const std::string& fragFilepath, 
 			const PipelineConfigInfo& info);
 
-		//This takes in the shader code in the form of a vector of characters and a pointer to a shader module
-		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+		//This takes in a view of the shader code and a pointer to a shader module
+		void createShaderModule(const VirtualFileSystem::File& code, VkShaderModule* shaderModule);
 
 	public:
 		Pipeline(const std::string& vertFilepath, 
@@ -69,5 +70,9 @@ namespace engine {
 
 		static void defultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 		static void enableAlphaBlending(PipelineConfigInfo& configInfo);
+		// For depth and shadow passes: keeps only the position at binding 0 in the vertex input
+		// and stops writing color. With split models (see Model::VertexLayout) the pass then
+		// fetches nothing but the position stream. Call it after setting the vertex input.
+		static void enableDepthOnly(PipelineConfigInfo& configInfo);
 	};
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ namespace engine {
 		// The advantage is that it allows a sequence of commands to be recoded once and reused for multiple
 		// frames. Unlike OpenGL where draw commands would need to be repeated for every frame.
 		createCommandBuffers();
+		frameAllocator = std::make_unique<FrameAllocator>(device, SwapChain::MAX_FRAMES_IN_FLIGHT);
 	}
 
 	Renderer::~Renderer() {
@@ -27,7 +28,11 @@ namespace engine {
 			extent = window.getExtent();
 			glfwWaitEvents();
 		}
-		vkDeviceWaitIdle(device.device());
+		// Only the frames and the presents have to be done before the old swap chain goes. Uploads
+		// on a dedicated transfer queue keep running, without one they share the graphics queue
+		// and wait here too when that is also the present queue.
+		device.getDeletionQueue().waitForFrames();
+		vkQueueWaitIdle(device.presentQueue());
 		//swapChain.reset(nullptr);
 
 		if (swapChain == nullptr) {
@@ -103,6 +108,12 @@ namespace engine {
 		}
 		isFrameStarted = true;
 
+		// acquireNextImage waited for this frame's in flight fence, so the GPU is done with
+		// everything the frame allocator handed out the last time this frame index was used
+		frameAllocator->beginFrame(currentFrameIndex);
+		// Buffers and heap ranges that the finished frames were the last to use go now
+		device.getDeletionQueue().collect();
+
 		auto commandBuffer = getCommandBuffer();
 
 		VkCommandBufferBeginInfo beginInfo{};
@@ -117,6 +128,9 @@ namespace engine {
 	void Renderer::endFrame() {
 		assert(isFrameStarted && "Cannot call endFrame() when frame is not in progress");
 
+		// Everything the systems wrote to the frame allocator goes to the GPU with one flush
+		frameAllocator->flush();
+
 		// Here's where we end the recording of the command buffer
 		auto commandBuffer = getCommandBuffer();
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "Device.h"
+#include "FrameAllocator.h"
 #include "SwapChain.h"
 #include "Window.h"
 
@@ -24,6 +25,7 @@ namespace engine {
 
 		std::unique_ptr<SwapChain> swapChain;
 		std::vector<VkCommandBuffer> commandBuffers;
+		std::unique_ptr<FrameAllocator> frameAllocator;		// Reset in beginFrame, flushed in endFrame
 
 		uint32_t currentImageIndex{ 0 };
 		int currentFrameIndex{ 0 };
@@ -43,6 +45,8 @@ namespace engine {
 		VkRenderPass getSwapChainRenderPass() const { return swapChain->getRenderPass(); }
 		float getAspectRatio() const { return swapChain->extentAspectRatio(); }
 		bool isFrameInProgress() const { return isFrameStarted; }
+		// Ranges for data that only lives for the frame in progress (see FrameAllocator.h)
+		FrameAllocator& getFrameAllocator() { return *frameAllocator; }
 
 		VkCommandBuffer getCommandBuffer() const { 
 			assert(isFrameStarted && "Cannot get command buffer when frame is not in progress");
@@ -0,0 +1,61 @@
+#version 450
+
+//*****************************************************
+//Vertex shader for models uploaded as Model::CompactVertex.
+//It does the same work as SimpleShader.vert, the only
+//difference is how the vertex attributes are stored.
+//The fixed function vertex input already turns the
+//normalized and half float values back into floats.
+//*****************************************************
+
+// position is 0 to 1 across the bounding box of the model, the model
+// matrix from RenderSystem.cpp already scales it back to model space.
+// normal is octahedral encoded, see Model.cpp for the encoding
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 color;
+layout (location = 2) in vec2 normal;
+layout (location = 3) in vec2 uv;
+
+layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec3 fragPosWorld;
+layout (location = 2) out vec3 fragNormalWorld;
+
+struct PointLight {
+	vec4 position;	// Ignore w
+	vec4 color;	// w is intensity
+};
+
+// set and binding must match what we used when setting up our descriptor set layout
+layout (set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projection;
+	mat4 view;
+	mat4 inverseView;
+	vec4 ambientLightColor; // The 4th dimension is intensity
+	PointLight pointLights[10];
+	int numLights;
+} ubo;
+
+// This communicates with the push constants struct in RenderSystem.cpp
+layout (push_constant) uniform Push {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+} push;
+
+// Unfolds the square back into an octahedron and then onto the unit sphere
+vec3 decodeOctahedral(vec2 encoded) {
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+void main() {
+
+	vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+	gl_Position = ubo.projection * ubo.view * positionWorld;
+
+	fragNormalWorld = normalize(mat3(push.normalMatrix) * decodeOctahedral(normal));
+	fragPosWorld = positionWorld.xyz;
+	fragColor = color;
+}
@@ -29,13 +29,26 @@ layout (set = 0, binding = 0) uniform GlobalUbo {
 	int numLights;
 } ubo;
 
+// Must match Model::Material in Model.h
+struct Material {
+	vec4 diffuse;	// w is the opacity
+	vec4 specular;	// w is the shininess
+};
+
+// Every model's materials, see MaterialTable.h
+layout (set = 1, binding = 0) readonly buffer MaterialTable {
+	Material materials[];
+} materialTable;
+
 // This communicates with the push constants struct in RenderSystem.cpp
+// The last column of the normal matrix holds the index of the material
 layout (push_constant) uniform Push {
 	mat4 modelMatrix;
 	mat4 normalMatrix;
 } push;
 
 void main() {
+	Material material = materialTable.materials[int(push.normalMatrix[3].x)];
 	vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
 	vec3 specularLight = vec3(0.0); 	// Holds the total for each point light specular contribution
 	vec3 surfaceNormal = normalize(fragNormalWorld);
@@ -67,12 +80,13 @@ void main() {
 
 		// Ignore cases when the viewer and light are on opossite sides of the surface
 		blinnTerm = clamp(blinnTerm, 0, 1);
-		blinnTerm = pow(blinnTerm, 512.0);	// Highter value = sharper highlight
+		blinnTerm = pow(blinnTerm, material.specular.w);	// Highter value = sharper highlight
 		specularLight += intensity * blinnTerm;
 	}
 
 	// These values are RGB and the Alpha, meaning the value of the color. This is just a compiling 
 	// stage that tells the graphics card which pixels the geometry mostly contains during the restorization 
 	// stage. It will use this to properly color the pixels later.
-	outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, 1.0);
+	outColor = vec4(diffuseLight * fragColor * material.diffuse.rgb
+		+ specularLight * fragColor * material.specular.rgb, material.diffuse.a);
 }
\ No newline at end of file
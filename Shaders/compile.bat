@@ -7,6 +7,7 @@ echo Compiling GLSL shaders...
 rem Compile vertex shader
 D:\C++Libraries\VulkanSDK\Bin\glslc.exe SimpleShader.vert -o SimpleShader.vert.spv
 D:\C++Libraries\VulkanSDK\Bin\glslc.exe PointLight.vert -o PointLight.vert.spv
+D:\C++Libraries\VulkanSDK\Bin\glslc.exe CompactShader.vert -o CompactShader.vert.spv
 
 rem Compile fragment shader
 D:\C++Libraries\VulkanSDK\Bin\glslc.exe SimpleShader.frag -o SimpleShader.frag.spv
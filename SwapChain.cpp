@@ -47,7 +47,7 @@ namespace engine {
         for (size_t i = 0; i < depthImages.size(); i++) {
             vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
             vkDestroyImage(device.device(), depthImages[i], nullptr);
-            vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+            device.freeMemory(depthImageMemorys[i]);
         }
 
         for (auto framebuffer : swapChainFramebuffers) {
@@ -114,8 +114,19 @@ namespace engine {
         // This is the semaphore that function will signal when it's done. The
         // wait semaphore(above) is the one that the function itself waits for.
         VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        // The frame also signals the deletion queue's timeline, so resources are only destroyed
+        // once every frame that could use them is done. The value of a binary semaphore is ignored.
+        DeletionQueue &deletionQueue = device.getDeletionQueue();
+        VkSemaphore frameSignalSemaphores[] = {renderFinishedSemaphores[currentFrame], deletionQueue.getFrameTimeline()};
+        uint64_t frameSignalValues[] = {0, deletionQueue.getNextFrame()};
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = frameSignalValues;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 2;
+        submitInfo.pSignalSemaphores = frameSignalSemaphores;
 
         // Here we reset the fences for the next frame
         vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
@@ -123,6 +134,7 @@ namespace engine {
             VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        deletionQueue.frameSubmitted();
 
         VkPresentInfoKHR presentInfo = {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -356,6 +368,7 @@ namespace engine {
             device.createImageWithInfo(
                 imageInfo,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                MemoryCategory::Depth,
                 depthImages[i],
                 depthImageMemorys[i]);
 
@@ -32,7 +32,7 @@ namespace engine {
         VkRenderPass renderPass = reinterpret_cast<VkRenderPass>(1);
 
         std::vector<VkImage> depthImages;
-        std::vector<VkDeviceMemory> depthImageMemorys;
+        std::vector<MemoryAllocation> depthImageMemorys;
         std::vector<VkImageView> depthImageViews;
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
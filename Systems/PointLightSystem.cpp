@@ -128,7 +128,7 @@ namespace engine {
 			pipelineLayout,
 			0, 1,
 			&frameInfo.globalDescriptorSet,
-			0, nullptr);
+			1, &frameInfo.globalUboOffset);
 
 		// Iterate through the sorted lights in reverse order so that we 
 		// maintain the correct transparency no matter the perspective
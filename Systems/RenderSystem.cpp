@@ -1,4 +1,5 @@
 #include "RenderSystem.h"
+#include "../GeometryHeap.h"
 
 #define GLM_FORCE_RADIANS				// All GLM functions will expect angles in radians 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE		// GLM will expect or depth buffer values to range from 0 - 1
@@ -7,16 +8,53 @@
 
 #include <stdexcept>
 #include <array>
+#include <algorithm>
+#include <cstddef>
 
 namespace engine {
+	// A level of detail is good enough once its simplification error covers less than this
+	// much of the screen height, which is about one pixel on a 1080 pixel high window
+	constexpr float LOD_SCREEN_ERROR = 0.001f;
+
+	namespace {
+		// The six planes of the view frustum, each one facing inwards. They come out of the
+		// rows of the combined matrix (Gribb and Hartmann), so with the model matrix included
+		// they are in model space. Vulkan's clip space depth goes from 0 to w.
+		struct Frustum {
+			glm::vec4 planes[6];
+
+			explicit Frustum(const glm::mat4& matrix) {
+				glm::vec4 rows[4];
+				for (int i = 0; i < 4; i++) rows[i] = { matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i] };
+				planes[0] = rows[3] + rows[0];	// Left
+				planes[1] = rows[3] - rows[0];	// Right
+				planes[2] = rows[3] + rows[1];	// Top or bottom, Vulkan flips y
+				planes[3] = rows[3] - rows[1];
+				planes[4] = rows[2];			// Near
+				planes[5] = rows[3] - rows[2];	// Far
+				for (auto& plane : planes) plane /= glm::length(glm::vec3(plane));
+			}
+
+			bool isOutside(const glm::vec3& center, float radius) const {
+				for (const auto& plane : planes) {
+					if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return true;
+				}
+				return false;
+			}
+		};
+	}
+
+	// The shaders only use the upper 3x3 of the normal matrix, so its last column carries the
+	// material index. That keeps us within the 128 bytes of push constants every device has.
 	struct SimplePushConstantData {
 		glm::mat4 modelMatrix{ 1.0f };
 		glm::mat4 normalMatrix{ 1.0f };
 	};
+	constexpr uint32_t MATERIAL_PUSH_OFFSET = offsetof(SimplePushConstantData, normalMatrix) + 3 * sizeof(glm::vec4);
 
 	RenderSystem::RenderSystem(
 		Device& tempDevice, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) 
-		: device{ tempDevice } {
+		: device{ tempDevice }, materialTable{ tempDevice.getMaterialTable() } {
 		// This creates the layout and initializes the device object settings
 		createPipelineLayout(globalSetLayout);
 		createPipeline(renderPass);
@@ -35,8 +73,9 @@ namespace engine {
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 
-		// Right now we only have one, but we will make vector for when we add more
-		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+		// Set 0 is the global uniform buffer and set 1 the material table
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts{
+			globalSetLayout, materialTable.getDescriptorSetLayout() };
 
 		// This where we tell the pipeline about the descriptor set layouts
 		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
@@ -67,34 +106,168 @@ namespace engine {
 		pipelineConfig.renderPass = renderPass;
 
 		pipelineConfig.pipelineLayout = pipelineLayout;
-		pipeline = std::make_unique<Pipeline>(
-			"Shaders/SimpleShader.vert.spv",		//These are the files written in GLSL for the graphics
-			"Shaders/SimpleShader.frag.spv",		//and then comipled using the compile.bat file
-			device,
-			pipelineConfig);
+
+		// The formats and layouts only differ in how the vertex buffer is read, everything else is shared
+		for (Model::VertexFormat format : { Model::VertexFormat::Standard, Model::VertexFormat::Compact }) {
+			for (Model::VertexLayout layout : { Model::VertexLayout::Interleaved, Model::VertexLayout::Split }) {
+				pipelineConfig.bindingDescriptions = Model::getBindingDescriptions(format, layout);
+				pipelineConfig.attributeDescriptions = Model::getAttributeDescriptions(format, layout);
+				pipelines[static_cast<int>(format)][static_cast<int>(layout)] = std::make_unique<Pipeline>(
+					format == Model::VertexFormat::Compact
+						? "Shaders/CompactShader.vert.spv"
+						: "Shaders/SimpleShader.vert.spv",		//These are the files written in GLSL for the graphics
+					"Shaders/SimpleShader.frag.spv",			//and then comipled using the compile.bat file
+					device,
+					pipelineConfig);
+			}
+		}
+	}
+
+	Pipeline* RenderSystem::getPipeline(const Model& model) const {
+		return pipelines[static_cast<int>(model.getVertexFormat())][static_cast<int>(model.getVertexLayout())].get();
+	}
+
+	// Picks the coarsest level of detail whose error would still be too small to see. The
+	// bounding sphere of the model is projected to find out how much of the screen it covers.
+	uint32_t RenderSystem::selectLod(const Model& model, const glm::mat4& modelMatrix, const Camera& camera) const {
+		if (model.getLodCount() == 1) return 0;
+
+		// The longest axis of the model matrix decides how big the sphere gets
+		const Model::BoundingBox& box = model.getBoundingBox();
+		float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		float radius = 0.5f * glm::length(box.max - box.min) * scale;
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+		float distance = glm::length(center - camera.getPosition());
+		if (distance <= radius) return 0;	// The camera is inside the sphere
+
+		// projection[1][1] is 1 / tan(fovy / 2), so this is the radius of the sphere as a
+		// fraction of the screen height. The errors are relative to the same radius.
+		float screenRadius = radius * camera.getProjection()[1][1] / (2.0f * distance);
+		for (uint32_t lod = model.getLodCount() - 1; lod > 0; lod--) {
+			if (model.getLod(lod).error * screenRadius <= LOD_SCREEN_ERROR) return lod;
+		}
+		return 0;
 	}
+
+	// Only the material index is pushed, the matrices of the model stay as they are
+	void RenderSystem::pushMaterial(FrameInfo& frameInfo, const Model& model, uint32_t material) {
+		glm::vec4 materialColumn{ static_cast<float>(model.getMaterialOffset() + material), 0.0f, 0.0f, 1.0f };
+		vkCmdPushConstants(
+			frameInfo.commandBuffer,
+			pipelineLayout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			MATERIAL_PUSH_OFFSET,
+			sizeof(glm::vec4),
+			&materialColumn);
+	}
+
+	// Draws the meshlets of the full detail level that can be seen. The culling happens
+	// in model space, so the frustum and the camera move into the model once instead of
+	// moving every meshlet out into the world.
+	void RenderSystem::drawMeshlets(FrameInfo& frameInfo, Model& model, const glm::mat4& modelMatrix) {
+		const Camera& camera = frameInfo.camera;
+		Frustum frustum{ camera.getProjection() * camera.getView() * modelMatrix };
+		glm::vec3 cameraPosition = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(camera.getPosition(), 1.0f));
+
+		// Meshlets that are next to each other in the index buffer share one draw, as long as
+		// they have the same material. The first sub mesh's material was pushed with the model.
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		uint32_t material = model.getSubMeshes()[0].material;
+		for (const Model::Meshlet& meshlet : model.getMeshlets()) {
+			stats.clustersTested++;
+			if (frustum.isOutside(meshlet.center, meshlet.radius)) {
+				stats.clustersFrustumCulled++;
+				continue;
+			}
+			if (clusterBackFaceCulling && meshlet.facesAway(cameraPosition)) {
+				stats.clustersBackFaceCulled++;
+				continue;
+			}
+			stats.clustersDrawn++;
+			stats.trianglesSubmitted += meshlet.indexCount / 3;
+
+			if (indexCount > 0 && firstIndex + indexCount == meshlet.firstIndex && meshlet.material == material) {
+				indexCount += meshlet.indexCount;
+				continue;
+			}
+			if (indexCount > 0) {
+				model.drawIndexRange(frameInfo.commandBuffer, firstIndex, indexCount);
+				stats.drawCalls++;
+			}
+			if (meshlet.material != material) {
+				material = meshlet.material;
+				pushMaterial(frameInfo, model, material);
+				stats.materialSwitches++;
+			}
+			firstIndex = meshlet.firstIndex;
+			indexCount = meshlet.indexCount;
+		}
+		if (indexCount > 0) {
+			model.drawIndexRange(frameInfo.commandBuffer, firstIndex, indexCount);
+			stats.drawCalls++;
+		}
+	}
+
 	void RenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-		pipeline->bind(frameInfo.commandBuffer);
+		stats = {};
+
+		// Most models are split, so that pipeline goes first
+		Pipeline* boundPipeline = pipelines[static_cast<int>(Model::VertexFormat::Compact)][static_cast<int>(Model::VertexLayout::Split)].get();
+		boundPipeline->bind(frameInfo.commandBuffer);
 
 		// We do this outside of the for loop (below this) 
 		// because there's no need to re-bind. We only do this 
 		// once and then the values in the GlobalUbo struct 
 		// (in Application.cpp) can be used by all game objects 
 		// without the need for re-binding
+		VkDescriptorSet descriptorSets[] = { frameInfo.globalDescriptorSet, materialTable.getDescriptorSet() };
 		vkCmdBindDescriptorSets(
 			frameInfo.commandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			pipelineLayout,
-			0, 1,
-			&frameInfo.globalDescriptorSet,
-			0, nullptr);
+			0, 2,
+			descriptorSets,
+			1, &frameInfo.globalUboOffset);
+
+		// What is bound out of the geometry heap. Models in it only bind again when their
+		// vertex format or index type differs from the one before.
+		GeometryHeap& geometryHeap = device.getGeometryHeap();
+		uint32_t boundVertexPool = UINT32_MAX;
+		VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
 
 		for (auto& kv : frameInfo.gameObjects) {
 			auto& obj = kv.second;
-			if (obj.model == nullptr) continue;
+			Model* model = frameInfo.modelRegistry.get(obj.model);
+			if (model == nullptr) {
+				if (frameInfo.modelRegistry.isLoading(obj.model)) stats.modelsLoading++;
+				continue;
+			}
+			// Streamed models start out without any triangles
+			if (model->getTriangleCount(0) == 0) continue;
+
+			// The materials go into the table the first time the model shows up
+			if (model->getMaterialOffset() == Model::NO_MATERIAL_OFFSET) {
+				model->setMaterialOffset(materialTable.add(model->getMaterials()));
+			}
+
+			// Every pipeline shares the layout, so the descriptor set stays bound when we switch
+			Pipeline* modelPipeline = getPipeline(*model);
+			if (modelPipeline != boundPipeline) {
+				modelPipeline->bind(frameInfo.commandBuffer);
+				boundPipeline = modelPipeline;
+			}
+
+			glm::mat4 modelMatrix = obj.transform.mat4();
 			SimplePushConstantData push{};
-			push.modelMatrix = obj.transform.mat4();
+			// The position transform turns compact positions back into model space first
+			push.modelMatrix = modelMatrix * model->getPositionTransform();
 			push.normalMatrix = obj.transform.normalMatrix();
+			uint32_t lod = selectLod(*model, modelMatrix, frameInfo.camera);
+			const Model::Lod& level = model->getLod(lod);
+			const Model::SubMesh* subMeshes = &model->getSubMeshes()[level.firstSubMesh];
+			push.normalMatrix[3] = glm::vec4{ static_cast<float>(model->getMaterialOffset() + subMeshes[0].material), 0.0f, 0.0f, 1.0f };
 
 			vkCmdPushConstants(
 				frameInfo.commandBuffer,
@@ -103,8 +276,44 @@ namespace engine {
 				0,
 				sizeof(SimplePushConstantData),
 				&push);
-			obj.model->bind(frameInfo.commandBuffer);
-			obj.model->draw(frameInfo.commandBuffer);
+			stats.trianglesFull += model->getTriangleCount(0);
+			if (model->isInGeometryHeap()) {
+				uint32_t vertexPool = static_cast<uint32_t>(model->getVertexFormat());
+				if (vertexPool != boundVertexPool) {
+					geometryHeap.bindVertices(frameInfo.commandBuffer, vertexPool);
+					boundVertexPool = vertexPool;
+					stats.geometryBinds++;
+				}
+				if (model->hasIndices() && model->getIndexType() != boundIndexType) {
+					geometryHeap.bindIndices(frameInfo.commandBuffer, model->getIndexType());
+					boundIndexType = model->getIndexType();
+					stats.geometryBinds++;
+				}
+			}
+			else {
+				// Models with buffers of their own replace whatever the heap had bound
+				model->bind(frameInfo.commandBuffer);
+				boundVertexPool = UINT32_MAX;
+				boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+				stats.geometryBinds++;
+			}
+
+			// Only the full detail level is split into meshlets, the
+			// simplified levels are small enough to draw as a whole
+			if (lod == 0 && !model->getMeshlets().empty()) {
+				drawMeshlets(frameInfo, *model, modelMatrix);
+				continue;
+			}
+			// One bind for the whole model, then a draw for each of its materials
+			stats.trianglesSubmitted += model->getTriangleCount(lod);
+			for (uint32_t i = 0; i < level.subMeshCount; i++) {
+				if (i > 0) {
+					pushMaterial(frameInfo, *model, subMeshes[i].material);
+					stats.materialSwitches++;
+				}
+				model->drawSubMesh(frameInfo.commandBuffer, subMeshes[i]);
+				stats.drawCalls++;
+			}
 		}
 	}
 }
\ No newline at end of file
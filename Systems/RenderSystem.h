@@ -5,6 +5,7 @@
 #include "../GameObject.h"
 #include "../Pipeline.h"
 #include "../FrameInfo.h"
+#include "../MaterialTable.h"
 
 // std
 #include <memory>
@@ -12,17 +13,44 @@
 namespace engine {
 
 	class RenderSystem {
+	public:
+		// Counted again every frame by renderGameObjects
+		struct Stats {
+			uint64_t trianglesSubmitted{ 0 };	// With the levels of detail that were picked
+			uint64_t trianglesFull{ 0 };		// If every model had been drawn at full detail
+
+			uint32_t clustersTested{ 0 };		// Meshlets of models drawn at full detail
+			uint32_t clustersFrustumCulled{ 0 };
+			uint32_t clustersBackFaceCulled{ 0 };
+			uint32_t clustersDrawn{ 0 };
+			uint32_t drawCalls{ 0 };
+			uint32_t materialSwitches{ 0 };		// Push constant updates between draws of one model
+			uint32_t geometryBinds{ 0 };		// Vertex and index buffer binds, see GeometryHeap.h
+
+			uint32_t modelsLoading{ 0 };		// Game objects skipped because their model isn't resident yet
+		};
+
 	private:
 		Device& device;
 
 		//Here we create a Pipeline fron Pipeline.h and pass in the compiled shader files that were compiled by the 
 		//compile.bat and Vulkan. This is how we get the files from the graphics card and use them in our program
 		//Pipeline also has a default configuration that we pass our values into in case there are no other values.
-		std::unique_ptr<Pipeline> pipeline;
+		// There is one for every vertex format and layout, indexed as [format][layout]. Compact
+		// models read Model::CompactVertex through CompactShader.vert.
+		std::unique_ptr<Pipeline> pipelines[2][2];
 		VkPipelineLayout pipelineLayout;
+		// Every model's materials in one storage buffer, bound once a frame as set 1
+		MaterialTable& materialTable;
+		Stats stats{};
+		bool clusterBackFaceCulling{ false };
 
 		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
 		void createPipeline(VkRenderPass renderPass);
+		Pipeline* getPipeline(const Model& model) const;
+		uint32_t selectLod(const Model& model, const glm::mat4& modelMatrix, const Camera& camera) const;
+		void drawMeshlets(FrameInfo& frameInfo, Model& model, const glm::mat4& modelMatrix);
+		void pushMaterial(FrameInfo& frameInfo, const Model& model, uint32_t material);
 
 	public:
 
@@ -30,6 +58,13 @@ namespace engine {
 		~RenderSystem();
 
 		void renderGameObjects(FrameInfo& frameInfo);
+		const Stats& getStats() const { return stats; }
+
+		// Skips the meshlets that only face away from the camera. The pipelines draw both sides
+		// of every triangle, so this is off by default and only right for closed, single sided
+		// models: open geometry seen from behind (panels, glass) would disappear with it.
+		void setClusterBackFaceCulling(bool enabled) { clusterBackFaceCulling = enabled; }
+		bool isClusterBackFaceCulling() const { return clusterBackFaceCulling; }
 
 		RenderSystem(const RenderSystem&) = delete;				//Delete copy constructors
 		RenderSystem& operator=(const RenderSystem&) = delete;
@@ -0,0 +1,108 @@
+#include "ThreadPool.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace engine {
+	ThreadPool::ThreadPool(unsigned threadCount) {
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		workers.reserve(threadCount);
+		for (unsigned i = 0; i < threadCount; i++) {
+			workers.emplace_back([this]() { workerLoop(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock{ queueMutex };
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool& ThreadPool::shared() {
+		static ThreadPool pool{};
+		return pool;
+	}
+
+	void ThreadPool::enqueue(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock{ queueMutex };
+			jobs.push(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	void ThreadPool::workerLoop() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock{ queueMutex };
+				jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				// We drain the queue before exiting so no future is left without a value
+				if (stopping && jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+			job();
+		}
+	}
+
+	void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& job) {
+		if (count == 0) return;
+		if (count == 1 || workers.empty()) {
+			for (size_t i = 0; i < count; i++) job(i);
+			return;
+		}
+
+		// The state is shared with the helper jobs because a helper may only get picked
+		// up after every item is already finished, at which point this function has
+		// returned. Such a late helper finds nothing left to do and simply exits.
+		struct State {
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> finished{ 0 };
+			size_t count{ 0 };
+			std::function<void(size_t)> job;
+			std::mutex mutex;
+			std::condition_variable done;
+			std::exception_ptr error;
+		};
+		auto state = std::make_shared<State>();
+		state->count = count;
+		state->job = job;
+
+		auto run = [](State& s) {
+			size_t i;
+			while ((i = s.next.fetch_add(1)) < s.count) {
+				try {
+					s.job(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock{ s.mutex };
+					if (!s.error) s.error = std::current_exception();
+				}
+				if (s.finished.fetch_add(1) + 1 == s.count) {
+					std::lock_guard<std::mutex> lock{ s.mutex };
+					s.done.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min(count - 1, workers.size());
+		for (size_t h = 0; h < helpers; h++) {
+			enqueue([state, run]() { run(*state); });
+		}
+		run(*state);
+
+		std::unique_lock<std::mutex> lock{ state->mutex };
+		state->done.wait(lock, [&]() { return state->finished.load() == state->count; });
+		if (state->error) std::rethrow_exception(state->error);
+	}
+}
@@ -0,0 +1,61 @@
+//**********************************************************************
+// A small pool of worker threads that we can hand jobs to. Starting a
+// thread is fairly expensive, so rather than creating new ones every
+// time we want to split up work (like parsing a large model file) we
+// keep a fixed number of them alive and feed them from a shared queue.
+//**********************************************************************
+
+#pragma once
+
+// std
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace engine {
+	class ThreadPool {
+	private:
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> jobs;
+		std::mutex queueMutex;
+		std::condition_variable jobAvailable;
+		bool stopping{ false };
+
+		void workerLoop();
+		void enqueue(std::function<void()> job);
+
+	public:
+		// A thread count of 0 uses one worker for every hardware thread
+		explicit ThreadPool(unsigned threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		unsigned getThreadCount() const { return static_cast<unsigned>(workers.size()); }
+
+		// Queues a job and hands back a future that will hold its result
+		template <typename Job>
+		auto submit(Job&& job) -> std::future<decltype(job())> {
+			using Result = decltype(job());
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Job>(job));
+			std::future<Result> result = task->get_future();
+			enqueue([task]() { (*task)(); });
+			return result;
+		}
+
+		// Calls job(i) for every i in [0, count) spread over the workers and the calling
+		// thread, then blocks until all of them are done. The calling thread takes part
+		// in the work, so this is safe to call from inside another job on the same pool.
+		void parallelFor(size_t count, const std::function<void(size_t)>& job);
+
+		// The engine wide pool used by the loaders
+		static ThreadPool& shared();
+	};
+}
@@ -0,0 +1,213 @@
+#include "TlsfAllocator.h"
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+// std
+#include <cassert>
+
+namespace engine {
+	namespace {
+		// Index of the highest set bit, value must not be 0
+		uint32_t highestBit(uint64_t value) {
+		#ifdef _MSC_VER
+			unsigned long index = 0;
+			_BitScanReverse64(&index, value);
+			return static_cast<uint32_t>(index);
+		#else
+			return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+		#endif
+		}
+
+		// Index of the lowest set bit, value must not be 0
+		uint32_t lowestBit(uint64_t value) {
+		#ifdef _MSC_VER
+			unsigned long index = 0;
+			_BitScanForward64(&index, value);
+			return static_cast<uint32_t>(index);
+		#else
+			return static_cast<uint32_t>(__builtin_ctzll(value));
+		#endif
+		}
+
+		uint64_t alignUp(uint64_t value, uint64_t alignment) {
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	TlsfAllocator::TlsfAllocator(uint64_t tempSize) : size{ tempSize & ~(GRANULARITY - 1) } {
+		assert(size >= GRANULARITY && "The block is smaller than the granularity");
+		for (auto& lists : freeLists) {
+			for (uint32_t& list : lists) list = INVALID_HANDLE;
+		}
+		insertFree(createNode(0, size));
+	}
+
+	// The first level is the highest bit of the size, the second level the next
+	// SECOND_LEVEL_BITS bits below it. Sizes are at least GRANULARITY, so there are
+	// always enough bits below the highest one.
+	void TlsfAllocator::mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel) {
+		firstLevel = highestBit(size);
+		secondLevel = static_cast<uint32_t>(size >> (firstLevel - SECOND_LEVEL_BITS)) & (SECOND_LEVEL_COUNT - 1);
+	}
+
+	// Rounds the size up to the next list boundary first, so that any range in the list
+	// that is found is large enough. That way the list head can be taken without a search.
+	uint32_t TlsfAllocator::findFreeNode(uint64_t size) const {
+		uint32_t firstLevel = highestBit(size);
+		uint64_t rounded = size + (uint64_t{ 1 } << (firstLevel - SECOND_LEVEL_BITS)) - 1;
+		uint32_t secondLevel = 0;
+		mapping(rounded, firstLevel, secondLevel);
+
+		uint32_t secondLevelMap = secondLevelMaps[firstLevel] & (~0u << secondLevel);
+		if (secondLevelMap == 0) {
+			uint64_t firstLevelMapAbove = firstLevel + 1 < FIRST_LEVEL_COUNT
+				? firstLevelMap & (~uint64_t{ 0 } << (firstLevel + 1)) : 0;
+			if (firstLevelMapAbove != 0) {
+				firstLevel = lowestBit(firstLevelMapAbove);
+				secondLevelMap = secondLevelMaps[firstLevel];
+			}
+		}
+		if (secondLevelMap != 0) return freeLists[firstLevel][lowestBit(secondLevelMap)];
+
+		// Only the list the size itself falls into is left. Some of its ranges may still be
+		// large enough, which matters when the block is nearly full.
+		mapping(size, firstLevel, secondLevel);
+		for (uint32_t node = freeLists[firstLevel][secondLevel]; node != INVALID_HANDLE; node = nodes[node].nextFree) {
+			if (nodes[node].size >= size) return node;
+		}
+		return INVALID_HANDLE;
+	}
+
+	uint32_t TlsfAllocator::createNode(uint64_t offset, uint64_t nodeSize) {
+		uint32_t node = 0;
+		if (!unusedNodes.empty()) {
+			node = unusedNodes.back();
+			unusedNodes.pop_back();
+			nodes[node] = Node{};
+		}
+		else {
+			node = static_cast<uint32_t>(nodes.size());
+			nodes.emplace_back();
+		}
+		nodes[node].offset = offset;
+		nodes[node].size = nodeSize;
+		return node;
+	}
+
+	void TlsfAllocator::insertFree(uint32_t node) {
+		uint32_t firstLevel = 0, secondLevel = 0;
+		mapping(nodes[node].size, firstLevel, secondLevel);
+
+		uint32_t head = freeLists[firstLevel][secondLevel];
+		nodes[node].free = true;
+		nodes[node].previousFree = INVALID_HANDLE;
+		nodes[node].nextFree = head;
+		if (head != INVALID_HANDLE) nodes[head].previousFree = node;
+		freeLists[firstLevel][secondLevel] = node;
+		firstLevelMap |= uint64_t{ 1 } << firstLevel;
+		secondLevelMaps[firstLevel] |= 1u << secondLevel;
+	}
+
+	void TlsfAllocator::removeFree(uint32_t node) {
+		uint32_t firstLevel = 0, secondLevel = 0;
+		mapping(nodes[node].size, firstLevel, secondLevel);
+
+		Node& removed = nodes[node];
+		if (removed.previousFree != INVALID_HANDLE) nodes[removed.previousFree].nextFree = removed.nextFree;
+		else freeLists[firstLevel][secondLevel] = removed.nextFree;
+		if (removed.nextFree != INVALID_HANDLE) nodes[removed.nextFree].previousFree = removed.previousFree;
+		removed.free = false;
+		removed.previousFree = removed.nextFree = INVALID_HANDLE;
+
+		if (freeLists[firstLevel][secondLevel] == INVALID_HANDLE) {
+			secondLevelMaps[firstLevel] &= ~(1u << secondLevel);
+			if (secondLevelMaps[firstLevel] == 0) firstLevelMap &= ~(uint64_t{ 1 } << firstLevel);
+		}
+	}
+
+	uint32_t TlsfAllocator::splitFront(uint32_t node, uint64_t frontSize) {
+		uint32_t front = createNode(nodes[node].offset, frontSize);
+		Node& back = nodes[node];
+		back.offset += frontSize;
+		back.size -= frontSize;
+
+		nodes[front].previousPhysical = back.previousPhysical;
+		nodes[front].nextPhysical = node;
+		if (back.previousPhysical != INVALID_HANDLE) nodes[back.previousPhysical].nextPhysical = front;
+		else firstNode = front;
+		back.previousPhysical = front;
+		return front;
+	}
+
+	void TlsfAllocator::mergeNext(uint32_t node) {
+		uint32_t next = nodes[node].nextPhysical;
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhysical = nodes[next].nextPhysical;
+		if (nodes[next].nextPhysical != INVALID_HANDLE) nodes[nodes[next].nextPhysical].previousPhysical = node;
+		unusedNodes.push_back(next);
+	}
+
+	TlsfAllocator::Allocation TlsfAllocator::allocate(uint64_t requestSize, uint64_t alignment) {
+		assert((alignment & (alignment - 1)) == 0 && "The alignment has to be a power of two");
+		uint64_t allocationSize = alignUp(requestSize == 0 ? 1 : requestSize, GRANULARITY);
+		alignment = alignment < GRANULARITY ? GRANULARITY : alignment;
+
+		// Every range starts on the granularity, so this much padding is enough for any alignment
+		uint32_t node = findFreeNode(allocationSize + alignment - GRANULARITY);
+		if (node == INVALID_HANDLE) return Allocation{};
+		removeFree(node);
+
+		// The padding in front goes back into the lists. The range before it is in use,
+		// otherwise the two would have been merged when it was freed.
+		uint64_t padding = alignUp(nodes[node].offset, alignment) - nodes[node].offset;
+		if (padding > 0) insertFree(splitFront(node, padding));
+
+		// Whatever is left behind the allocation is free again
+		if (nodes[node].size > allocationSize) {
+			uint32_t used = splitFront(node, allocationSize);
+			insertFree(node);
+			node = used;
+		}
+
+		usedBytes += nodes[node].size;
+		allocationCount++;
+		return Allocation{ node, nodes[node].offset, nodes[node].size };
+	}
+
+	void TlsfAllocator::free(uint32_t handle) {
+		assert(handle < nodes.size() && !nodes[handle].free && "Freeing a range that isn't allocated");
+		usedBytes -= nodes[handle].size;
+		allocationCount--;
+
+		uint32_t node = handle;
+		uint32_t next = nodes[node].nextPhysical;
+		if (next != INVALID_HANDLE && nodes[next].free) {
+			removeFree(next);
+			mergeNext(node);
+		}
+		uint32_t previous = nodes[node].previousPhysical;
+		if (previous != INVALID_HANDLE && nodes[previous].free) {
+			removeFree(previous);
+			mergeNext(previous);
+			node = previous;
+		}
+		insertFree(node);
+	}
+
+	TlsfAllocator::Stats TlsfAllocator::getStats() const {
+		Stats stats{};
+		stats.size = size;
+		stats.usedBytes = usedBytes;
+		stats.allocationCount = allocationCount;
+
+		// The physical links go through the whole block, which is fine for statistics
+		for (uint32_t node = firstNode; node != INVALID_HANDLE; node = nodes[node].nextPhysical) {
+			if (!nodes[node].free) continue;
+			stats.freeRangeCount++;
+			if (nodes[node].size > stats.largestFreeRange) stats.largestFreeRange = nodes[node].size;
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,88 @@
+//**********************************************************************
+// A two level segregated fit allocator (Masmano et al. 2004) for ranges
+// of one large block. It doesn't own any memory, it only hands out
+// offsets, so the MemoryAllocator uses one for every VkDeviceMemory
+// block. Free ranges sit in lists by size: the first level is the power
+// of two of the size and the second level splits that into 16 steps.
+// Two bitmaps say which lists have anything in them, so finding a
+// range that fits and freeing one are both constant time. Neighbouring
+// free ranges are merged right away, which keeps fragmentation low.
+//**********************************************************************
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	class TlsfAllocator {
+	public:
+		// Every offset and size is a multiple of this
+		static constexpr uint64_t GRANULARITY = 64;
+		static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+		struct Allocation {
+			uint32_t handle{ INVALID_HANDLE };	// Give this back to free
+			uint64_t offset{ 0 };
+			uint64_t size{ 0 };					// Rounded up to the granularity
+		};
+
+		struct Stats {
+			uint64_t size{ 0 };
+			uint64_t usedBytes{ 0 };
+			uint32_t allocationCount{ 0 };
+			uint32_t freeRangeCount{ 0 };
+			uint64_t largestFreeRange{ 0 };
+		};
+
+		explicit TlsfAllocator(uint64_t size);
+
+		// alignment has to be a power of two. Returns an allocation with INVALID_HANDLE
+		// when no free range is large enough.
+		Allocation allocate(uint64_t size, uint64_t alignment = GRANULARITY);
+		void free(uint32_t handle);
+
+		bool isEmpty() const { return allocationCount == 0; }
+		uint64_t getSize() const { return size; }
+		Stats getStats() const;
+
+	private:
+		static constexpr uint32_t SECOND_LEVEL_BITS = 4;
+		static constexpr uint32_t SECOND_LEVEL_COUNT = 1u << SECOND_LEVEL_BITS;
+		static constexpr uint32_t FIRST_LEVEL_COUNT = 64;
+
+		// One range of the block, free or in use. The physical links connect the ranges in
+		// address order, the free links the ranges in the same size list.
+		struct Node {
+			uint64_t offset{ 0 };
+			uint64_t size{ 0 };
+			uint32_t previousPhysical{ INVALID_HANDLE };
+			uint32_t nextPhysical{ INVALID_HANDLE };
+			uint32_t previousFree{ INVALID_HANDLE };
+			uint32_t nextFree{ INVALID_HANDLE };
+			bool free{ false };
+		};
+
+		uint64_t size;
+		uint64_t usedBytes{ 0 };
+		uint32_t allocationCount{ 0 };
+		std::vector<Node> nodes{};
+		std::vector<uint32_t> unusedNodes{};
+		uint32_t firstNode{ 0 };	// The range at offset 0
+		uint64_t firstLevelMap{ 0 };
+		uint32_t secondLevelMaps[FIRST_LEVEL_COUNT]{};
+		uint32_t freeLists[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+
+		static void mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+		uint32_t findFreeNode(uint64_t size) const;
+		uint32_t createNode(uint64_t offset, uint64_t size);
+		void insertFree(uint32_t node);
+		void removeFree(uint32_t node);
+		// Cuts the front of the node off into a new node of the given size and returns it
+		uint32_t splitFront(uint32_t node, uint64_t frontSize);
+		// Merges next into node, next has to follow node and goes back to the unused nodes
+		void mergeNext(uint32_t node);
+	};
+}
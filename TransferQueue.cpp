@@ -0,0 +1,286 @@
+#include "TransferQueue.h"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		VkSemaphore createTimeline(VkDevice device) {
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+
+			VkSemaphoreCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			createInfo.pNext = &typeInfo;
+
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			if (vkCreateSemaphore(device, &createInfo, nullptr, &semaphore) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create timeline semaphore!");
+			}
+			return semaphore;
+		}
+
+		VkCommandPool createPool(VkDevice device, uint32_t family) {
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = family;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			VkCommandPool pool = VK_NULL_HANDLE;
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create transfer command pool!");
+			}
+			return pool;
+		}
+	}
+
+	void TransferQueue::Batch::copyBuffer(VkBuffer source, VkBuffer destination,
+		uint32_t regionCount, const VkBufferCopy *regions) {
+		vkCmdCopyBuffer(commandBuffer, source, destination, regionCount, regions);
+		for (uint32_t i = 0; i < regionCount; i++) {
+			if (regions[i].size == 0) continue;
+			VkBufferMemoryBarrier range{};
+			range.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			range.buffer = destination;
+			range.offset = regions[i].dstOffset;
+			range.size = regions[i].size;
+			ranges.push_back(range);
+			bytes += regions[i].size;
+		}
+	}
+
+	TransferQueue::TransferQueue(VkDevice tempDevice, VkQueue tempGraphicsQueue, uint32_t tempGraphicsFamily,
+		VkQueue tempTransferQueue, uint32_t tempTransferFamily)
+		: device{ tempDevice }, graphicsQueue{ tempGraphicsQueue }, transferQueue{ tempTransferQueue },
+		graphicsFamily{ tempGraphicsFamily }, transferFamily{ tempTransferFamily } {
+		transferPool = createPool(device, transferFamily);
+		transferTimeline = createTimeline(device);
+		if (hasDedicatedQueue()) {
+			acquirePool = createPool(device, graphicsFamily);
+			acquireTimeline = createTimeline(device);
+		}
+	}
+
+	TransferQueue::~TransferQueue() {
+		waitIdle();
+		vkDestroySemaphore(device, transferTimeline, nullptr);
+		if (acquireTimeline != VK_NULL_HANDLE) vkDestroySemaphore(device, acquireTimeline, nullptr);
+		// Destroying the pools frees whatever command buffers are left in them
+		vkDestroyCommandPool(device, transferPool, nullptr);
+		if (acquirePool != VK_NULL_HANDLE) vkDestroyCommandPool(device, acquirePool, nullptr);
+	}
+
+	VkCommandBuffer TransferQueue::allocateCommandBuffer(VkCommandPool pool) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate transfer command buffer!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		return commandBuffer;
+	}
+
+	uint64_t TransferQueue::getValue(VkSemaphore semaphore) const {
+		uint64_t value = 0;
+		vkGetSemaphoreCounterValue(device, semaphore, &value);
+		return value;
+	}
+
+	TransferQueue::Batch TransferQueue::begin() {
+		Batch batch{};
+		batch.commandBuffer = allocateCommandBuffer(transferPool);
+		return batch;
+	}
+
+	uint64_t TransferQueue::submit(Batch &batch) {
+		Submission submission{};
+		submission.value = nextValue++;
+		submission.transferCommands = batch.commandBuffer;
+
+		if (hasDedicatedQueue()) {
+			// The release half of the ownership transfer, the graphics queue acquires the same ranges
+			for (VkBufferMemoryBarrier &range : batch.ranges) {
+				range.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				range.dstAccessMask = 0;
+				range.srcQueueFamilyIndex = transferFamily;
+				range.dstQueueFamilyIndex = graphicsFamily;
+			}
+			if (!batch.ranges.empty()) {
+				vkCmdPipelineBarrier(
+					batch.commandBuffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					0,
+					0, nullptr,
+					static_cast<uint32_t>(batch.ranges.size()), batch.ranges.data(),
+					0, nullptr);
+			}
+			submission.ranges = std::move(batch.ranges);
+		}
+		else {
+			// Same queue, so the frames submitted later only need the writes made visible
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier(
+				batch.commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr);
+		}
+		vkEndCommandBuffer(batch.commandBuffer);
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &submission.value;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &submission.transferCommands;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &transferTimeline;
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit transfer!");
+		}
+
+		stats.submits++;
+		stats.bytesUploaded += batch.bytes;
+		stats.ownershipTransfers += submission.ranges.size();
+		batch = Batch{};
+		submissions.push_back(std::move(submission));
+		return submissions.back().value;
+	}
+
+	// The acquire half. It waits for the copies on the GPU as well, which costs nothing because
+	// they are already done by the time this is recorded.
+	void TransferQueue::submitAcquire(Submission &submission) {
+		if (!submission.ranges.empty()) {
+			submission.acquireCommands = allocateCommandBuffer(acquirePool);
+			for (VkBufferMemoryBarrier &range : submission.ranges) {
+				range.srcAccessMask = 0;
+				range.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			vkCmdPipelineBarrier(
+				submission.acquireCommands,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				0, nullptr,
+				static_cast<uint32_t>(submission.ranges.size()), submission.ranges.data(),
+				0, nullptr);
+			vkEndCommandBuffer(submission.acquireCommands);
+		}
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = 1;
+		timelineInfo.pWaitSemaphoreValues = &submission.value;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &submission.value;
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &transferTimeline;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = submission.acquireCommands != VK_NULL_HANDLE ? 1 : 0;
+		submitInfo.pCommandBuffers = &submission.acquireCommands;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &acquireTimeline;
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit ownership transfer!");
+		}
+	}
+
+	void TransferQueue::update() {
+		uint64_t transferred = getValue(transferTimeline);
+		uint64_t acquired = hasDedicatedQueue() ? getValue(acquireTimeline) : transferred;
+
+		for (Submission &submission : submissions) {
+			if (submission.value > transferred) break;
+			if (submission.transferCommands != VK_NULL_HANDLE) {
+				vkFreeCommandBuffers(device, transferPool, 1, &submission.transferCommands);
+				submission.transferCommands = VK_NULL_HANDLE;
+			}
+			if (submission.value <= acquiredValue) continue;
+			if (hasDedicatedQueue()) submitAcquire(submission);
+			acquiredValue = submission.value;
+		}
+
+		// Submissions leave once their acquire has run on the graphics queue as well
+		while (!submissions.empty() && submissions.front().value <= std::min(acquired, acquiredValue)) {
+			Submission &submission = submissions.front();
+			if (submission.acquireCommands != VK_NULL_HANDLE) {
+				vkFreeCommandBuffers(device, acquirePool, 1, &submission.acquireCommands);
+			}
+			submissions.pop_front();
+		}
+	}
+
+	bool TransferQueue::isComplete(uint64_t value) {
+		if (value <= acquiredValue) return true;
+		update();
+		return value <= acquiredValue;
+	}
+
+	void TransferQueue::wait(uint64_t value) {
+		if (value == 0 || isComplete(value)) return;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &transferTimeline;
+		waitInfo.pValues = &value;
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+		update();
+
+		stats.stalls++;
+		stats.stallMilliseconds += std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void TransferQueue::waitIdle() {
+		wait(nextValue - 1);
+		if (acquireTimeline != VK_NULL_HANDLE) {
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &acquireTimeline;
+			waitInfo.pValues = &acquiredValue;
+			vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+			update();
+		}
+	}
+
+	void TransferQueue::waitForCopies(uint64_t value) const {
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &transferTimeline;
+		waitInfo.pValues = &value;
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	}
+}
@@ -0,0 +1,127 @@
+//**********************************************************************
+// Copies to the GPU used to go through the graphics queue followed by
+// vkQueueWaitIdle, which stalled the CPU and every frame in flight for
+// each upload. The transfer queue submits them to a queue family that
+// only does transfers when the device has one, so they run next to the
+// rendering, and tracks them with a timeline semaphore: every submit
+// signals the next value and a value is done once the semaphore has
+// reached it. Nothing waits unless it has to, and the times something
+// does are counted as stalls.
+//
+// Buffers belong to one queue family at a time. When the copies ran on
+// the transfer family, the ranges they wrote are released there and
+// acquired again by the graphics family with a second, tiny submit on
+// the graphics queue. That one is only recorded after the copies are
+// done, so the graphics queue never waits on the transfer queue. On
+// devices without a separate transfer family the copies go straight to
+// the graphics queue and no ownership changes hands.
+//
+// Command pools and queues aren't thread safe, so all of it has to be
+// used from the thread that renders.
+//**********************************************************************
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace engine {
+	class TransferQueue {
+	public:
+		struct Stats {
+			uint64_t submits{ 0 };
+			uint64_t ownershipTransfers{ 0 };	// Buffer ranges handed from the transfer to the graphics family
+			VkDeviceSize bytesUploaded{ 0 };
+			uint64_t stalls{ 0 };				// Times a caller had to block for a value that wasn't done yet
+			double stallMilliseconds{ 0.0 };
+		};
+
+		// The copies of one submit. Recording them through copyBuffer remembers the ranges
+		// they write, so their ownership can be handed to the graphics family afterwards.
+		class Batch {
+		public:
+			VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+			void copyBuffer(VkBuffer source, VkBuffer destination, uint32_t regionCount, const VkBufferCopy *regions);
+			VkDeviceSize getSize() const { return bytes; }
+
+		private:
+			friend class TransferQueue;
+			VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+			std::vector<VkBufferMemoryBarrier> ranges{};
+			VkDeviceSize bytes{ 0 };
+		};
+
+		// transferFamily can be the graphics family, then both queues are the same
+		TransferQueue(VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamily,
+			VkQueue transferQueue, uint32_t transferFamily);
+		// Waits for everything that was submitted
+		~TransferQueue();
+
+		TransferQueue(const TransferQueue&) = delete;
+		TransferQueue& operator=(const TransferQueue&) = delete;
+
+		Batch begin();
+		// Returns the timeline value that says when the copies are done
+		uint64_t submit(Batch &batch);
+
+		// Acquires the ranges of finished copies for the graphics family and frees the command
+		// buffers that are done. isComplete and wait call it, the model loader once a frame.
+		void update();
+		// True once the copies are done and the graphics queue owns what they wrote. Whatever
+		// is drawn in a frame submitted after that sees the data, the staging memory can go.
+		bool isComplete(uint64_t value);
+		// Blocks until isComplete, counting a stall when it actually has to wait
+		void wait(uint64_t value);
+		// Also waits for the acquires on the graphics queue, after this the buffers can be destroyed
+		void waitIdle();
+
+		// Only about the copies themselves, once they are done their source memory can be reused.
+		// Unlike the rest these two are thread safe, they only look at the semaphore.
+		uint64_t getCopiedValue() const { return getValue(transferTimeline); }
+		void waitForCopies(uint64_t value) const;
+		// Thread safe as well. True once the copies up to value are done and so are their acquires
+		// on the graphics queue, after that nothing on the GPU uses what they wrote anymore.
+		bool isFinished(uint64_t value) const {
+			return getCopiedValue() >= value && (!hasDedicatedQueue() || getValue(acquireTimeline) >= value);
+		}
+		// The value of the last submit, 0 before the first one. Thread safe.
+		uint64_t getSubmittedValue() const { return nextValue - 1; }
+
+		bool hasDedicatedQueue() const { return graphicsFamily != transferFamily; }
+		const Stats &getStats() const { return stats; }
+
+	private:
+		struct Submission {
+			uint64_t value{ 0 };
+			VkCommandBuffer transferCommands{ VK_NULL_HANDLE };
+			VkCommandBuffer acquireCommands{ VK_NULL_HANDLE };
+			std::vector<VkBufferMemoryBarrier> ranges{};
+		};
+
+		VkCommandBuffer allocateCommandBuffer(VkCommandPool pool);
+		void submitAcquire(Submission &submission);
+		uint64_t getValue(VkSemaphore semaphore) const;
+
+		VkDevice device;
+		VkQueue graphicsQueue;
+		VkQueue transferQueue;
+		uint32_t graphicsFamily;
+		uint32_t transferFamily;
+		VkCommandPool transferPool{ VK_NULL_HANDLE };
+		VkCommandPool acquirePool{ VK_NULL_HANDLE };
+
+		// Signaled by the copies, and on a dedicated queue by the acquires on the graphics queue.
+		// The acquires use their own semaphore because they signal in a different order.
+		VkSemaphore transferTimeline{ VK_NULL_HANDLE };
+		VkSemaphore acquireTimeline{ VK_NULL_HANDLE };
+		std::atomic<uint64_t> nextValue{ 1 };
+		uint64_t acquiredValue{ 0 };		// Every value up to this one has been handed to the graphics queue
+		std::deque<Submission> submissions{};	// In value order
+		Stats stats{};
+	};
+}
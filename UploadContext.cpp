@@ -0,0 +1,189 @@
+#include "UploadContext.h"
+
+// std
+#include <cassert>
+#include <chrono>
+
+namespace engine {
+	namespace {
+		VkDeviceSize alignRange(VkDeviceSize size) {
+			return (size + UploadContext::RANGE_ALIGNMENT - 1) / UploadContext::RANGE_ALIGNMENT * UploadContext::RANGE_ALIGNMENT;
+		}
+	}
+
+	UploadContext::Allocation::~Allocation() {
+		context.release(*this);
+	}
+
+	UploadContext::UploadContext(Device& tempDevice, TransferQueue& tempTransferQueue, VkDeviceSize ringSize)
+		: device{ tempDevice }, transferQueue{ tempTransferQueue } {
+		ring = std::make_unique<Buffer>(
+			device,
+			alignRange(ringSize),
+			1,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging);
+		ring->map();
+		ringMemory = static_cast<char*>(ring->getMappedMemory());
+		stats.ringSize = ring->getBufferSize();
+	}
+
+	UploadContext::~UploadContext() {
+		finish();
+	}
+
+	bool UploadContext::findRoom(VkDeviceSize size, VkDeviceSize& offset) const {
+		VkDeviceSize capacity = ring->getBufferSize();
+		if (regions.empty()) {
+			offset = 0;
+			return size <= capacity;
+		}
+
+		// The head never catches up with the tail, so equal only ever means empty
+		VkDeviceSize tail = regions.front().start;
+		if (head >= tail) {
+			if (capacity - head >= size) {
+				offset = head;
+				return true;
+			}
+			offset = 0;
+			return size < tail;
+		}
+		offset = head;
+		return tail - head > size;
+	}
+
+	void UploadContext::reclaim(uint64_t copiedValue) {
+		while (!regions.empty()) {
+			const Region& region = regions.front();
+			bool done = region.state == RegionState::Free
+				|| (region.state == RegionState::Submitted && region.value <= copiedValue);
+			if (!done) break;
+			regions.pop_front();
+			firstRegion++;
+		}
+		if (regions.empty()) head = 0;
+	}
+
+	std::unique_ptr<UploadContext::Allocation> UploadContext::allocate(VkDeviceSize size) {
+		assert(size > 0 && "Staging ranges can't be empty");
+		std::unique_ptr<Allocation> allocation{ new Allocation{ *this } };
+		allocation->size = size;
+		VkDeviceSize alignedSize = alignRange(size);
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		stats.allocations++;
+		if (alignedSize <= ring->getBufferSize() / 2) {
+			VkDeviceSize offset = 0;
+			reclaim(transferQueue.getCopiedValue());
+			bool found = findRoom(alignedSize, offset);
+
+			// Waits for the oldest copies as long as they're what is in the way. The lock is let go
+			// for the wait so the thread that renders can keep recording and flushing, and the
+			// ring is looked at again afterwards since other threads may have used it meanwhile.
+			while (!found && !regions.empty() && regions.front().state == RegionState::Submitted) {
+				uint64_t value = regions.front().value;
+				lock.unlock();
+				auto start = std::chrono::high_resolution_clock::now();
+				transferQueue.waitForCopies(value);
+				double waited = std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - start).count();
+				lock.lock();
+
+				stats.stalls++;
+				stats.stallMilliseconds += waited;
+				reclaim(transferQueue.getCopiedValue());
+				found = findRoom(alignedSize, offset);
+			}
+
+			if (found) {
+				if (offset < head) stats.ringWraps++;
+				Region region{};
+				region.start = regions.empty() ? offset : head;
+				region.end = offset + alignedSize;
+				regions.push_back(region);
+				head = region.end;
+
+				allocation->region = firstRegion + regions.size() - 1;
+				allocation->buffer = ring->getBuffer();
+				allocation->offset = offset;
+				allocation->mapped = ringMemory + offset;
+				return allocation;
+			}
+		}
+		stats.overflows++;
+		lock.unlock();
+
+		// Too large for the ring, or the ring is held up by ranges that haven't been submitted
+		allocation->overflow = std::make_unique<Buffer>(
+			device,
+			size,
+			1,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging);
+		allocation->overflow->map();
+		allocation->buffer = allocation->overflow->getBuffer();
+		allocation->mapped = allocation->overflow->getMappedMemory();
+		return allocation;
+	}
+
+	// Ranges that were recorded stay until their copies are done, whether the owner still holds them or not
+	void UploadContext::release(const Allocation& allocation) {
+		if (allocation.overflow) return;
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (allocation.region < firstRegion) return;	// Already copied and reused
+		Region& region = getRegion(allocation.region);
+		if (region.state == RegionState::Writing) region.state = RegionState::Free;
+	}
+
+	TransferQueue::Batch& UploadContext::record(const Allocation& source) {
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!batchOpen) {
+			batch = transferQueue.begin();
+			batchOpen = true;
+		}
+		if (!source.overflow) {
+			Region& region = getRegion(source.region);
+			if (region.state == RegionState::Writing) {
+				region.state = RegionState::Recorded;
+				recorded.push_back(source.region);
+			}
+		}
+		return batch;
+	}
+
+	uint64_t UploadContext::flush() {
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!batchOpen) return lastValue;
+
+		stats.bytesUploaded += batch.getSize();
+		lastValue = transferQueue.submit(batch);
+		batchOpen = false;
+		stats.submits++;
+		for (uint64_t id : recorded) {
+			Region& region = getRegion(id);
+			region.state = RegionState::Submitted;
+			region.value = lastValue;
+		}
+		recorded.clear();
+		return lastValue;
+	}
+
+	void UploadContext::finish() {
+		transferQueue.wait(flush());
+	}
+
+	UploadContext::Stats UploadContext::getStats() const {
+		std::lock_guard<std::mutex> lock{ mutex };
+		Stats current = stats;
+		for (const Region& region : regions) {
+			if (region.state == RegionState::Free) continue;
+			// A range that wrapped also holds the bytes it skipped at the end of the ring
+			current.ringUsed += region.end > region.start ? region.end - region.start
+				: current.ringSize - region.start + region.end;
+		}
+		return current;
+	}
+}
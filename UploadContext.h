@@ -0,0 +1,133 @@
+//**********************************************************************
+// Every model used to create two staging buffers of its own for its
+// vertices and indices and throw them away after the upload. The upload
+// context keeps one large staging buffer instead that stays mapped for
+// as long as the device lives, and hands out ranges of it as a ring:
+// new ranges go after the newest one and the oldest ones are reused once
+// the copies out of them are done on the GPU. The copies of everything
+// staged in between are recorded into one transfer queue batch and go
+// over with a single submit and a single timeline value, so loading N
+// models costs one submission instead of one or two per model.
+//
+// Ranges are handed out on any thread, models are created on the loader
+// threads. When the ring has no room, allocate waits for the oldest
+// submitted copies to finish (a ring wrap stall) without holding the
+// lock, so recording and flushing carry on meanwhile. When what's in the way
+// hasn't been submitted yet, or the request is more than half the ring,
+// the range gets a staging buffer of its own so nothing can deadlock.
+// Recording and flushing have to happen on the thread that renders,
+// like everything else on the transfer queue.
+//**********************************************************************
+
+#pragma once
+
+#include "Buffer.h"
+#include "TransferQueue.h"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace engine {
+	class UploadContext {
+	public:
+		static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64 * 1024 * 1024;
+		// Every range starts on this, enough for any vertex or index and for the SIMD decoders
+		static constexpr VkDeviceSize RANGE_ALIGNMENT = 256;
+
+		struct Stats {
+			VkDeviceSize bytesUploaded{ 0 };
+			uint64_t submits{ 0 };
+			uint64_t allocations{ 0 };
+			uint64_t ringWraps{ 0 };		// Times the ring started over at the beginning
+			uint64_t stalls{ 0 };			// Times allocate had to wait for copies to free up the ring
+			double stallMilliseconds{ 0.0 };
+			uint64_t overflows{ 0 };		// Ranges that got a staging buffer of their own
+			VkDeviceSize ringSize{ 0 };
+			VkDeviceSize ringUsed{ 0 };
+		};
+
+		// A range of staging memory. Write to it, record the copies out of it with record, and
+		// destroy it once those are done. A range that is never recorded goes straight back.
+		class Allocation {
+		public:
+			~Allocation();
+
+			Allocation(const Allocation&) = delete;
+			Allocation& operator=(const Allocation&) = delete;
+
+			void* getMappedMemory() const { return mapped; }
+			VkBuffer getBuffer() const { return buffer; }
+			VkDeviceSize getOffset() const { return offset; }	// Where the range starts in getBuffer
+			VkDeviceSize getSize() const { return size; }
+
+		private:
+			friend class UploadContext;
+			Allocation(UploadContext& tempContext) : context{ tempContext } {}
+
+			UploadContext& context;
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			VkDeviceSize offset{ 0 };
+			VkDeviceSize size{ 0 };
+			void* mapped{ nullptr };
+			uint64_t region{ 0 };
+			std::unique_ptr<Buffer> overflow{};		// Only set when the range isn't in the ring
+		};
+
+		UploadContext(Device& device, TransferQueue& transferQueue, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+		// Submits whatever is still recorded and waits for it
+		~UploadContext();
+
+		UploadContext(const UploadContext&) = delete;
+		UploadContext& operator=(const UploadContext&) = delete;
+
+		// Thread safe, may block for a ring wrap stall
+		std::unique_ptr<Allocation> allocate(VkDeviceSize size);
+
+		// The batch the next flush submits. Copies out of source go into it, and source is
+		// reused once that submit is done.
+		TransferQueue::Batch& record(const Allocation& source);
+		// Submits everything recorded since the last flush. Returns the timeline value of that
+		// submit, or of the one before when nothing was recorded (see TransferQueue::isComplete).
+		uint64_t flush();
+		// flush and wait for the copies
+		void finish();
+
+		Stats getStats() const;
+
+	private:
+		enum class RegionState { Writing, Recorded, Submitted, Free };
+
+		struct Region {
+			VkDeviceSize start{ 0 };	// Where the ring was before this range, the bytes skipped on a wrap belong to it
+			VkDeviceSize end{ 0 };
+			RegionState state{ RegionState::Writing };
+			uint64_t value{ 0 };		// The submit that copies out of it
+		};
+
+		Region& getRegion(uint64_t region) { return regions[static_cast<size_t>(region - firstRegion)]; }
+		void release(const Allocation& allocation);
+		// Drops the oldest regions that nothing uses anymore. Needs the lock.
+		void reclaim(uint64_t copiedValue);
+		// Where a range of size would go, false when the ring has no room for it. Needs the lock.
+		bool findRoom(VkDeviceSize size, VkDeviceSize& offset) const;
+
+		Device& device;
+		TransferQueue& transferQueue;
+		std::unique_ptr<Buffer> ring;
+		char* ringMemory{ nullptr };
+
+		mutable std::mutex mutex;
+		std::deque<Region> regions{};		// Oldest first
+		uint64_t firstRegion{ 0 };			// The id of regions.front()
+		VkDeviceSize head{ 0 };				// Where the next range goes
+		TransferQueue::Batch batch{};
+		bool batchOpen{ false };
+		std::vector<uint64_t> recorded{};	// Regions in the batch
+		uint64_t lastValue{ 0 };
+		Stats stats{};
+	};
+}
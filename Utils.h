@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 namespace engine {
@@ -10,4 +12,24 @@ namespace engine {
 		seed ^= std::hash<T>{}(v)+0x9e3779b9 + (seed << 6) + (seed >> 2);
 		(hashCombine(seed, rest), ...);
 	};
+
+	// A quick 64 bit hash of a block of memory, used to tell whether the contents of
+	// a file have changed. It reads eight bytes at a time so it keeps up with the disk.
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+		const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t hash = seed ^ (size * multiplier);
+
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, 8);
+			hash = (hash ^ word) * multiplier;
+			hash ^= hash >> 29;
+		}
+		uint64_t tail = 0;
+		if (i < size) std::memcpy(&tail, bytes + i, size - i);
+		hash = (hash ^ tail) * multiplier;
+		return hash ^ (hash >> 32);
+	}
 }
\ No newline at end of file
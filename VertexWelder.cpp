@@ -0,0 +1,173 @@
+#include "VertexWelder.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+
+namespace engine {
+	namespace {
+		// Small models aren't worth the hand off to other threads
+		constexpr size_t PARALLEL_THRESHOLD = 16 * 1024;
+		constexpr size_t PARTITIONS_PER_THREAD = 4;
+		constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+		static_assert(sizeof(Model::Vertex) == 11 * sizeof(uint32_t),
+			"The welder hashes Model::Vertex as 11 packed 32 bit floats");
+
+		struct Slot {
+			uint32_t tag;		// Upper half of the hash, saves comparing whole vertices on a miss
+			uint32_t corner;	// The first corner that had this vertex
+		};
+
+		// Hashes the raw bits of the vertex. Negative zero is turned into positive zero
+		// first because the two compare equal, so they need to end up in the same slot.
+		uint64_t hashVertex(const Model::Vertex& vertex) {
+			uint32_t words[12]{};
+			std::memcpy(words, &vertex, sizeof(Model::Vertex));
+
+			const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+			uint64_t hash = 0;
+			for (int i = 0; i < 12; i += 2) {
+				uint32_t low = words[i] == 0x80000000u ? 0u : words[i];
+				uint32_t high = words[i + 1] == 0x80000000u ? 0u : words[i + 1];
+				hash = (hash ^ (static_cast<uint64_t>(high) << 32 | low)) * multiplier;
+				hash ^= hash >> 29;
+			}
+			return hash;
+		}
+
+		size_t nextPowerOfTwo(size_t value) {
+			size_t result = 1;
+			while (result < value) result <<= 1;
+			return result;
+		}
+
+		// Splits [0, count) into chunkCount nearly equal ranges
+		size_t chunkBegin(size_t chunk, size_t chunkCount, size_t count) {
+			return count * chunk / chunkCount;
+		}
+	}
+
+	void VertexWelder::weld(
+		const Model::Vertex* corners,
+		size_t cornerCount,
+		std::vector<Model::Vertex>& vertices,
+		std::vector<uint32_t>& indices,
+		ThreadPool& pool) {
+		vertices.clear();
+		indices.resize(cornerCount);
+		if (cornerCount == 0) return;
+
+		bool parallel = cornerCount >= PARALLEL_THRESHOLD && pool.getThreadCount() > 1;
+		size_t threads = parallel ? pool.getThreadCount() : 1;
+		size_t chunkCount = parallel ? threads * PARTITIONS_PER_THREAD : 1;
+
+		// The top bits of the hash pick the partition and the low bits pick the slot,
+		// so the corners of one partition still spread evenly over its table
+		size_t partitionCount = parallel ? nextPowerOfTwo(threads * PARTITIONS_PER_THREAD) : 1;
+		int partitionBits = 0;
+		while ((size_t{ 1 } << partitionBits) < partitionCount) partitionBits++;
+		auto partitionOf = [partitionBits](uint64_t hash) {
+			return partitionBits == 0 ? size_t{ 0 } : static_cast<size_t>(hash >> (64 - partitionBits));
+		};
+
+		// Hash every corner and count how many land in each partition per chunk
+		std::vector<uint64_t> hashes(cornerCount);
+		std::vector<size_t> partitionCounts(chunkCount * partitionCount, 0);
+		pool.parallelFor(chunkCount, [&](size_t chunk) {
+			size_t* counts = &partitionCounts[chunk * partitionCount];
+			for (size_t i = chunkBegin(chunk, chunkCount, cornerCount); i < chunkBegin(chunk + 1, chunkCount, cornerCount); i++) {
+				hashes[i] = hashVertex(corners[i]);
+				counts[partitionOf(hashes[i])]++;
+			}
+		});
+
+		// Turn the counts into offsets, partition major, so that every partition is one
+		// contiguous run of corner numbers that stays in the original corner order
+		std::vector<size_t> partitionStarts(partitionCount + 1, 0);
+		size_t offset = 0;
+		for (size_t partition = 0; partition < partitionCount; partition++) {
+			partitionStarts[partition] = offset;
+			for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+				size_t count = partitionCounts[chunk * partitionCount + partition];
+				partitionCounts[chunk * partitionCount + partition] = offset;
+				offset += count;
+			}
+		}
+		partitionStarts[partitionCount] = offset;
+
+		std::vector<uint32_t> order(cornerCount);
+		pool.parallelFor(chunkCount, [&](size_t chunk) {
+			size_t* offsets = &partitionCounts[chunk * partitionCount];
+			for (size_t i = chunkBegin(chunk, chunkCount, cornerCount); i < chunkBegin(chunk + 1, chunkCount, cornerCount); i++) {
+				order[offsets[partitionOf(hashes[i])]++] = static_cast<uint32_t>(i);
+			}
+		});
+
+		// Every partition gets its own table that is at least twice as big as the number
+		// of corners in it. A single probe either finds the first corner with the same
+		// vertex or claims the empty slot it stopped at for this corner.
+		std::vector<uint32_t> firstCorner(cornerCount);
+		pool.parallelFor(partitionCount, [&](size_t partition) {
+			size_t begin = partitionStarts[partition];
+			size_t end = partitionStarts[partition + 1];
+			if (begin == end) return;
+
+			size_t mask = nextPowerOfTwo((end - begin) * 2) - 1;
+			std::vector<Slot> table(mask + 1, Slot{ 0, EMPTY_SLOT });
+			for (size_t i = begin; i < end; i++) {
+				uint32_t corner = order[i];
+				uint64_t hash = hashes[corner];
+				uint32_t tag = static_cast<uint32_t>(hash >> 32);
+				size_t slot = static_cast<size_t>(hash) & mask;
+				while (true) {
+					Slot& entry = table[slot];
+					if (entry.corner == EMPTY_SLOT) {
+						entry = { tag, corner };
+						firstCorner[corner] = corner;
+						break;
+					}
+					if (entry.tag == tag && corners[entry.corner] == corners[corner]) {
+						firstCorner[corner] = entry.corner;
+						break;
+					}
+					slot = (slot + 1) & mask;
+				}
+			}
+		});
+
+		// Number the unique vertices in the order they first appear. Each chunk counts its
+		// unique corners, a prefix sum gives every chunk its first vertex number, and then
+		// the chunks copy their vertices out and remember which number each one got.
+		std::vector<size_t> uniqueCounts(chunkCount + 1, 0);
+		pool.parallelFor(chunkCount, [&](size_t chunk) {
+			size_t count = 0;
+			for (size_t i = chunkBegin(chunk, chunkCount, cornerCount); i < chunkBegin(chunk + 1, chunkCount, cornerCount); i++) {
+				if (firstCorner[i] == i) count++;
+			}
+			uniqueCounts[chunk + 1] = count;
+		});
+		for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+			uniqueCounts[chunk + 1] += uniqueCounts[chunk];
+		}
+
+		vertices.resize(uniqueCounts[chunkCount]);
+		pool.parallelFor(chunkCount, [&](size_t chunk) {
+			uint32_t next = static_cast<uint32_t>(uniqueCounts[chunk]);
+			for (size_t i = chunkBegin(chunk, chunkCount, cornerCount); i < chunkBegin(chunk + 1, chunkCount, cornerCount); i++) {
+				if (firstCorner[i] == i) {
+					vertices[next] = corners[i];
+					indices[i] = next++;
+				}
+			}
+		});
+
+		// The first corner of a vertex always comes before the others, but it may sit in
+		// an earlier chunk, which is why this has to wait until every number is handed out
+		pool.parallelFor(chunkCount, [&](size_t chunk) {
+			for (size_t i = chunkBegin(chunk, chunkCount, cornerCount); i < chunkBegin(chunk + 1, chunkCount, cornerCount); i++) {
+				if (firstCorner[i] != i) indices[i] = indices[firstCorner[i]];
+			}
+		});
+	}
+}
@@ -0,0 +1,34 @@
+//**********************************************************************
+// The vertex welder finds the vertices that are exactly the same and
+// keeps only one copy of each of them, writing an index per corner so
+// the faces still point at the right vertex. The raw bits of each
+// vertex are hashed into flat open addressing tables that are sized up
+// front, so there are no node allocations and every corner is looked
+// up once. The hashes also split the corners into partitions that the
+// threads of a ThreadPool weld on their own. The unique vertices come
+// out in the order they first show up, which is exactly what the old
+// std::unordered_map version produced.
+//**********************************************************************
+
+#pragma once
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine {
+	class VertexWelder {
+	public:
+		// Fills vertices with the unique corners and indices with one entry per corner
+		static void weld(
+			const Model::Vertex* corners,
+			size_t cornerCount,
+			std::vector<Model::Vertex>& vertices,
+			std::vector<uint32_t>& indices,
+			ThreadPool& pool = ThreadPool::shared());
+	};
+}
@@ -0,0 +1,276 @@
+#include "VirtualFileSystem.h"
+
+#include "Inflater.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace engine {
+	namespace {
+		std::atomic<uint32_t> diskReads{ 0 };
+		std::atomic<uint32_t> storedReads{ 0 };
+		std::atomic<uint32_t> packedReads{ 0 };
+		std::atomic<uint32_t> inflatedReads{ 0 };
+		std::atomic<uint64_t> inflatedBytes{ 0 };
+
+		// Thrown out of the progress callback to stop inflating a file nobody reads anymore
+		struct Cancelled {};
+
+		std::string normalize(const std::string& filePath) {
+			std::string path = std::filesystem::path(filePath).lexically_normal().generic_string();
+			if (path == ".") path.clear();
+			while (!path.empty() && path.back() == '/') path.pop_back();
+			return path;
+		}
+
+		bool isFileOnDisk(const std::string& filePath) {
+			std::error_code error;
+			return std::filesystem::is_regular_file(filePath, error);
+		}
+
+		std::string describe(const std::string& archivePath, const std::string& filePath) {
+			return filePath + " (in " + archivePath + ")";
+		}
+	}
+
+	// The state shared between a deflated File and the thread inflating it. ready only
+	// ever grows and every byte before it is final, so readers only need the lock to wait.
+	struct VirtualFileSystem::Inflation {
+		std::shared_ptr<const MappedFile> mapping;	// Keeps the compressed data alive
+		std::unique_ptr<char[]> buffer;
+		std::atomic<size_t> ready{ 0 };
+		std::atomic<bool> cancelled{ false };
+		std::exception_ptr error{};
+		std::mutex mutex;
+		std::condition_variable progressed;
+		std::thread thread;
+
+		~Inflation() {
+			cancelled = true;
+			if (thread.joinable()) thread.join();
+		}
+
+		void publish(size_t finished, std::exception_ptr failure = nullptr) {
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				if (failure) error = failure;
+				else ready = finished;
+			}
+			progressed.notify_all();
+		}
+	};
+
+	size_t VirtualFileSystem::File::waitFor(size_t count) const {
+		if (!inflation) return size_;
+		count = std::min(count, size_);
+
+		size_t ready = inflation->ready.load(std::memory_order_acquire);
+		if (ready >= count) return ready;
+
+		std::unique_lock<std::mutex> lock{ inflation->mutex };
+		inflation->progressed.wait(lock, [&]() { return inflation->error || inflation->ready >= count; });
+		if (inflation->error) std::rethrow_exception(inflation->error);
+		return inflation->ready;
+	}
+
+	bool VirtualFileSystem::File::isInflating() const {
+		return inflation && inflation->ready.load(std::memory_order_acquire) < size_;
+	}
+
+	void VirtualFileSystem::mount(const std::string& archivePath, const std::string& mountPoint) {
+		Mount mount{};
+		mount.prefix = normalize(mountPoint);
+		if (!mount.prefix.empty()) mount.prefix += '/';
+		if (PackedArchive::isPackedArchive(archivePath)) {
+			mount.pack = std::make_shared<const PackedArchive>(archivePath);
+			mount.pack->prefetchAll();
+		}
+		else {
+			mount.zip = std::make_shared<const ZipArchive>(archivePath);
+		}
+
+		std::lock_guard<std::mutex> lock{ mountMutex };
+		mounts.push_back(std::move(mount));
+	}
+
+	size_t VirtualFileSystem::prefetch(const std::vector<std::string>& filePaths) const {
+		// Grouped by archive so every archive gets one batch
+		std::vector<std::pair<std::shared_ptr<const PackedArchive>, std::vector<const PackedArchive::TocEntry*>>> batches{};
+		for (const std::string& filePath : filePaths) {
+			Location location{};
+			if (isFileOnDisk(filePath) || !locate(filePath, location) || !location.pack) continue;
+			auto batch = std::find_if(batches.begin(), batches.end(),
+				[&](const auto& existing) { return existing.first == location.pack; });
+			if (batch == batches.end()) batch = batches.insert(batches.end(), { location.pack, {} });
+			batch->second.push_back(location.packEntry);
+		}
+
+		size_t systemCalls = 0;
+		for (const auto& batch : batches) systemCalls += batch.first->prefetch(batch.second);
+		return systemCalls;
+	}
+
+	bool VirtualFileSystem::locate(const std::string& filePath, Location& location) const {
+		std::string path = normalize(filePath);
+		std::lock_guard<std::mutex> lock{ mountMutex };
+		for (auto mount = mounts.rbegin(); mount != mounts.rend(); ++mount) {
+			if (path.compare(0, mount->prefix.size(), mount->prefix) != 0) continue;
+			std::string name = path.substr(mount->prefix.size());
+			if (mount->pack) {
+				location.packEntry = mount->pack->find(name);
+				if (location.packEntry) {
+					location.pack = mount->pack;
+					return true;
+				}
+			}
+			else {
+				location.zipEntry = mount->zip->find(name);
+				if (location.zipEntry) {
+					location.zip = mount->zip;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool VirtualFileSystem::exists(const std::string& filePath) const {
+		if (isFileOnDisk(filePath)) return true;
+		Location location{};
+		return locate(filePath, location);
+	}
+
+	bool VirtualFileSystem::getInfo(const std::string& filePath, FileInfo& info) const {
+		if (isFileOnDisk(filePath)) {
+			std::error_code error;
+			info.size = std::filesystem::file_size(filePath, error);
+			if (error) return false;
+			auto time = std::filesystem::last_write_time(filePath, error);
+			if (error) return false;
+			info.modifiedTime = static_cast<int64_t>(time.time_since_epoch().count());
+			info.inArchive = false;
+			info.crc32 = 0;
+			return true;
+		}
+
+		Location location{};
+		if (!locate(filePath, location)) return false;
+		if (location.pack) {
+			info.size = location.packEntry->size;
+			info.modifiedTime = 0;		// Packed assets never change while they're mounted
+			info.crc32 = location.packEntry->crc32;
+		}
+		else {
+			info.size = location.zipEntry->size;
+			info.modifiedTime = location.zipEntry->modifiedTime;
+			info.crc32 = location.zipEntry->crc32;
+		}
+		info.inArchive = true;
+		return true;
+	}
+
+	VirtualFileSystem::File VirtualFileSystem::open(const std::string& filePath) const {
+		File file{};
+		if (isFileOnDisk(filePath)) {
+			file.mapping = std::make_shared<const MappedFile>(filePath);
+			file.data_ = file.mapping->data();
+			file.size_ = file.mapping->size();
+			diskReads++;
+			return file;
+		}
+
+		Location location{};
+		if (!locate(filePath, location)) throw std::runtime_error("Failed to open file: " + filePath);
+		if (location.pack) {
+			file.mapping = location.pack->getMapping();
+			file.data_ = location.pack->getData(*location.packEntry);
+			file.size_ = static_cast<size_t>(location.packEntry->size);
+			packedReads++;
+			return file;
+		}
+
+		const ZipArchive& archive = *location.zip;
+		const ZipArchive::Entry* entry = location.zipEntry;
+		if (entry->size > SIZE_MAX) throw std::runtime_error("File is too large to load: " + describe(archive.getFilePath(), filePath));
+
+		const char* compressed = archive.getData(*entry);
+		file.mapping = archive.getMapping();
+		file.size_ = static_cast<size_t>(entry->size);
+		if (entry->method == ZipArchive::Method::Stored) {
+			file.data_ = compressed;
+			storedReads++;
+			return file;
+		}
+
+		auto inflation = std::make_shared<Inflation>();
+		inflation->mapping = archive.getMapping();
+		inflation->buffer.reset(new char[file.size_]);		// No need to zero what is about to be overwritten
+		file.data_ = inflation->buffer.get();
+		inflatedReads++;
+		inflatedBytes += file.size_;
+
+		size_t compressedSize = static_cast<size_t>(entry->compressedSize);
+		if (file.size_ < BACKGROUND_INFLATE_SIZE) {
+			Inflater::inflate(compressed, compressedSize, inflation->buffer.get(), file.size_);
+			if (Inflater::updateCrc32(0, file.data_, file.size_) != entry->crc32) {
+				throw std::runtime_error("Checksum mismatch in " + describe(archive.getFilePath(), filePath));
+			}
+			inflation->ready = file.size_;
+			file.inflation = std::move(inflation);
+			return file;
+		}
+
+		// The checksum is updated as the data comes in so it's still warm in the cache, only
+		// the very last part is held back until the whole entry turned out to be intact
+		Inflation* state = inflation.get();
+		uint32_t expectedCrc = entry->crc32;
+		size_t size = file.size_;
+		std::string name = describe(archive.getFilePath(), filePath);
+		state->thread = std::thread([state, compressed, compressedSize, size, expectedCrc, name]() {
+			uint32_t crc = 0;
+			size_t checked = 0;
+			try {
+				Inflater::inflate(compressed, compressedSize, state->buffer.get(), size, [&](size_t finished) {
+					if (state->cancelled) throw Cancelled{};
+					crc = Inflater::updateCrc32(crc, state->buffer.get() + checked, finished - checked);
+					checked = finished;
+					if (finished < size) state->publish(finished);
+				});
+				if (crc != expectedCrc) throw std::runtime_error("Checksum mismatch in " + name);
+				state->publish(size);
+			}
+			catch (const Cancelled&) {
+			}
+			catch (const std::exception& error) {
+				state->publish(0, std::make_exception_ptr(std::runtime_error("Failed to inflate " + name + ": " + error.what())));
+			}
+		});
+		file.inflation = std::move(inflation);
+		return file;
+	}
+
+	VirtualFileSystem::Stats VirtualFileSystem::getStats() {
+		return { diskReads.load(), storedReads.load(), packedReads.load(), inflatedReads.load(), inflatedBytes.load() };
+	}
+
+	void VirtualFileSystem::resetStats() {
+		diskReads = 0;
+		storedReads = 0;
+		packedReads = 0;
+		inflatedReads = 0;
+		inflatedBytes = 0;
+	}
+
+	VirtualFileSystem& VirtualFileSystem::shared() {
+		static VirtualFileSystem fileSystem{};
+		return fileSystem;
+	}
+}
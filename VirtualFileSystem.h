@@ -0,0 +1,133 @@
+//**********************************************************************
+// Everything that loads an asset (models, materials and shaders) opens
+// it through here instead of going to the disk directly. Zip archives
+// and our own packed archives (see PackedArchive.h) can be mounted at a
+// directory, after that their entries look like regular files inside
+// of it, so with TestModels/Models.zip mounted at TestModels the path
+// TestModels/cube.obj works whether or not the archive was ever
+// extracted. Files that really exist on disk always win over archive
+// entries, which keeps editing an extracted copy easy.
+//
+// Files on disk, packed assets and zip entries stored without
+// compression are memory mapped and never copied. Deflated entries are inflated into a buffer
+// of their final size, large ones on a thread of their own so whoever
+// opened the file can already work on the start of it while the rest
+// is still being inflated (see File::waitFor).
+//**********************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include "PackedArchive.h"
+#include "ZipArchive.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace engine {
+	class VirtualFileSystem {
+	private:
+		struct Inflation;
+
+	public:
+		class File {
+		public:
+			File() = default;
+
+			const char* data() const { return data_; }
+			size_t size() const { return size_; }
+			bool empty() const { return size_ == 0; }
+
+			// Blocks until at least the first count bytes (or all of them if count is larger) can
+			// be read and returns how many bytes can be read right now, which may be more. Throws
+			// std::runtime_error when the entry turned out to be corrupt while it was inflated.
+			size_t waitFor(size_t count) const;
+			void waitForAll() const { waitFor(size_); }
+
+			// True while a deflated entry is still being inflated in the background
+			bool isInflating() const;
+
+		private:
+			friend class VirtualFileSystem;
+
+			std::shared_ptr<const MappedFile> mapping{};
+			std::shared_ptr<Inflation> inflation{};
+			const char* data_ = nullptr;
+			size_t size_ = 0;
+		};
+
+		struct FileInfo {
+			uint64_t size{ 0 };
+			// Only good for telling whether a file changed, archive entries use the MS-DOS
+			// time from the zip file and files on disk the file system's clock
+			int64_t modifiedTime{ 0 };
+			bool inArchive{ false };
+			uint32_t crc32{ 0 };	// Free to get for archive entries, 0 for files on disk
+		};
+
+		struct Stats {
+			uint32_t diskReads{ 0 };
+			uint32_t storedReads{ 0 };		// Zip entries used straight from the archive mapping
+			uint32_t packedReads{ 0 };
+			uint32_t inflatedReads{ 0 };
+			uint64_t inflatedBytes{ 0 };
+		};
+
+		// Entries at least this large are inflated in the background
+		static constexpr size_t BACKGROUND_INFLATE_SIZE = 1024 * 1024;
+
+		VirtualFileSystem() = default;
+
+		VirtualFileSystem(const VirtualFileSystem&) = delete;
+		VirtualFileSystem& operator=(const VirtualFileSystem&) = delete;
+
+		// Makes the entries of the archive visible under mountPoint, archives mounted later
+		// win over earlier ones. Throws std::runtime_error if the archive can't be read.
+		// Packed archives only hold what the engine needs right away, so the whole archive
+		// is prefetched in the background as soon as it's mounted.
+		void mount(const std::string& archivePath, const std::string& mountPoint);
+
+		// Read ahead hints for files that are about to be opened, batched into as few system
+		// calls as possible. Only packed assets are prefetched, everything else is skipped.
+		// Returns the number of system calls it took.
+		size_t prefetch(const std::vector<std::string>& filePaths) const;
+
+		bool exists(const std::string& filePath) const;
+		// Returns false when the file doesn't exist
+		bool getInfo(const std::string& filePath, FileInfo& info) const;
+		// Throws std::runtime_error when the file doesn't exist or can't be read
+		File open(const std::string& filePath) const;
+
+		static Stats getStats();
+		static void resetStats();
+
+		// The engine wide file system the loaders read through
+		static VirtualFileSystem& shared();
+
+	private:
+		struct Mount {
+			std::string prefix;		// The normalized mount point followed by a slash, empty for the root
+			std::shared_ptr<const ZipArchive> zip;			// Only one of these two is set
+			std::shared_ptr<const PackedArchive> pack;
+		};
+
+		// The archive entry a path that isn't on disk ends up in
+		struct Location {
+			std::shared_ptr<const ZipArchive> zip;
+			const ZipArchive::Entry* zipEntry = nullptr;
+			std::shared_ptr<const PackedArchive> pack;
+			const PackedArchive::TocEntry* packEntry = nullptr;
+		};
+
+		// Returns false when no mounted archive has the file
+		bool locate(const std::string& filePath, Location& location) const;
+
+		mutable std::mutex mountMutex;
+		std::vector<Mount> mounts{};
+	};
+}
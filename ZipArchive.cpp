@@ -0,0 +1,147 @@
+#include "ZipArchive.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace engine {
+	namespace {
+		constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034B50;
+		constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014B50;
+		constexpr uint32_t END_SIGNATURE = 0x06054B50;
+		constexpr uint32_t ZIP64_END_SIGNATURE = 0x06064B50;
+		constexpr uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064B50;
+		constexpr uint16_t ZIP64_EXTRA_FIELD = 0x0001;
+
+		constexpr size_t LOCAL_HEADER_SIZE = 30;
+		constexpr size_t CENTRAL_HEADER_SIZE = 46;
+		constexpr size_t END_SIZE = 22;
+		constexpr size_t ZIP64_LOCATOR_SIZE = 20;
+		constexpr size_t ZIP64_END_SIZE = 56;
+		constexpr size_t MAX_COMMENT_SIZE = 0xFFFF;
+
+		constexpr uint16_t FLAG_ENCRYPTED = 0x0001;
+
+		// Zip files are little endian and nothing in them is aligned
+		template <typename T>
+		T read(const char *data) {
+			T value;
+			std::memcpy(&value, data, sizeof(T));
+			return value;
+		}
+	}
+
+	ZipArchive::ZipArchive(const std::string &tempFilePath)
+		: filePath{ tempFilePath }, mapping{ std::make_shared<const MappedFile>(tempFilePath) } {
+		auto fail = [&](const std::string &reason) {
+			return std::runtime_error("Failed to read zip file " + filePath + ": " + reason);
+		};
+		const char *data = mapping->data();
+		size_t size = mapping->size();
+
+		// The end record is the last thing in the file, only followed by a comment of up to 64 KB
+		if (size < END_SIZE) throw fail("it's too small");
+		size_t end = size - END_SIZE;
+		size_t lowest = size - END_SIZE - std::min(size - END_SIZE, MAX_COMMENT_SIZE);
+		while (read<uint32_t>(data + end) != END_SIGNATURE) {
+			if (end == lowest) throw fail("there is no end of central directory record");
+			end--;
+		}
+
+		uint64_t entryCount = read<uint16_t>(data + end + 10);
+		uint64_t directorySize = read<uint32_t>(data + end + 12);
+		uint64_t directoryOffset = read<uint32_t>(data + end + 16);
+		if (read<uint16_t>(data + end + 4) != 0 || read<uint16_t>(data + end + 6) != 0) throw fail("split archives aren't supported");
+
+		// Values that don't fit are all ones and the real ones are in the zip64 end record
+		bool zip64 = entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF;
+		if (zip64 && end >= ZIP64_LOCATOR_SIZE && read<uint32_t>(data + end - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_SIGNATURE) {
+			uint64_t zip64End = read<uint64_t>(data + end - ZIP64_LOCATOR_SIZE + 8);
+			if (zip64End > size - ZIP64_END_SIZE || read<uint32_t>(data + zip64End) != ZIP64_END_SIGNATURE) {
+				throw fail("the zip64 end of central directory record is missing");
+			}
+			entryCount = read<uint64_t>(data + zip64End + 32);
+			directorySize = read<uint64_t>(data + zip64End + 40);
+			directoryOffset = read<uint64_t>(data + zip64End + 48);
+		}
+		if (directoryOffset > size || directorySize > size - directoryOffset) throw fail("the central directory is outside of the file");
+
+		entries.reserve(static_cast<size_t>(entryCount));
+		const char *record = data + directoryOffset;
+		const char *directoryEnd = record + directorySize;
+		for (uint64_t i = 0; i < entryCount; i++) {
+			if (directoryEnd - record < static_cast<ptrdiff_t>(CENTRAL_HEADER_SIZE) || read<uint32_t>(record) != CENTRAL_HEADER_SIGNATURE) {
+				throw fail("the central directory is corrupt");
+			}
+			uint16_t flags = read<uint16_t>(record + 8);
+			uint16_t method = read<uint16_t>(record + 10);
+			size_t nameLength = read<uint16_t>(record + 28);
+			size_t extraLength = read<uint16_t>(record + 30);
+			size_t commentLength = read<uint16_t>(record + 32);
+			size_t recordSize = CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+			if (static_cast<size_t>(directoryEnd - record) < recordSize) throw fail("the central directory is corrupt");
+
+			Entry entry{};
+			entry.method = static_cast<Method>(method);
+			entry.modifiedTime = read<uint16_t>(record + 14) << 16 | read<uint16_t>(record + 12);
+			entry.crc32 = read<uint32_t>(record + 16);
+			entry.compressedSize = read<uint32_t>(record + 20);
+			entry.size = read<uint32_t>(record + 24);
+			entry.localHeaderOffset = read<uint32_t>(record + 42);
+			std::string name{ record + CENTRAL_HEADER_SIZE, nameLength };
+
+			// The zip64 extra field only holds the values that were all ones, in this order
+			const char *extra = record + CENTRAL_HEADER_SIZE + nameLength;
+			const char *extraEnd = extra + extraLength;
+			while (extraEnd - extra >= 4) {
+				uint16_t id = read<uint16_t>(extra);
+				uint16_t length = read<uint16_t>(extra + 2);
+				const char *fieldStart = extra + 4;
+				const char *fieldEnd = fieldStart + length;
+				if (fieldEnd > extraEnd) break;
+				if (id == ZIP64_EXTRA_FIELD) {
+					const char *field = fieldStart;
+					for (uint64_t *value : { &entry.size, &entry.compressedSize, &entry.localHeaderOffset }) {
+						if (*value != 0xFFFFFFFF) continue;
+						if (fieldEnd - field < 8) throw fail("a zip64 extra field is too short");
+						*value = read<uint64_t>(field);
+						field += 8;
+					}
+				}
+				extra = fieldEnd;
+			}
+			record += recordSize;
+
+			// Directories end with a slash and have nothing to read
+			if (name.empty() || name.back() == '/') continue;
+			if (flags & FLAG_ENCRYPTED) continue;
+			if (entry.method != Method::Stored && entry.method != Method::Deflated) continue;
+			if (entry.method == Method::Stored && entry.compressedSize != entry.size) throw fail(name + " has the wrong size");
+
+			std::replace(name.begin(), name.end(), '\\', '/');
+			if (entries.emplace(name, entry).second) names.push_back(name);
+		}
+	}
+
+	const ZipArchive::Entry* ZipArchive::find(const std::string &name) const {
+		auto entry = entries.find(name);
+		return entry != entries.end() ? &entry->second : nullptr;
+	}
+
+	const char* ZipArchive::getData(const Entry &entry) const {
+		// The name and extra field in the local header don't have to match the central directory, so it has to be read
+		const char *data = mapping->data();
+		size_t size = mapping->size();
+		if (entry.localHeaderOffset > size - LOCAL_HEADER_SIZE ||
+			read<uint32_t>(data + entry.localHeaderOffset) != LOCAL_HEADER_SIGNATURE) {
+			throw std::runtime_error("Failed to read zip file " + filePath + ": a local header is corrupt");
+		}
+		uint64_t start = entry.localHeaderOffset + LOCAL_HEADER_SIZE +
+			read<uint16_t>(data + entry.localHeaderOffset + 26) + read<uint16_t>(data + entry.localHeaderOffset + 28);
+		if (start > size || entry.compressedSize > size - start) {
+			throw std::runtime_error("Failed to read zip file " + filePath + ": an entry runs past the end of the file");
+		}
+		return data + start;
+	}
+}
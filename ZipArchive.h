@@ -0,0 +1,67 @@
+//**********************************************************************
+// A read only view of a zip file. The archive is memory mapped and its
+// central directory (the list of entries at the end of the file) is
+// read once when it's opened, after that finding an entry is a single
+// hash map lookup and its data is a pointer into the mapping. Entries
+// that are stored without compression can be used right where they
+// are, deflated ones have to go through the Inflater first (see
+// VirtualFileSystem.h). Zip64 archives are supported, encrypted
+// entries and archives split over several files are not.
+//**********************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace engine {
+	class ZipArchive {
+	public:
+		enum class Method : uint16_t {
+			Stored = 0,
+			Deflated = 8
+		};
+
+		struct Entry {
+			Method method{ Method::Stored };
+			uint64_t compressedSize{ 0 };
+			uint64_t size{ 0 };
+			uint32_t crc32{ 0 };
+			uint32_t modifiedTime{ 0 };		// MS-DOS date in the high and time in the low 16 bits
+			uint64_t localHeaderOffset{ 0 };
+		};
+
+		// Maps the file and reads the central directory. Throws std::runtime_error when it
+		// isn't a zip file we can read.
+		explicit ZipArchive(const std::string &filePath);
+
+		ZipArchive(const ZipArchive&) = delete;
+		ZipArchive& operator=(const ZipArchive&) = delete;
+
+		// Names use forward slashes and are relative to the root of the archive.
+		// Returns nullptr when there is no such file, directories aren't entries.
+		const Entry* find(const std::string &name) const;
+
+		// The stored or deflated bytes of the entry, compressedSize of them. Throws when the
+		// local header in front of the data doesn't fit inside the archive.
+		const char* getData(const Entry &entry) const;
+
+		const std::string& getFilePath() const { return filePath; }
+		const std::vector<std::string>& getNames() const { return names; }
+		// Entries point into this, so it stays alive for as long as somebody reads from them
+		const std::shared_ptr<const MappedFile>& getMapping() const { return mapping; }
+
+	private:
+		std::string filePath;
+		std::shared_ptr<const MappedFile> mapping;
+		std::unordered_map<std::string, Entry> entries{};
+		std::vector<std::string> names{};	// In the order of the central directory
+	};
+}